@@ -191,6 +191,22 @@ def __extract_transform_data(object_name, frameno):
     return matrix_data[key]
 
 
+def __extract_keyframed_transform(object_name, frameno):
+    # Transform from the exported mesh to simulation space, matching the
+    # transformations applied in __extract_keyframed_mesh
+    data = __get_simulation_data()
+    scale = data.domain_data.initialize.scale
+    bbox = data.domain_data.initialize.bbox
+
+    matrix = [scale * v for v in __extract_transform_data(object_name, frameno)[:12]]
+    matrix[3] -= scale * bbox.x
+    matrix[7] -= scale * bbox.y
+    matrix[11] -= scale * bbox.z
+    matrix += [0.0, 0.0, 0.0, 1.0]
+
+    return matrix
+
+
 def __extract_keyframed_mesh(object_name, frameno):
     mesh_directory = __get_mesh_directory(object_name)
     filepath_keyframed = __get_keyframed_mesh_filepath(object_name)
@@ -266,6 +282,20 @@ def __extract_keyframed_frame_meshes(object_name, frameno):
     return mesh_previous, mesh_current, mesh_next
 
 
+def __extract_keyframed_frame_transforms(object_name, frameno):
+    transform_current = __extract_keyframed_transform(object_name, frameno)
+    if frameno - 1 < 0 or not __keyframed_mesh_exists(object_name, frameno - 1):
+        transform_previous = transform_current
+    else:
+        transform_previous = __extract_keyframed_transform(object_name, frameno - 1)
+
+    if not __keyframed_mesh_exists(object_name, frameno + 1):
+        transform_next = transform_current
+    else:
+        transform_next = __extract_keyframed_transform(object_name, frameno + 1)
+    return transform_previous, transform_current, transform_next
+
+
 def __extract_animated_frame_meshes(object_name, frameno):
     mesh_current = __extract_animated_mesh(object_name, frameno)
     if frameno - 1 < 0 or not __animated_mesh_exists(object_name, frameno - 1):
@@ -755,6 +785,9 @@ def __initialize_fluid_simulation_settings(fluidsim, data):
     fluidsim.enable_internal_obstacle_mesh_output = \
         __get_parameter_data(dprops.debug.export_internal_obstacle_mesh, frameno)
 
+    fluidsim.enable_profiling = \
+        __get_parameter_data(dprops.debug.export_profiling_trace, frameno)
+
     # Internal Settings
 
     fluidsim.set_mesh_output_format_as_bobj()
@@ -880,11 +913,14 @@ def __add_obstacle_objects(fluidsim, data, bakedata):
     bbox = init_data.bbox
     isize, jsize, ksize = init_data.isize, init_data.jsize, init_data.ksize
     dx = init_data.dx
+    is_cache_enabled = __get_parameter_data(data.domain_data.advanced.cache_keyframed_obstacles)
 
     obstacle_objects = []
     for obj in data.obstacle_data:
         obstacle = MeshObject(isize, jsize, ksize, dx)
         obstacle.inverse = __get_parameter_data(obj.is_inversed)
+        if is_cache_enabled and __is_object_keyframed(obj.name):
+            obstacle.enable_rigid_mesh_levelset_cache = True
 
         if not __is_object_dynamic(obj.name):
             mesh = __extract_static_frame_mesh(obj.name)
@@ -1029,6 +1065,11 @@ def __update_animatable_obstacle_properties(data, frameid):
         if __is_object_dynamic(data.name):
             __update_dynamic_object_mesh(mesh_object, data)
 
+        if mesh_object.enable_rigid_mesh_levelset_cache:
+            timeline_frame = __get_timeline_frame()
+            transforms = __extract_keyframed_frame_transforms(data.name, timeline_frame)
+            mesh_object.set_mesh_transforms(*transforms)
+
         mesh_object.enable = __get_parameter_data(data.is_enabled, frameid)
         mesh_object.friction = __get_parameter_data(data.friction, frameid)
         mesh_object.whitewater_influence = __get_parameter_data(data.whitewater_influence, frameid)
@@ -1345,6 +1386,8 @@ def __update_animatable_domain_properties(fluidsim, data, frameno):
     debug = dprops.debug
     export_internal_obstacle_mesh = __get_parameter_data(debug.export_internal_obstacle_mesh, frameno)
     __set_property(fluidsim, 'enable_internal_obstacle_mesh_output', export_internal_obstacle_mesh)
+    export_profiling_trace = __get_parameter_data(debug.export_profiling_trace, frameno)
+    __set_property(fluidsim, 'enable_profiling', export_profiling_trace)
 
 
 def __update_animatable_properties(fluidsim, data, frameno):
@@ -1474,6 +1517,17 @@ def __write_logfile_data(cache_directory, logfile_name, fluidsim):
         f.write(filedata)
 
 
+def __write_profiling_trace_data(cache_directory, logfile_name, fluidsim, frameno):
+    if not fluidsim.enable_profiling:
+        return
+    fstring = __frame_number_to_string(frameno)
+    trace_filename = os.path.splitext(logfile_name)[0] + "_trace" + fstring + ".json"
+    tracepath = os.path.join(cache_directory, "logs", trace_filename)
+    filedata = fluidsim.get_profiling_trace_data()
+    with open(tracepath, 'w') as f:
+        f.write(filedata)
+
+
 def __get_mesh_stats_dict(mstats):
     stats = {}
     stats["enabled"] = bool(mstats.enabled)
@@ -1624,6 +1678,7 @@ def __write_simulation_output(domain_data, fluidsim, frameno, cache_directory):
         __write_internal_obstacle_mesh_data(cache_directory, fluidsim, frameno)
 
     __write_logfile_data(cache_directory, domain_data.initialize.logfile_name, fluidsim)
+    __write_profiling_trace_data(cache_directory, domain_data.initialize.logfile_name, fluidsim, frameno)
     __write_frame_stats_data(cache_directory, fluidsim, frameno)
     __write_autosave_data(domain_data, cache_directory, fluidsim, frameno)
 
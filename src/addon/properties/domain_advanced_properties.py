@@ -140,6 +140,14 @@ class DomainAdvancedProperties(bpy.types.PropertyGroup):
                 " more RAM if enabled",
             default = True,
             ); exec(conv("precompute_static_obstacles"))
+    cache_keyframed_obstacles = BoolProperty(
+            name="Cache Keyframed Obstacles (Experimental)",
+            description="Compute data for keyframed obstacles once and reuse"
+                " it while the obstacle only moves and rotates. Increases"
+                " simulation performance for scenes with large keyframed"
+                " obstacles but obstacle surfaces may be less accurate",
+            default = False,
+            ); exec(conv("cache_keyframed_obstacles"))
     reserve_temporary_grids = BoolProperty(
             name="Reserve Temporary Grid Memory",
             description="Reserve space in memory for temporary grids. Increases"
@@ -173,6 +181,7 @@ class DomainAdvancedProperties(bpy.types.PropertyGroup):
         add(path + ".num_threads_fixed",                      "Num Threads (fixed)",                group_id=1)
         add(path + ".enable_asynchronous_meshing",            "Async Meshing",                      group_id=1)
         add(path + ".precompute_static_obstacles",            "Precompute Static Obstacles",        group_id=1)
+        add(path + ".cache_keyframed_obstacles",              "Cache Keyframed Obstacles",          group_id=1)
         add(path + ".reserve_temporary_grids",                "Reserve Temporary Grid Memory",      group_id=1)
         add(path + ".disable_changing_topology_warning",      "Disable Changing Topology Warning",  group_id=1)
 
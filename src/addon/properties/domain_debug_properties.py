@@ -196,6 +196,14 @@ class DomainDebugProperties(bpy.types.PropertyGroup):
             default=False,
             update=lambda self, context: self._update_export_internal_obstacle_mesh(context),
             ); exec(conv("export_internal_obstacle_mesh"))
+    export_profiling_trace = BoolProperty(
+            name="Enable Profiling Trace",
+            description="Enable to record the time spent in each stage of the"
+                        " simulation. A trace file is written to the cache"
+                        " logs directory for each frame and can be viewed in"
+                        " chrome://tracing or the Perfetto UI",
+            default=False,
+            ); exec(conv("export_profiling_trace"))
     display_console_output = BoolProperty(
             name="Display Console Output",
             description="Display simulation info in the Blender system console",
@@ -227,6 +235,7 @@ class DomainDebugProperties(bpy.types.PropertyGroup):
         add(path + ".fluid_particle_gradient_mode",    "Fluid Speed Gradient Mode",       group_id=1)
         add(path + ".particle_size",                   "Particle Size",                   group_id=1)
         add(path + ".export_internal_obstacle_mesh",   "Enable Obstacle Debugging",       group_id=2)
+        add(path + ".export_profiling_trace",          "Enable Profiling Trace",          group_id=2)
         add(path + ".display_console_output",          "Display Console Output",          group_id=2)
 
 
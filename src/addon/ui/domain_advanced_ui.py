@@ -80,6 +80,7 @@ class FLIPFLUID_PT_DomainTypeAdvancedPanel(bpy.types.Panel):
             column.label(text="Performance and Optimization:")
             column.prop(aprops, "enable_asynchronous_meshing")
             column.prop(aprops, "precompute_static_obstacles")
+            column.prop(aprops, "cache_keyframed_obstacles")
             column.prop(aprops, "reserve_temporary_grids")
 
             # Allowing changing topology is disabled. Does not seem to be stable
@@ -110,6 +110,7 @@ class FLIPFLUID_PT_DomainTypeDebugPanel(bpy.types.Panel):
 
         column = self.layout.column(align=True)
         column.prop(gprops, "export_internal_obstacle_mesh")
+        column.prop(gprops, "export_profiling_trace")
 
         column = self.layout.column(align=True)
         column.prop(gprops, "display_console_output")
@@ -629,6 +629,24 @@ extern "C" {
         );
     }
 
+    EXPORTDLL void FluidSimulation_enable_profiling(FluidSimulation* obj, int *err) {
+        CBindings::safe_execute_method_void_0param(
+            obj, &FluidSimulation::enableProfiling, err
+        );
+    }
+
+    EXPORTDLL void FluidSimulation_disable_profiling(FluidSimulation* obj, int *err) {
+        CBindings::safe_execute_method_void_0param(
+            obj, &FluidSimulation::disableProfiling, err
+        );
+    }
+
+    EXPORTDLL int FluidSimulation_is_profiling_enabled(FluidSimulation* obj, int *err) {
+        return CBindings::safe_execute_method_ret_0param(
+            obj, &FluidSimulation::isProfilingEnabled, err
+        );
+    }
+
     EXPORTDLL void FluidSimulation_enable_diffuse_material_output(FluidSimulation* obj,
                                                                   int *err) {
         CBindings::safe_execute_method_void_0param(
@@ -1776,6 +1794,139 @@ extern "C" {
         );
     }
 
+    EXPORTDLL void FluidSimulation_enable_matrix_free_pressure_solver(FluidSimulation* obj,
+                                                                      int *err) {
+        CBindings::safe_execute_method_void_0param(
+            obj, &FluidSimulation::enableMatrixFreePressureSolver, err
+        );
+    }
+
+    EXPORTDLL void FluidSimulation_disable_matrix_free_pressure_solver(FluidSimulation* obj,
+                                                                       int *err) {
+        CBindings::safe_execute_method_void_0param(
+            obj, &FluidSimulation::disableMatrixFreePressureSolver, err
+        );
+    }
+
+    EXPORTDLL int FluidSimulation_is_matrix_free_pressure_solver_enabled(FluidSimulation* obj,
+                                                                        int *err) {
+        return CBindings::safe_execute_method_ret_0param(
+            obj, &FluidSimulation::isMatrixFreePressureSolverEnabled, err
+        );
+    }
+
+    EXPORTDLL int FluidSimulation_get_pressure_solver_preconditioner(FluidSimulation* obj,
+                                                                     int *err) {
+        PressurePreconditioner p = CBindings::safe_execute_method_ret_0param(
+            obj, &FluidSimulation::getPressureSolverPreconditioner, err
+        );
+
+        int enum_value = 0;
+        if (p == PressurePreconditioner::mic) {
+            enum_value = 0;
+        } else if (p == PressurePreconditioner::multigrid) {
+            enum_value = 1;
+        } else if (p == PressurePreconditioner::parallelMIC) {
+            enum_value = 2;
+        }
+
+        return enum_value;
+    }
+
+    EXPORTDLL void FluidSimulation_set_pressure_solver_preconditioner(FluidSimulation* obj,
+                                                                      int enum_value,
+                                                                      int *err) {
+        PressurePreconditioner p = PressurePreconditioner::mic;
+        if (enum_value == 0) {
+            p = PressurePreconditioner::mic;
+        } else if (enum_value == 1) {
+            p = PressurePreconditioner::multigrid;
+        } else if (enum_value == 2) {
+            p = PressurePreconditioner::parallelMIC;
+        }
+
+        CBindings::safe_execute_method_void_1param(
+            obj, &FluidSimulation::setPressureSolverPreconditioner, p, err
+        );
+    }
+
+    EXPORTDLL void FluidSimulation_enable_pressure_solver_preconditioner_comparison(FluidSimulation* obj,
+                                                                                    int *err) {
+        CBindings::safe_execute_method_void_0param(
+            obj, &FluidSimulation::enablePressureSolverPreconditionerComparison, err
+        );
+    }
+
+    EXPORTDLL void FluidSimulation_disable_pressure_solver_preconditioner_comparison(FluidSimulation* obj,
+                                                                                     int *err) {
+        CBindings::safe_execute_method_void_0param(
+            obj, &FluidSimulation::disablePressureSolverPreconditionerComparison, err
+        );
+    }
+
+    EXPORTDLL int FluidSimulation_is_pressure_solver_preconditioner_comparison_enabled(FluidSimulation* obj,
+                                                                                      int *err) {
+        return CBindings::safe_execute_method_ret_0param(
+            obj, &FluidSimulation::isPressureSolverPreconditionerComparisonEnabled, err
+        );
+    }
+
+    EXPORTDLL void FluidSimulation_enable_pressure_solver_warm_start(FluidSimulation* obj,
+                                                                     int *err) {
+        CBindings::safe_execute_method_void_0param(
+            obj, &FluidSimulation::enablePressureSolverWarmStart, err
+        );
+    }
+
+    EXPORTDLL void FluidSimulation_disable_pressure_solver_warm_start(FluidSimulation* obj,
+                                                                      int *err) {
+        CBindings::safe_execute_method_void_0param(
+            obj, &FluidSimulation::disablePressureSolverWarmStart, err
+        );
+    }
+
+    EXPORTDLL int FluidSimulation_is_pressure_solver_warm_start_enabled(FluidSimulation* obj,
+                                                                       int *err) {
+        return CBindings::safe_execute_method_ret_0param(
+            obj, &FluidSimulation::isPressureSolverWarmStartEnabled, err
+        );
+    }
+
+    EXPORTDLL void FluidSimulation_enable_mixed_precision_pressure_solver(FluidSimulation* obj,
+                                                                          int *err) {
+        CBindings::safe_execute_method_void_0param(
+            obj, &FluidSimulation::enableMixedPrecisionPressureSolver, err
+        );
+    }
+
+    EXPORTDLL void FluidSimulation_disable_mixed_precision_pressure_solver(FluidSimulation* obj,
+                                                                           int *err) {
+        CBindings::safe_execute_method_void_0param(
+            obj, &FluidSimulation::disableMixedPrecisionPressureSolver, err
+        );
+    }
+
+    EXPORTDLL int FluidSimulation_is_mixed_precision_pressure_solver_enabled(FluidSimulation* obj,
+                                                                            int *err) {
+        return CBindings::safe_execute_method_ret_0param(
+            obj, &FluidSimulation::isMixedPrecisionPressureSolverEnabled, err
+        );
+    }
+
+    EXPORTDLL int FluidSimulation_get_pressure_solver_refinement_steps(FluidSimulation* obj,
+                                                                       int *err) {
+        return CBindings::safe_execute_method_ret_0param(
+            obj, &FluidSimulation::getPressureSolverRefinementSteps, err
+        );
+    }
+
+    EXPORTDLL void FluidSimulation_set_pressure_solver_refinement_steps(FluidSimulation* obj,
+                                                                        int n, int *err) {
+        CBindings::safe_execute_method_void_1param(
+            obj, &FluidSimulation::setPressureSolverRefinementSteps, n, err
+        );
+    }
+
 
     EXPORTDLL void FluidSimulation_add_mesh_fluid_source(FluidSimulation* obj, 
                                                          MeshFluidSource *source,
@@ -2146,6 +2297,32 @@ extern "C" {
         return 0;
     }
 
+    EXPORTDLL int FluidSimulation_get_profiling_trace_data_size(FluidSimulation* obj, int *err) {
+        *err = CBindings::SUCCESS;
+        try {
+            std::vector<char> *data = obj->getProfilingTraceData();
+            return (int)data->size();
+        } catch (std::exception &ex) {
+            CBindings::set_error_message(ex);
+            *err = CBindings::FAIL;
+        }
+
+        return 0;
+    }
+
+    EXPORTDLL int FluidSimulation_get_num_marker_particle_fragments(FluidSimulation* obj, int *err) {
+        return CBindings::safe_execute_method_ret_0param(
+            obj, &FluidSimulation::getNumMarkerParticleFragments, err
+        );
+    }
+
+    EXPORTDLL FluidSimulationMarkerParticleFragmentView FluidSimulation_get_marker_particle_fragment_view(
+            FluidSimulation* obj, int fragmentIndex, int *err) {
+        return CBindings::safe_execute_method_ret_1param(
+            obj, &FluidSimulation::getMarkerParticleFragmentView, fragmentIndex, err
+        );
+    }
+
     EXPORTDLL unsigned int FluidSimulation_get_marker_particle_position_data_size(FluidSimulation* obj, int *err) {
         return CBindings::safe_execute_method_ret_0param(
             obj, &FluidSimulation::getMarkerParticlePositionDataSize, err
@@ -2344,6 +2521,18 @@ extern "C" {
         }
     }
 
+    EXPORTDLL void FluidSimulation_get_profiling_trace_data(FluidSimulation* obj, 
+                                                            char *c_data, int *err) {
+        *err = CBindings::SUCCESS;
+        try {
+            std::vector<char> *data = obj->getProfilingTraceData();
+            std::memcpy(c_data, data->data(), data->size());
+        } catch (std::exception &ex) {
+            CBindings::set_error_message(ex);
+            *err = CBindings::FAIL;
+        }
+    }
+
     EXPORTDLL FluidSimulationFrameStats FluidSimulation_get_frame_stats_data(FluidSimulation* obj, 
                                                                              int *err) {
         return CBindings::safe_execute_method_ret_0param(
@@ -85,6 +85,30 @@ extern "C" {
         }
     }
 
+    EXPORTDLL void MeshObject_set_mesh_transforms(MeshObject* obj, 
+                                                  float *previous, 
+                                                  float *current, 
+                                                  float *next, 
+                                                  int *err) {
+        // Transforms are row-major 4x4 affine matrices
+        float *matrices[3] = {previous, current, next};
+        MeshTransform transforms[3];
+        for (int i = 0; i < 3; i++) {
+            float *m = matrices[i];
+            transforms[i].linear = vmath::mat3(m[0], m[4], m[8], 
+                                               m[1], m[5], m[9], 
+                                               m[2], m[6], m[10]);
+            transforms[i].translation = vmath::vec3(m[3], m[7], m[11]);
+        }
+
+        try {
+            obj->setMeshTransforms(transforms[0], transforms[1], transforms[2]);
+        } catch (std::exception &ex) {
+            CBindings::set_error_message(ex);
+            *err = CBindings::FAIL;
+        }
+    }
+
     EXPORTDLL void MeshObject_enable(MeshObject* obj, int *err) {
         CBindings::safe_execute_method_void_0param(
             obj, &MeshObject::enable, err
@@ -183,6 +207,24 @@ extern "C" {
         );
     }
 
+    EXPORTDLL void MeshObject_enable_rigid_mesh_levelset_cache(MeshObject* obj, int *err) {
+        CBindings::safe_execute_method_void_0param(
+            obj, &MeshObject::enableRigidMeshLevelSetCache, err
+        );
+    }
+
+    EXPORTDLL void MeshObject_disable_rigid_mesh_levelset_cache(MeshObject* obj, int *err) {
+        CBindings::safe_execute_method_void_0param(
+            obj, &MeshObject::disableRigidMeshLevelSetCache, err
+        );
+    }
+
+    EXPORTDLL int MeshObject_is_rigid_mesh_levelset_cache_enabled(MeshObject* obj, int *err) {
+        return CBindings::safe_execute_method_ret_0param(
+            obj, &MeshObject::isRigidMeshLevelSetCacheEnabled, err
+        );
+    }
+
     EXPORTDLL float MeshObject_get_object_velocity_influence(MeshObject* obj, int *err) {
         return CBindings::safe_execute_method_ret_0param(
             obj, &MeshObject::getObjectVelocityInfluence, err
@@ -0,0 +1,164 @@
+/*
+MIT License
+
+Copyright (c) 2019 Ryan L. Guy
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef FLUIDENGINE_COMPACTIONUTILS_H
+#define FLUIDENGINE_COMPACTIONUTILS_H
+
+#include <vector>
+#include <algorithm>
+
+#include "fragmentedvector.h"
+#include "threadutils.h"
+
+/*
+    Parallel stable compaction
+
+    Elements are counted per chunk, an exclusive prefix sum of the counts 
+    gives each chunk its output offset and the chunks then scatter their 
+    elements in parallel. The result is independent of the number of 
+    threads.
+*/
+namespace CompactionUtils {
+
+    const int _chunkSize = 65536;
+
+    /*
+        Writes the indices of the elements that are not flagged in 
+        isRemoved to keptIndices in increasing order.
+    */
+    template<class FlagVector>
+    void getKeptIndices(const FlagVector &isRemoved, std::vector<int> &keptIndices) {
+        int n = (int)isRemoved.size();
+        int numChunks = ThreadUtils::getNumChunks(0, n, _chunkSize);
+        std::vector<int> offsets(numChunks + 1, 0);
+        ThreadUtils::parallelFor(0, numChunks, 1, [&](int chunkBegin, int chunkEnd) {
+            for (int c = chunkBegin; c < chunkEnd; c++) {
+                int begin = c * _chunkSize;
+                int end = std::min(begin + _chunkSize, n);
+                int count = 0;
+                for (int i = begin; i < end; i++) {
+                    if (!isRemoved[i]) {
+                        count++;
+                    }
+                }
+                offsets[c + 1] = count;
+            }
+        });
+
+        for (int c = 0; c < numChunks; c++) {
+            offsets[c + 1] += offsets[c];
+        }
+
+        keptIndices.resize(offsets[numChunks]);
+        ThreadUtils::parallelFor(0, numChunks, 1, [&](int chunkBegin, int chunkEnd) {
+            for (int c = chunkBegin; c < chunkEnd; c++) {
+                int begin = c * _chunkSize;
+                int end = std::min(begin + _chunkSize, n);
+                int dst = offsets[c];
+                for (int i = begin; i < end; i++) {
+                    if (!isRemoved[i]) {
+                        keptIndices[dst] = i;
+                        dst++;
+                    }
+                }
+            }
+        });
+    }
+
+    /*
+        Position of the first kept element that has to move. All kept 
+        elements before it are already in place.
+    */
+    inline int getFirstMovedIndex(const std::vector<int> &keptIndices) {
+        // keptIndices[i] - i is non-decreasing, so the elements that stay 
+        // in place form a prefix
+        int lo = 0;
+        int hi = (int)keptIndices.size();
+        while (lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+            if (keptIndices[mid] == mid) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+    /*
+        Moves items[keptIndices[i]] to items[i] for every i from the first 
+        moved index. Moved elements are gathered into temporary storage 
+        first, so the elements may be read and written in parallel.
+    */
+    template<class T, class Container>
+    void _gatherKeptItems(Container &items, const std::vector<int> &keptIndices) {
+        int first = getFirstMovedIndex(keptIndices);
+        int n = (int)keptIndices.size();
+        if (first == n) {
+            return;
+        }
+
+        std::vector<T> temp(n - first);
+        ThreadUtils::parallelFor(first, n, [&](int startidx, int endidx) {
+            for (int i = startidx; i < endidx; i++) {
+                temp[i - first] = items[keptIndices[i]];
+            }
+        });
+
+        ThreadUtils::parallelFor(first, n, [&](int startidx, int endidx) {
+            for (int i = startidx; i < endidx; i++) {
+                items[i] = temp[i - first];
+            }
+        });
+    }
+
+    /*
+        Removes the items flagged in isRemoved. The order of the remaining 
+        items is preserved.
+    */
+    template<class T, class FlagVector>
+    void removeItems(FragmentedVector<T> &items, const FlagVector &isRemoved) {
+        FLUIDSIM_ASSERT(items.size() == isRemoved.size());
+
+        std::vector<int> keptIndices;
+        getKeptIndices(isRemoved, keptIndices);
+        _gatherKeptItems<T>(items, keptIndices);
+        items.truncate(keptIndices.size());
+        items.shrink_to_fit();
+    }
+
+    template<class T, class FlagVector>
+    void removeItems(std::vector<T> &items, const FlagVector &isRemoved) {
+        FLUIDSIM_ASSERT(items.size() == isRemoved.size());
+
+        std::vector<int> keptIndices;
+        getKeptIndices(isRemoved, keptIndices);
+        _gatherKeptItems<T>(items, keptIndices);
+        items.erase(items.begin() + keptIndices.size(), items.end());
+        items.shrink_to_fit();
+    }
+}
+
+#endif
@@ -29,9 +29,10 @@ SOFTWARE.
 #include "threadutils.h"
 #include "interpolation.h"
 #include "diffuseparticle.h"
-#include "markerparticle.h"
+#include "markerparticlestore.h"
 #include "meshlevelset.h"
 #include "particlelevelset.h"
+#include "compactionutils.h"
 
 DiffuseParticleSimulation::DiffuseParticleSimulation() {
     double inf = std::numeric_limits<float>::infinity();
@@ -758,18 +759,9 @@ void DiffuseParticleSimulation::_trilinearInterpolate(std::vector<vmath::vec3> &
                                                       std::vector<vmath::vec3> &output) {
     FLUIDSIM_ASSERT(output.size() == input.size());
 
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, input.size());
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, input.size(), numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&DiffuseParticleSimulation::_trilinearInterpolateThread, this,
-                                 intervals[i], intervals[i + 1], &input, vfield, &output);
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, input.size(), [&](int startidx, int endidx) {
+        _trilinearInterpolateThread(startidx, endidx, &input, vfield, &output);
+    });
 }
 
 void DiffuseParticleSimulation::_trilinearInterpolateThread(int startidx, int endidx, 
@@ -805,7 +797,7 @@ void DiffuseParticleSimulation::
     vmath::vec3 p;
     GridIndex g;
     for (int i = 0; i < (int)_markerParticles->size(); i++) {
-        p = _markerParticles->at(i).position;
+        p = _markerParticles->getPosition(i);
         p = _jitterParticlePosition(p, jitter);
         if (!_emitterGenerationBounds.isPointInside(p)) {
             continue;
@@ -841,28 +833,14 @@ void DiffuseParticleSimulation::_initializeMaterialGrid() {
     }
 
     int gridsize = _mgrid.width * _mgrid.height * _mgrid.depth;
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, gridsize);
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, gridsize, numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&DiffuseParticleSimulation::_initializeMaterialGridThread, this,
-                                 intervals[i], intervals[i + 1]);
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, gridsize, [&](int startidx, int endidx) {
+        _initializeMaterialGridThread(startidx, endidx);
+    });
 
     FluidMaterialGrid mgridtemp = _mgrid;
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&DiffuseParticleSimulation::_shrinkMaterialGridFluidThread, this,
-                                 intervals[i], intervals[i + 1], &mgridtemp);
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, gridsize, [&](int startidx, int endidx) {
+        _shrinkMaterialGridFluidThread(startidx, endidx, &mgridtemp);
+    });
 
     _mgrid = mgridtemp;
 
@@ -1293,18 +1271,9 @@ void DiffuseParticleSimulation::_advanceSprayParticles(double dt) {
         return;
     }
 
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, _diffuseParticles.size());
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, _diffuseParticles.size(), numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&DiffuseParticleSimulation::_advanceSprayParticlesThread, this,
-                                 intervals[i], intervals[i + 1], dt);
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, _diffuseParticles.size(), [&](int startidx, int endidx) {
+        _advanceSprayParticlesThread(startidx, endidx, dt);
+    });
 }
 
 void DiffuseParticleSimulation::_advanceBubbleParticles(double dt) {
@@ -1314,18 +1283,9 @@ void DiffuseParticleSimulation::_advanceBubbleParticles(double dt) {
         return;
     }
 
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, _diffuseParticles.size());
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, _diffuseParticles.size(), numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&DiffuseParticleSimulation::_advanceBubbleParticlesThread, this,
-                                 intervals[i], intervals[i + 1], dt);
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, _diffuseParticles.size(), [&](int startidx, int endidx) {
+        _advanceBubbleParticlesThread(startidx, endidx, dt);
+    });
 }
 
 void DiffuseParticleSimulation::_advanceFoamParticles(double dt) {
@@ -1335,18 +1295,9 @@ void DiffuseParticleSimulation::_advanceFoamParticles(double dt) {
         return;
     }
 
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, _diffuseParticles.size());
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, _diffuseParticles.size(), numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&DiffuseParticleSimulation::_advanceFoamParticlesThread, this,
-                                 intervals[i], intervals[i + 1], dt);
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, _diffuseParticles.size(), [&](int startidx, int endidx) {
+        _advanceFoamParticlesThread(startidx, endidx, dt);
+    });
 }
 
 void DiffuseParticleSimulation::_advanceSprayParticlesThread(int startidx, int endidx, double dt) {
@@ -1681,14 +1632,8 @@ void DiffuseParticleSimulation::_removeDiffuseParticles() {
         }
     }
 
-    _removeItemsFromVector(_diffuseParticles, isRemoved);
-
-    if (_diffuseParticles.size() >= _maxNumDiffuseParticles) {
-        int n = _diffuseParticles.size() - _maxNumDiffuseParticles;
-        for (int i = 0; i < n; i++) {
-            _diffuseParticles.pop_back();
-        }
-    }
+    CompactionUtils::removeItems(_diffuseParticles, isRemoved);
+    _diffuseParticles.truncate(_maxNumDiffuseParticles);
 }
 
 void DiffuseParticleSimulation::_getDiffuseParticleFileDataWWP(std::vector<vmath::vec3> &positions, 
@@ -38,7 +38,7 @@ SOFTWARE.
 #include "fluidmaterialgrid.h"
 #include "turbulencefield.h"
 
-struct MarkerParticle;
+class MarkerParticleStore;
 struct DiffuseParticle;
 enum class DiffuseParticleType : char;
 class MeshLevelSet;
@@ -56,7 +56,7 @@ struct DiffuseParticleSimulationParameters {
     double markerParticleRadius;
     vmath::vec3 bodyForce;
 
-    FragmentedVector<MarkerParticle> *markerParticles;
+    MarkerParticleStore *markerParticles;
     MACVelocityField *vfield;
     ParticleLevelSet *liquidSDF;
     MeshLevelSet *solidSDF;
@@ -302,25 +302,6 @@ private:
                                         std::vector<unsigned char> &ids,
                                         std::vector<char> &data);
 
-    template<class T>
-    void _removeItemsFromVector(FragmentedVector<T> &items, std::vector<bool> &isRemoved) {
-        FLUIDSIM_ASSERT(items.size() == isRemoved.size());
-
-        int currentidx = 0;
-        for (unsigned int i = 0; i < items.size(); i++) {
-            if (!isRemoved[i]) {
-                items[currentidx] = items[i];
-                currentidx++;
-            }
-        }
-
-        int numRemoved = (int)items.size() - currentidx;
-        for (int i = 0; i < numRemoved; i++) {
-            items.pop_back();
-        }
-        items.shrink_to_fit();
-    }
-
     inline double _randomDouble(double min, double max) {
         return min + ((double)rand() / (double)RAND_MAX) * (max - min);
     }
@@ -384,7 +365,7 @@ private:
     std::vector<bool> _sprayActiveSides;
     AABB _emitterGenerationBounds;
 
-    FragmentedVector<MarkerParticle> *_markerParticles;
+    MarkerParticleStore *_markerParticles;
     MACVelocityField *_vfield;
     ParticleLevelSet *_liquidSDF;
     MeshLevelSet *_solidSDF;
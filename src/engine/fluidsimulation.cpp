@@ -26,9 +26,12 @@ SOFTWARE.
 
 #include <cstring>
 #include <iomanip>
+#include <atomic>
 
 #include "threadutils.h"
 #include "stopwatch.h"
+#include "taskgraph.h"
+#include "profiler.h"
 #include "openclutils.h"
 #include "viscositysolver.h"
 #include "particlemesher.h"
@@ -42,6 +45,10 @@ SOFTWARE.
 #include "versionutils.h"
 #include "interpolation.h"
 #include "gridutils.h"
+#include "sortutils.h"
+#include "particleadvectionkernels.h"
+#include "compactionutils.h"
+#include "scatterutils.h"
 
 FluidSimulation::FluidSimulation() {
 }
@@ -1665,6 +1672,220 @@ bool FluidSimulation::isExtremeVelocityRemovalEnabled() {
     return _isExtremeVelocityRemovalEnabled;
 }
 
+void FluidSimulation::enableMatrixFreePressureSolver() {
+    _logfile.log(std::ostringstream().flush() << 
+                 _logfile.getTime() << " enableMatrixFreePressureSolver" << std::endl);
+
+    _isMatrixFreePressureSolverEnabled = true;
+}
+
+void FluidSimulation::disableMatrixFreePressureSolver() {
+    _logfile.log(std::ostringstream().flush() << 
+                 _logfile.getTime() << " disableMatrixFreePressureSolver" << std::endl);
+
+    _isMatrixFreePressureSolverEnabled = false;
+}
+
+bool FluidSimulation::isMatrixFreePressureSolverEnabled() {
+    return _isMatrixFreePressureSolverEnabled;
+}
+
+PressurePreconditioner FluidSimulation::getPressureSolverPreconditioner() {
+    return _pressureSolverPreconditioner;
+}
+
+void FluidSimulation::setPressureSolverPreconditioner(PressurePreconditioner p) {
+    std::string typestr;
+    if (p == PressurePreconditioner::mic) {
+        typestr = "mic";
+    } else if (p == PressurePreconditioner::multigrid) {
+        typestr = "multigrid";
+    } else if (p == PressurePreconditioner::parallelMIC) {
+        typestr = "parallelMIC";
+    }
+
+    _logfile.log(std::ostringstream().flush() << 
+                 _logfile.getTime() << " setPressureSolverPreconditioner: " << typestr << std::endl);
+
+    _pressureSolverPreconditioner = p;
+}
+
+void FluidSimulation::enablePressureSolverPreconditionerComparison() {
+    _logfile.log(std::ostringstream().flush() << 
+                 _logfile.getTime() << " enablePressureSolverPreconditionerComparison" << std::endl);
+
+    _isPressureSolverPreconditionerComparisonEnabled = true;
+}
+
+void FluidSimulation::disablePressureSolverPreconditionerComparison() {
+    _logfile.log(std::ostringstream().flush() << 
+                 _logfile.getTime() << " disablePressureSolverPreconditionerComparison" << std::endl);
+
+    _isPressureSolverPreconditionerComparisonEnabled = false;
+}
+
+bool FluidSimulation::isPressureSolverPreconditionerComparisonEnabled() {
+    return _isPressureSolverPreconditionerComparisonEnabled;
+}
+
+void FluidSimulation::enablePressureSolverWarmStart() {
+    _logfile.log(std::ostringstream().flush() << 
+                 _logfile.getTime() << " enablePressureSolverWarmStart" << std::endl);
+
+    _isPressureSolverWarmStartEnabled = true;
+}
+
+void FluidSimulation::disablePressureSolverWarmStart() {
+    _logfile.log(std::ostringstream().flush() << 
+                 _logfile.getTime() << " disablePressureSolverWarmStart" << std::endl);
+
+    _isPressureSolverWarmStartEnabled = false;
+    _pressureGrid = Array3d<float>();
+}
+
+bool FluidSimulation::isPressureSolverWarmStartEnabled() {
+    return _isPressureSolverWarmStartEnabled;
+}
+
+void FluidSimulation::enableMixedPrecisionPressureSolver() {
+    _logfile.log(std::ostringstream().flush() << 
+                 _logfile.getTime() << " enableMixedPrecisionPressureSolver" << std::endl);
+
+    _isMixedPrecisionPressureSolverEnabled = true;
+}
+
+void FluidSimulation::disableMixedPrecisionPressureSolver() {
+    _logfile.log(std::ostringstream().flush() << 
+                 _logfile.getTime() << " disableMixedPrecisionPressureSolver" << std::endl);
+
+    _isMixedPrecisionPressureSolverEnabled = false;
+}
+
+bool FluidSimulation::isMixedPrecisionPressureSolverEnabled() {
+    return _isMixedPrecisionPressureSolverEnabled;
+}
+
+int FluidSimulation::getPressureSolverRefinementSteps() {
+    return _pressureSolverRefinementSteps;
+}
+
+void FluidSimulation::setPressureSolverRefinementSteps(int n) {
+    if (n < 0) {
+        std::string msg = "Error: number of refinement steps must be greater than or equal to 0.\n";
+        msg += "refinement steps: " + _toString(n) + "\n";
+        throw std::domain_error(msg);
+    }
+
+    _logfile.log(std::ostringstream().flush() << 
+                 _logfile.getTime() << " setPressureSolverRefinementSteps: " << n << std::endl);
+
+    _pressureSolverRefinementSteps = n;
+}
+
+int FluidSimulation::getMarkerParticleSortInterval() {
+    return _markerParticleSortInterval;
+}
+
+void FluidSimulation::setMarkerParticleSortInterval(int n) {
+    if (n < 0) {
+        std::string msg = "Error: marker particle sort interval must be greater than or equal to 0.\n";
+        msg += "interval: " + _toString(n) + "\n";
+        throw std::domain_error(msg);
+    }
+
+    _logfile.log(std::ostringstream().flush() << 
+                 _logfile.getTime() << " setMarkerParticleSortInterval: " << n << std::endl);
+
+    _markerParticleSortInterval = n;
+}
+
+void FluidSimulation::enableQuantizedMarkerParticlePositions() {
+    _logfile.log(std::ostringstream().flush() << 
+                 _logfile.getTime() << " enableQuantizedMarkerParticlePositions" << std::endl);
+
+    _isQuantizedMarkerParticlePositionsEnabled = true;
+    if (_isSimulationInitialized) {
+        _updateMarkerParticleStorageFormat();
+    }
+}
+
+void FluidSimulation::disableQuantizedMarkerParticlePositions() {
+    _logfile.log(std::ostringstream().flush() << 
+                 _logfile.getTime() << " disableQuantizedMarkerParticlePositions" << std::endl);
+
+    _isQuantizedMarkerParticlePositionsEnabled = false;
+    if (_isSimulationInitialized) {
+        _updateMarkerParticleStorageFormat();
+    }
+}
+
+bool FluidSimulation::isQuantizedMarkerParticlePositionsEnabled() {
+    return _isQuantizedMarkerParticlePositionsEnabled;
+}
+
+void FluidSimulation::enableHalfPrecisionMarkerParticleVelocities() {
+    _logfile.log(std::ostringstream().flush() << 
+                 _logfile.getTime() << " enableHalfPrecisionMarkerParticleVelocities" << std::endl);
+
+    _isHalfPrecisionMarkerParticleVelocitiesEnabled = true;
+    if (_isSimulationInitialized) {
+        _updateMarkerParticleStorageFormat();
+    }
+}
+
+void FluidSimulation::disableHalfPrecisionMarkerParticleVelocities() {
+    _logfile.log(std::ostringstream().flush() << 
+                 _logfile.getTime() << " disableHalfPrecisionMarkerParticleVelocities" << std::endl);
+
+    _isHalfPrecisionMarkerParticleVelocitiesEnabled = false;
+    if (_isSimulationInitialized) {
+        _updateMarkerParticleStorageFormat();
+    }
+}
+
+bool FluidSimulation::isHalfPrecisionMarkerParticleVelocitiesEnabled() {
+    return _isHalfPrecisionMarkerParticleVelocitiesEnabled;
+}
+
+ParticleScatterMethod FluidSimulation::getParticleScatterMethod() {
+    return _particleScatterMethod;
+}
+
+void FluidSimulation::setParticleScatterMethod(ParticleScatterMethod m) {
+    std::string typestr;
+    if (m == ParticleScatterMethod::queue) {
+        typestr = "queue";
+    } else if (m == ParticleScatterMethod::colored) {
+        typestr = "colored";
+    }
+
+    _logfile.log(std::ostringstream().flush() << 
+                 _logfile.getTime() << " setParticleScatterMethod: " << typestr << std::endl);
+
+    _particleScatterMethod = m;
+}
+
+void FluidSimulation::enableProfiling() {
+    _logfile.log(std::ostringstream().flush() << 
+                 _logfile.getTime() << " enableProfiling" << std::endl);
+
+    _isProfilingEnabled = true;
+    Profiler::enable();
+}
+
+void FluidSimulation::disableProfiling() {
+    _logfile.log(std::ostringstream().flush() << 
+                 _logfile.getTime() << " disableProfiling" << std::endl);
+
+    _isProfilingEnabled = false;
+    Profiler::disable();
+    Profiler::clear();
+}
+
+bool FluidSimulation::isProfilingEnabled() {
+    return _isProfilingEnabled;
+}
+
 double FluidSimulation::getPICFLIPRatio() {
     return _ratioPICFLIP;
 }
@@ -1869,7 +2090,7 @@ std::vector<vmath::vec3> FluidSimulation::getMarkerParticlePositions(int startid
     particles.reserve(endidx - startidx);
 
     for (int i = startidx; i < endidx; i++) {
-        particles.push_back(_markerParticles[i].position);
+        particles.push_back(_markerParticles.getPosition(i));
     }
 
     return particles;
@@ -1891,12 +2112,38 @@ std::vector<vmath::vec3> FluidSimulation::getMarkerParticleVelocities(int starti
     velocities.reserve(endidx - startidx);
 
     for (int i = startidx; i < endidx; i++) {
-        velocities.push_back(_markerParticles[i].velocity);
+        velocities.push_back(_markerParticles.getVelocity(i));
     }
 
     return velocities;
 }
 
+int FluidSimulation::getNumMarkerParticleFragments() {
+    return _markerParticles.getNumFragments();
+}
+
+FluidSimulationMarkerParticleFragmentView FluidSimulation::getMarkerParticleFragmentView(int fragmentIndex) {
+    if (!(fragmentIndex >= 0 && fragmentIndex < _markerParticles.getNumFragments())) {
+        std::string msg = "Error: fragment index out of range.\n";
+        msg += "index: " + _toString(fragmentIndex) + "\n";
+        throw std::out_of_range(msg);
+    }
+
+    MarkerParticleFragmentView f = _markerParticles.getFragmentView(fragmentIndex);
+    FluidSimulationMarkerParticleFragmentView view;
+    view.size = f.size;
+    view.startIndex = f.startIndex;
+    view.stride = sizeof(float);
+    view.positionsX = (char*)f.px;
+    view.positionsY = (char*)f.py;
+    view.positionsZ = (char*)f.pz;
+    view.velocitiesX = (char*)f.vx;
+    view.velocitiesY = (char*)f.vy;
+    view.velocitiesZ = (char*)f.vz;
+
+    return view;
+}
+
 unsigned int FluidSimulation::getNumDiffuseParticles() {
     return _diffuseMaterial.getNumDiffuseParticles();
 }
@@ -2076,6 +2323,10 @@ std::vector<char>* FluidSimulation::getLogFileData() {
     return &_outputData.logfileData;
 }
 
+std::vector<char>* FluidSimulation::getProfilingTraceData() {
+    return &_outputData.profilingTraceData;
+}
+
 FluidSimulationFrameStats FluidSimulation::getFrameStatsData() {
     return _outputData.frameData;
 }
@@ -2083,14 +2334,14 @@ FluidSimulationFrameStats FluidSimulation::getFrameStatsData() {
 void FluidSimulation::getMarkerParticlePositionData(char *data) {
     vmath::vec3 *positions = (vmath::vec3*)data;
     for (size_t i = 0; i < _markerParticles.size(); i++) {
-        positions[i] = _markerParticles[i].position * _domainScale + _domainOffset;
+        positions[i] = _markerParticles.getPosition(i) * _domainScale + _domainOffset;
     }
 }
 
 void FluidSimulation::getMarkerParticleVelocityData(char *data) {
     vmath::vec3 *velocities = (vmath::vec3*)data;
     for (size_t i = 0; i < _markerParticles.size(); i++) {
-        velocities[i] = _markerParticles[i].velocity;
+        velocities[i] = _markerParticles.getVelocity(i);
     }
 }
 
@@ -2229,7 +2480,16 @@ void FluidSimulation::_initializeSimulationGrids(int isize, int jsize, int ksize
                  "\tGrid Dimensions: " << isize << " x " << 
                                         jsize << " x " << 
                                         ksize << std::endl <<
-                 "\tCell Size:       " << dx << std::endl);
+                 "\tCell Size:       " << dx << std::endl <<
+                 "\tAdvection ISA:   " << ParticleAdvectionKernels::getInstructionSetName(
+                                           ParticleAdvectionKernels::getInstructionSet()) << std::endl);
+
+    if (!_markerParticles.setQuantizationGrid(isize, jsize, ksize, dx)) {
+        _logfile.log(std::ostringstream().flush() << 
+                     "\tGrid dimensions exceed the range of quantized marker particle " <<
+                     "positions. Positions will be stored as float32." << std::endl);
+    }
+    _updateMarkerParticleStorageFormat();
 
     StopWatch t;
     t.start();
@@ -2287,9 +2547,38 @@ void FluidSimulation::_addMarkerParticle(vmath::vec3 p, vmath::vec3 velocity) {
     GridIndex g = Grid3d::positionToGridIndex(p, _dx);
     if (Grid3d::isGridIndexInRange(g, _isize, _jsize, _ksize)) {
         _markerParticles.push_back(MarkerParticle(p, velocity));
+
+        if (_markerParticleStats.isMaxSpeedValid) {
+            vmath::vec3 v = _markerParticles.getVelocity(_markerParticles.size() - 1);
+            _markerParticleStats.maxSpeedSquared = std::max(_markerParticleStats.maxSpeedSquared, 
+                                                            (double)vmath::dot(v, v));
+        }
     }
 }
 
+void FluidSimulation::_updateMarkerParticleStorageFormat() {
+    bool isQuantized = _isQuantizedMarkerParticlePositionsEnabled && 
+                       _markerParticles.isQuantizationGridSet();
+    MarkerParticlePositionFormat pformat = isQuantized ? 
+                                           MarkerParticlePositionFormat::quantized : 
+                                           MarkerParticlePositionFormat::float32;
+    MarkerParticleVelocityFormat vformat = _isHalfPrecisionMarkerParticleVelocitiesEnabled ? 
+                                           MarkerParticleVelocityFormat::float16 : 
+                                           MarkerParticleVelocityFormat::float32;
+    if (pformat == _markerParticles.getPositionFormat() && 
+            vformat == _markerParticles.getVelocityFormat()) {
+        return;
+    }
+
+    _markerParticles.setStorageFormat(pformat, vformat);
+    _markerParticleStats.isMaxSpeedValid = false;
+    _markerParticleCellIndex.isValid = false;
+
+    _logfile.log(std::ostringstream().flush() << 
+                 _logfile.getTime() << " Marker particle storage: " << 
+                 _markerParticles.getBytesPerParticle() << " bytes per particle" << std::endl);
+}
+
 void FluidSimulation::_initializeParticleRadii() {
     double volume = _dx*_dx*_dx / 8.0;
     double pi = 3.141592653;
@@ -2330,6 +2619,8 @@ void FluidSimulation::_loadMarkerParticles(MarkerParticleLoadData &data) {
             _markerParticles.push_back(mp);
         }
     }
+    _markerParticleStats.isMaxSpeedValid = false;
+    _markerParticleCellIndex.isValid = false;
 }
 
 void FluidSimulation::_loadDiffuseParticles(DiffuseParticleLoadData &data) {
@@ -2439,35 +2730,50 @@ void FluidSimulation::_addAnimatedObjectsToSolidSDF(double dt) {
     float frameTime = (float)(_currentFrameDeltaTimeRemaining + _currentFrameTimeStep);
     float frameProgress = 1.0f - frameTime / (float)_currentFrameDeltaTime;
 
-    if (!_isTempSolidLevelSetEnabled && (!normalObstacles.empty() || !inversedObstacles.empty())) {
-        _tempSolidSDF = MeshLevelSet(_isize, _jsize, _ksize, _dx);
-    }
-
     for (size_t i = 0; i < normalObstacles.size(); i++) {
-        _tempSolidSDF.reset();
-        normalObstacles[i]->getMeshLevelSet(dt, frameProgress, _solidLevelSetExactBand, _tempSolidSDF);
-        _solidSDF.calculateUnion(_tempSolidSDF);
+        _addMeshObjectToSDF(normalObstacles[i], dt, frameProgress, _solidSDF);
     }
 
     if (!inversedObstacles.empty()) {
-        MeshLevelSet tempSolidInversedSDF(_isize, _jsize, _ksize, _dx);
-        tempSolidInversedSDF.disableVelocityData();
+        if (!_isTempSolidLevelSetEnabled) {
+            _tempSolidSDF = MeshLevelSet(_isize, _jsize, _ksize, _dx);
+        }
 
+        _tempSolidSDF.reset();
+        _tempSolidSDF.disableVelocityData();
         for (size_t i = 0; i < inversedObstacles.size(); i++) {
-            _tempSolidSDF.reset();
-            _tempSolidSDF.disableVelocityData();
-            inversedObstacles[i]->getMeshLevelSet(dt, frameProgress, _solidLevelSetExactBand, _tempSolidSDF);
-            tempSolidInversedSDF.calculateUnion(_tempSolidSDF);
+            _addMeshObjectToSDF(inversedObstacles[i], dt, frameProgress, _tempSolidSDF);
+        }
+
+        _tempSolidSDF.enableVelocityData();
+        _tempSolidSDF.negate();
+        _solidSDF.calculateUnion(_tempSolidSDF);
+
+        if (!_isTempSolidLevelSetEnabled) {
+            _tempSolidSDF = MeshLevelSet();
         }
+    }
+}
 
-        tempSolidInversedSDF.enableVelocityData();
-        tempSolidInversedSDF.negate();
-        _solidSDF.calculateUnion(tempSolidInversedSDF);
+void FluidSimulation::_addMeshObjectToSDF(MeshObject *object, double dt, 
+                                          float frameProgress, MeshLevelSet &sdf) {
+    // The object level set only covers the cells that the object can write to
+    // so that the cost of the level set and the union scales with the size of
+    // the object rather than the size of the domain
+    TriangleMesh mesh = object->getMesh(frameProgress);
+    GridIndex gmin, gmax;
+    if (!object->getMeshLevelSetGridBounds(mesh, _solidLevelSetExactBand, &gmin, &gmax)) {
+        return;
     }
 
-    if (!_isTempSolidLevelSetEnabled) {
-        _tempSolidSDF = MeshLevelSet();
+    MeshLevelSet objectSDF(gmax.i - gmin.i, gmax.j - gmin.j, gmax.k - gmin.k, _dx);
+    objectSDF.setGridOffset(gmin);
+    if (!sdf.isVelocityDataEnabled()) {
+        objectSDF.disableVelocityData();
     }
+
+    object->getMeshLevelSet(mesh, dt, frameProgress, _solidLevelSetExactBand, objectSDF);
+    sdf.calculateUnion(objectSDF);
 }
 
 void FluidSimulation::_addStaticObjectsToSDF(double dt, MeshLevelSet &sdf){
@@ -2496,30 +2802,28 @@ void FluidSimulation::_addStaticObjectsToSDF(double dt, MeshLevelSet &sdf){
     float frameTime = (float)(_currentFrameDeltaTimeRemaining + _currentFrameTimeStep);
     float frameProgress = 1.0f - frameTime / (float)_currentFrameDeltaTime;
 
-    if (!_isTempSolidLevelSetEnabled && (!normalObstacles.empty() || !inversedObstacles.empty())) {
-        _tempSolidSDF = MeshLevelSet(_isize, _jsize, _ksize, _dx);
-    }
-
     for (size_t i = 0; i < normalObstacles.size(); i++) {
-        _tempSolidSDF.reset();
-        normalObstacles[i]->getMeshLevelSet(dt, frameProgress, _solidLevelSetExactBand, _tempSolidSDF);
-        sdf.calculateUnion(_tempSolidSDF);
+        _addMeshObjectToSDF(normalObstacles[i], dt, frameProgress, sdf);
     }
 
     if (!inversedObstacles.empty()) {
-        MeshLevelSet tempSolidInversedSDF(_isize, _jsize, _ksize, _dx);
-        tempSolidInversedSDF.disableVelocityData();
+        if (!_isTempSolidLevelSetEnabled) {
+            _tempSolidSDF = MeshLevelSet(_isize, _jsize, _ksize, _dx);
+        }
 
+        _tempSolidSDF.reset();
+        _tempSolidSDF.disableVelocityData();
         for (size_t i = 0; i < inversedObstacles.size(); i++) {
-            _tempSolidSDF.reset();
-            _tempSolidSDF.disableVelocityData();
-            inversedObstacles[i]->getMeshLevelSet(dt, frameProgress, _solidLevelSetExactBand, _tempSolidSDF);
-            tempSolidInversedSDF.calculateUnion(_tempSolidSDF);
+            _addMeshObjectToSDF(inversedObstacles[i], dt, frameProgress, _tempSolidSDF);
         }
 
-        tempSolidInversedSDF.enableVelocityData();
-        tempSolidInversedSDF.negate();
-        sdf.calculateUnion(tempSolidInversedSDF);
+        _tempSolidSDF.enableVelocityData();
+        _tempSolidSDF.negate();
+        sdf.calculateUnion(_tempSolidSDF);
+
+        if (!_isTempSolidLevelSetEnabled) {
+            _tempSolidSDF = MeshLevelSet();
+        }
     }
 }
 
@@ -2649,23 +2953,14 @@ void FluidSimulation::_updateNearSolidGrid() {
         _nearSolidGrid.fill(false);
     }
 
-    int numCPU = ThreadUtils::getMaxThreadCount();
     int gridsize = _isize * _jsize * _ksize;
-    int numthreads = (int)fmin(numCPU, gridsize);
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, gridsize, numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&FluidSimulation::_initializeNearSolidGridThread, this,
-                                 intervals[i], intervals[i + 1]);
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, gridsize, [&](int startidx, int endidx) {
+        _initializeNearSolidGridThread(startidx, endidx);
+    });
 
     int numlayers = (int)std::ceil((float)_CFLConditionNumber / (float)_nearSolidGridCellSizeFactor);
     for (int i = 0; i < numlayers; i++) {
-        GridUtils::featherGrid6(&_nearSolidGrid, ThreadUtils::getMaxThreadCount());
+        GridUtils::featherGrid6(&_nearSolidGrid);
     }
 }
 
@@ -2674,7 +2969,7 @@ void FluidSimulation::_resolveSolidLevelSetUpdateCollisionsThread(int startidx,
     AABB boundary = _getBoundaryAABB();
     float maxResolvedDistance = _CFLConditionNumber * _dx;
     for (int i = startidx; i < endidx; i++) {
-        vmath::vec3 p = _markerParticles[i].position;
+        vmath::vec3 p = _markerParticles.getPosition(i);
 
         GridIndex n = Grid3d::positionToGridIndex(p, _nearSolidGridCellSize);
         if (!_nearSolidGrid(n)) {
@@ -2704,7 +2999,7 @@ void FluidSimulation::_resolveSolidLevelSetUpdateCollisionsThread(int startidx,
             continue;
         }
 
-        _markerParticles[i].position = resolvedPosition;
+        _markerParticles.setPosition(i, resolvedPosition);
     }
     */
 }
@@ -2723,21 +3018,13 @@ void FluidSimulation::_resolveSolidLevelSetUpdateCollisions() {
         _nearSolidGrid.fill(false);
     }
     
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, _markerParticles.size());
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, _markerParticles.size(), numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&FluidSimulation::_resolveSolidLevelSetUpdateCollisionsThread, this,
-                                 intervals[i], intervals[i + 1]);
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, _markerParticles.size(), [&](int startidx, int endidx) {
+        _resolveSolidLevelSetUpdateCollisionsThread(startidx, endidx);
+    });
 }
 
 void FluidSimulation::_updateObstacleObjects(double) {
+    FLUIDSIM_PROFILE_SCOPE("Update Obstacle Objects");
     _logfile.logString(_logfile.getTime() + " BEGIN       Update Obstacle Objects");
 
     StopWatch t;
@@ -2753,25 +3040,18 @@ void FluidSimulation::_updateObstacleObjects(double) {
     _logfile.logString(_logfile.getTime() + " COMPLETE    Update Obstacle Objects");
 }
 
-void FluidSimulation::_launchUpdateObstacleObjectsThread(double dt) {
-    _updateObstacleObjectsThread = std::thread(&FluidSimulation::_updateObstacleObjects, 
-                                               this, dt);
-}
-    
-void FluidSimulation::_joinUpdateObstacleObjectsThread() {
-    _updateObstacleObjectsThread.join();
-}
-
 /********************************************************************************
     #. Update Fluid Material
 ********************************************************************************/
 
 void FluidSimulation::_updateLiquidLevelSet() {
+    FLUIDSIM_PROFILE_SCOPE("Update Liquid Level Set");
     _logfile.logString(_logfile.getTime() + " BEGIN       Update Liquid Level Set");
 
     StopWatch t;
     t.start();
 
+    _liquidSDF.setScatterMethod(_particleScatterMethod);
     _liquidSDF.calculateSignedDistanceField(_markerParticles, _liquidSDFParticleRadius);
 
     t.stop();
@@ -2781,12 +3061,8 @@ void FluidSimulation::_updateLiquidLevelSet() {
     _logfile.logString(_logfile.getTime() + " COMPLETE    Update Liquid Level Set");
 }
 
-void FluidSimulation::_launchUpdateLiquidLevelSetThread() {
-    _updateLiquidLevelSetThread = std::thread(&FluidSimulation::_updateLiquidLevelSet, this);
-}
-
-void FluidSimulation::_joinUpdateLiquidLevelSetThread() {
-    _updateLiquidLevelSetThread.join();
+void FluidSimulation::_postProcessLiquidLevelSet() {
+    FLUIDSIM_PROFILE_SCOPE("Post Process Liquid Level Set");
     _liquidSDF.postProcessSignedDistanceField(_solidSDF);
 }
 
@@ -2795,6 +3071,7 @@ void FluidSimulation::_joinUpdateLiquidLevelSetThread() {
 ********************************************************************************/
 
 void FluidSimulation::_advectVelocityField() {
+    FLUIDSIM_PROFILE_SCOPE("Advect Velocity Field");
 _logfile.logString(_logfile.getTime() + " BEGIN       Advect Velocity Field");
 
     StopWatch t;
@@ -2808,6 +3085,7 @@ _logfile.logString(_logfile.getTime() + " BEGIN       Advect Velocity Field");
         params.vfield = &_MACVelocity;
         params.validVelocities = &_validVelocities;
         params.particleRadius = _liquidSDFParticleRadius;
+        params.scatterMethod = _particleScatterMethod;
         
         _velocityAdvector.advect(params);
 
@@ -2820,15 +3098,8 @@ _logfile.logString(_logfile.getTime() + " BEGIN       Advect Velocity Field");
     _logfile.logString(_logfile.getTime() + " COMPLETE    Advect Velocity Field");
 }
 
-void FluidSimulation::_launchAdvectVelocityFieldThread() {
-    _advectVelocityFieldThread = std::thread(&FluidSimulation::_advectVelocityField, this);
-}
-
-void FluidSimulation::_joinAdvectVelocityFieldThread() {
-    _advectVelocityFieldThread.join();
-}
-
 void FluidSimulation::_saveVelocityField() {
+    FLUIDSIM_PROFILE_SCOPE("Save Velocity Field");
     _logfile.logString(_logfile.getTime() + " BEGIN       Save Velocity Field");
 
     StopWatch t;
@@ -2857,7 +3128,8 @@ void FluidSimulation::_deleteSavedVelocityField() {
     #.  Calculate Fluid Curvature
 ********************************************************************************/
 
-void FluidSimulation::_calculateFluidCurvatureGridThread() {
+void FluidSimulation::_calculateFluidCurvatureGrid() {
+    FLUIDSIM_PROFILE_SCOPE("Calculate Surface Curvature");
     _logfile.logString(_logfile.getTime() + " BEGIN       Calculate Surface Curvature");
 
     StopWatch t;
@@ -2881,23 +3153,8 @@ void FluidSimulation::_calculateFluidCurvatureGridThread() {
     _logfile.logString(_logfile.getTime() + " COMPLETE    Calculate Surface Curvature");
 }
 
-void FluidSimulation::_launchCalculateFluidCurvatureGridThread() {
-    if (!_isSurfaceTensionEnabled && !_isSheetSeedingEnabled && !_isDiffuseMaterialOutputEnabled) {
-        return;
-    }
-
-    _fluidCurvatureThread = std::thread(&FluidSimulation::_calculateFluidCurvatureGridThread, 
-                                        this);
-    _isCalculateFluidCurvatureGridThreadRunning = true;
-}
-
-void FluidSimulation::_joinCalculateFluidCurvatureGridThread() {
-    if (!_isCalculateFluidCurvatureGridThreadRunning) {
-        return;
-    }
-
-    _fluidCurvatureThread.join();
-    _isCalculateFluidCurvatureGridThreadRunning = false;
+bool FluidSimulation::_isFluidCurvatureGridRequired() {
+    return _isSurfaceTensionEnabled || _isSheetSeedingEnabled || _isDiffuseMaterialOutputEnabled;
 }
 
 /********************************************************************************
@@ -3024,6 +3281,7 @@ void FluidSimulation::_applyConstantBodyForces(ValidVelocityComponentGrid &ex, d
 }
 
 void FluidSimulation::_applyBodyForcesToVelocityField(double dt) {
+    FLUIDSIM_PROFILE_SCOPE("Apply Body Forces");
     _logfile.logString(_logfile.getTime() + " BEGIN       Apply Body Forces");
 
     StopWatch t;
@@ -3042,6 +3300,7 @@ void FluidSimulation::_applyBodyForcesToVelocityField(double dt) {
 ********************************************************************************/
 
 void FluidSimulation::_applyViscosityToVelocityField(double dt) {
+    FLUIDSIM_PROFILE_SCOPE("Apply Viscosity");
     _viscositySolverStatus = "";
 
     if (!_isViscosityEnabled || _markerParticles.empty()) {
@@ -3125,18 +3384,9 @@ void FluidSimulation::_updateWeightGridMT(int dir) {
         gridsize = _isize * _jsize * _ksize;
     }
 
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, gridsize);
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, gridsize, numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&FluidSimulation::_updateWeightGridThread, this,
-                                 intervals[i], intervals[i + 1], dir);
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, gridsize, [&](int startidx, int endidx) {
+        _updateWeightGridThread(startidx, endidx, dir);
+    });
 }
 
 void FluidSimulation::_updateWeightGridThread(int startidx, int endidx, int dir) {
@@ -3182,6 +3432,7 @@ void FluidSimulation::_updateWeightGridThread(int startidx, int endidx, int dir)
 }
 
 void FluidSimulation::_pressureSolve(double dt) {
+    FLUIDSIM_PROFILE_SCOPE("Solve Pressure System");
     _logfile.logString(_logfile.getTime() + " BEGIN       Solve Pressure System");
 
     StopWatch t;
@@ -3207,6 +3458,19 @@ void FluidSimulation::_pressureSolve(double dt) {
         params.surfaceTensionConstant = _surfaceTensionConstant;
         params.curvatureGrid = &_fluidCurvatureGrid;
     }
+    params.isMatrixFreeEnabled = _isMatrixFreePressureSolverEnabled;
+    params.preconditioner = _pressureSolverPreconditioner;
+    params.isPreconditionerComparisonEnabled = _isPressureSolverPreconditionerComparisonEnabled;
+    params.isMixedPrecisionEnabled = _isMixedPrecisionPressureSolverEnabled;
+    params.maxRefinementSteps = _pressureSolverRefinementSteps;
+
+    if (_isPressureSolverWarmStartEnabled) {
+        if (_pressureGrid.width != _isize || _pressureGrid.height != _jsize || 
+                _pressureGrid.depth != _ksize) {
+            _pressureGrid = Array3d<float>(_isize, _jsize, _ksize, 0.0f);
+        }
+        params.pressureGrid = &_pressureGrid;
+    }
 
     PressureSolver psolver;
     psolver.solve(params);
@@ -3319,18 +3583,9 @@ void FluidSimulation::_constrainVelocityFieldMT(MACVelocityField &MACGrid, int d
         gridsize = _isize * _jsize * (_ksize + 1);
     }
 
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, gridsize);
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, gridsize, numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&FluidSimulation::_constrainVelocityFieldThread, this,
-                                 intervals[i], intervals[i + 1], &MACGrid, dir);
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, gridsize, [&](int startidx, int endidx) {
+        _constrainVelocityFieldThread(startidx, endidx, &MACGrid, dir);
+    });
 }
 
 void FluidSimulation::_constrainVelocityFieldThread(int startidx, int endidx, 
@@ -3387,6 +3642,7 @@ void FluidSimulation::_constrainVelocityFieldThread(int startidx, int endidx,
 }
 
 void FluidSimulation::_constrainVelocityFields() {
+    FLUIDSIM_PROFILE_SCOPE("Constrain Velocity Fields");
     _logfile.logString(_logfile.getTime() + " BEGIN       Constrain Velocity Field");
 
     StopWatch t;
@@ -3404,6 +3660,7 @@ void FluidSimulation::_constrainVelocityFields() {
 ********************************************************************************/
 
 void FluidSimulation::_updateDiffuseMaterial(double dt) {
+    FLUIDSIM_PROFILE_SCOPE("Simulate Diffuse Material");
     if (!_isDiffuseMaterialOutputEnabled) {
         return;
     }
@@ -3470,6 +3727,7 @@ void FluidSimulation::_updateDiffuseInfluenceGrid(double dt) {
 ********************************************************************************/
 
 void FluidSimulation::_updateSheetSeeding() {
+    FLUIDSIM_PROFILE_SCOPE("Update Sheet Seeding");
     if (!_isSheetSeedingEnabled) {
         return;
     }
@@ -3534,23 +3792,14 @@ void FluidSimulation::_updatePICFLIPMarkerParticleVelocitiesThread(int startidx,
                             _savedVelocityField.evaluateVelocityAtPositionLinear(mp.position);
         vmath::vec3 v = (float)_ratioPICFLIP * vPIC + (float)(1 - _ratioPICFLIP) * vFLIP;
 
-        _markerParticles[i].velocity = v;
+        _markerParticles.setVelocity(i, v);
     }
 }
 
 void FluidSimulation::_updatePICFLIPMarkerParticleVelocities() {
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, _markerParticles.size());
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, _markerParticles.size(), numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&FluidSimulation::_updatePICFLIPMarkerParticleVelocitiesThread, this,
-                                 intervals[i], intervals[i + 1]);
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, _markerParticles.size(), [&](int startidx, int endidx) {
+        _updatePICFLIPMarkerParticleVelocitiesThread(startidx, endidx);
+    });
 }
 
 void FluidSimulation::_constrainMarkerParticleVelocities(MeshFluidSource *inflow) {
@@ -3564,43 +3813,70 @@ void FluidSimulation::_constrainMarkerParticleVelocities(MeshFluidSource *inflow
 
     float substepFactor = (_currentFrameTimeStep / _currentFrameDeltaTime) / (float)numSubsteps;
 
-    Array3d<bool> isInflowCell(_isize, _jsize, _ksize, false);
+    _updateMarkerParticleCellIndex();
+    std::vector<int> &cellStart = _markerParticleCellIndex.cellStart;
+    std::vector<int> &cellParticles = _markerParticleCellIndex.cellParticles;
+    int numIndexedParticles = _markerParticleCellIndex.numIndexedParticles;
+
+    std::vector<int> inflowCells;
     for (int subidx = 0; subidx < numSubsteps; subidx++) {
         float frameInterpolation = frameProgress + (float)subidx * substepFactor;
         inflow->setFrame(_currentFrame, frameInterpolation);
         inflow->update(_currentFrameDeltaTime);
 
-        std::vector<GridIndex> inflowCells;
-        inflow->getCells(frameInterpolation, inflowCells);
-        isInflowCell.fill(false);
-        isInflowCell.set(inflowCells, true);
+        std::vector<GridIndex> cells;
+        inflow->getCells(frameInterpolation, cells);
+        inflowCells.clear();
+        inflowCells.reserve(cells.size());
+        for (size_t i = 0; i < cells.size(); i++) {
+            inflowCells.push_back(Grid3d::getFlatIndex(cells[i], _isize, _jsize));
+        }
+        std::sort(inflowCells.begin(), inflowCells.end());
+        inflowCells.erase(std::unique(inflowCells.begin(), inflowCells.end()), inflowCells.end());
 
         MeshLevelSet *inflowSDF = inflow->getMeshLevelSet();
         vmath::vec3 v = inflow->getVelocity();
         RigidBodyVelocity rv = inflow->getRigidBodyVelocity(_currentFrameDeltaTime);
         VelocityFieldData *vdata = inflow->getVelocityFieldData();
-        for (size_t i = 0; i < _markerParticles.size(); i++) {
-            vmath::vec3 p = _markerParticles[i].position;
-            GridIndex g = Grid3d::positionToGridIndex(p, _dx);
-            if (!isInflowCell(g)) {
-                continue;
-            }
-
+        auto constrainParticle = [&](int i) {
+            vmath::vec3 p = _markerParticles.getPosition(i);
             if (inflowSDF->trilinearInterpolate(p) > 0.0f) {
-                continue;
+                return;
             }
 
             if (inflow->isAppendObjectVelocityEnabled()) {
                 if (inflow->isRigidMeshEnabled()) {
                     vmath::vec3 tv = vmath::cross(rv.angular * rv.axis, p - rv.centroid);
-                    _markerParticles[i].velocity = v + rv.linear + tv;
+                    _markerParticles.setVelocity(i, v + rv.linear + tv);
                 } else {
                     vmath::vec3 datap = p - vdata->offset;
                     vmath::vec3 fv = vdata->vfield.evaluateVelocityAtPositionLinear(datap);
-                    _markerParticles[i].velocity = v + fv;
+                    _markerParticles.setVelocity(i, v + fv);
                 }
             } else {
-                _markerParticles[i].velocity = v;
+                _markerParticles.setVelocity(i, v);
+            }
+        };
+
+        // Cells hold disjoint sets of particles
+        ThreadUtils::parallelFor(0, (int)inflowCells.size(), [&](int startidx, int endidx) {
+            for (int cidx = startidx; cidx < endidx; cidx++) {
+                int flatidx = inflowCells[cidx];
+                for (int pidx = cellStart[flatidx]; pidx < cellStart[flatidx + 1]; pidx++) {
+                    constrainParticle(cellParticles[pidx]);
+                }
+            }
+        });
+
+        for (int i = numIndexedParticles; i < (int)_markerParticles.size(); i++) {
+            GridIndex g = Grid3d::positionToGridIndex(_markerParticles.getPosition(i), _dx);
+            if (!Grid3d::isGridIndexInRange(g, _isize, _jsize, _ksize)) {
+                continue;
+            }
+
+            int flatidx = Grid3d::getFlatIndex(g, _isize, _jsize);
+            if (std::binary_search(inflowCells.begin(), inflowCells.end(), flatidx)) {
+                constrainParticle(i);
             }
         }
     }
@@ -3618,6 +3894,7 @@ void FluidSimulation::_constrainMarkerParticleVelocities() {
 }
 
 void FluidSimulation::_updateMarkerParticleVelocities() {
+    FLUIDSIM_PROFILE_SCOPE("Update Marker Particle Velocities");
     _logfile.logString(_logfile.getTime() + " BEGIN       Update Marker Particle Velocities");
 
     StopWatch t;
@@ -3625,6 +3902,7 @@ void FluidSimulation::_updateMarkerParticleVelocities() {
 
     _updatePICFLIPMarkerParticleVelocities();
     _constrainMarkerParticleVelocities();
+    _markerParticleStats.isMaxSpeedValid = false;
 
     t.stop();
     _timingData.updateMarkerParticleVelocities += t.getTime();
@@ -3636,34 +3914,109 @@ void FluidSimulation::_updateMarkerParticleVelocities() {
     #. Advance MarkerParticles
 ********************************************************************************/
 
-vmath::vec3 FluidSimulation::_RK3(vmath::vec3 p0, double dt) {
-    vmath::vec3 k1 = _MACVelocity.evaluateVelocityAtPositionLinear(p0);
-    vmath::vec3 k2 = _MACVelocity.evaluateVelocityAtPositionLinear(p0 + (float)(0.5*dt)*k1);
-    vmath::vec3 k3 = _MACVelocity.evaluateVelocityAtPositionLinear(p0 + (float)(0.75*dt)*k2);
-    vmath::vec3 p1 = p0 + (float)(dt/9.0f)*(2.0f*k1 + 3.0f*k2 + 4.0f*k3);
+void FluidSimulation::_advanceMarkerParticlesThread(double dt, int startidx, int endidx) {
+    AABB boundary = _getBoundaryAABB();
+    boundary.expand(-_solidBufferWidth * _dx);
 
-    return p1;
-}
+    ParticleAdvectionKernels::VelocityFieldData field;
+    field.u = _MACVelocity.getRawArrayU();
+    field.v = _MACVelocity.getRawArrayV();
+    field.w = _MACVelocity.getRawArrayW();
+    field.isize = _isize;
+    field.jsize = _jsize;
+    field.ksize = _ksize;
+    field.dx = _dx;
+
+    // Positions are advected in batches directly from the fragment streams.
+    // Quantized positions are decoded one batch at a time. A batch never 
+    // crosses a fragment boundary.
+    const int batchSize = ParticleAdvectionKernels::batchSize;
+    float decodedx[batchSize];
+    float decodedy[batchSize];
+    float decodedz[batchSize];
+    float newx[batchSize];
+    float newy[batchSize];
+    float newz[batchSize];
+    std::vector<int> speedLimitCounts(_markerParticleStats.speedLimitCounts.size(), 0);
+    int fragmentSize = _markerParticles.getFragmentSize();
+    int batchStart = startidx;
+    while (batchStart < endidx) {
+        MarkerParticleFragmentView view = _markerParticles.getFragmentView(batchStart / fragmentSize);
+        int offset = batchStart - view.startIndex;
+        int count = std::min(batchSize, std::min(endidx - batchStart, view.size - offset));
+        float *px = decodedx;
+        float *py = decodedy;
+        float *pz = decodedz;
+        if (view.px != nullptr) {
+            px = view.px + offset;
+            py = view.py + offset;
+            pz = view.pz + offset;
+        } else {
+            _markerParticles.getPositions(batchStart, count, px, py, pz);
+        }
 
-void FluidSimulation::_advanceMarkerParticlesThread(double dt, int startidx, int endidx,
-                                                    std::vector<vmath::vec3> *positions,
-                                                    std::vector<vmath::vec3> *output) {
-    for (int i = startidx; i < endidx; i++) {
-        (*output)[i] = _RK3(positions->at(i), dt);
+        ParticleAdvectionKernels::advectRK3(field, dt, px, py, pz, count, newx, newy, newz);
+
+        for (int i = 0; i < count; i++) {
+            int pidx = batchStart + i;
+            vmath::vec3 p(px[i], py[i], pz[i]);
+            vmath::vec3 pnew(newx[i], newy[i], newz[i]);
+            pnew = _resolveCollision(p, pnew, boundary);
+            _markerParticles.setPosition(pidx, pnew);
+            if (view.px == nullptr) {
+                pnew = _markerParticles.getPosition(pidx);
+            }
+
+            // Statistics used by particle removal and the next time step
+            vmath::vec3 v = _markerParticles.getVelocity(pidx);
+            double speed = (double)v.length();
+            int speedLimitIndex = fmin(floor(speed / _markerParticleStats.speedLimitStep), 
+                                       speedLimitCounts.size() - 1);
+            speedLimitCounts[speedLimitIndex]++;
+            _markerParticleStats.speedsSquared[pidx] = vmath::dot(v, v);
+
+            if (_solidSDF.trilinearInterpolate(pnew) < 0.0f) {
+                _markerParticleStats.cellIndices[pidx] = -1;
+            } else {
+                GridIndex g = Grid3d::positionToGridIndex(pnew, _dx);
+                int flatidx = Grid3d::getFlatIndex(g, _isize, _jsize);
+                _markerParticleStats.cellIndices[pidx] = flatidx;
+                _markerParticleStats.cellCounts[flatidx].fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        batchStart += count;
     }
 
-    _resolveMarkerParticleCollisions(startidx, endidx, *positions, *output);
+    for (size_t i = 0; i < speedLimitCounts.size(); i++) {
+        if (speedLimitCounts[i] > 0) {
+            _markerParticleStats.speedLimitCounts[i].fetch_add(speedLimitCounts[i], 
+                                                               std::memory_order_relaxed);
+        }
+    }
 }
 
+void FluidSimulation::_initializeMarkerParticleStats() {
+    MarkerParticleStats &stats = _markerParticleStats;
+    int n = (int)_markerParticles.size();
+    stats.speedsSquared.resize(n);
+    stats.cellIndices.resize(n);
 
-void FluidSimulation::_resolveMarkerParticleCollisions(int startidx, int endidx,
-                                                       std::vector<vmath::vec3> &positionsOld, 
-                                                       std::vector<vmath::vec3> &positionsNew) {
-    AABB boundary = _getBoundaryAABB();
-    boundary.expand(-_solidBufferWidth * _dx);
-    for (int i = startidx; i < endidx; i++) {
-        positionsNew[i] = _resolveCollision(positionsOld[i], positionsNew[i], boundary);
+    int gridsize = _isize * _jsize * _ksize;
+    if ((int)stats.cellCounts.size() != gridsize) {
+        stats.cellCounts = std::vector<std::atomic<int> >(gridsize);
+    }
+    ThreadUtils::parallelFor(0, gridsize, [&](int startidx, int endidx) {
+        for (int i = startidx; i < endidx; i++) {
+            stats.cellCounts[i].store(0, std::memory_order_relaxed);
+        }
+    });
+
+    stats.speedLimitCounts = std::vector<std::atomic<int> >(_maxFrameTimeSteps);
+    for (size_t i = 0; i < stats.speedLimitCounts.size(); i++) {
+        stats.speedLimitCounts[i].store(0, std::memory_order_relaxed);
     }
+    stats.speedLimitStep = _CFLConditionNumber * _dx / _currentFrameDeltaTime;
 }
 
 vmath::vec3 FluidSimulation::_resolveCollision(vmath::vec3 oldp, vmath::vec3 newp,
@@ -3743,14 +4096,9 @@ vmath::vec3 FluidSimulation::_resolveCollision(vmath::vec3 oldp, vmath::vec3 new
     return resolvedPosition;
 }
 
-float FluidSimulation::_getMarkerParticleSpeedLimit(double dt) {
-    double speedLimitStep = _CFLConditionNumber * _dx / dt;
-    std::vector<int> speedLimitCounts(_maxFrameTimeSteps, 0);
-    for (unsigned int i = 0; i < _markerParticles.size(); i++) {
-        double speed = (double)_markerParticles[i].velocity.length();
-        int speedLimitIndex = fmin(floor(speed / speedLimitStep), _maxFrameTimeSteps - 1);
-        speedLimitCounts[speedLimitIndex]++;
-    }
+float FluidSimulation::_getMarkerParticleSpeedLimit() {
+    double speedLimitStep = _markerParticleStats.speedLimitStep;
+    std::vector<std::atomic<int> > &speedLimitCounts = _markerParticleStats.speedLimitCounts;
 
     double maxpct = _maxExtremeVelocityRemovalPercent;
     int maxabs = _maxExtremeVelocityRemovalAbsolute;
@@ -3769,73 +4117,197 @@ float FluidSimulation::_getMarkerParticleSpeedLimit(double dt) {
     return maxspeed;
 }
 
-void FluidSimulation::_removeMarkerParticles(double dt) {
-    Array3d<int> countGrid = Array3d<int>(_isize, _jsize, _ksize, 0);
-
-    float maxspeed = _getMarkerParticleSpeedLimit(dt);
+void FluidSimulation::_removeMarkerParticles() {
+    float maxspeed = _getMarkerParticleSpeedLimit();
     double maxspeedsq = maxspeed * maxspeed;
 
-    std::vector<bool> isRemoved;
-    _solidSDF.trilinearInterpolateSolidPoints(_markerParticles, isRemoved);
-    for (unsigned int i = 0; i < _markerParticles.size(); i++) {
-        if (isRemoved[i]) {
-            continue;
+    // Cell indices, cell counts and speeds were gathered while advancing
+    // the particles
+    MarkerParticleStats &stats = _markerParticleStats;
+    std::vector<int> &cellIndices = stats.cellIndices;
+    std::vector<std::atomic<int> > &countGrid = stats.cellCounts;
+    int n = (int)_markerParticles.size();
+    std::vector<char> isRemoved(n);
+    std::vector<char> isUnderLimit(n);
+    ThreadUtils::parallelFor(0, n, [&](int startidx, int endidx) {
+        for (int i = startidx; i < endidx; i++) {
+            int flatidx = cellIndices[i];
+            isRemoved[i] = flatidx == -1 || 
+                           (_isExtremeVelocityRemovalEnabled && stats.speedsSquared[i] > maxspeedsq);
+            isUnderLimit[i] = flatidx == -1 || 
+                              countGrid[flatidx].load(std::memory_order_relaxed) <= _maxMarkerParticlesPerCell;
         }
+    });
 
-        MarkerParticle mp = _markerParticles[i];
-        GridIndex g = Grid3d::positionToGridIndex(mp.position, _dx);
-        if (countGrid(g) >= _maxMarkerParticlesPerCell) {
-            isRemoved[i] = true;
-            continue;
-        }
-        countGrid.add(g, 1);
-
-        if (_isExtremeVelocityRemovalEnabled && 
-                vmath::dot(mp.velocity, mp.velocity) > maxspeedsq) {
+    // Only particles in cells over the limit can be removed by the cap. These 
+    // are recounted in index order so that the particles kept in each cell 
+    // are the same as with a serial count.
+    std::vector<int> overLimitIndices;
+    CompactionUtils::getKeptIndices(isUnderLimit, overLimitIndices);
+    for (size_t idx = 0; idx < overLimitIndices.size(); idx++) {
+        countGrid[cellIndices[overLimitIndices[idx]]] = 0;
+    }
+    for (size_t idx = 0; idx < overLimitIndices.size(); idx++) {
+        int i = overLimitIndices[idx];
+        std::atomic<int> &count = countGrid[cellIndices[i]];
+        if (count >= _maxMarkerParticlesPerCell) {
             isRemoved[i] = true;
-            continue;
+        } else {
+            count++;
         }
     }
 
-    _removeItemsFromVector(_markerParticles, isRemoved);
+    stats.maxSpeedSquared = ThreadUtils::parallelReduce(0, n, 0, 0.0, 
+        [&](int startidx, int endidx) {
+            double maxsq = 0.0;
+            for (int i = startidx; i < endidx; i++) {
+                if (!isRemoved[i]) {
+                    maxsq = std::max(maxsq, (double)stats.speedsSquared[i]);
+                }
+            }
+            return maxsq;
+        },
+        [](double a, double b) { return std::max(a, b); }
+    );
+    stats.isMaxSpeedValid = true;
+    std::vector<float>().swap(stats.speedsSquared);
+    std::vector<int>().swap(stats.cellIndices);
+
+    _markerParticles.removeParticles(isRemoved);
 }
 
 void FluidSimulation::_advanceMarkerParticles(double dt) {
+    FLUIDSIM_PROFILE_SCOPE("Advance Marker Particles");
     _logfile.logString(_logfile.getTime() + " BEGIN       Advect Marker Particles");
 
     StopWatch t;
     t.start();
     
-    std::vector<vmath::vec3> positions;
-    positions.reserve(_markerParticles.size());
-    for (size_t i = 0; i < _markerParticles.size(); i++) {
-        positions.push_back(_markerParticles[i].position);
+    _initializeMarkerParticleStats();
+    _markerParticleCellIndex.isValid = false;
+    ThreadUtils::parallelFor(0, _markerParticles.size(), [&](int startidx, int endidx) {
+        _advanceMarkerParticlesThread(dt, startidx, endidx);
+    });
+
+    _removeMarkerParticles();
+
+    t.stop();
+    _timingData.advanceMarkerParticles += t.getTime();
+
+    _logfile.logString(_logfile.getTime() + " COMPLETE    Advect Marker Particles");
+}
+
+/********************************************************************************
+    #. Sort Marker Particles
+********************************************************************************/
+
+void FluidSimulation::_computeMarkerParticleSortKeys(std::vector<uint64_t> &keys, 
+                                                     uint64_t *maxKey) {
+    int bw = _velocityAdvector.getBlockWidth();
+    int bisize = (int)ceil(_isize / (double)bw);
+    int bjsize = (int)ceil(_jsize / (double)bw);
+    int bksize = (int)ceil(_ksize / (double)bw);
+
+    // Blocks are ordered along a Morton curve when there are at most 1024 
+    // blocks per axis and in row-major order otherwise. The low bits of the
+    // key order particles by cell within their block.
+    bool isMortonOrder = bisize <= 1024 && bjsize <= 1024 && bksize <= 1024;
+    uint64_t maxBlockKey = 0;
+    if (isMortonOrder) {
+        maxBlockKey = SortUtils::mortonCode3D(bisize - 1, bjsize - 1, bksize - 1);
+    } else {
+        maxBlockKey = (uint64_t)bisize * (uint64_t)bjsize * (uint64_t)bksize - 1;
     }
 
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, positions.size());
-    std::vector<std::thread> threads(numthreads);
-    std::vector<vmath::vec3> output(positions.size());
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, positions.size(), numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&FluidSimulation::_advanceMarkerParticlesThread, this,
-                                 dt, intervals[i], intervals[i + 1], &positions, &output);
+    int cellBits = 0;
+    while ((1 << cellBits) < bw * bw * bw) {
+        cellBits++;
     }
+    *maxKey = (maxBlockKey << cellBits) | (((uint64_t)1 << cellBits) - 1);
+
+    keys.resize(_markerParticles.size());
+    ThreadUtils::parallelFor(0, _markerParticles.size(), [&](int startidx, int endidx) {
+        for (int idx = startidx; idx < endidx; idx++) {
+            GridIndex g = Grid3d::positionToGridIndex(_markerParticles.getPosition(idx), _dx);
+            int i = std::max(0, std::min(g.i, _isize - 1));
+            int j = std::max(0, std::min(g.j, _jsize - 1));
+            int k = std::max(0, std::min(g.k, _ksize - 1));
+            int bi = i / bw;
+            int bj = j / bw;
+            int bk = k / bw;
+
+            uint64_t blockKey = 0;
+            if (isMortonOrder) {
+                blockKey = SortUtils::mortonCode3D(bi, bj, bk);
+            } else {
+                blockKey = (uint64_t)bi + (uint64_t)bisize * ((uint64_t)bj + (uint64_t)bjsize * (uint64_t)bk);
+            }
+            uint64_t cellKey = (i - bi * bw) + bw * ((j - bj * bw) + bw * (k - bk * bw));
+            keys[idx] = (blockKey << cellBits) | cellKey;
+        }
+    });
+}
 
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
+double FluidSimulation::_getMarkerParticleLocality(std::vector<uint64_t> &keys, 
+                                                   std::vector<int> *order) {
+    int n = (int)keys.size();
+    if (n <= 1) {
+        return 1.0;
     }
 
-    for (size_t i = 0; i < _markerParticles.size(); i++) {
-        _markerParticles[i].position = output[i];
+    int count = ThreadUtils::parallelReduce(1, n, 0, 0, 
+        [&](int startidx, int endidx) {
+            int chunkCount = 0;
+            for (int i = startidx; i < endidx; i++) {
+                uint64_t k1 = order == nullptr ? keys[i - 1] : keys[(*order)[i - 1]];
+                uint64_t k2 = order == nullptr ? keys[i] : keys[(*order)[i]];
+                if (k1 == k2) {
+                    chunkCount++;
+                }
+            }
+            return chunkCount;
+        },
+        [](int a, int b) { return a + b; }
+    );
+
+    return (double)count / (double)(n - 1);
+}
+
+void FluidSimulation::_sortMarkerParticles() {
+    _numStepsSinceMarkerParticleSort++;
+    if (_markerParticleSortInterval <= 0 || 
+            _numStepsSinceMarkerParticleSort < _markerParticleSortInterval || 
+            _markerParticles.empty()) {
+        return;
     }
+    _numStepsSinceMarkerParticleSort = 0;
+
+    FLUIDSIM_PROFILE_SCOPE("Sort Marker Particles");
+    _logfile.logString(_logfile.getTime() + " BEGIN       Sort Marker Particles");
+
+    StopWatch t;
+    t.start();
+
+    std::vector<uint64_t> keys;
+    uint64_t maxKey = 0;
+    _computeMarkerParticleSortKeys(keys, &maxKey);
+    double localityBefore = _getMarkerParticleLocality(keys, nullptr);
 
-    _removeMarkerParticles(_currentFrameDeltaTime);
+    std::vector<int> order;
+    SortUtils::radixSortIndices(keys, maxKey, order);
+    double localityAfter = _getMarkerParticleLocality(keys, &order);
+    std::vector<uint64_t>().swap(keys);
+
+    _markerParticles.applyPermutation(order);
+    _markerParticleCellIndex.isValid = false;
 
     t.stop();
-    _timingData.advanceMarkerParticles += t.getTime();
+    _timingData.sortMarkerParticles += t.getTime();
+    _timingData.numMarkerParticleSorts++;
+    _timingData.markerParticleLocalityBefore = localityBefore;
+    _timingData.markerParticleLocalityAfter = localityAfter;
 
-    _logfile.logString(_logfile.getTime() + " COMPLETE    Advect Marker Particles");
+    _logfile.logString(_logfile.getTime() + " COMPLETE    Sort Marker Particles");
 }
 
 /********************************************************************************
@@ -4033,7 +4505,8 @@ void FluidSimulation::_updateInflowMeshFluidSource(MeshFluidSource *source,
     }
 }
 
-void FluidSimulation::_updateOutflowMeshFluidSource(MeshFluidSource *source) {
+void FluidSimulation::_updateOutflowMeshFluidSource(MeshFluidSource *source, 
+                                                    std::vector<char> &isMarkerParticleRemoved) {
     if (!source->isEnabled()) {
         return;
     }
@@ -4062,20 +4535,39 @@ void FluidSimulation::_updateOutflowMeshFluidSource(MeshFluidSource *source) {
     }
 
     if (source->isFluidOutflowEnabled()) {
-        std::vector<bool> isRemoved(_markerParticles.size(), false);
-        for (int i = 0; i < (int)_markerParticles.size(); i++) {
-            vmath::vec3 p = _markerParticles[i].position;
-            GridIndex g = Grid3d::positionToGridIndex(p, _dx);
-            if (isOutflowCell(g)) {
-                float d = sourceSDF->trilinearInterpolate(p);
-                if (source->isOutflowInversed() && d >= 0.0f) {
-                    isRemoved[i] = true;
-                } else if (!source->isOutflowInversed() && d < 0.0f) {
-                    isRemoved[i] = true;
+        _updateMarkerParticleCellIndex();
+        std::vector<int> &cellStart = _markerParticleCellIndex.cellStart;
+        std::vector<int> &cellParticles = _markerParticleCellIndex.cellParticles;
+        int numIndexedParticles = _markerParticleCellIndex.numIndexedParticles;
+        bool isInversed = source->isOutflowInversed();
+        auto removeParticle = [&](int i) {
+            float d = sourceSDF->trilinearInterpolate(_markerParticles.getPosition(i));
+            if ((isInversed && d >= 0.0f) || (!isInversed && d < 0.0f)) {
+                isMarkerParticleRemoved[i] = true;
+            }
+        };
+
+        // Cells hold disjoint sets of particles
+        int gridsize = _isize * _jsize * _ksize;
+        ThreadUtils::parallelFor(0, gridsize, [&](int startidx, int endidx) {
+            for (int flatidx = startidx; flatidx < endidx; flatidx++) {
+                if (cellStart[flatidx] == cellStart[flatidx + 1] || 
+                        !isOutflowCell(Grid3d::getUnflattenedIndex(flatidx, _isize, _jsize))) {
+                    continue;
                 }
+
+                for (int pidx = cellStart[flatidx]; pidx < cellStart[flatidx + 1]; pidx++) {
+                    removeParticle(cellParticles[pidx]);
+                }
+            }
+        });
+
+        for (int i = numIndexedParticles; i < (int)_markerParticles.size(); i++) {
+            GridIndex g = Grid3d::positionToGridIndex(_markerParticles.getPosition(i), _dx);
+            if (isOutflowCell(g)) {
+                removeParticle(i);
             }
         }
-        _removeItemsFromVector(_markerParticles, isRemoved);
     }
     
     if (source->isDiffuseOutflowEnabled()) {
@@ -4097,7 +4589,7 @@ void FluidSimulation::_updateOutflowMeshFluidSource(MeshFluidSource *source) {
                 }
             }
         }
-        _removeItemsFromVector(*dps, isRemoved);
+        CompactionUtils::removeItems(*dps, isRemoved);
     }
 }
 
@@ -4114,9 +4606,7 @@ void FluidSimulation::_updateInflowMeshFluidSources() {
     }
 
     ParticleMaskGrid maskgrid(_isize, _jsize, _ksize, _dx);
-    for (unsigned int i = 0; i < _markerParticles.size(); i++) {
-        maskgrid.addParticle(_markerParticles[i].position);
-    }
+    _initializeParticleMaskGrid(maskgrid);
 
     for (size_t i = 0; i < _meshFluidSources.size(); i++) {
         if (_meshFluidSources[i]->isInflow()) {
@@ -4137,11 +4627,67 @@ void FluidSimulation::_updateOutflowMeshFluidSources() {
         return;
     }
 
+    // Particles are removed once after all sources have been applied so
+    // that every source can read the same particle cell index
+    std::vector<char> isMarkerParticleRemoved(_markerParticles.size(), false);
     for (size_t i = 0; i < _meshFluidSources.size(); i++) {
         if (_meshFluidSources[i]->isOutflow()) {
-            _updateOutflowMeshFluidSource(_meshFluidSources[i]);
+            _updateOutflowMeshFluidSource(_meshFluidSources[i], isMarkerParticleRemoved);
         }
     }
+
+    if (std::find(isMarkerParticleRemoved.begin(), 
+                  isMarkerParticleRemoved.end(), true) != isMarkerParticleRemoved.end()) {
+        _markerParticles.removeParticles(isMarkerParticleRemoved);
+        _markerParticleStats.isMaxSpeedValid = false;
+        _markerParticleCellIndex.isValid = false;
+    }
+}
+
+void FluidSimulation::_updateMarkerParticleCellIndex() {
+    MarkerParticleCellIndex &index = _markerParticleCellIndex;
+    if (index.isValid && index.numIndexedParticles <= (int)_markerParticles.size()) {
+        return;
+    }
+
+    int n = (int)_markerParticles.size();
+    std::vector<uint64_t> cellKeys(n);
+    ThreadUtils::parallelFor(0, n, [&](int startidx, int endidx) {
+        for (int i = startidx; i < endidx; i++) {
+            GridIndex g = Grid3d::positionToGridIndex(_markerParticles.getPosition(i), _dx);
+            g.i = std::min(std::max(g.i, 0), _isize - 1);
+            g.j = std::min(std::max(g.j, 0), _jsize - 1);
+            g.k = std::min(std::max(g.k, 0), _ksize - 1);
+            cellKeys[i] = Grid3d::getFlatIndex(g, _isize, _jsize);
+        }
+    });
+
+    ScatterUtils::sortPointsIntoBlocks(cellKeys, _isize * _jsize * _ksize, 
+                                       index.cellParticles, index.cellStart);
+    index.numIndexedParticles = n;
+    index.isValid = true;
+}
+
+void FluidSimulation::_initializeParticleMaskGrid(ParticleMaskGrid &maskgrid) {
+    _updateMarkerParticleCellIndex();
+    std::vector<int> &cellStart = _markerParticleCellIndex.cellStart;
+    std::vector<int> &cellParticles = _markerParticleCellIndex.cellParticles;
+
+    // Particles only set the mask of the cell that contains them, so cells
+    // can be filled in parallel
+    int gridsize = _isize * _jsize * _ksize;
+    ThreadUtils::parallelFor(0, gridsize, [&](int startidx, int endidx) {
+        for (int flatidx = startidx; flatidx < endidx; flatidx++) {
+            for (int pidx = cellStart[flatidx]; pidx < cellStart[flatidx + 1]; pidx++) {
+                maskgrid.addParticle(_markerParticles.getPosition(cellParticles[pidx]));
+            }
+        }
+    });
+
+    int numIndexedParticles = _markerParticleCellIndex.numIndexedParticles;
+    for (int i = numIndexedParticles; i < (int)_markerParticles.size(); i++) {
+        maskgrid.addParticle(_markerParticles.getPosition(i));
+    }
 }
 
 void FluidSimulation::_updateMeshFluidSources() {
@@ -4155,9 +4701,7 @@ void FluidSimulation::_updateAddedFluidMeshObjectQueue() {
     }
 
     ParticleMaskGrid maskgrid(_isize, _jsize, _ksize, _dx);
-    for (unsigned int i = 0; i < _markerParticles.size(); i++) {
-        maskgrid.addParticle(_markerParticles[i].position);
-    }
+    _initializeParticleMaskGrid(maskgrid);
 
     MeshLevelSet meshSDF(_isize, _jsize, _ksize, _dx);
     meshSDF.disableVelocityData();
@@ -4200,7 +4744,7 @@ int FluidSimulation::_getNumFluidCells() {
     if (count == 0 && !_markerParticles.empty()) {
         Array3d<bool> isFluidCell(_isize, _jsize, _ksize, false);
         for (unsigned int i = 0; i < _markerParticles.size(); i++) {
-            GridIndex g = Grid3d::positionToGridIndex(_markerParticles[i].position, _dx);
+            GridIndex g = Grid3d::positionToGridIndex(_markerParticles.getPosition(i), _dx);
             isFluidCell.set(g, true);
         }
 
@@ -4219,6 +4763,7 @@ int FluidSimulation::_getNumFluidCells() {
 }
 
 void FluidSimulation::_updateFluidObjects() {
+    FLUIDSIM_PROFILE_SCOPE("Update Fluid Objects");
     _logfile.logString(_logfile.getTime() + " BEGIN       Update Fluid Objects");
 
     StopWatch t;
@@ -4487,6 +5032,7 @@ void FluidSimulation::_polygonizeOutputSurface(TriangleMesh &surface, TriangleMe
     if (_isPreviewSurfaceMeshEnabled) {
         params.previewdx = _previewdx;
     }
+    params.scatterMethod = _particleScatterMethod;
 
     ParticleMesher mesher;
     surface = mesher.meshParticles(params);
@@ -4543,11 +5089,13 @@ void FluidSimulation::_filterParticlesOutsideMeshingVolume(std::vector<vmath::ve
 
     std::vector<bool> isSolid;
     _meshingVolumeSDF.trilinearInterpolateSolidPoints(*particles, isSolid);
-    _removeItemsFromVector(*particles, isSolid);
+    CompactionUtils::removeItems(*particles, isSolid);
 }
 
 void FluidSimulation::_outputSurfaceMeshThread(std::vector<vmath::vec3> *particles,
                                                MeshLevelSet *solidSDF) {
+    Profiler::setThreadName("Mesher");
+    FLUIDSIM_PROFILE_SCOPE("Generate Surface Mesh");
     if (!_isSurfaceMeshReconstructionEnabled) { return; }
 
     _logfile.logString(_logfile.getTime() + " BEGIN       Generate Surface Mesh");
@@ -4619,7 +5167,7 @@ void FluidSimulation::_launchOutputSurfaceMeshThread() {
     std::vector<vmath::vec3> *particles = new std::vector<vmath::vec3>();
     particles->reserve(_markerParticles.size());
     for (size_t i = 0; i < _markerParticles.size(); i++) {
-        particles->push_back(_markerParticles[i].position);
+        particles->push_back(_markerParticles.getPosition(i));
     }
 
     // solidSDF will be deleted within the thread after use
@@ -4699,7 +5247,7 @@ float FluidSimulation::_calculateParticleSpeedPercentileThreshold(float pct) {
     int nbins = 10000;
     std::vector<int> binCounts(nbins, 0);
     for (size_t i = 0; i < _markerParticles.size(); i++) {
-        float s = vmath::length(_markerParticles[i].velocity);
+        float s = vmath::length(_markerParticles.getVelocity(i));
         int binidx = (int)fmin(floor(s * invmax * (nbins - 1)), nbins - 1);
         binCounts[binidx]++;
     }
@@ -4727,7 +5275,7 @@ void FluidSimulation::_outputFluidParticles() {
     int nbins = 1024;
     std::vector<int> binCounts(nbins, 0);
     for (size_t i = 0; i < _markerParticles.size(); i++) {
-        float s = vmath::length(_markerParticles[i].velocity);
+        float s = vmath::length(_markerParticles.getVelocity(i));
         int binidx = (int)fmin(floor(s * invmax * (nbins - 1)), nbins - 1);
         binCounts[binidx]++;
     }
@@ -4745,12 +5293,12 @@ void FluidSimulation::_outputFluidParticles() {
     std::vector<vmath::vec3> sortedParticles(_markerParticles.size());
     std::vector<int> binStartsCopy = binStarts;
     for (size_t i = 0; i < _markerParticles.size(); i++) {
-        float s = vmath::length(_markerParticles[i].velocity);
+        float s = vmath::length(_markerParticles.getVelocity(i));
         int binidx = (int)fmin(floor(s * invmax * (nbins - 1)), nbins - 1);
         int vidx = binStartsCopy[binidx];
         binStartsCopy[binidx]++;
 
-        vmath::vec3 p = _markerParticles[i].position;
+        vmath::vec3 p = _markerParticles.getPosition(i);
         p *= _domainScale;
         p += _domainOffset;
         sortedParticles[vidx] = p;
@@ -4801,7 +5349,16 @@ void FluidSimulation::_outputSimulationLogFile() {
     _outputData.logfileData = _logfile.flush();
 }
 
+void FluidSimulation::_outputProfilingTraceData() {
+    if (_isProfilingEnabled) {
+        Profiler::getChromeTraceData(_outputData.profilingTraceData);
+    } else {
+        _outputData.profilingTraceData.clear();
+    }
+}
+
 void FluidSimulation::_outputSimulationData() {
+    FLUIDSIM_PROFILE_SCOPE("Output Simulation Data");
     if (_currentFrameTimeStepNumber == 0) {
         _logfile.logString(_logfile.getTime() + " BEGIN       Generate Output Data");
 
@@ -4826,43 +5383,96 @@ void FluidSimulation::_outputSimulationData() {
     TIME STEP
 ********************************************************************************/
 
+/*
+    The stages of a time step form a dependency graph. The obstacle update,
+    the liquid level set and the velocity advection depend on different 
+    inputs and run concurrently. The surface curvature runs alongside the 
+    velocity update stages until the first stage that uses it.
+*/
 void FluidSimulation::_stepFluid(double dt) {
-    if (!_isSkippedFrame) {
-        _launchUpdateObstacleObjectsThread(dt);
-        _joinUpdateObstacleObjectsThread();
-        _launchUpdateLiquidLevelSetThread();
-        _joinUpdateLiquidLevelSetThread();
-        _launchAdvectVelocityFieldThread();
-        _joinAdvectVelocityFieldThread();
-        _launchCalculateFluidCurvatureGridThread();
-        _saveVelocityField();
-        _applyBodyForcesToVelocityField(dt);
-        _applyViscosityToVelocityField(dt);
-
-        if (_isSurfaceTensionEnabled) {
-            _joinCalculateFluidCurvatureGridThread();
-        }
+    if (_isSkippedFrame) {
+        return;
+    }
 
-        _pressureSolve(dt);
-        _constrainVelocityFields();
+    TaskGraph graph;
+    int updateObstacles = graph.addTask("Update Obstacle Objects", [this, dt]() { 
+        _updateObstacleObjects(dt); 
+    });
+    int updateLiquidLevelSet = graph.addTask("Update Liquid Level Set", [this]() { 
+        _updateLiquidLevelSet(); 
+    });
+    int advectVelocityField = graph.addTask("Advect Velocity Field", [this]() { 
+        _advectVelocityField(); 
+    });
 
-        if (_isDiffuseMaterialOutputEnabled) {
-            _joinCalculateFluidCurvatureGridThread();
-        }
+    int postProcessLiquidLevelSet = graph.addTask("Post Process Liquid Level Set", [this]() { 
+        _postProcessLiquidLevelSet(); 
+    });
+    graph.addDependency(postProcessLiquidLevelSet, updateObstacles);
+    graph.addDependency(postProcessLiquidLevelSet, updateLiquidLevelSet);
 
-        _updateDiffuseMaterial(dt);
+    int calculateCurvature = -1;
+    if (_isFluidCurvatureGridRequired()) {
+        calculateCurvature = graph.addTask("Calculate Surface Curvature", [this]() { 
+            _calculateFluidCurvatureGrid(); 
+        });
+        graph.addDependency(calculateCurvature, postProcessLiquidLevelSet);
+    }
 
-        if (_isSheetSeedingEnabled) {
-            _joinCalculateFluidCurvatureGridThread();
-        }
+    int saveVelocityField = graph.addTask("Save Velocity Field", [this]() { 
+        _saveVelocityField(); 
+    });
+    graph.addDependency(saveVelocityField, advectVelocityField);
+
+    int applyBodyForces = graph.addTask("Apply Body Forces", [this, dt]() { 
+        _applyBodyForcesToVelocityField(dt); 
+    });
+    graph.addDependency(applyBodyForces, saveVelocityField);
+    graph.addDependency(applyBodyForces, postProcessLiquidLevelSet);
 
+    int applyViscosity = graph.addTask("Apply Viscosity", [this, dt]() { 
+        _applyViscosityToVelocityField(dt); 
+    });
+    graph.addDependency(applyViscosity, applyBodyForces);
+
+    int pressureSolve = graph.addTask("Pressure Projection", [this, dt]() { 
+        _pressureSolve(dt); 
+        _constrainVelocityFields();
+    });
+    graph.addDependency(pressureSolve, applyViscosity);
+    if (_isSurfaceTensionEnabled) {
+        graph.addDependency(pressureSolve, calculateCurvature);
+    }
+
+    int updateDiffuseMaterial = graph.addTask("Simulate Diffuse Material", [this, dt]() { 
+        _updateDiffuseMaterial(dt); 
+    });
+    graph.addDependency(updateDiffuseMaterial, pressureSolve);
+    if (_isDiffuseMaterialOutputEnabled) {
+        graph.addDependency(updateDiffuseMaterial, calculateCurvature);
+    }
+
+    int updateParticles = graph.addTask("Update Marker Particles", [this, dt]() { 
         _updateSheetSeeding();
         _updateMarkerParticleVelocities();
         _deleteSavedVelocityField();
         _advanceMarkerParticles(dt);
+        _sortMarkerParticles();
+    });
+    graph.addDependency(updateParticles, updateDiffuseMaterial);
+    if (_isSheetSeedingEnabled) {
+        graph.addDependency(updateParticles, calculateCurvature);
+    }
+
+    int outputData = graph.addTask("Output Simulation Data", [this]() { 
         _updateFluidObjects();
         _outputSimulationData();
-    }
+    });
+    graph.addDependency(outputData, updateParticles);
+
+    graph.run();
+
+    _timingData.criticalPath += graph.getCriticalPathTime();
 }
 
 double FluidSimulation::_getMaximumMeshObjectFluidVelocity(MeshObject *object, 
@@ -4909,17 +5519,23 @@ double FluidSimulation::_predictMaximumMarkerParticleSpeed(double dt) {
 }
 
 double FluidSimulation::_getMaximumMarkerParticleSpeed() {
-    double maxsq = 0.0;
-    MarkerParticle mp;
-    for (unsigned int i = 0; i < _markerParticles.size(); i++) {
-        mp = _markerParticles[i];
-        double distsq = vmath::dot(mp.velocity, mp.velocity);
-        if (distsq > maxsq) {
-            maxsq = distsq;
-        }
+    MarkerParticleStats &stats = _markerParticleStats;
+    if (!stats.isMaxSpeedValid) {
+        stats.maxSpeedSquared = ThreadUtils::parallelReduce(0, _markerParticles.size(), 0, 0.0, 
+            [&](int startidx, int endidx) {
+                double maxsq = 0.0;
+                for (int i = startidx; i < endidx; i++) {
+                    vmath::vec3 v = _markerParticles.getVelocity(i);
+                    maxsq = std::max(maxsq, (double)vmath::dot(v, v));
+                }
+                return maxsq;
+            },
+            [](double a, double b) { return std::max(a, b); }
+        );
+        stats.isMaxSpeedValid = true;
     }
 
-    return sqrt(maxsq);
+    return sqrt(stats.maxSpeedSquared);
 }
 
 double FluidSimulation::_getMaximumObstacleSpeed(double dt) {
@@ -4989,6 +5605,7 @@ void FluidSimulation::_updateTimingData() {
     tstats.particles = tdata.updateSheetSeeding + 
                        tdata.updateMarkerParticleVelocities + 
                        tdata.advanceMarkerParticles + 
+                       tdata.sortMarkerParticles + 
                        tdata.updateLiquidLevelSet;
     tstats.pressure = tdata.pressureSolve;
     tstats.diffuse = diffuseCurvatureTimeFactor * tdata.calculateFluidCurvatureGrid + tdata.updateDiffuseMaterial;
@@ -5021,6 +5638,7 @@ void FluidSimulation::_logFrameInfo() {
         PrintData("Update Marker Particle Velocities    ", tdata.updateMarkerParticleVelocities),
         PrintData("Delete Saved Velocity Field          ", tdata.deleteSavedVelocityField),
         PrintData("Advance Marker Particles             ", tdata.advanceMarkerParticles),
+        PrintData("Sort Marker Particles                ", tdata.sortMarkerParticles),
         PrintData("Update Fluid Objects                 ", tdata.updateFluidObjects),
         PrintData("Output Simulation Data               ", tdata.outputNonMeshSimulationData),
         PrintData("Generate Surface Mesh                ", tdata.outputMeshSimulationData)
@@ -5056,6 +5674,14 @@ void FluidSimulation::_logFrameInfo() {
 
     _logfile.newline();
     _logfile.log("Frame Time:   ", tdata.frameTime, 3);
+    _logfile.log("Critical Path: ", tdata.criticalPath, 3);
+    if (tdata.numMarkerParticleSorts > 0) {
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(1) << 
+              "Particle Locality: " << tdata.markerParticleLocalityBefore * 100.0 << "% -> " <<
+              tdata.markerParticleLocalityAfter * 100.0 << "%";
+        _logfile.logString(ss.str());
+    }
     _logfile.log("Total Time:   ", _totalSimulationTime, 3);
     _logfile.newline();
 }
@@ -5134,6 +5760,7 @@ void FluidSimulation::update(double dt) {
 
     double eps = 1e-9;
     do {
+        FLUIDSIM_PROFILE_SCOPE("Time Step");
         StopWatch stepTimer;
         stepTimer.start();
 
@@ -5190,6 +5817,7 @@ void FluidSimulation::update(double dt) {
     _outputData.isInitialized = true;
 
     _outputSimulationLogFile();
+    _outputProfilingTraceData();
 
     _currentFrame++;
 
@@ -32,11 +32,14 @@ SOFTWARE.
 #endif
 
 #include <vector>
+#include <cstdint>
+#include <atomic>
 
 #include "vmath.h"
 #include "array3d.h"
 #include "meshobject.h"
 #include "fragmentedvector.h"
+#include "markerparticlestore.h"
 #include "logfile.h"
 #include "particlelevelset.h"
 #include "pressuresolver.h"
@@ -101,6 +104,23 @@ struct FluidSimulationMarkerParticleData {
     char *velocities;
 };
 
+/*
+    Marker particle data of a single storage fragment. Each stream holds 
+    'size' 32-bit floats spaced 'stride' bytes apart. A stream pointer is 
+    null if the stream is not stored as 32-bit floats.
+*/
+struct FluidSimulationMarkerParticleFragmentView {
+    int size = 0;
+    int startIndex = 0;
+    int stride = 0;
+    char *positionsX = nullptr;
+    char *positionsY = nullptr;
+    char *positionsZ = nullptr;
+    char *velocitiesX = nullptr;
+    char *velocitiesY = nullptr;
+    char *velocitiesZ = nullptr;
+};
+
 struct FluidSimulationDiffuseParticleData {
     int size = 0;
     char *positions;
@@ -809,6 +829,149 @@ public:
     void disableExtremeVelocityRemoval();
     bool isExtremeVelocityRemovalEnabled();
 
+    /*
+        Enable/Disable matrix-free pressure solver
+
+        If enabled, the pressure matrix is not assembled. Matrix coefficients
+        are computed from the weight grid and liquid SDF during each solver
+        iteration, which reduces peak memory usage of the pressure solve.
+        Results are identical to the assembled matrix.
+    */
+    void enableMatrixFreePressureSolver();
+    void disableMatrixFreePressureSolver();
+    bool isMatrixFreePressureSolverEnabled();
+
+    /*
+        Preconditioner used by the pressure solver
+
+        PressurePreconditioner::mic         - Modified incomplete Cholesky, MIC(0)
+        PressurePreconditioner::multigrid   - Geometric multigrid V-cycle. Runs in
+                                              parallel and iteration counts grow
+                                              slowly with grid resolution.
+        PressurePreconditioner::parallelMIC - Block Jacobi MIC(0) with one block
+                                              of pressure cells per thread. 
+                                              Factorization and triangular solves
+                                              run in parallel at the cost of a
+                                              few more iterations.
+
+        The preconditioner, iteration count and solve time are reported in
+        the pressure solver status of the log.
+    */
+    PressurePreconditioner getPressureSolverPreconditioner();
+    void setPressureSolverPreconditioner(PressurePreconditioner p);
+
+    /*
+        Enable/Disable comparison against the serial preconditioner
+
+        If enabled and the pressure solver is not using the MIC(0) 
+        preconditioner, each pressure system is solved a second time with
+        MIC(0) and the iteration counts and solve times of both solves are
+        reported in the pressure solver status. Intended for benchmarking
+        as it increases the cost of the pressure solve.
+    */
+    void enablePressureSolverPreconditionerComparison();
+    void disablePressureSolverPreconditionerComparison();
+    bool isPressureSolverPreconditionerComparisonEnabled();
+
+    /*
+        Enable/Disable warm starting of the pressure solver
+
+        If enabled, the pressure field of the previous time step is kept and
+        used as the initial guess of the next pressure solve. Reduces the 
+        number of solver iterations for settled or slowly changing liquid.
+        The pressure field is a float grid of the simulation dimensions that
+        stays allocated while enabled (4 bytes per cell).
+
+        Disabled by default.
+    */
+    void enablePressureSolverWarmStart();
+    void disablePressureSolverWarmStart();
+    bool isPressureSolverWarmStartEnabled();
+
+    /*
+        Enable/Disable mixed precision pressure solver
+
+        If enabled, the pressure matrix, preconditioner and solver work 
+        vectors are stored in single precision while the pressure and all
+        dot products are kept in double precision. This halves the memory
+        traffic of each solver iteration. Iterative refinement recomputes
+        the true residual in double precision and restarts the solver until
+        the solver tolerance is reached. Not used by the matrix-free
+        pressure solver.
+    */
+    void enableMixedPrecisionPressureSolver();
+    void disableMixedPrecisionPressureSolver();
+    bool isMixedPrecisionPressureSolverEnabled();
+
+    /*
+        Maximum number of iterative refinement restarts of the mixed 
+        precision pressure solver. A value of 0 disables refinement.
+    */
+    int getPressureSolverRefinementSteps();
+    void setPressureSolverRefinementSteps(int n);
+
+    /*
+        Number of time steps between spatial sorts of the marker particles. 
+        Particles are reordered along a Morton curve over the blocks used 
+        for velocity transfer and by cell within each block so that 
+        particles that are close in space are close in memory. A value of 0
+        disables sorting.
+    */
+    int getMarkerParticleSortInterval();
+    void setMarkerParticleSortInterval(int n);
+
+    /*
+        Enable/Disable compressed marker particle storage
+
+        Quantized positions are stored as a block coordinate and 16-bit 
+        offsets within the block, a precision of 1/8192 of a cell width.
+        Half precision velocities are stored as 16-bit floats with a relative
+        precision of about 1/2048. Particles are decoded where they are used
+        by the advection and transfer stages. Enabling either option reduces 
+        the memory used by each particle at a small cost in accuracy and 
+        decoding time.
+    */
+    void enableQuantizedMarkerParticlePositions();
+    void disableQuantizedMarkerParticlePositions();
+    bool isQuantizedMarkerParticlePositionsEnabled();
+    void enableHalfPrecisionMarkerParticleVelocities();
+    void disableHalfPrecisionMarkerParticleVelocities();
+    bool isHalfPrecisionMarkerParticleVelocitiesEnabled();
+
+    /*
+        Method used to scatter particles onto grid blocks when transferring
+        velocities, computing the liquid level set and meshing the surface
+
+        ParticleScatterMethod::queue   - Particles are copied into every block
+                                         they overlap. Blocks are computed by 
+                                         worker threads and merged into the 
+                                         grid by a single thread.
+        ParticleScatterMethod::colored - Particles are sorted once into the 
+                                         block that contains them. Blocks are
+                                         processed in 8 colour groups so that
+                                         threads write directly into 
+                                         neighbouring blocks without locking.
+
+        The colored method falls back to the queue when a particle footprint
+        is too large for the block width.
+    */
+    ParticleScatterMethod getParticleScatterMethod();
+    void setParticleScatterMethod(ParticleScatterMethod m);
+
+    /*
+        Enable/Disable profiling
+
+        If enabled, the time spent in each stage of the simulation and in
+        the major solver and meshing routines is recorded per thread. The 
+        zones recorded during a frame are available after each update 
+        through getProfilingTraceData() as Chrome trace event JSON. Zones of
+        the asynchronous surface mesher may be reported with the following
+        frame.
+    */
+    void enableProfiling();
+    void disableProfiling();
+    bool isProfilingEnabled();
+
     /*
         Ratio of PIC to FLIP velocity update
     */
@@ -949,6 +1112,20 @@ public:
     std::vector<vmath::vec3> getMarkerParticleVelocities();
     std::vector<vmath::vec3> getMarkerParticleVelocities(int startidx, int endidx);
 
+    /*
+        Direct access to marker particle storage without copying. Particles
+        are stored in fragments that each hold separate x, y and z streams of
+        positions and velocities. Fragment n holds the particles starting at
+        index view.startIndex. Positions are in simulation space, the same 
+        as getMarkerParticlePositions().
+
+        Stream pointers are null when quantized positions or half precision
+        velocities are enabled. Views are invalidated by the next call to 
+        update() or any method that adds or removes marker particles.
+    */
+    int getNumMarkerParticleFragments();
+    FluidSimulationMarkerParticleFragmentView getMarkerParticleFragmentView(int fragmentIndex);
+
     /*
         Returns the number of diffuse particles in the simulation.
     */
@@ -1023,6 +1200,7 @@ public:
     std::vector<char>* getFluidParticleData();
     std::vector<char>* getInternalObstacleMeshData();
     std::vector<char>* getLogFileData();
+    std::vector<char>* getProfilingTraceData();
     FluidSimulationFrameStats getFrameStatsData();
 
     void getMarkerParticlePositionData(char *data);
@@ -1071,6 +1249,7 @@ private:
         std::vector<char> fluidParticleData;
         std::vector<char> internalObstacleMeshData;
         std::vector<char> logfileData;
+        std::vector<char> profilingTraceData;
         FluidSimulationFrameStats frameData;
         bool isInitialized = false;
     };
@@ -1083,6 +1262,39 @@ private:
         FragmentedVector<DiffuseParticle> particles;
     };
 
+    /*
+        Marker particle statistics gathered while advancing the particles 
+        and read by particle removal and the time step calculation. The 
+        per-particle and per-cell data are only kept between advection and
+        removal. The maximum speed is kept up to date as particles are 
+        added and is recomputed once invalidated.
+    */
+    struct MarkerParticleStats {
+        std::vector<float> speedsSquared;
+        std::vector<int> cellIndices;               // -1 if inside a solid
+        std::vector<std::atomic<int> > cellCounts;
+        std::vector<std::atomic<int> > speedLimitCounts;
+        double speedLimitStep = 0.0;
+
+        bool isMaxSpeedValid = false;
+        double maxSpeedSquared = 0.0;
+    };
+
+    /*
+        Marker particle indices grouped by grid cell. The particles in flat
+        cell index c are cellParticles[cellStart[c]] to 
+        cellParticles[cellStart[c + 1] - 1] in increasing index order. 
+        Particles appended after the index was built, from 
+        numIndexedParticles onwards, are not in the index. The index is
+        invalidated when particles move, are removed or are reordered.
+    */
+    struct MarkerParticleCellIndex {
+        bool isValid = false;
+        int numIndexedParticles = 0;
+        std::vector<int> cellStart;
+        std::vector<int> cellParticles;
+    };
+
     struct TimingData {
         double updateObstacleObjects = 0.0;
         double updateLiquidLevelSet = 0.0;
@@ -1098,11 +1310,22 @@ private:
         double updateMarkerParticleVelocities = 0.0;
         double deleteSavedVelocityField = 0.0;
         double advanceMarkerParticles = 0.0;
+        double sortMarkerParticles = 0.0;
         double updateFluidObjects = 0.0;
         double outputNonMeshSimulationData = 0.0;
         double outputMeshSimulationData = 0.0;
         double frameTime = 0.0;
 
+        // Sum of the critical path times of the time step task graphs. Not
+        // included in normalizeTimes as stage times overlap.
+        double criticalPath = 0.0;
+
+        // Fraction of consecutive marker particles that lie in the same 
+        // grid cell before and after the last sort of the frame
+        int numMarkerParticleSorts = 0;
+        double markerParticleLocalityBefore = 0.0;
+        double markerParticleLocalityAfter = 0.0;
+
         void normalizeTimes() {
             double total = updateObstacleObjects +
                            updateLiquidLevelSet +
@@ -1118,6 +1341,7 @@ private:
                            updateMarkerParticleVelocities +
                            deleteSavedVelocityField +
                            advanceMarkerParticles +
+                           sortMarkerParticles +
                            updateFluidObjects +
                            outputNonMeshSimulationData +
                            outputMeshSimulationData;
@@ -1140,6 +1364,7 @@ private:
             updateMarkerParticleVelocities *= factor;
             deleteSavedVelocityField       *= factor;
             advanceMarkerParticles         *= factor;
+            sortMarkerParticles            *= factor;
             updateFluidObjects             *= factor;
             outputNonMeshSimulationData    *= factor;
             outputMeshSimulationData       *= factor;
@@ -1152,6 +1377,7 @@ private:
     void _initializeLogFile();
     void _initializeSimulationGrids(int isize, int jsize, int ksize, double dx);
     void _initializeSimulation();
+    void _updateMarkerParticleStorageFormat();
     void _initializeParticleRadii();
     double _getMarkerParticleJitter();
     vmath::vec3 _jitterMarkerParticlePosition(vmath::vec3 p, double jitter);
@@ -1182,6 +1408,8 @@ private:
     AABB _getBoundaryAABB();
     TriangleMesh _getBoundaryTriangleMesh();
     void _addAnimatedObjectsToSolidSDF(double dt);
+    void _addMeshObjectToSDF(MeshObject *object, double dt, 
+                             float frameProgress, MeshLevelSet &sdf);
     void _updatePrecomputedSolidLevelSet(double dt, std::vector<MeshObjectStatus> &objectStatus);
     void _addStaticObjectsToSolidSDF(double dt, std::vector<MeshObjectStatus> &objectStatus);
     void _addStaticObjectsToSDF(double dt, MeshLevelSet &sdf);
@@ -1195,21 +1423,16 @@ private:
     void _resolveSolidLevelSetUpdateCollisionsThread(int startidx, int endidx);
     void _resolveSolidLevelSetUpdateCollisions();
     void _updateObstacleObjects(double dt);
-    void _launchUpdateObstacleObjectsThread(double dt);
-    void _joinUpdateObstacleObjectsThread();
 
     /*
         Update Fluid Levelset
     */
-    void _launchUpdateLiquidLevelSetThread();
-    void _joinUpdateLiquidLevelSetThread();
     void _updateLiquidLevelSet();
+    void _postProcessLiquidLevelSet();
 
     /*
         Advect Velocity Field
     */
-    void _launchAdvectVelocityFieldThread();
-    void _joinAdvectVelocityFieldThread();
     void _advectVelocityField();
     void _saveVelocityField();
     void _deleteSavedVelocityField();
@@ -1217,9 +1440,8 @@ private:
     /*
         Calculate Fluid Curvature
     */
-    void _calculateFluidCurvatureGridThread();
-    void _launchCalculateFluidCurvatureGridThread();
-    void _joinCalculateFluidCurvatureGridThread();
+    void _calculateFluidCurvatureGrid();
+    bool _isFluidCurvatureGridRequired();
 
     /*
         Apply Body Forces
@@ -1279,18 +1501,22 @@ private:
         Advance MarkerParticles
     */
     void _advanceMarkerParticles(double dt);
-    void _advanceMarkerParticlesThread(double dt, int startidx, int endidx,
-                                       std::vector<vmath::vec3> *positions,
-                                       std::vector<vmath::vec3> *output);
-    vmath::vec3 _RK3(vmath::vec3 p0, double dt);
-
-    void _resolveMarkerParticleCollisions(int startidx, int endidx,
-                                          std::vector<vmath::vec3> &positionsOld, 
-                                          std::vector<vmath::vec3> &positionsNew);
+    void _advanceMarkerParticlesThread(double dt, int startidx, int endidx);
+    void _initializeMarkerParticleStats();
+
     vmath::vec3 _resolveCollision(vmath::vec3 oldp, vmath::vec3 newp,
                                   AABB &boundary);
-    float _getMarkerParticleSpeedLimit(double dt);
-    void _removeMarkerParticles(double dt);
+    float _getMarkerParticleSpeedLimit();
+    void _removeMarkerParticles();
+
+    /*
+        Sort MarkerParticles
+    */
+    void _sortMarkerParticles();
+    void _computeMarkerParticleSortKeys(std::vector<uint64_t> &keys, 
+                                        uint64_t *maxKey);
+    double _getMarkerParticleLocality(std::vector<uint64_t> &keys, 
+                                      std::vector<int> *order);
 
     /*
         #. Update Fluid Objects
@@ -1317,7 +1543,10 @@ private:
     void _updateInflowMeshFluidSources();
     void _updateOutflowMeshFluidSources();
     void _updateInflowMeshFluidSource(MeshFluidSource *source, ParticleMaskGrid &maskgrid);
-    void _updateOutflowMeshFluidSource(MeshFluidSource *source);
+    void _updateOutflowMeshFluidSource(MeshFluidSource *source, 
+                                       std::vector<char> &isMarkerParticleRemoved);
+    void _updateMarkerParticleCellIndex();
+    void _initializeParticleMaskGrid(ParticleMaskGrid &maskgrid);
     int _getNumFluidCells();
     void _updateSheetSeeding();
 
@@ -1351,49 +1580,12 @@ private:
                                   std::vector<vmath::vec3> *particles,
                                   MeshLevelSet *soldSDF);
     void _outputSimulationLogFile();
+    void _outputProfilingTraceData();
 
 
     /*
         Misc Methods
     */
-    template<class T>
-    void _removeItemsFromVector(FragmentedVector<T> &items, std::vector<bool> &isRemoved) {
-        FLUIDSIM_ASSERT(items.size() == isRemoved.size());
-
-        int currentidx = 0;
-        for (unsigned int i = 0; i < items.size(); i++) {
-            if (!isRemoved[i]) {
-                items[currentidx] = items[i];
-                currentidx++;
-            }
-        }
-
-        int numRemoved = items.size() - currentidx;
-        for (int i = 0; i < numRemoved; i++) {
-            items.pop_back();
-        }
-        items.shrink_to_fit();
-    }
-
-    template<class T>
-    void _removeItemsFromVector(std::vector<T> &items, std::vector<bool> &isRemoved) {
-        FLUIDSIM_ASSERT(items.size() == isRemoved.size());
-
-        int currentidx = 0;
-        for (unsigned int i = 0; i < items.size(); i++) {
-            if (!isRemoved[i]) {
-                items[currentidx] = items[i];
-                currentidx++;
-            }
-        }
-
-        int numRemoved = items.size() - currentidx;
-        for (int i = 0; i < numRemoved; i++) {
-            items.pop_back();
-        }
-        items.shrink_to_fit();
-    }
-
     inline double _randomDouble(double min, double max) {
         return min + ((double)rand() / (double)RAND_MAX) * (max - min);
     }
@@ -1440,7 +1632,9 @@ private:
     // Update fluid material
     ParticleLevelSet _liquidSDF;
     std::vector<MeshFluidSource*> _meshFluidSources;
-    FragmentedVector<MarkerParticle> _markerParticles;
+    MarkerParticleStore _markerParticles;
+    MarkerParticleStats _markerParticleStats;
+    MarkerParticleCellIndex _markerParticleCellIndex;
     std::vector<FluidMeshObject> _addedFluidMeshObjectQueue;
     double _markerParticleJitterFactor = 0.0;
     bool _isJitterSurfaceMarkerParticlesEnabled = false;
@@ -1453,7 +1647,6 @@ private:
 
     // Update obstacles
     std::vector<MeshObject*> _obstacles;
-    std::thread _updateObstacleObjectsThread;
     Array3d<bool> _nearSolidGrid;
     int _nearSolidGridCellSizeFactor = 3;
     double _nearSolidGridCellSize = 0.0f;
@@ -1471,7 +1664,6 @@ private:
     int _solidLevelSetExactBand = 3;
     double _liquidSDFParticleScale = 1.0;
     double _liquidSDFParticleRadius = 0.0;
-    std::thread _updateLiquidLevelSetThread;
 
     // Reconstruct output fluid surface
     bool _isSurfaceMeshReconstructionEnabled = true;
@@ -1516,13 +1708,10 @@ private:
     // Advect velocity field
     VelocityAdvector _velocityAdvector;
     int _maxParticlesPerVelocityAdvection = 5e6;
-    std::thread _advectVelocityFieldThread;
 
     // Calculate fluid curvature
     Array3d<float> _fluidSurfaceLevelSet;
     Array3d<float> _fluidCurvatureGrid;
-    std::thread _fluidCurvatureThread;
-    bool _isCalculateFluidCurvatureGridThreadRunning = false;
 
     // Apply body forces
     std::vector<vmath::vec3> _constantBodyForces;
@@ -1544,6 +1733,19 @@ private:
     double _pressureSolveAcceptableTolerance = 1.0;
     double _maxPressureSolveIterations = 1000;
     std::string _pressureSolverStatus;
+    bool _isMatrixFreePressureSolverEnabled = false;
+    PressurePreconditioner _pressureSolverPreconditioner = PressurePreconditioner::mic;
+    bool _isPressureSolverPreconditionerComparisonEnabled = false;
+    bool _isPressureSolverWarmStartEnabled = false;
+    bool _isMixedPrecisionPressureSolverEnabled = false;
+    int _pressureSolverRefinementSteps = 2;
+    int _markerParticleSortInterval = 8;
+    bool _isQuantizedMarkerParticlePositionsEnabled = false;
+    bool _isHalfPrecisionMarkerParticleVelocitiesEnabled = false;
+    ParticleScatterMethod _particleScatterMethod = ParticleScatterMethod::queue;
+    int _numStepsSinceMarkerParticleSort = 0;
+    bool _isProfilingEnabled = false;
+    Array3d<float> _pressureGrid;
 
     // Extrapolate fluid velocities
     ValidVelocityComponentGrid _validVelocities;
@@ -138,16 +138,35 @@ public:
 		_size = 0;
 	}
 
+	// Removes all elements from index n onwards. Fragments past the new end
+	// are emptied as a whole.
+	inline void truncate(unsigned int n) {
+		if (n >= _size) {
+			return;
+		}
+
+		int lastNodeIndex = (int)(n / _elementsPerFragment);
+		for (int i = (int)_nodes.size() - 1; i > lastNodeIndex; i--) {
+			_nodes[i].clear();
+		}
+		if (lastNodeIndex < (int)_nodes.size()) {
+			_nodes[lastNodeIndex].truncate(n - lastNodeIndex * _elementsPerFragment);
+		}
+
+		_size = n;
+		_currentNodeIndex = _size == 0 ? 0 : (int)((_size - 1) / _elementsPerFragment);
+	}
+
 	const T operator [](int i) const {
 		FLUIDSIM_ASSERT(i >= 0 && i < (int)_size);
-		int nodeIdx = i * _invElementsPerFragment;
+		int nodeIdx = i / _elementsPerFragment;
 		int itemIdx = i % _elementsPerFragment;
 		return _nodes[nodeIdx][itemIdx];
 	}
 
 	T& operator[](int i) {
 		FLUIDSIM_ASSERT(i >= 0 && i < (int)_size);
-		int nodeIdx = i * _invElementsPerFragment;
+		int nodeIdx = i / _elementsPerFragment;
 		int itemIdx = i % _elementsPerFragment;
 		return _nodes[nodeIdx][itemIdx];
 	}
@@ -275,6 +294,12 @@ private:
 				_vector.clear();
 			}
 
+			inline void truncate(size_t n) {
+				if (n < _vector.size()) {
+					_vector.erase(_vector.begin() + n, _vector.end());
+				}
+			}
+
 			const T operator [](int i) const {
 				FLUIDSIM_ASSERT(i >= 0 && i < (int)_vector.size());
 				return _vector[i];
@@ -297,8 +322,6 @@ private:
 		if (_elementsPerFragment == 0) {
 			_elementsPerFragment = 1;
 		}
-
-		_invElementsPerFragment = 1.0 / (double)_elementsPerFragment;
 	}
 
 	void _addNewVectorNode() {
@@ -320,7 +343,6 @@ private:
 	std::vector<VectorNode> _nodes;
 	unsigned int _bytesPerFragment = 5e6;
 	unsigned int _elementsPerFragment = 0;
-	double _invElementsPerFragment = 0;
 	int _currentNodeIndex = -1;
 	unsigned int _size = 0;
 
@@ -42,20 +42,13 @@ void extrapolateGrid(Array3d<float> *grid, Array3d<bool> *valid, int numLayers)
     Array3d<char> status(grid->width, grid->height, grid->depth, UNKNOWN);
 
     int gridsize = grid->width * grid->height * grid->depth;
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, gridsize);
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, gridsize, numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&_initializeStatusGridThread,
-                                 intervals[i], intervals[i + 1], valid, &status);
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, gridsize, [&](int startidx, int endidx) {
+        _initializeStatusGridThread(startidx, endidx, valid, &status);
+    });
 
-    std::vector<std::vector<GridIndex> > threadResults(numthreads);
+    int grainsize = ThreadUtils::getGrainSize(0, gridsize, 0);
+    int numchunks = ThreadUtils::getNumChunks(0, gridsize, grainsize);
+    std::vector<std::vector<GridIndex> > threadResults(numchunks);
     std::vector<GridIndex> extrapolationCells;
     for (int layers = 0; layers < numLayers; layers++) {
         extrapolationCells.clear();
@@ -63,15 +56,12 @@ void extrapolateGrid(Array3d<float> *grid, Array3d<bool> *valid, int numLayers)
             threadResults[i].clear();
         }
 
-        threads = std::vector<std::thread>(numthreads);
-        for (int i = 0; i < numthreads; i++) {
-            threads[i] = std::thread(&_findExtrapolationCells,
-                                     intervals[i], intervals[i + 1], &status, &(threadResults[i]));
-        }
+        ThreadUtils::parallelFor(0, gridsize, grainsize, [&](int startidx, int endidx) {
+            _findExtrapolationCells(startidx, endidx, &status, &(threadResults[startidx / grainsize]));
+        });
 
         int cellcount = 0;
-        for (int i = 0; i < numthreads; i++) {
-            threads[i].join();
+        for (size_t i = 0; i < threadResults.size(); i++) {
             cellcount += threadResults[i].size();
         }
         
@@ -80,18 +70,9 @@ void extrapolateGrid(Array3d<float> *grid, Array3d<bool> *valid, int numLayers)
             extrapolationCells.insert(extrapolationCells.end(), threadResults[i].begin(), threadResults[i].end());
         }
 
-        int extrapolationThreads = (int)fmin(numCPU, extrapolationCells.size());
-        threads = std::vector<std::thread>(extrapolationThreads);
-        std::vector<int> extrapolationIntervals = ThreadUtils::splitRangeIntoIntervals(0, extrapolationCells.size(), extrapolationThreads);
-        for (int i = 0; i < extrapolationThreads; i++) {
-            threads[i] = std::thread(&_extrapolateCellsThread,
-                                     extrapolationIntervals[i], extrapolationIntervals[i + 1], 
-                                     &extrapolationCells, &status, grid);
-        }
-
-        for (int i = 0; i < extrapolationThreads; i++) {
-            threads[i].join();
-        }
+        ThreadUtils::parallelFor(0, extrapolationCells.size(), [&](int startidx, int endidx) {
+            _extrapolateCellsThread(startidx, endidx, &extrapolationCells, &status, grid);
+        });
 
         if (layers != numLayers - 1) {
             status.set(extrapolationCells, KNOWN);
@@ -227,20 +208,13 @@ void _extrapolateCellsThread(int startidx, int endidx,
     }
 }
 
-void featherGrid6(Array3d<bool> *grid, int numthreads) {
+void featherGrid6(Array3d<bool> *grid) {
     Array3d<bool> tempgrid = *grid;
 
     int gridsize = grid->width * grid->height * grid->depth;
-    numthreads = (int)fmin(numthreads, gridsize);
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, gridsize, numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&_featherGrid6Thread, grid, &tempgrid, intervals[i], intervals[i + 1]);
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, gridsize, [&](int startidx, int endidx) {
+        _featherGrid6Thread(grid, &tempgrid, startidx, endidx);
+    });
 }
 
 void _featherGrid6Thread(Array3d<bool> *grid, Array3d<bool> *valid, int startidx, int endidx) {
@@ -262,20 +236,13 @@ void _featherGrid6Thread(Array3d<bool> *grid, Array3d<bool> *valid, int startidx
     }
 }
 
-void featherGrid26(Array3d<bool> *grid, int numthreads) {
+void featherGrid26(Array3d<bool> *grid) {
     Array3d<bool> tempgrid = *grid;
 
     int gridsize = grid->width * grid->height * grid->depth;
-    numthreads = (int)fmin(numthreads, gridsize);
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, gridsize, numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&_featherGrid26Thread, grid, &tempgrid, intervals[i], intervals[i + 1]);
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, gridsize, [&](int startidx, int endidx) {
+        _featherGrid26Thread(grid, &tempgrid, startidx, endidx);
+    });
 }
 
 void _featherGrid26Thread(Array3d<bool> *grid, Array3d<bool> *valid, int startidx, int endidx) {
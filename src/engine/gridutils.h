@@ -36,10 +36,10 @@ namespace GridUtils {
                                  Array3d<char> *status, 
                                  Array3d<float> *grid);
 
-    void featherGrid6(Array3d<bool> *grid, int numthreads);
+    void featherGrid6(Array3d<bool> *grid);
     void _featherGrid6Thread(Array3d<bool> *grid, Array3d<bool> *valid, int startidx, int endidx);
 
-    void featherGrid26(Array3d<bool> *grid, int numthreads);
+    void featherGrid26(Array3d<bool> *grid);
     void _featherGrid26Thread(Array3d<bool> *grid, Array3d<bool> *valid, int startidx, int endidx);
 }
 
@@ -122,18 +122,9 @@ void InfluenceGrid::_updateSpread(double dt) {
     }
 
     int gridsize = _isize * _jsize * _ksize;
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, gridsize);
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, gridsize, numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&InfluenceGrid::_updateSpreadThread, this,
-                                 intervals[i], intervals[i + 1], dt);
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, gridsize, [&](int startidx, int endidx) {
+        _updateSpreadThread(startidx, endidx, dt);
+    });
 
     for (int k = 0; k < _influence.depth; k++) {
         for (int j = 0; j < _influence.height; j++) {
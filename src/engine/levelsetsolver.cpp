@@ -53,18 +53,9 @@ void LevelSetSolver::reinitialize(Array3d<float> &inputSDF,
     Array3d<float> *outputPtr = &outputSDF;
 
     for (int n = 0; n < numIterations; n++) {
-        int numCPU = ThreadUtils::getMaxThreadCount();
-        int numthreads = (int)fmin(numCPU, solverCells.size());
-        std::vector<std::thread> threads(numthreads);
-        std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, solverCells.size(), numthreads);
-        for (int i = 0; i < numthreads; i++) {
-            threads[i] = std::thread(&LevelSetSolver::_stepSolverThread, this,
-                                     intervals[i], intervals[i + 1], tempPtr, outputPtr, dx, dtau, &solverCells);
-        }
-
-        for (int i = 0; i < numthreads; i++) {
-            threads[i].join();
-        }
+        ThreadUtils::parallelFor(0, solverCells.size(), [&](int startidx, int endidx) {
+            _stepSolverThread(startidx, endidx, tempPtr, outputPtr, dx, dtau, &solverCells);
+        });
 
         std::swap(tempPtr, outputPtr);
     }
@@ -23,9 +23,16 @@ SOFTWARE.
 */
 
 #include <fstream>
+#include <iostream>
+#include <string>
+#include <cstdlib>
 
 #include "fluidsimulation.h"
 #include "triangle.h"
+#include "stopwatch.h"
+#include "pcgsolver/pcgsolver.h"
+#include "meshutils.h"
+#include "meshlevelset.h"
 
 void writeSurfaceMesh(int frameno, FluidSimulation &fluidsim) {
     std::ostringstream ss;
@@ -66,7 +73,158 @@ TriangleMesh getTriangleMeshFromAABB(AABB bbox) {
     return m;
 }
 
-int main() {
+// 7-point Poisson system on an n^3 grid with Dirichlet boundaries, the same
+// structure as the pressure system of a fully liquid domain.
+void initializePoissonSystem(int n, FixedSparseMatrixd &matrix, std::vector<double> &rhs) {
+    int size = n * n * n;
+    FixedSparseMatrixBuilderd builder(size, 7);
+    ThreadUtils::parallelFor(0, size, [&](int startidx, int endidx) {
+        for (int idx = startidx; idx < endidx; idx++) {
+            GridIndex g = Grid3d::getUnflattenedIndex(idx, n, n);
+            builder.set(idx, idx, 6.0);
+            if (g.i > 0)     { builder.set(idx, idx - 1, -1.0); }
+            if (g.i < n - 1) { builder.set(idx, idx + 1, -1.0); }
+            if (g.j > 0)     { builder.set(idx, idx - n, -1.0); }
+            if (g.j < n - 1) { builder.set(idx, idx + n, -1.0); }
+            if (g.k > 0)     { builder.set(idx, idx - n * n, -1.0); }
+            if (g.k < n - 1) { builder.set(idx, idx + n * n, -1.0); }
+        }
+    });
+    builder.build(matrix);
+
+    rhs = std::vector<double>(size);
+    for (int idx = 0; idx < size; idx++) {
+        GridIndex g = Grid3d::getUnflattenedIndex(idx, n, n);
+        rhs[idx] = sin(0.1 * g.i) * cos(0.07 * g.j) + 0.01 * g.k;
+    }
+}
+
+double timePCGSolve(FixedSparseMatrixd &matrix, std::vector<double> &rhs, 
+                    int iterations, bool isFused, std::vector<double> &result) {
+    PCGSolver<double> solver;
+    solver.setSolverParameters(1e-30, iterations);
+    solver.setFusedIterationEnabled(isFused);
+
+    double residual;
+    int iterationsOut;
+    result = std::vector<double>(rhs.size(), 0.0);
+    StopWatch timer;
+    timer.start();
+    solver.solve(matrix, rhs, result, residual, iterationsOut);
+    timer.stop();
+
+    return timer.getTime();
+}
+
+// Compares the fused and unfused PCG iteration on an n^3 Poisson system. The
+// solver runs a fixed number of iterations. The time of a zero iteration 
+// solve (preconditioner factorization) is subtracted to get the time per 
+// iteration. Bytes moved are counted for the passes that differ between the
+// two modes: the matrix-vector product with its dot product, the two vector
+// updates and the residual norm.
+void runPCGBenchmark(int n, int iterations) {
+    FixedSparseMatrixd matrix;
+    std::vector<double> rhs;
+    initializePoissonSystem(n, matrix, rhs);
+
+    double rows = matrix.n;
+    double nonzeros = matrix.value.size();
+    double matrixBytes = nonzeros * (sizeof(double) + sizeof(unsigned int)) + 
+                         (rows + 1) * sizeof(unsigned int);
+    double vectorBytes = rows * sizeof(double);
+    double unfusedBytes = matrixBytes + 11 * vectorBytes;
+    double fusedBytes = matrixBytes + 8 * vectorBytes;
+
+    std::cout << "PCG benchmark: " << n << "^3 Poisson system, " << 
+                 (int)rows << " rows, " << (int)nonzeros << " nonzeros, " << 
+                 iterations << " iterations" << std::endl;
+
+    std::vector<double> unfusedResult, fusedResult;
+    double setupTime = timePCGSolve(matrix, rhs, 0, true, fusedResult);
+    double unfusedTime = timePCGSolve(matrix, rhs, iterations, false, unfusedResult);
+    double fusedTime = timePCGSolve(matrix, rhs, iterations, true, fusedResult);
+    double unfusedIterationTime = (unfusedTime - setupTime) / iterations;
+    double fusedIterationTime = (fusedTime - setupTime) / iterations;
+
+    double maxdiff = 0.0;
+    for (size_t i = 0; i < fusedResult.size(); i++) {
+        maxdiff = fmax(maxdiff, fabs(fusedResult[i] - unfusedResult[i]));
+    }
+
+    double MB = 1024.0 * 1024.0;
+    std::cout << "    Preconditioner setup:  " << setupTime << "s" << std::endl;
+    std::cout << "    Unfused:  " << 1000.0 * unfusedIterationTime << "ms/iteration, " << 
+                 unfusedBytes / MB << "MB/iteration moved by matrix and update passes" << std::endl;
+    std::cout << "    Fused:    " << 1000.0 * fusedIterationTime << "ms/iteration, " << 
+                 fusedBytes / MB << "MB/iteration moved by matrix and update passes" << std::endl;
+    std::cout << "    Speedup:  " << unfusedIterationTime / fusedIterationTime << "x" << std::endl;
+    std::cout << "    Max solution difference:  " << maxdiff << std::endl;
+}
+
+// Classifies grid nodes inside of two overlapping boxes where one box crosses
+// the domain boundary. Crossings of the two boxes must not cancel in the 
+// overlap: the result must match classifying each box on its own, and the 
+// level set must be negative in the overlap.
+bool runInsideNodesCheck() {
+    int n = 32;
+    double dx = 1.0 / n;
+    TriangleMesh meshA = getTriangleMeshFromAABB(AABB(vmath::vec3(0.2, 0.2, 0.2), 0.4, 0.4, 0.4));
+    TriangleMesh meshB = getTriangleMeshFromAABB(AABB(vmath::vec3(0.41, 0.41, -0.3), 0.4, 0.4, 0.77));
+    TriangleMesh mesh = meshA;
+    mesh.append(meshB);
+
+    Array3d<bool> nodes(n + 1, n + 1, n + 1);
+    Array3d<bool> nodesA(n + 1, n + 1, n + 1);
+    Array3d<bool> nodesB(n + 1, n + 1, n + 1);
+    MeshUtils::getGridNodesInsideTriangleMesh(mesh, dx, nodes);
+    MeshUtils::getGridNodesInsideTriangleMesh(meshA, dx, nodesA);
+    MeshUtils::getGridNodesInsideTriangleMesh(meshB, dx, nodesB);
+
+    int numInside = 0;
+    int numMismatched = 0;
+    for (int k = 0; k < nodes.depth; k++) {
+        for (int j = 0; j < nodes.height; j++) {
+            for (int i = 0; i < nodes.width; i++) {
+                bool isInside = nodesA(i, j, k) || nodesB(i, j, k);
+                if (nodes(i, j, k) != isInside) {
+                    numMismatched++;
+                }
+                if (nodes(i, j, k)) {
+                    numInside++;
+                }
+            }
+        }
+    }
+
+    MeshLevelSet levelset(n, n, n, dx);
+    levelset.fastCalculateSignedDistanceField(mesh);
+
+    GridIndex overlap(16, 16, 11);
+    bool isOverlapInside = nodes(overlap) && levelset(overlap) < 0.0f;
+    bool isPassed = numMismatched == 0 && isOverlapInside;
+
+    std::cout << "Inside nodes check: " << numInside << " inside nodes, " << 
+                 numMismatched << " mismatched nodes, overlap " << 
+                 (isOverlapInside ? "inside" : "outside") << std::endl;
+    std::cout << "    " << (isPassed ? "PASSED" : "FAILED") << std::endl;
+
+    return isPassed;
+}
+
+int main(int argc, char *argv[]) {
+    // Usage: engine_test --benchmark-pcg [gridsize] [iterations]
+    if (argc > 1 && std::string(argv[1]) == "--benchmark-pcg") {
+        int n = argc > 2 ? atoi(argv[2]) : 256;
+        int iterations = argc > 3 ? atoi(argv[3]) : 20;
+        runPCGBenchmark(n, iterations);
+        return 0;
+    }
+
+    // Usage: engine_test --check-inside-nodes
+    if (argc > 1 && std::string(argv[1]) == "--check-inside-nodes") {
+        return runInsideNodesCheck() ? 0 : 1;
+    }
+
     // This example will drop a box of fluid in the center
     // of the fluid simulation domain.
     int isize = 64;
@@ -0,0 +1,551 @@
+/*
+MIT License
+
+Copyright (c) 2019 Ryan L. Guy
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "markerparticlestore.h"
+
+#include <cstdint>
+#include <algorithm>
+#include <cstring>
+
+#include "threadutils.h"
+#include "compactionutils.h"
+
+MarkerParticleStore::MarkerParticleStore() {
+    _layout = _getStreamLayout(_positionFormat, _velocityFormat);
+}
+
+MarkerParticleStore::~MarkerParticleStore() {
+}
+
+void MarkerParticleStore::setFragmentSize(int n) {
+    if (_size != 0 || !_fragments.empty()) {
+        return;
+    }
+
+    int shift = 4;
+    while ((1 << shift) < n && shift < 30) {
+        shift++;
+    }
+
+    _fragmentShift = shift;
+    _fragmentMask = (1 << shift) - 1;
+}
+
+int MarkerParticleStore::getFragmentSize() {
+    return _fragmentMask + 1;
+}
+
+bool MarkerParticleStore::setQuantizationGrid(int isize, int jsize, int ksize, double dx) {
+    // Quantized particles are decoded with the current grid and re-encoded
+    // with the new grid
+    MarkerParticlePositionFormat positionFormat = _positionFormat;
+    if (_positionFormat == MarkerParticlePositionFormat::quantized) {
+        setStorageFormat(MarkerParticlePositionFormat::float32, _velocityFormat);
+    }
+    _isQuantizationGridSet = false;
+
+    int cellsPerBlock = 1 << (16 - _quantizationCellBits);
+    int maxGridSize = 1 << (32 - _quantizationCellBits);
+    int gridsize[3] = {isize, jsize, ksize};
+    int blockBits[3] = {0, 0, 0};
+    int shift = 0;
+    for (int dim = 0; dim < 3; dim++) {
+        if (gridsize[dim] <= 0 || gridsize[dim] >= maxGridSize) {
+            return false;
+        }
+
+        int numBlocks = gridsize[dim] / cellsPerBlock + 1;
+        while ((1 << blockBits[dim]) < numBlocks) {
+            blockBits[dim]++;
+        }
+        shift += blockBits[dim];
+    }
+
+    if (shift > 32) {
+        return false;
+    }
+
+    shift = 0;
+    for (int dim = 0; dim < 3; dim++) {
+        _maxQuantizedValue[dim] = (uint32_t)gridsize[dim] << _quantizationCellBits;
+        _blockMask[dim] = (uint32_t)(((uint64_t)1 << blockBits[dim]) - 1);
+        _blockShift[dim] = shift;
+        shift += blockBits[dim];
+    }
+
+    double quantum = dx / (double)(1 << _quantizationCellBits);
+    _quantum = (float)quantum;
+    _invQuantum = 1.0 / quantum;
+    _isQuantizationGridSet = true;
+
+    setStorageFormat(positionFormat, _velocityFormat);
+
+    return true;
+}
+
+bool MarkerParticleStore::isQuantizationGridSet() {
+    return _isQuantizationGridSet;
+}
+
+void MarkerParticleStore::setStorageFormat(MarkerParticlePositionFormat positionFormat,
+                                           MarkerParticleVelocityFormat velocityFormat) {
+    if (positionFormat == MarkerParticlePositionFormat::quantized && !_isQuantizationGridSet) {
+        positionFormat = MarkerParticlePositionFormat::float32;
+    }
+    if (positionFormat == _positionFormat && velocityFormat == _velocityFormat) {
+        return;
+    }
+
+    StreamLayout layout = _getStreamLayout(positionFormat, velocityFormat);
+    int capacity = getFragmentSize();
+    for (size_t fidx = 0; fidx < _fragments.size(); fidx++) {
+        Fragment &oldFragment = _fragments[fidx];
+        Fragment newFragment(layout, capacity);
+
+        int count = std::max(std::min((int)_size - (int)(fidx << _fragmentShift), capacity), 0);
+        ThreadUtils::parallelFor(0, count, [&](int startidx, int endidx) {
+            for (int j = startidx; j < endidx; j++) {
+                vmath::vec3 p = _getPosition(oldFragment, j, _positionFormat);
+                vmath::vec3 v = _getVelocity(oldFragment, j, _positionFormat, _velocityFormat);
+                _setPosition(newFragment, j, p, positionFormat);
+                _setVelocity(newFragment, j, v, positionFormat, velocityFormat);
+            }
+        });
+
+        newFragment.floatAttributes = std::move(oldFragment.floatAttributes);
+        newFragment.intAttributes = std::move(oldFragment.intAttributes);
+        oldFragment = std::move(newFragment);
+    }
+
+    _positionFormat = positionFormat;
+    _velocityFormat = velocityFormat;
+    _layout = layout;
+}
+
+MarkerParticlePositionFormat MarkerParticleStore::getPositionFormat() {
+    return _positionFormat;
+}
+
+MarkerParticleVelocityFormat MarkerParticleStore::getVelocityFormat() {
+    return _velocityFormat;
+}
+
+int MarkerParticleStore::getBytesPerParticle() {
+    int bytes = 0;
+    for (int sidx = 0; sidx < _layout.numStreams; sidx++) {
+        bytes += _layout.elementSize[sidx];
+    }
+    bytes += (int)_floatAttributeInfo.size() * (int)sizeof(float);
+    bytes += (int)_intAttributeInfo.size() * (int)sizeof(int);
+    return bytes;
+}
+
+void MarkerParticleStore::reserve(unsigned int n) {
+    while ((size_t)_fragments.size() * (size_t)getFragmentSize() < (size_t)n) {
+        _addFragment();
+    }
+}
+
+void MarkerParticleStore::clear() {
+    _size = 0;
+}
+
+void MarkerParticleStore::shrink_to_fit() {
+    int numFragments = getNumFragments();
+    if ((int)_fragments.size() > numFragments) {
+        _fragments.erase(_fragments.begin() + numFragments, _fragments.end());
+    }
+}
+
+void MarkerParticleStore::push_back(vmath::vec3 p, vmath::vec3 v) {
+    if (_size == (unsigned int)_fragments.size() * (unsigned int)getFragmentSize()) {
+        _addFragment();
+    }
+
+    Fragment &f = _fragments[_size >> _fragmentShift];
+    int j = _size & _fragmentMask;
+    _setPosition(f, j, p, _positionFormat);
+    _setVelocity(f, j, v, _positionFormat, _velocityFormat);
+    for (size_t aidx = 0; aidx < _floatAttributeInfo.size(); aidx++) {
+        f.floatAttributes[aidx][j] = _floatAttributeInfo[aidx].floatDefault;
+    }
+    for (size_t aidx = 0; aidx < _intAttributeInfo.size(); aidx++) {
+        f.intAttributes[aidx][j] = _intAttributeInfo[aidx].intDefault;
+    }
+
+    _size++;
+}
+
+MarkerParticleFragmentView MarkerParticleStore::getFragmentView(int fragmentIndex) {
+    FLUIDSIM_ASSERT(fragmentIndex >= 0 && fragmentIndex < getNumFragments());
+
+    Fragment &f = _fragments[fragmentIndex];
+    MarkerParticleFragmentView view;
+    if (_positionFormat == MarkerParticlePositionFormat::float32) {
+        view.px = f.getStream<float>(0);
+        view.py = f.getStream<float>(1);
+        view.pz = f.getStream<float>(2);
+    }
+    if (_velocityFormat == MarkerParticleVelocityFormat::float32) {
+        int sidx = _getVelocityStreamIndex(_positionFormat);
+        view.vx = f.getStream<float>(sidx);
+        view.vy = f.getStream<float>(sidx + 1);
+        view.vz = f.getStream<float>(sidx + 2);
+    }
+    view.startIndex = fragmentIndex << _fragmentShift;
+    view.size = std::min((int)_size - view.startIndex, getFragmentSize());
+
+    return view;
+}
+
+void MarkerParticleStore::getPositions(int i, int count, float *x, float *y, float *z) const {
+    FLUIDSIM_ASSERT(i >= 0 && count >= 0 && i + count <= (int)_size);
+    FLUIDSIM_ASSERT(count == 0 || (i >> _fragmentShift) == ((i + count - 1) >> _fragmentShift));
+
+    if (count == 0) {
+        return;
+    }
+
+    const Fragment &f = _fragments[i >> _fragmentShift];
+    int offset = i & _fragmentMask;
+    if (_positionFormat == MarkerParticlePositionFormat::float32) {
+        std::memcpy(x, f.getStream<float>(0) + offset, count * sizeof(float));
+        std::memcpy(y, f.getStream<float>(1) + offset, count * sizeof(float));
+        std::memcpy(z, f.getStream<float>(2) + offset, count * sizeof(float));
+        return;
+    }
+
+    const uint32_t *blocks = f.getStream<uint32_t>(0) + offset;
+    const uint16_t *oi = f.getStream<uint16_t>(1) + offset;
+    const uint16_t *oj = f.getStream<uint16_t>(2) + offset;
+    const uint16_t *ok = f.getStream<uint16_t>(3) + offset;
+    for (int idx = 0; idx < count; idx++) {
+        uint32_t block = blocks[idx];
+        uint32_t qi = ((block & _blockMask[0]) << 16) | oi[idx];
+        uint32_t qj = (((block >> _blockShift[1]) & _blockMask[1]) << 16) | oj[idx];
+        uint32_t qk = (((block >> _blockShift[2]) & _blockMask[2]) << 16) | ok[idx];
+        x[idx] = (float)qi * _quantum;
+        y[idx] = (float)qj * _quantum;
+        z[idx] = (float)qk * _quantum;
+    }
+}
+
+void MarkerParticleStore::removeParticles(std::vector<bool> &isRemoved) {
+    _removeParticles(isRemoved);
+}
+
+void MarkerParticleStore::removeParticles(std::vector<char> &isRemoved) {
+    _removeParticles(isRemoved);
+}
+
+void MarkerParticleStore::applyPermutation(std::vector<int> &order) {
+    FLUIDSIM_ASSERT(order.size() == _size);
+    _gatherParticles(order, 0);
+}
+
+template<class FlagVector>
+void MarkerParticleStore::_removeParticles(FlagVector &isRemoved) {
+    FLUIDSIM_ASSERT(isRemoved.size() == _size);
+
+    std::vector<int> keptIndices;
+    CompactionUtils::getKeptIndices(isRemoved, keptIndices);
+
+    // Particles in front of the first removed particle are already in place
+    int first = CompactionUtils::getFirstMovedIndex(keptIndices);
+    if (first < (int)keptIndices.size()) {
+        _gatherParticles(keptIndices, first);
+    }
+
+    _size = (unsigned int)keptIndices.size();
+    shrink_to_fit();
+}
+
+void MarkerParticleStore::_gatherParticles(std::vector<int> &indices, int begin) {
+    // Streams are gathered one at a time so that only a single stream of 
+    // temporary storage of each type is needed
+    size_t n = indices.size() - begin;
+    int velocityStream = _getVelocityStreamIndex(_positionFormat);
+
+    std::vector<float> floatTemp(n);
+    if (_positionFormat == MarkerParticlePositionFormat::float32) {
+        for (int sidx = 0; sidx < 3; sidx++) {
+            _gatherParticleStream(indices, begin, floatTemp, sidx);
+        }
+    }
+    if (_velocityFormat == MarkerParticleVelocityFormat::float32) {
+        for (int sidx = velocityStream; sidx < velocityStream + 3; sidx++) {
+            _gatherParticleStream(indices, begin, floatTemp, sidx);
+        }
+    }
+    for (size_t aidx = 0; aidx < _floatAttributeInfo.size(); aidx++) {
+        _gatherStream(indices, begin, floatTemp, [this, aidx](int fidx) { 
+            return _fragments[fidx].floatAttributes[aidx].data(); 
+        });
+    }
+    std::vector<float>().swap(floatTemp);
+
+    if (_positionFormat == MarkerParticlePositionFormat::quantized || 
+            _velocityFormat == MarkerParticleVelocityFormat::float16) {
+        std::vector<uint16_t> halfTemp(n);
+        for (int sidx = 0; sidx < _layout.numStreams; sidx++) {
+            if (_layout.elementSize[sidx] == (int)sizeof(uint16_t)) {
+                _gatherParticleStream(indices, begin, halfTemp, sidx);
+            }
+        }
+    }
+
+    if (_positionFormat == MarkerParticlePositionFormat::quantized) {
+        std::vector<uint32_t> blockTemp(n);
+        _gatherParticleStream(indices, begin, blockTemp, 0);
+    }
+
+    if (!_intAttributeInfo.empty()) {
+        std::vector<int> intTemp(n);
+        for (size_t aidx = 0; aidx < _intAttributeInfo.size(); aidx++) {
+            _gatherStream(indices, begin, intTemp, [this, aidx](int fidx) { 
+                return _fragments[fidx].intAttributes[aidx].data(); 
+            });
+        }
+    }
+}
+
+template<class T>
+void MarkerParticleStore::_gatherParticleStream(std::vector<int> &indices, int begin, 
+                                                std::vector<T> &temp, int sidx) {
+    _gatherStream(indices, begin, temp, [this, sidx](int fidx) { 
+        return _fragments[fidx].getStream<T>(sidx); 
+    });
+}
+
+template<class T, class StreamFunc>
+void MarkerParticleStore::_gatherStream(std::vector<int> &indices, int begin, 
+                                        std::vector<T> &temp, 
+                                        StreamFunc getStream) {
+    int n = (int)indices.size();
+    ThreadUtils::parallelFor(begin, n, [&](int startidx, int endidx) {
+        for (int i = startidx; i < endidx; i++) {
+            int src = indices[i];
+            temp[i - begin] = getStream(src >> _fragmentShift)[src & _fragmentMask];
+        }
+    });
+
+    int fragmentBegin = begin >> _fragmentShift;
+    int fragmentEnd = (n + _fragmentMask) >> _fragmentShift;
+    ThreadUtils::parallelFor(fragmentBegin, fragmentEnd, 1, [&](int startidx, int endidx) {
+        for (int fidx = startidx; fidx < endidx; fidx++) {
+            int fragmentStart = fidx << _fragmentShift;
+            int dst = std::max(fragmentStart, begin);
+            int count = std::min(n, fragmentStart + getFragmentSize()) - dst;
+            std::memcpy(getStream(fidx) + (dst - fragmentStart), 
+                        &(temp[dst - begin]), count * sizeof(T));
+        }
+    });
+}
+
+int MarkerParticleStore::addFloatAttribute(std::string name, float defaultValue) {
+    int attr = getFloatAttributeIndex(name);
+    if (attr != -1) {
+        return attr;
+    }
+
+    AttributeInfo info;
+    info.name = name;
+    info.floatDefault = defaultValue;
+    _floatAttributeInfo.push_back(info);
+
+    int capacity = getFragmentSize();
+    for (size_t fidx = 0; fidx < _fragments.size(); fidx++) {
+        _fragments[fidx].floatAttributes.push_back(std::vector<float>(capacity, defaultValue));
+    }
+
+    return (int)_floatAttributeInfo.size() - 1;
+}
+
+int MarkerParticleStore::addIntAttribute(std::string name, int defaultValue) {
+    int attr = getIntAttributeIndex(name);
+    if (attr != -1) {
+        return attr;
+    }
+
+    AttributeInfo info;
+    info.name = name;
+    info.intDefault = defaultValue;
+    _intAttributeInfo.push_back(info);
+
+    int capacity = getFragmentSize();
+    for (size_t fidx = 0; fidx < _fragments.size(); fidx++) {
+        _fragments[fidx].intAttributes.push_back(std::vector<int>(capacity, defaultValue));
+    }
+
+    return (int)_intAttributeInfo.size() - 1;
+}
+
+int MarkerParticleStore::getFloatAttributeIndex(std::string name) {
+    for (size_t i = 0; i < _floatAttributeInfo.size(); i++) {
+        if (_floatAttributeInfo[i].name == name) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+int MarkerParticleStore::getIntAttributeIndex(std::string name) {
+    for (size_t i = 0; i < _intAttributeInfo.size(); i++) {
+        if (_intAttributeInfo[i].name == name) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+int MarkerParticleStore::getNumFloatAttributes() {
+    return (int)_floatAttributeInfo.size();
+}
+
+int MarkerParticleStore::getNumIntAttributes() {
+    return (int)_intAttributeInfo.size();
+}
+
+float* MarkerParticleStore::getFloatAttributeStream(int fragmentIndex, int attr) {
+    FLUIDSIM_ASSERT(fragmentIndex >= 0 && fragmentIndex < getNumFragments());
+    FLUIDSIM_ASSERT(attr >= 0 && attr < (int)_floatAttributeInfo.size());
+    return _fragments[fragmentIndex].floatAttributes[attr].data();
+}
+
+int* MarkerParticleStore::getIntAttributeStream(int fragmentIndex, int attr) {
+    FLUIDSIM_ASSERT(fragmentIndex >= 0 && fragmentIndex < getNumFragments());
+    FLUIDSIM_ASSERT(attr >= 0 && attr < (int)_intAttributeInfo.size());
+    return _fragments[fragmentIndex].intAttributes[attr].data();
+}
+
+MarkerParticleStore::Fragment::Fragment(const StreamLayout &layout, int capacity) {
+    _initializeStreams(layout, capacity);
+}
+
+MarkerParticleStore::Fragment::Fragment(const Fragment &other) {
+    _initializeStreams(other._layout, other._capacity);
+    _copyStreams(other);
+    floatAttributes = other.floatAttributes;
+    intAttributes = other.intAttributes;
+}
+
+// Moving the allocation keeps the stream pointers valid
+MarkerParticleStore::Fragment::Fragment(Fragment &&other) noexcept :
+        floatAttributes(std::move(other.floatAttributes)),
+        intAttributes(std::move(other.intAttributes)),
+        _data(std::move(other._data)),
+        _layout(other._layout),
+        _capacity(other._capacity) {
+    std::copy(other.streams, other.streams + _maxNumStreams, streams);
+}
+
+MarkerParticleStore::Fragment& MarkerParticleStore::Fragment::operator=(const Fragment &other) {
+    if (this != &other) {
+        _initializeStreams(other._layout, other._capacity);
+        _copyStreams(other);
+        floatAttributes = other.floatAttributes;
+        intAttributes = other.intAttributes;
+    }
+    return *this;
+}
+
+MarkerParticleStore::Fragment& MarkerParticleStore::Fragment::operator=(Fragment &&other) noexcept {
+    if (this != &other) {
+        floatAttributes = std::move(other.floatAttributes);
+        intAttributes = std::move(other.intAttributes);
+        _data = std::move(other._data);
+        _layout = other._layout;
+        _capacity = other._capacity;
+        std::copy(other.streams, other.streams + _maxNumStreams, streams);
+    }
+    return *this;
+}
+
+/*
+    The streams share one allocation. Each stream is padded to a multiple of
+    the stream alignment so every stream starts on an aligned address once 
+    the first one does.
+*/
+void MarkerParticleStore::Fragment::_initializeStreams(const StreamLayout &layout, int capacity) {
+    _layout = layout;
+    _capacity = capacity;
+
+    size_t offsets[_maxNumStreams];
+    size_t totalBytes = 0;
+    for (int sidx = 0; sidx < layout.numStreams; sidx++) {
+        size_t bytes = (size_t)capacity * layout.elementSize[sidx];
+        offsets[sidx] = totalBytes;
+        totalBytes += (bytes + _streamAlignment - 1) / _streamAlignment * _streamAlignment;
+    }
+    _data = std::vector<char>(totalBytes + _streamAlignment, 0);
+
+    uintptr_t address = (uintptr_t)_data.data();
+    size_t offset = (_streamAlignment - address % _streamAlignment) % _streamAlignment;
+    char *base = _data.data() + offset;
+    for (int sidx = 0; sidx < _maxNumStreams; sidx++) {
+        streams[sidx] = sidx < layout.numStreams ? base + offsets[sidx] : nullptr;
+    }
+}
+
+void MarkerParticleStore::Fragment::_copyStreams(const Fragment &other) {
+    for (int sidx = 0; sidx < _layout.numStreams; sidx++) {
+        std::memcpy(streams[sidx], other.streams[sidx], (size_t)_capacity * _layout.elementSize[sidx]);
+    }
+}
+
+MarkerParticleStore::StreamLayout MarkerParticleStore::_getStreamLayout(
+        MarkerParticlePositionFormat pformat, MarkerParticleVelocityFormat vformat) {
+    StreamLayout layout;
+    if (pformat == MarkerParticlePositionFormat::float32) {
+        for (int i = 0; i < 3; i++) {
+            layout.elementSize[layout.numStreams++] = sizeof(float);
+        }
+    } else {
+        layout.elementSize[layout.numStreams++] = sizeof(uint32_t);
+        for (int i = 0; i < 3; i++) {
+            layout.elementSize[layout.numStreams++] = sizeof(uint16_t);
+        }
+    }
+
+    int velocitySize = vformat == MarkerParticleVelocityFormat::float32 ? sizeof(float) : sizeof(uint16_t);
+    for (int i = 0; i < 3; i++) {
+        layout.elementSize[layout.numStreams++] = velocitySize;
+    }
+
+    return layout;
+}
+
+void MarkerParticleStore::_addFragment() {
+    int capacity = getFragmentSize();
+    _fragments.push_back(Fragment(_layout, capacity));
+
+    Fragment &f = _fragments.back();
+    for (size_t aidx = 0; aidx < _floatAttributeInfo.size(); aidx++) {
+        f.floatAttributes.push_back(std::vector<float>(capacity, _floatAttributeInfo[aidx].floatDefault));
+    }
+    for (size_t aidx = 0; aidx < _intAttributeInfo.size(); aidx++) {
+        f.intAttributes.push_back(std::vector<int>(capacity, _intAttributeInfo[aidx].intDefault));
+    }
+}
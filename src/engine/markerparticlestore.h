@@ -0,0 +1,464 @@
+/*
+MIT License
+
+Copyright (c) 2019 Ryan L. Guy
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#ifndef FLUIDENGINE_MARKERPARTICLESTORE_H
+#define FLUIDENGINE_MARKERPARTICLESTORE_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+
+#include "vmath.h"
+#include "markerparticle.h"
+#include "fluidsimassert.h"
+
+/*
+    Contiguous streams of a single fragment. Streams of the same fragment 
+    hold 'size' values and the position and velocity streams are aligned to
+    64 bytes. startIndex is the store index of the first particle in the 
+    fragment.
+
+    The position and velocity pointers are only set for streams stored as
+    32-bit floats and are null otherwise.
+*/
+struct MarkerParticleFragmentView {
+    float *px = nullptr;
+    float *py = nullptr;
+    float *pz = nullptr;
+    float *vx = nullptr;
+    float *vy = nullptr;
+    float *vz = nullptr;
+    int startIndex = 0;
+    int size = 0;
+};
+
+/*
+    quantized: a packed block coordinate and 16-bit fixed point offsets 
+               within the block. Blocks are 8 cells wide so positions are
+               stored to 1/8192 of a cell width.
+*/
+enum class MarkerParticlePositionFormat : char { 
+    float32   = 0x00, 
+    quantized = 0x01
+};
+
+enum class MarkerParticleVelocityFormat : char { 
+    float32 = 0x00, 
+    float16 = 0x01
+};
+
+/*
+    MarkerParticleStore
+
+    Structure-of-arrays storage of marker particles. Positions and velocities
+    are stored as separate x/y/z streams within fixed capacity fragments so 
+    that growing the store never moves existing particles or requires a 
+    single large allocation.
+
+    Positions may be stored quantized to the simulation grid and velocities 
+    as half floats to reduce memory use. Values are encoded and decoded in 
+    the accessors so the storage format is transparent to users of the 
+    store.
+
+    Additional per-particle float or int attribute channels may be added. 
+    Attribute values stay with their particle when particles are removed.
+*/
+class MarkerParticleStore
+{
+public:
+    MarkerParticleStore();
+    ~MarkerParticleStore();
+
+    /*
+        Number of particles per fragment, rounded up to a power of two. May
+        only be changed while the store is empty.
+    */
+    void setFragmentSize(int n);
+    int getFragmentSize();
+
+    /*
+        Grid that quantized positions are relative to. Quantized positions 
+        are clamped to the grid bounds. If the store holds quantized 
+        positions, they are re-quantized to the new grid.
+
+        Returns false if the grid is too large for the packed 32-bit block
+        coordinate. The store is then left without a quantization grid and
+        positions are stored as float32.
+    */
+    bool setQuantizationGrid(int isize, int jsize, int ksize, double dx);
+    bool isQuantizationGridSet();
+
+    /*
+        Changes the storage format. Existing particles are converted one 
+        fragment at a time. Quantized positions fall back to float32 if no
+        quantization grid is set.
+    */
+    void setStorageFormat(MarkerParticlePositionFormat positionFormat,
+                          MarkerParticleVelocityFormat velocityFormat);
+    MarkerParticlePositionFormat getPositionFormat();
+    MarkerParticleVelocityFormat getVelocityFormat();
+
+    // Bytes per particle, including attribute channels
+    int getBytesPerParticle();
+
+    inline unsigned int size() const {
+        return _size;
+    }
+
+    inline bool empty() const {
+        return _size == 0;
+    }
+
+    void reserve(unsigned int n);
+    void clear();
+    void shrink_to_fit();
+
+    void push_back(vmath::vec3 p, vmath::vec3 v);
+    void push_back(const MarkerParticle &mp) {
+        push_back(mp.position, mp.velocity);
+    }
+
+    inline vmath::vec3 getPosition(int i) const {
+        FLUIDSIM_ASSERT(i >= 0 && i < (int)_size);
+        return _getPosition(_fragments[i >> _fragmentShift], i & _fragmentMask, _positionFormat);
+    }
+
+    inline vmath::vec3 getVelocity(int i) const {
+        FLUIDSIM_ASSERT(i >= 0 && i < (int)_size);
+        return _getVelocity(_fragments[i >> _fragmentShift], i & _fragmentMask, 
+                            _positionFormat, _velocityFormat);
+    }
+
+    // dim: 0 = x, 1 = y, 2 = z
+    inline float getVelocityComponent(int i, int dim) const {
+        FLUIDSIM_ASSERT(i >= 0 && i < (int)_size && dim >= 0 && dim < 3);
+        const Fragment &f = _fragments[i >> _fragmentShift];
+        int j = i & _fragmentMask;
+        int sidx = _getVelocityStreamIndex(_positionFormat) + dim;
+        if (_velocityFormat == MarkerParticleVelocityFormat::float32) {
+            return f.getStream<float>(sidx)[j];
+        }
+        return _halfToFloat(f.getStream<uint16_t>(sidx)[j]);
+    }
+
+    inline void setPosition(int i, vmath::vec3 p) {
+        FLUIDSIM_ASSERT(i >= 0 && i < (int)_size);
+        _setPosition(_fragments[i >> _fragmentShift], i & _fragmentMask, p, _positionFormat);
+    }
+
+    inline void setVelocity(int i, vmath::vec3 v) {
+        FLUIDSIM_ASSERT(i >= 0 && i < (int)_size);
+        _setVelocity(_fragments[i >> _fragmentShift], i & _fragmentMask, v, 
+                     _positionFormat, _velocityFormat);
+    }
+
+    inline MarkerParticle operator[](int i) const {
+        return MarkerParticle(getPosition(i), getVelocity(i));
+    }
+
+    inline MarkerParticle at(int i) const {
+        return (*this)[i];
+    }
+
+    /*
+        Decodes the positions of the count particles starting at index i 
+        into x, y and z. The range may not cross a fragment boundary.
+    */
+    void getPositions(int i, int count, float *x, float *y, float *z) const;
+
+    inline int getNumFragments() const {
+        return (int)((_size + _fragmentMask) >> _fragmentShift);
+    }
+
+    MarkerParticleFragmentView getFragmentView(int fragmentIndex);
+
+    /*
+        Removes the particles flagged in isRemoved. The order of the 
+        remaining particles is preserved.
+    */
+    void removeParticles(std::vector<bool> &isRemoved);
+    void removeParticles(std::vector<char> &isRemoved);
+
+    /*
+        Reorders the particles so that the particle at index order[n] is 
+        moved to index n. order must be a permutation of [0, size()).
+    */
+    void applyPermutation(std::vector<int> &order);
+
+    /*
+        Attribute channels
+
+        Adding an attribute returns its channel index and sets the attribute
+        of all existing and future particles to defaultValue. Adding an
+        attribute with an existing name returns the existing channel.
+    */
+    int addFloatAttribute(std::string name, float defaultValue = 0.0f);
+    int addIntAttribute(std::string name, int defaultValue = 0);
+    int getFloatAttributeIndex(std::string name);
+    int getIntAttributeIndex(std::string name);
+    int getNumFloatAttributes();
+    int getNumIntAttributes();
+
+    inline float getFloatAttribute(int attr, int i) const {
+        FLUIDSIM_ASSERT(i >= 0 && i < (int)_size);
+        return _fragments[i >> _fragmentShift].floatAttributes[attr][i & _fragmentMask];
+    }
+
+    inline void setFloatAttribute(int attr, int i, float value) {
+        FLUIDSIM_ASSERT(i >= 0 && i < (int)_size);
+        _fragments[i >> _fragmentShift].floatAttributes[attr][i & _fragmentMask] = value;
+    }
+
+    inline int getIntAttribute(int attr, int i) const {
+        FLUIDSIM_ASSERT(i >= 0 && i < (int)_size);
+        return _fragments[i >> _fragmentShift].intAttributes[attr][i & _fragmentMask];
+    }
+
+    inline void setIntAttribute(int attr, int i, int value) {
+        FLUIDSIM_ASSERT(i >= 0 && i < (int)_size);
+        _fragments[i >> _fragmentShift].intAttributes[attr][i & _fragmentMask] = value;
+    }
+
+    float* getFloatAttributeStream(int fragmentIndex, int attr);
+    int* getIntAttributeStream(int fragmentIndex, int attr);
+
+private:
+
+    static const int _maxNumStreams = 7;
+    static const int _streamAlignment = 64;     // in bytes
+
+    // Quantized offsets cover 2^_quantizationCellBits steps per cell and
+    // 2^16 steps per block
+    static const int _quantizationCellBits = 13;
+
+    /*
+        Element size in bytes of each stream. Positions come first, followed
+        by the x/y/z velocity streams.
+    */
+    struct StreamLayout {
+        int numStreams = 0;
+        int elementSize[_maxNumStreams];
+    };
+
+    class Fragment {
+    public:
+        Fragment(const StreamLayout &layout, int capacity);
+        Fragment(const Fragment &other);
+        Fragment(Fragment &&other) noexcept;
+        Fragment& operator=(const Fragment &other);
+        Fragment& operator=(Fragment &&other) noexcept;
+
+        template<class T>
+        inline T* getStream(int sidx) {
+            return reinterpret_cast<T*>(streams[sidx]);
+        }
+
+        template<class T>
+        inline const T* getStream(int sidx) const {
+            return reinterpret_cast<const T*>(streams[sidx]);
+        }
+
+        char *streams[_maxNumStreams];
+        std::vector<std::vector<float> > floatAttributes;
+        std::vector<std::vector<int> > intAttributes;
+
+    private:
+        void _initializeStreams(const StreamLayout &layout, int capacity);
+        void _copyStreams(const Fragment &other);
+
+        std::vector<char> _data;
+        StreamLayout _layout;
+        int _capacity = 0;
+    };
+
+    struct AttributeInfo {
+        std::string name;
+        float floatDefault = 0.0f;
+        int intDefault = 0;
+    };
+
+    inline static int _getVelocityStreamIndex(MarkerParticlePositionFormat pformat) {
+        return pformat == MarkerParticlePositionFormat::float32 ? 3 : 4;
+    }
+
+    inline vmath::vec3 _getPosition(const Fragment &f, int j, 
+                                    MarkerParticlePositionFormat pformat) const {
+        if (pformat == MarkerParticlePositionFormat::float32) {
+            return vmath::vec3(f.getStream<float>(0)[j], 
+                               f.getStream<float>(1)[j], 
+                               f.getStream<float>(2)[j]);
+        }
+
+        uint32_t block = f.getStream<uint32_t>(0)[j];
+        uint32_t qi = ((block & _blockMask[0]) << 16) | f.getStream<uint16_t>(1)[j];
+        uint32_t qj = (((block >> _blockShift[1]) & _blockMask[1]) << 16) | f.getStream<uint16_t>(2)[j];
+        uint32_t qk = (((block >> _blockShift[2]) & _blockMask[2]) << 16) | f.getStream<uint16_t>(3)[j];
+        return vmath::vec3((float)qi * _quantum, (float)qj * _quantum, (float)qk * _quantum);
+    }
+
+    inline void _setPosition(Fragment &f, int j, vmath::vec3 p, 
+                             MarkerParticlePositionFormat pformat) {
+        if (pformat == MarkerParticlePositionFormat::float32) {
+            f.getStream<float>(0)[j] = p.x;
+            f.getStream<float>(1)[j] = p.y;
+            f.getStream<float>(2)[j] = p.z;
+            return;
+        }
+
+        uint32_t qi = _quantize(p.x, _maxQuantizedValue[0]);
+        uint32_t qj = _quantize(p.y, _maxQuantizedValue[1]);
+        uint32_t qk = _quantize(p.z, _maxQuantizedValue[2]);
+        f.getStream<uint32_t>(0)[j] = (qi >> 16) | 
+                                      ((qj >> 16) << _blockShift[1]) | 
+                                      ((qk >> 16) << _blockShift[2]);
+        f.getStream<uint16_t>(1)[j] = (uint16_t)(qi & 0xFFFF);
+        f.getStream<uint16_t>(2)[j] = (uint16_t)(qj & 0xFFFF);
+        f.getStream<uint16_t>(3)[j] = (uint16_t)(qk & 0xFFFF);
+    }
+
+    inline vmath::vec3 _getVelocity(const Fragment &f, int j, 
+                                    MarkerParticlePositionFormat pformat,
+                                    MarkerParticleVelocityFormat vformat) const {
+        int sidx = _getVelocityStreamIndex(pformat);
+        if (vformat == MarkerParticleVelocityFormat::float32) {
+            return vmath::vec3(f.getStream<float>(sidx)[j], 
+                               f.getStream<float>(sidx + 1)[j], 
+                               f.getStream<float>(sidx + 2)[j]);
+        }
+        return vmath::vec3(_halfToFloat(f.getStream<uint16_t>(sidx)[j]), 
+                           _halfToFloat(f.getStream<uint16_t>(sidx + 1)[j]), 
+                           _halfToFloat(f.getStream<uint16_t>(sidx + 2)[j]));
+    }
+
+    inline void _setVelocity(Fragment &f, int j, vmath::vec3 v, 
+                             MarkerParticlePositionFormat pformat,
+                             MarkerParticleVelocityFormat vformat) {
+        int sidx = _getVelocityStreamIndex(pformat);
+        if (vformat == MarkerParticleVelocityFormat::float32) {
+            f.getStream<float>(sidx)[j] = v.x;
+            f.getStream<float>(sidx + 1)[j] = v.y;
+            f.getStream<float>(sidx + 2)[j] = v.z;
+            return;
+        }
+        f.getStream<uint16_t>(sidx)[j] = _floatToHalf(v.x);
+        f.getStream<uint16_t>(sidx + 1)[j] = _floatToHalf(v.y);
+        f.getStream<uint16_t>(sidx + 2)[j] = _floatToHalf(v.z);
+    }
+
+    inline uint32_t _quantize(float x, uint32_t maxValue) const {
+        double q = std::floor((double)x * _invQuantum + 0.5);
+        if (!(q > 0.0)) {
+            return 0;
+        }
+        return q >= (double)maxValue ? maxValue : (uint32_t)q;
+    }
+
+    inline static uint32_t _floatBits(float x) {
+        uint32_t bits;
+        std::memcpy(&bits, &x, sizeof(float));
+        return bits;
+    }
+
+    inline static float _bitsToFloat(uint32_t bits) {
+        float x;
+        std::memcpy(&x, &bits, sizeof(float));
+        return x;
+    }
+
+    /*
+        IEEE 754 binary16 conversions. Float to half rounds to nearest even,
+        values too large for a half become infinity and NaN stays NaN.
+    */
+    inline static uint16_t _floatToHalf(float x) {
+        uint32_t f = _floatBits(x);
+        uint32_t sign = f & 0x80000000u;
+        f ^= sign;
+
+        uint32_t h;
+        if (f >= (127u + 16u) << 23) {
+            h = f > (255u << 23) ? 0x7E00 : 0x7C00;
+        } else if (f < (113u << 23)) {
+            // Subnormal or zero, the float addition does the rounding
+            float denormMagic = _bitsToFloat(((127u - 15u) + (23u - 10u) + 1u) << 23);
+            h = _floatBits(_bitsToFloat(f) + denormMagic) - _floatBits(denormMagic);
+        } else {
+            uint32_t mantissaOdd = (f >> 13) & 1;
+            f -= (127u - 15u) << 23;
+            f += 0xFFF + mantissaOdd;
+            h = f >> 13;
+        }
+
+        return (uint16_t)(h | (sign >> 16));
+    }
+
+    inline static float _halfToFloat(uint16_t h) {
+        const uint32_t shiftedExponent = 0x7C00u << 13;
+        uint32_t f = ((uint32_t)h & 0x7FFF) << 13;
+        uint32_t exponent = f & shiftedExponent;
+        f += (127u - 15u) << 23;
+        if (exponent == shiftedExponent) {
+            // Infinity or NaN
+            f += (128u - 16u) << 23;
+        } else if (exponent == 0) {
+            // Subnormal or zero, renormalized with a float subtraction
+            f += 1u << 23;
+            f = _floatBits(_bitsToFloat(f) - _bitsToFloat(113u << 23));
+        }
+        return _bitsToFloat(f | (((uint32_t)h & 0x8000) << 16));
+    }
+
+    StreamLayout _getStreamLayout(MarkerParticlePositionFormat pformat,
+                                  MarkerParticleVelocityFormat vformat);
+    void _addFragment();
+    template<class FlagVector>
+    void _removeParticles(FlagVector &isRemoved);
+    void _gatherParticles(std::vector<int> &indices, int begin);
+    template<class T>
+    void _gatherParticleStream(std::vector<int> &indices, int begin, 
+                               std::vector<T> &temp, int sidx);
+    template<class T, class StreamFunc>
+    void _gatherStream(std::vector<int> &indices, int begin, 
+                       std::vector<T> &temp, StreamFunc getStream);
+
+    std::vector<Fragment> _fragments;
+    std::vector<AttributeInfo> _floatAttributeInfo;
+    std::vector<AttributeInfo> _intAttributeInfo;
+    unsigned int _size = 0;
+    int _fragmentShift = 16;
+    int _fragmentMask = (1 << 16) - 1;
+
+    MarkerParticlePositionFormat _positionFormat = MarkerParticlePositionFormat::float32;
+    MarkerParticleVelocityFormat _velocityFormat = MarkerParticleVelocityFormat::float32;
+    StreamLayout _layout;
+
+    bool _isQuantizationGridSet = false;
+    float _quantum = 0.0f;
+    double _invQuantum = 0.0;
+    uint32_t _maxQuantizedValue[3] = {0, 0, 0};
+    uint32_t _blockMask[3] = {0, 0, 0};
+    int _blockShift[3] = {0, 0, 0};
+};
+
+#endif
@@ -27,6 +27,7 @@ SOFTWARE.
 #include "interpolation.h"
 #include "levelsetutils.h"
 #include "meshutils.h"
+#include "profiler.h"
 
 MeshLevelSet::MeshLevelSet() {
 }
@@ -261,18 +262,9 @@ void MeshLevelSet::trilinearInterpolateSolidGridPoints(vmath::vec3 offset, doubl
                                                        Array3d<bool> &grid) {
 
     int gridsize = grid.width * grid.height * grid.depth;
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, gridsize);
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, gridsize, numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&MeshLevelSet::_trilinearInterpolateSolidGridPointsThread, this,
-                                 intervals[i], intervals[i + 1], offset, dx, &grid);
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, gridsize, [&](int startidx, int endidx) {
+        _trilinearInterpolateSolidGridPointsThread(startidx, endidx, offset, dx, &grid);
+    });
 }
 
 void MeshLevelSet::_trilinearInterpolateSolidGridPointsThread(int startidx, int endidx, 
@@ -516,6 +508,7 @@ void MeshLevelSet::calculateSignedDistanceField(TriangleMesh &m, int bandwidth)
 void MeshLevelSet::calculateSignedDistanceField(TriangleMesh &m, 
                                                 std::vector<vmath::vec3> &vertexVelocities, 
                                                 int bandwidth) {
+    FLUIDSIM_PROFILE_SCOPE("Calculate Mesh Signed Distance Field");
     FLUIDSIM_ASSERT(vertexVelocities.size() == m.vertices.size());
 
     _mesh = m;
@@ -524,8 +517,8 @@ void MeshLevelSet::calculateSignedDistanceField(TriangleMesh &m,
     // we begin by initializing distances near the mesh, and figuring out intersection counts
     _computeExactBandDistanceField(bandwidth);
 
-    // then propagate distances outwards to the rest of the grid
-    _propagateDistanceField();
+    // then propagate distances outwards into a narrow band around the mesh
+    _propagateDistanceField(bandwidth);
 
     // then figure out signs (inside/outside) from intersection counts
     if (_isSignCalculationEnabled) {
@@ -590,19 +583,30 @@ void MeshLevelSet::calculateUnion(MeshLevelSet &levelset) {
     levelset.getGridDimensions(&isizeOther, &jsizeOther, &ksizeOther);
 
     int gridsize = (isizeOther + 1) * (jsizeOther + 1) * (ksizeOther + 1);
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, gridsize);
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, gridsize, numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&MeshLevelSet::_calculateUnionThread, this,
-                                 intervals[i], intervals[i + 1], 
-                                 triIndexOffset, meshObjectIndexOffset, 
-                                 &levelset);
-    }
+    ThreadUtils::parallelFor(0, gridsize, [&](int startidx, int endidx) {
+        _calculateUnionThread(startidx, endidx, triIndexOffset, meshObjectIndexOffset, &levelset);
+    });
+}
 
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
+void MeshLevelSet::resampleSignedDistanceField(MeshLevelSet &source, 
+                                               vmath::mat3 rotation, 
+                                               vmath::vec3 translation,
+                                               TriangleMesh &m, 
+                                               std::vector<vmath::vec3> &vertexVelocities) {
+    FLUIDSIM_ASSERT(vertexVelocities.size() == m.vertices.size());
+    FLUIDSIM_ASSERT(m.triangles.size() == source.getTriangleMesh()->triangles.size());
+
+    _mesh = m;
+    _vertexVelocities = vertexVelocities;
+    _meshObjects = source.getMeshObjects();
+
+    int gridsize = (_isize + 1) * (_jsize + 1) * (_ksize + 1);
+    ThreadUtils::parallelFor(0, gridsize, [&](int startidx, int endidx) {
+        _resampleSignedDistanceFieldThread(startidx, endidx, &source, rotation, translation);
+    });
+
+    if (_isVelocityDataEnabled && !_isMinimalLevelSet) {
+        _computeVelocityGrids();
     }
 }
 
@@ -612,56 +616,28 @@ void MeshLevelSet::normalizeVelocityGrid() {
     ValidVelocityComponentGrid validVelocities(_isize, _jsize, _ksize);
 
     int gridsize = (_isize + 1) * _jsize * _ksize;
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, gridsize);
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, gridsize, numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&MeshLevelSet::_normalizeVelocityGridThread, this,
-                                 intervals[i], intervals[i + 1], 
-                                 _velocityData.field.getArray3dU(), 
-                                 &(_velocityData.weightU),
-                                 &(validVelocities.validU)
-                                 );
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, gridsize, [&](int startidx, int endidx) {
+        _normalizeVelocityGridThread(startidx, endidx,
+                                     _velocityData.field.getArray3dU(), 
+                                     &(_velocityData.weightU),
+                                     &(validVelocities.validU));
+    });
 
     gridsize = _isize * (_jsize + 1) * _ksize;
-    numthreads = (int)fmin(numCPU, gridsize);
-    threads = std::vector<std::thread>(numthreads);
-    intervals = ThreadUtils::splitRangeIntoIntervals(0, gridsize, numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&MeshLevelSet::_normalizeVelocityGridThread, this,
-                                 intervals[i], intervals[i + 1], 
-                                 _velocityData.field.getArray3dV(), 
-                                 &(_velocityData.weightV),
-                                 &(validVelocities.validV)
-                                 );
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, gridsize, [&](int startidx, int endidx) {
+        _normalizeVelocityGridThread(startidx, endidx,
+                                     _velocityData.field.getArray3dV(), 
+                                     &(_velocityData.weightV),
+                                     &(validVelocities.validV));
+    });
 
     gridsize = _isize * _jsize * (_ksize + 1);
-    numthreads = (int)fmin(numCPU, gridsize);
-    threads = std::vector<std::thread>(numthreads);
-    intervals = ThreadUtils::splitRangeIntoIntervals(0, gridsize, numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&MeshLevelSet::_normalizeVelocityGridThread, this,
-                                 intervals[i], intervals[i + 1], 
-                                 _velocityData.field.getArray3dW(), 
-                                 &(_velocityData.weightW),
-                                 &(validVelocities.validW)
-                                 );
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, gridsize, [&](int startidx, int endidx) {
+        _normalizeVelocityGridThread(startidx, endidx,
+                                     _velocityData.field.getArray3dW(), 
+                                     &(_velocityData.weightW),
+                                     &(validVelocities.validW));
+    });
 
     _velocityData.field.extrapolateVelocityField(
             validVelocities, _numVelocityExtrapolationLayers
@@ -740,6 +716,7 @@ float MeshLevelSet::getDistanceUpperBound() {
 }
 
 void MeshLevelSet::_computeExactBandDistanceField(int bandwidth) {
+    FLUIDSIM_PROFILE_SCOPE("Compute Exact Band Distance Field");
     if (_isMultiThreadingEnabled) {
         _computeExactBandDistanceFieldMultiThreaded(bandwidth);
     } else {
@@ -898,19 +875,9 @@ void MeshLevelSet::_initializeBlockGrid(std::vector<TriangleData> &triangleData,
 
     Array3d<bool> activeBlocks(dims.i, dims.j, dims.k, false);
 
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, triangleData.size());
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, triangleData.size(), numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&MeshLevelSet::_initializeActiveBlocksThread, this,
-                                 intervals[i], intervals[i + 1], 
-                                 &triangleData, bandwidth, &activeBlocks);
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, triangleData.size(), [&](int startidx, int endidx) {
+        _initializeActiveBlocksThread(startidx, endidx, &triangleData, bandwidth, &activeBlocks);
+    });
 
     for (int k = 0; k < dims.k; k++) {
         for (int j = 0; j < dims.j; j++) {
@@ -960,19 +927,13 @@ void MeshLevelSet::_computeGridCountData(std::vector<TriangleData> &triangledata
     _initializeGridCountData(triangledata, blockphi, countdata);
 
     int numthreads = countdata.numthreads;
-    std::vector<std::thread> threads(numthreads);
     std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, triangledata.size(), numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&MeshLevelSet::_computeGridCountDataThread, this,
-                                 intervals[i], intervals[i + 1], 
-                                 &triangledata, 
-                                 &blockphi, 
-                                 &(countdata.threadGridCountData[i]));
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, numthreads, 1, [&](int tidx, int) {
+        _computeGridCountDataThread(intervals[tidx], intervals[tidx + 1], 
+                                    &triangledata, 
+                                    &blockphi, 
+                                    &(countdata.threadGridCountData[tidx]));
+    });
 
     for (int tidx = 0; tidx < countdata.numthreads; tidx++) {
         std::vector<int> *threadGridCount = &(countdata.threadGridCountData[tidx].gridCount);
@@ -1083,6 +1044,7 @@ void MeshLevelSet::_sortTrianglesIntoBlocks(std::vector<TriangleData> &triangleD
 
 void MeshLevelSet::_computeExactBandProducerThread(BoundedBuffer<ComputeBlock> *computeBlockQueue,
                                                    BoundedBuffer<ComputeBlock> *finishedComputeBlockQueue) {
+    Profiler::setThreadName("Mesh Level Set Worker");
     
     while (computeBlockQueue->size() > 0) {
         std::vector<ComputeBlock> computeBlocks;
@@ -1091,6 +1053,8 @@ void MeshLevelSet::_computeExactBandProducerThread(BoundedBuffer<ComputeBlock> *
             continue;
         }
 
+        FLUIDSIM_PROFILE_SCOPE("Exact Band Blocks");
+
         for (size_t bidx = 0; bidx < computeBlocks.size(); bidx++) {
             ComputeBlock block = computeBlocks[bidx];
             GridIndex blockIndex = block.gridBlock.index;
@@ -1202,87 +1166,152 @@ void MeshLevelSet::_computeExactBandDistanceFieldSingleThreaded(int bandwidth) {
     }
 }
 
-void MeshLevelSet::_propagateDistanceField() {
-    int isize = _phi.width;
-    int jsize = _phi.height;
-    int ksize = _phi.depth;
+void MeshLevelSet::_propagateDistanceField(int bandwidth) {
+    FLUIDSIM_PROFILE_SCOPE("Propagate Distance Field");
+    if (_mesh.vertices.empty()) {
+        return;
+    }
 
-    std::vector<GridIndex> queue;
-    queue.reserve(isize * jsize * ksize);
-    Array3d<bool> searchGrid(isize, jsize, ksize, false);
-    for(int k = 0; k < ksize; k++) {
-        for(int j = 0; j < jsize; j++) {
-            for(int i = 0; i < isize; i++) {
-                if (_closestTriangles(i, j, k) != -1) {
-                    searchGrid.set(i, j, k, true);
-                    queue.push_back(GridIndex(i, j, k));
-                }
-            }
+    // Closest triangles are only propagated from nodes within 
+    // _numDistancePropagationLayers cells outside of the exact band. Nodes 
+    // further from the mesh may keep the distance upper bound.
+    int numLayers = bandwidth + _numDistancePropagationLayers;
+    float maxDistance = numLayers * _dx;
+
+    AABB bbox(_mesh.vertices);
+    bbox.position -= _positionOffset;
+    GridIndex gmin = Grid3d::positionToGridIndex(bbox.getMinPoint(), _dx);
+    GridIndex gmax = Grid3d::positionToGridIndex(bbox.getMaxPoint(), _dx);
+    gmin = GridIndex(_clamp(gmin.i - numLayers, 0, _phi.width - 1),
+                     _clamp(gmin.j - numLayers, 0, _phi.height - 1),
+                     _clamp(gmin.k - numLayers, 0, _phi.depth - 1));
+    gmax = GridIndex(_clamp(gmax.i + numLayers + 1, 0, _phi.width - 1),
+                     _clamp(gmax.j + numLayers + 1, 0, _phi.height - 1),
+                     _clamp(gmax.k + numLayers + 1, 0, _phi.depth - 1));
+
+    // Within the band, closest triangles are propagated outwards from the 
+    // exact band by sweeping forward and backward along each grid axis. Lines 
+    // along the sweep axis are independent, so each sweep runs in parallel 
+    // without a queue. Two passes let closest triangles turn corners in any 
+    // axis order.
+    int numPasses = 2;
+    for (int pass = 0; pass < numPasses; pass++) {
+        for (int dir = 0; dir < 3; dir++) {
+            _propagateDistanceFieldSweep(dir, gmin, gmax, maxDistance);
         }
     }
+}
 
-    int unknownidx = (int)queue.size();
-    int startidx = 0;
-    GridIndex g, n, nbs[6];
-    while (startidx < (int)queue.size()) {
-        g = queue[startidx];
-        startidx++;
+void MeshLevelSet::_propagateDistanceFieldSweep(int dir, GridIndex gmin, GridIndex gmax, 
+                                                float maxDistance) {
+    int U = 0; int V = 1; int W = 2;
+    int jsize = gmax.j - gmin.j + 1;
+    int ksize = gmax.k - gmin.k + 1;
 
-        Grid3d::getNeighbourGridIndices6(g, nbs);
-        for (int nidx = 0; nidx < 6; nidx++) {
-            n = nbs[nidx];
-            if (Grid3d::isGridIndexInRange(n, isize, jsize, ksize) && !searchGrid(n)) {
-                searchGrid.set(n, true);
-                queue.push_back(n);
+    if (dir == U) {
+
+        ThreadUtils::parallelFor(0, jsize * ksize, [&](int startidx, int endidx) {
+            for (int idx = startidx; idx < endidx; idx++) {
+                int j = gmin.j + idx % jsize;
+                int k = gmin.k + idx / jsize;
+                for (int i = gmin.i + 1; i <= gmax.i; i++) {
+                    _propagateClosestTriangle(GridIndex(i, j, k), GridIndex(i - 1, j, k), maxDistance);
+                }
+                for (int i = gmax.i - 1; i >= gmin.i; i--) {
+                    _propagateClosestTriangle(GridIndex(i, j, k), GridIndex(i + 1, j, k), maxDistance);
+                }
             }
-        }
-    }
+        });
 
-    vmath::vec3 gpos;
-    Triangle t;
-    startidx = unknownidx;
-    while (startidx < (int)queue.size()) {
-        g = queue[startidx];
-        startidx++;
-
-        gpos = Grid3d::GridIndexToPosition(g, _dx);
-        Grid3d::getNeighbourGridIndices6(g, nbs);
-        for (int nidx = 0; nidx < 6; nidx++) {
-            n = nbs[nidx];
-            if (Grid3d::isGridIndexInRange(n, isize, jsize, ksize) && _closestTriangles(n) != -1) {
-                t = _mesh.triangles[_closestTriangles(n)];
-                double dist = _pointToTriangleDistance(gpos, _mesh.vertices[t.tri[0]] - _positionOffset, 
-                                                             _mesh.vertices[t.tri[1]] - _positionOffset, 
-                                                             _mesh.vertices[t.tri[2]] - _positionOffset);
-                if (dist < _phi(g)) {
-                    _phi.set(g, dist);
-                    _closestTriangles.set(g, _closestTriangles(n));
-                    _closestTriangles.set(g, _closestMeshObjects(n));
+    } else if (dir == V) {
+
+        // Lines along j are swept together row by row so that the inner 
+        // loop runs along contiguous memory
+        ThreadUtils::parallelFor(gmin.k, gmin.k + ksize, [&](int startidx, int endidx) {
+            for (int k = startidx; k < endidx; k++) {
+                for (int j = gmin.j + 1; j <= gmax.j; j++) {
+                    for (int i = gmin.i; i <= gmax.i; i++) {
+                        _propagateClosestTriangle(GridIndex(i, j, k), GridIndex(i, j - 1, k), maxDistance);
+                    }
+                }
+                for (int j = gmax.j - 1; j >= gmin.j; j--) {
+                    for (int i = gmin.i; i <= gmax.i; i++) {
+                        _propagateClosestTriangle(GridIndex(i, j, k), GridIndex(i, j + 1, k), maxDistance);
+                    }
                 }
             }
-        }
+        });
+
+    } else if (dir == W) {
+
+        ThreadUtils::parallelFor(gmin.j, gmin.j + jsize, [&](int startidx, int endidx) {
+            for (int j = startidx; j < endidx; j++) {
+                for (int k = gmin.k + 1; k <= gmax.k; k++) {
+                    for (int i = gmin.i; i <= gmax.i; i++) {
+                        _propagateClosestTriangle(GridIndex(i, j, k), GridIndex(i, j, k - 1), maxDistance);
+                    }
+                }
+                for (int k = gmax.k - 1; k >= gmin.k; k--) {
+                    for (int i = gmin.i; i <= gmax.i; i++) {
+                        _propagateClosestTriangle(GridIndex(i, j, k), GridIndex(i, j, k + 1), maxDistance);
+                    }
+                }
+            }
+        });
+
+    }
+}
+
+void MeshLevelSet::_propagateClosestTriangle(GridIndex g, GridIndex n, float maxDistance) {
+    int tidx = _closestTriangles(n);
+    if (tidx == -1 || tidx == _closestTriangles(g) || _phi(n) > maxDistance) {
+        return;
+    }
+
+    Triangle t = _mesh.triangles[tidx];
+    vmath::vec3 gpos = Grid3d::GridIndexToPosition(g, _dx);
+    float dist = _pointToTriangleDistance(gpos, _mesh.vertices[t.tri[0]] - _positionOffset, 
+                                                _mesh.vertices[t.tri[1]] - _positionOffset, 
+                                                _mesh.vertices[t.tri[2]] - _positionOffset);
+    if (dist < _phi(g)) {
+        _phi.set(g, dist);
+        _closestTriangles.set(g, tidx);
+        _closestMeshObjects.set(g, _closestMeshObjects(n));
     }
 }
 
 void MeshLevelSet::_computeDistanceFieldSigns() {
+    FLUIDSIM_PROFILE_SCOPE("Compute Distance Field Signs");
+    if (_mesh.vertices.empty()) {
+        return;
+    }
+
     int isize = _phi.width;
     int jsize = _phi.height;
     int ksize = _phi.depth;
     Array3d<bool> nodes(isize, jsize, ksize, false);
 
-    TriangleMesh tempMesh = _mesh;
-    tempMesh.translate(-_positionOffset);
+    // Nodes outside of the mesh bounds can never be inside of the mesh
+    AABB bbox(_mesh.vertices);
+    bbox.position -= _positionOffset;
+    GridIndex gmin = Grid3d::positionToGridIndex(bbox.getMinPoint(), _dx);
+    GridIndex gmax = Grid3d::positionToGridIndex(bbox.getMaxPoint(), _dx);
+    gmax = GridIndex(gmax.i + 1, gmax.j + 1, gmax.k + 1);
 
-    MeshUtils::getGridNodesInsideTriangleMesh(tempMesh, _dx, nodes);
+    MeshUtils::getGridNodesInsideTriangleMesh(
+        _mesh, _positionOffset, _dx, gmin, gmax, nodes
+    );
 
     int size = _phi.getNumElements();
     bool *nodesArray = nodes.getRawArray();
     float *phiArray = _phi.getRawArray();
-    for (int i = 0; i < size; i++) {
-        if (nodesArray[i]) {
-            phiArray[i] = -phiArray[i];
+    ThreadUtils::parallelFor(0, size, [&](int startidx, int endidx) {
+        for (int i = startidx; i < endidx; i++) {
+            if (nodesArray[i]) {
+                phiArray[i] = -phiArray[i];
+            }
         }
-    }
+    });
 }
 
 void MeshLevelSet::_computeVelocityGridThread(int startidx, int endidx, 
@@ -1352,21 +1381,13 @@ void MeshLevelSet::_computeVelocityGridMT(bool isStatic, int dir) {
         gridsize = _isize * _jsize * (_ksize + 1);
     }
 
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, gridsize);
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, gridsize, numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&MeshLevelSet::_computeVelocityGridThread, this,
-                                 intervals[i], intervals[i + 1], isStatic, dir);
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, gridsize, [&](int startidx, int endidx) {
+        _computeVelocityGridThread(startidx, endidx, isStatic, dir);
+    });
 }
 
 void MeshLevelSet::_computeVelocityGrids() {
+    FLUIDSIM_PROFILE_SCOPE("Compute Velocity Grids");
     if (_isMultiThreadingEnabled) {
         _computeVelocityGridsMultiThreaded();
     } else {
@@ -1715,6 +1736,39 @@ void MeshLevelSet::_normalizeVelocityGridThread(int startidx, int endidx,
     }
 }
 
+void MeshLevelSet::_resampleSignedDistanceFieldThread(int startidx, int endidx, 
+                                                     MeshLevelSet *source, 
+                                                     vmath::mat3 rotation, 
+                                                     vmath::vec3 translation) {
+    int isizeSource, jsizeSource, ksizeSource;
+    source->getGridDimensions(&isizeSource, &jsizeSource, &ksizeSource);
+    vmath::vec3 sourceOffset = source->getPositionOffset();
+    float upperBound = getDistanceUpperBound();
+
+    for (int idx = startidx; idx < endidx; idx++) {
+        GridIndex g = Grid3d::getUnflattenedIndex(idx, _isize + 1, _jsize + 1);
+        vmath::vec3 p = Grid3d::GridIndexToPosition(g, _dx) + _positionOffset;
+        vmath::vec3 q = rotation * p + translation - sourceOffset;
+
+        // Only sample where all interpolation points are inside of the 
+        // source grid. The source is padded past its exact band, so nodes 
+        // that map outside of it are far from the mesh.
+        GridIndex sg = Grid3d::positionToGridIndex(q, _dx);
+        if (!Grid3d::isGridIndexInRange(sg, isizeSource, jsizeSource, ksizeSource)) {
+            _phi.set(g, upperBound);
+            _closestTriangles.set(g, -1);
+            _closestMeshObjects.set(g, -1);
+            continue;
+        }
+
+        _phi.set(g, (float)Interpolation::trilinearInterpolate(q, _dx, source->_phi));
+
+        GridIndex ng = Grid3d::positionToGridIndex(q + vmath::vec3(0.5 * _dx, 0.5 * _dx, 0.5 * _dx), _dx);
+        _closestTriangles.set(g, source->_closestTriangles(ng));
+        _closestMeshObjects.set(g, source->_closestMeshObjects(ng));
+    }
+}
+
 void MeshLevelSet::_calculateUnionThread(int startidx, int endidx, 
                                          int triIndexOffset, 
                                          int meshObjectIndexOffset,
@@ -61,7 +61,7 @@ USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "macvelocityfield.h"
 #include "trianglemesh.h"
 #include "fragmentedvector.h"
-#include "markerparticle.h"
+#include "markerparticlestore.h"
 #include "threadutils.h"
 #include "blockarray3d.h"
 #include "boundedbuffer.h"
@@ -161,6 +161,19 @@ public:
                                           std::vector<vmath::vec3> &vertexVelocities, 
                                           int bandwidth = 1);
     void calculateUnion(MeshLevelSet &levelset);
+
+    /*
+        Fill this level set by resampling a level set of the same mesh in 
+        another pose. A grid node at world position p samples the source at 
+        rotation * p + translation. The mesh m and its vertex velocities 
+        must be in the current pose and have the same triangle ordering as 
+        the source mesh.
+    */
+    void resampleSignedDistanceField(MeshLevelSet &source, 
+                                     vmath::mat3 rotation, 
+                                     vmath::vec3 translation,
+                                     TriangleMesh &m, 
+                                     std::vector<vmath::vec3> &vertexVelocities);
     void normalizeVelocityGrid();
     void negate();
     void reset();
@@ -185,36 +198,38 @@ public:
     void trilinearInterpolateSolidPoints(FragmentedVector<T> &points, 
                                          std::vector<bool> &isSolid) {
         isSolid = std::vector<bool>(points.size());
-        int numCPU = ThreadUtils::getMaxThreadCount();
-        int numthreads = (int)fmin(numCPU, points.size());
-        std::vector<std::thread> threads(numthreads);
-        std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, points.size(), numthreads);
-        for (int i = 0; i < numthreads; i++) {
-            threads[i] = std::thread(&MeshLevelSet::_trilinearInterpolateSolidPointsThread<T>, this,
-                                     intervals[i], intervals[i + 1], &points, &isSolid);
-        }
-
-        for (int i = 0; i < numthreads; i++) {
-            threads[i].join();
-        }
+        // Chunks are aligned to 64 elements so that no two threads write
+        // to the same word of isSolid
+        int grain = ThreadUtils::getGrainSize(0, points.size(), 0);
+        grain = ((grain + 63) / 64) * 64;
+        ThreadUtils::parallelFor(0, points.size(), grain, [&](int startidx, int endidx) {
+            _trilinearInterpolateSolidPointsThread<T>(startidx, endidx, &points, &isSolid);
+        });
     }
 
     template<class T>
     void trilinearInterpolateSolidPoints(std::vector<T> &points, 
                                          std::vector<bool> &isSolid) {
         isSolid = std::vector<bool>(points.size());
-        int numCPU = ThreadUtils::getMaxThreadCount();
-        int numthreads = (int)fmin(numCPU, points.size());
-        std::vector<std::thread> threads(numthreads);
-        std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, points.size(), numthreads);
-        for (int i = 0; i < numthreads; i++) {
-            threads[i] = std::thread(&MeshLevelSet::_trilinearInterpolateSolidPointsVectorThread<T>, this,
-                                     intervals[i], intervals[i + 1], &points, &isSolid);
-        }
+        // Chunks are aligned to 64 elements so that no two threads write
+        // to the same word of isSolid
+        int grain = ThreadUtils::getGrainSize(0, points.size(), 0);
+        grain = ((grain + 63) / 64) * 64;
+        ThreadUtils::parallelFor(0, points.size(), grain, [&](int startidx, int endidx) {
+            _trilinearInterpolateSolidPointsVectorThread<T>(startidx, endidx, &points, &isSolid);
+        });
+    }
 
-        for (int i = 0; i < numthreads; i++) {
-            threads[i].join();
-        }
+    void trilinearInterpolateSolidPoints(MarkerParticleStore &particles, 
+                                         std::vector<bool> &isSolid) {
+        isSolid = std::vector<bool>(particles.size());
+        int grain = ThreadUtils::getGrainSize(0, particles.size(), 0);
+        grain = ((grain + 63) / 64) * 64;
+        ThreadUtils::parallelFor(0, particles.size(), grain, [&](int startidx, int endidx) {
+            for (int i = startidx; i < endidx; i++) {
+                isSolid[i] = trilinearInterpolate(particles.getPosition(i)) < 0.0f;
+            }
+        });
     }
     
 private:
@@ -282,7 +297,10 @@ private:
 
     void _computeExactBandDistanceFieldSingleThreaded(int bandwidth);
 
-    void _propagateDistanceField();
+    void _propagateDistanceField(int bandwidth);
+    void _propagateDistanceFieldSweep(int dir, GridIndex gmin, GridIndex gmax, 
+                                      float maxDistance);
+    void _propagateClosestTriangle(GridIndex g, GridIndex n, float maxDistance);
     void _computeDistanceFieldSigns();
     void _computeVelocityGrids();
     void _computeVelocityGridsMultiThreaded();
@@ -315,6 +333,10 @@ private:
     void _calculateUnionThread(int startidx, int endidx, 
                                int triIndexOffset, int meshObjectIndexOffset, 
                                MeshLevelSet *levelset);
+    void _resampleSignedDistanceFieldThread(int startidx, int endidx, 
+                                            MeshLevelSet *source, 
+                                            vmath::mat3 rotation, 
+                                            vmath::vec3 translation);
     
     template<class T>
     void _trilinearInterpolateSolidPointsThread(int startidx, int endidx, 
@@ -357,6 +379,7 @@ private:
     vmath::vec3 _positionOffset;
 
     int _numVelocityExtrapolationLayers = 5;
+    int _numDistancePropagationLayers = 3;
     bool _isVelocityDataEnabled = true;
     bool _isMultiThreadingEnabled = true;
     bool _isSignCalculationEnabled = true;
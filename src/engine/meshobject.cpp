@@ -48,6 +48,7 @@ void MeshObject::updateMeshStatic(TriangleMesh meshCurrent) {
     _vertexTranslationsNext = std::vector<vmath::vec3>(meshCurrent.vertices.size());
     _isAnimated = false;
     _isChangingTopology = false;
+    _isMeshTransformSet = false;
 }
 
 void MeshObject::updateMeshAnimated(TriangleMesh meshPrevious, 
@@ -57,6 +58,7 @@ void MeshObject::updateMeshAnimated(TriangleMesh meshPrevious,
     _meshCurrent = meshCurrent;
     _meshNext = meshNext;
     _isChangingTopology = false;
+    _isMeshTransformSet = false;
 
     _vertexTranslationsCurrent = std::vector<vmath::vec3>(meshCurrent.vertices.size());
     if (_meshPrevious.vertices.size() == _meshCurrent.vertices.size()) {
@@ -220,10 +222,23 @@ std::vector<vmath::vec3> MeshObject::getFrameVertexVelocities(int frameno, doubl
 void MeshObject::getMeshLevelSet(double dt, float frameInterpolation, int exactBand, 
                                  MeshLevelSet &levelset) {
     TriangleMesh m = getMesh(frameInterpolation);
+    getMeshLevelSet(m, dt, frameInterpolation, exactBand, levelset);
+}
+
+void MeshObject::getMeshLevelSet(TriangleMesh &m, 
+                                 double dt, 
+                                 float frameInterpolation, 
+                                 int exactBand, 
+                                 MeshLevelSet &levelset) {
+    if (_isRigidMeshLevelSetCacheEnabled && 
+            _getRigidMeshLevelSet(dt, frameInterpolation, exactBand, levelset)) {
+        return;
+    }
+
+    std::vector<vmath::vec3> vertexVelocities = getVertexVelocities(dt, frameInterpolation);
 
     // Loose geometry will cause problems when splitting into mesh islands
     std::vector<int> removedVertices = m.removeExtraneousVertices();
-    std::vector<vmath::vec3> vertexVelocities = getVertexVelocities(dt, frameInterpolation);
     for (int i = removedVertices.size() - 1; i >= 0; i--) {
         vertexVelocities.erase(vertexVelocities.begin() + removedVertices[i]);
     }
@@ -241,6 +256,59 @@ void MeshObject::getMeshLevelSet(double dt, float frameInterpolation, int exactB
     }
 }
 
+bool MeshObject::getMeshLevelSetGridBounds(float frameInterpolation, int exactBand, 
+                                           GridIndex *gmin, GridIndex *gmax) {
+    TriangleMesh m = getMesh(frameInterpolation);
+    return getMeshLevelSetGridBounds(m, exactBand, gmin, gmax);
+}
+
+bool MeshObject::getMeshLevelSetGridBounds(TriangleMesh &m, int exactBand, 
+                                           GridIndex *gmin, GridIndex *gmax) {
+    if (m.vertices.empty()) {
+        return false;
+    }
+
+    GridIndex g1, g2;
+    _getMeshGridBounds(m, exactBand, &g1, &g2);
+    g1.i = (int)fmax(g1.i, 0);
+    g1.j = (int)fmax(g1.j, 0);
+    g1.k = (int)fmax(g1.k, 0);
+    g2.i = (int)fmin(g2.i, _isize);
+    g2.j = (int)fmin(g2.j, _jsize);
+    g2.k = (int)fmin(g2.k, _ksize);
+
+    if (g2.i <= g1.i || g2.j <= g1.j || g2.k <= g1.k) {
+        return false;
+    }
+
+    *gmin = g1;
+    *gmax = g2;
+
+    return true;
+}
+
+void MeshObject::enableRigidMeshLevelSetCache() {
+    _isRigidMeshLevelSetCacheEnabled = true;
+}
+
+void MeshObject::disableRigidMeshLevelSetCache() {
+    _isRigidMeshLevelSetCacheEnabled = false;
+    _rigidCache = RigidMeshLevelSetCache();
+}
+
+bool MeshObject::isRigidMeshLevelSetCacheEnabled() {
+    return _isRigidMeshLevelSetCacheEnabled;
+}
+
+void MeshObject::setMeshTransforms(MeshTransform previous, 
+                                   MeshTransform current, 
+                                   MeshTransform next) {
+    _transformPrevious = previous;
+    _transformCurrent = current;
+    _transformNext = next;
+    _isMeshTransformSet = true;
+}
+
 void MeshObject::enable() {
     if (!_isEnabled) {
         _isObjectStateChanged = true;
@@ -451,7 +519,7 @@ void MeshObject::_getMeshIslands(TriangleMesh &m,
     int isize, jsize, ksize;
     levelset.getGridDimensions(&isize, &jsize, &ksize);
     double dx = levelset.getCellSize();
-    AABB gridAABB(0.0, 0.0, 0.0, isize * dx, jsize * dx, ksize * dx);
+    AABB gridAABB(levelset.getPositionOffset(), isize * dx, jsize * dx, ksize * dx);
 
     for (size_t i = 0; i < tempIslands.size(); i++) {
         AABB meshAABB(tempIslands[i].vertices);
@@ -477,19 +545,9 @@ MeshLevelSet MeshObject::_getMeshIslandLevelSet(TriangleMesh &m,
                                                 MeshLevelSet &domainLevelSet,
                                                 int exactBand) {
     
-    int isize, jsize, ksize;
-    domainLevelSet.getGridDimensions(&isize, &jsize, &ksize);
     double dx = domainLevelSet.getCellSize();
-
-    AABB islandAABB(m.vertices);
-    GridIndex gmin = Grid3d::positionToGridIndex(islandAABB.getMinPoint(), dx);
-    GridIndex gmax = Grid3d::positionToGridIndex(islandAABB.getMaxPoint(), dx);
-    gmin.i = (int)fmax(gmin.i - exactBand, 0);
-    gmin.j = (int)fmax(gmin.j - exactBand, 0);
-    gmin.k = (int)fmax(gmin.k - exactBand, 0);
-    gmax.i = (int)fmin(gmax.i + exactBand + 1, isize - 1);
-    gmax.j = (int)fmin(gmax.j + exactBand + 1, jsize - 1);
-    gmax.k = (int)fmin(gmax.k + exactBand + 1, ksize - 1);
+    GridIndex gmin, gmax;
+    _getMeshIslandGridBounds(m, domainLevelSet, exactBand, &gmin, &gmax);
 
     int gwidth = gmax.i - gmin.i;
     int gheight = gmax.j - gmin.j;
@@ -502,6 +560,199 @@ MeshLevelSet MeshObject::_getMeshIslandLevelSet(TriangleMesh &m,
     return islandLevelSet;
 }
 
+void MeshObject::_getMeshGridBounds(TriangleMesh &m, int exactBand, 
+                                    GridIndex *gmin, GridIndex *gmax) {
+    // Mesh islands are expanded by up to half of the mesh expansion value and
+    // island level sets extend exactBand + 1 cells past the island bounds. An
+    // extra cell of padding keeps the island bounds from being clamped by
+    // this range.
+    AABB bbox(m.vertices);
+    bbox.expand(fabs(_meshExpansion));
+    GridIndex g1 = Grid3d::positionToGridIndex(bbox.getMinPoint(), _dx);
+    GridIndex g2 = Grid3d::positionToGridIndex(bbox.getMaxPoint(), _dx);
+    *gmin = GridIndex(g1.i - exactBand - 1, g1.j - exactBand - 1, g1.k - exactBand - 1);
+    *gmax = GridIndex(g2.i + exactBand + 2, g2.j + exactBand + 2, g2.k + exactBand + 2);
+}
+
+bool MeshObject::_getRigidMeshLevelSet(double dt,
+                                       float frameInterpolation,
+                                       int exactBand,
+                                       MeshLevelSet &levelset) {
+    if (!_isAnimated || !_isMeshTransformSet || _isChangingTopology) {
+        return false;
+    }
+
+    RigidMeshLevelSetCache &cache = _rigidCache;
+    MeshTransform pose = _getMeshTransform(frameInterpolation);
+    bool isCacheValid = cache.isLevelSetValid &&
+                        cache.meshExpansion == _meshExpansion &&
+                        cache.exactBand == exactBand &&
+                        cache.numVertices == _meshCurrent.vertices.size() &&
+                        cache.numTriangles == _meshCurrent.triangles.size();
+    if (!isCacheValid || !_isRigidMotion(cache.transform, pose, exactBand)) {
+        // A new reference level set is only computed in the current pose if
+        // it can be reused for the remainder of the frame
+        if (!_isRigidMotion(pose, _transformNext, exactBand)) {
+            return false;
+        }
+        _initializeRigidMeshLevelSetCache(frameInterpolation, exactBand);
+    }
+
+    // Maps positions in the current pose to the reference pose
+    vmath::mat3 toReference = cache.transform.linear * vmath::inverse(pose.linear);
+    vmath::vec3 toReferenceTranslation = cache.transform.translation -
+                                         toReference * pose.translation;
+
+    // The reference mesh islands are moved into the current pose so that
+    // triangle indices in the cached level set refer to the same triangles
+    vmath::mat3 fromReference = pose.linear * vmath::inverse(cache.transform.linear);
+    vmath::vec3 fromReferenceTranslation = pose.translation -
+                                           fromReference * cache.transform.translation;
+
+    // Vertex velocities are interpolated from the frame translations of the
+    // transform in the same way as getVertexVelocities
+    frameInterpolation = fmax(0.0f, frameInterpolation);
+    frameInterpolation = fmin(1.0f, frameInterpolation);
+    vmath::mat3 linear1 = _transformCurrent.linear - _transformPrevious.linear;
+    vmath::mat3 linear2 = _transformNext.linear - _transformCurrent.linear;
+    vmath::vec3 translation1 = _transformCurrent.translation - _transformPrevious.translation;
+    vmath::vec3 translation2 = _transformNext.translation - _transformCurrent.translation;
+    vmath::mat3 frameLinear = linear1 + frameInterpolation * (linear2 - linear1);
+    vmath::vec3 frameTranslation = translation1 + frameInterpolation * (translation2 - translation1);
+    vmath::mat3 toUntransformed = vmath::inverse(cache.transform.linear);
+
+    double eps = 1e-10;
+    float invdt = dt < eps ? 0.0f : (float)(1.0 / dt);
+
+    TriangleMesh islandMesh = cache.mesh;
+    std::vector<vmath::vec3> islandMeshVelocities(islandMesh.vertices.size());
+    for (size_t i = 0; i < cache.mesh.vertices.size(); i++) {
+        vmath::vec3 v = cache.mesh.vertices[i];
+        vmath::vec3 p = toUntransformed * (v - cache.transform.translation);
+        islandMesh.vertices[i] = fromReference * v + fromReferenceTranslation;
+        islandMeshVelocities[i] = invdt * (frameLinear * p + frameTranslation);
+    }
+
+    int isize, jsize, ksize;
+    levelset.getGridDimensions(&isize, &jsize, &ksize);
+    GridIndex offset = levelset.getGridOffset();
+    GridIndex gmin, gmax;
+    _getMeshGridBounds(islandMesh, exactBand, &gmin, &gmax);
+    gmin.i = (int)fmax(gmin.i, offset.i);
+    gmin.j = (int)fmax(gmin.j, offset.j);
+    gmin.k = (int)fmax(gmin.k, offset.k);
+    gmax.i = (int)fmin(gmax.i, offset.i + isize);
+    gmax.j = (int)fmin(gmax.j, offset.j + jsize);
+    gmax.k = (int)fmin(gmax.k, offset.k + ksize);
+    if (gmax.i <= gmin.i || gmax.j <= gmin.j || gmax.k <= gmin.k) {
+        return true;
+    }
+
+    MeshLevelSet meshLevelSet(gmax.i - gmin.i, gmax.j - gmin.j, gmax.k - gmin.k, _dx);
+    meshLevelSet.setGridOffset(gmin);
+    if (!levelset.isVelocityDataEnabled()) {
+        meshLevelSet.disableVelocityData();
+    }
+    meshLevelSet.resampleSignedDistanceField(cache.levelset, toReference, toReferenceTranslation,
+                                             islandMesh, islandMeshVelocities);
+    levelset.calculateUnion(meshLevelSet);
+
+    return true;
+}
+
+void MeshObject::_initializeRigidMeshLevelSetCache(float frameInterpolation, int exactBand) {
+    TriangleMesh mesh = getMesh(frameInterpolation);
+    mesh.removeExtraneousVertices();
+    std::vector<vmath::vec3> vertexVelocities(mesh.vertices.size());
+
+    std::vector<TriangleMesh> islands;
+    std::vector<std::vector<vmath::vec3> > islandVertexVelocities;
+    MeshUtils::splitIntoMeshIslands(mesh, vertexVelocities, islands, islandVertexVelocities);
+    _expandMeshIslands(islands);
+
+    RigidMeshLevelSetCache &cache = _rigidCache;
+    cache.mesh = TriangleMesh();
+    for (size_t i = 0; i < islands.size(); i++) {
+        cache.mesh.append(islands[i]);
+    }
+
+    // The reference level set covers the whole mesh, including parts
+    // outside of the domain that may move into it
+    GridIndex gmin, gmax;
+    _getMeshGridBounds(mesh, exactBand, &gmin, &gmax);
+    cache.levelset = MeshLevelSet(gmax.i - gmin.i, gmax.j - gmin.j, gmax.k - gmin.k, _dx);
+    cache.levelset.setGridOffset(gmin);
+    cache.levelset.disableVelocityData();
+    _addMeshIslandsToLevelSet(islands, islandVertexVelocities, exactBand, cache.levelset);
+
+    cache.transform = _getMeshTransform(frameInterpolation);
+    cache.numVertices = _meshCurrent.vertices.size();
+    cache.numTriangles = _meshCurrent.triangles.size();
+    cache.meshExpansion = _meshExpansion;
+    cache.exactBand = exactBand;
+    cache.isLevelSetValid = true;
+}
+
+MeshTransform MeshObject::_getMeshTransform(float frameInterpolation) {
+    if (_isChangingTopology) {
+        return _transformCurrent;
+    }
+
+    frameInterpolation = fmax(0.0f, frameInterpolation);
+    frameInterpolation = fmin(1.0f, frameInterpolation);
+
+    MeshTransform t1 = _transformCurrent;
+    MeshTransform t2 = _transformNext;
+    MeshTransform transform;
+    transform.linear = t1.linear + frameInterpolation * (t2.linear - t1.linear);
+    transform.translation = t1.translation + frameInterpolation * (t2.translation - t1.translation);
+
+    return transform;
+}
+
+bool MeshObject::_isRigidMotion(MeshTransform &from, MeshTransform &to, int exactBand) {
+    float eps = 1e-12f;
+    if (fabs(vmath::determinant(from.linear)) < eps) {
+        return false;
+    }
+
+    // A linear map M changes the length of a vector d by at most about
+    // 1.5 * max|M^T * M - I| * |d|. Level set values are only exact within
+    // exactBand + 2 cells of the mesh.
+    vmath::mat3 m = to.linear * vmath::inverse(from.linear);
+    vmath::mat3 err = vmath::transpose(m) * m - vmath::mat3();
+    float maxerr = 0.0f;
+    for (int i = 0; i < 9; i++) {
+        maxerr = fmax(maxerr, fabs(err.m[i]));
+    }
+
+    return 1.5f * maxerr * (exactBand + 2) <= _rigidTransformTolerance;
+}
+
+void MeshObject::_getMeshIslandGridBounds(TriangleMesh &m, 
+                                          MeshLevelSet &levelset,
+                                          int exactBand,
+                                          GridIndex *gmin, 
+                                          GridIndex *gmax) {
+    int isize, jsize, ksize;
+    levelset.getGridDimensions(&isize, &jsize, &ksize);
+    double dx = levelset.getCellSize();
+    GridIndex offset = levelset.getGridOffset();
+
+    AABB islandAABB(m.vertices);
+    GridIndex g1 = Grid3d::positionToGridIndex(islandAABB.getMinPoint(), dx);
+    GridIndex g2 = Grid3d::positionToGridIndex(islandAABB.getMaxPoint(), dx);
+    g1.i = (int)fmax(g1.i - exactBand, offset.i);
+    g1.j = (int)fmax(g1.j - exactBand, offset.j);
+    g1.k = (int)fmax(g1.k - exactBand, offset.k);
+    g2.i = (int)fmin(g2.i + exactBand + 1, offset.i + isize - 1);
+    g2.j = (int)fmin(g2.j + exactBand + 1, offset.j + jsize - 1);
+    g2.k = (int)fmin(g2.k + exactBand + 1, offset.k + ksize - 1);
+
+    *gmin = g1;
+    *gmax = g2;
+}
+
 void MeshObject::_expandMeshIslands(std::vector<TriangleMesh> &islands) {
     float eps = 1e-9f;
     if (fabs(_meshExpansion) < eps) {
@@ -594,8 +845,6 @@ void MeshObject::_islandMeshLevelSetProducerThread(BoundedBuffer<MeshIslandWorkI
                                                    BoundedBuffer<MeshLevelSet*> *finishedWorkQueue,
                                                    MeshLevelSet *domainLevelSet,
                                                    int exactBand) {
-    int isize, jsize, ksize;
-    domainLevelSet->getGridDimensions(&isize, &jsize, &ksize);
     double dx = domainLevelSet->getCellSize();
 
     while (workQueue->size() > 0) {
@@ -606,15 +855,8 @@ void MeshObject::_islandMeshLevelSetProducerThread(BoundedBuffer<MeshIslandWorkI
         }
         MeshIslandWorkItem w = items[0];
 
-        AABB islandAABB(w.mesh.vertices);
-        GridIndex gmin = Grid3d::positionToGridIndex(islandAABB.getMinPoint(), dx);
-        GridIndex gmax = Grid3d::positionToGridIndex(islandAABB.getMaxPoint(), dx);
-        gmin.i = (int)fmax(gmin.i - exactBand, 0);
-        gmin.j = (int)fmax(gmin.j - exactBand, 0);
-        gmin.k = (int)fmax(gmin.k - exactBand, 0);
-        gmax.i = (int)fmin(gmax.i + exactBand + 1, isize - 1);
-        gmax.j = (int)fmin(gmax.j + exactBand + 1, jsize - 1);
-        gmax.k = (int)fmin(gmax.k + exactBand + 1, ksize - 1);
+        GridIndex gmin, gmax;
+        _getMeshIslandGridBounds(w.mesh, *domainLevelSet, exactBand, &gmin, &gmax);
 
         int gwidth = gmax.i - gmin.i;
         int gheight = gmax.j - gmin.j;
@@ -49,6 +49,25 @@ struct MeshObjectStatus {
     bool isMeshChanged = false;
 };
 
+struct MeshTransform {
+    // Maps a point p of the untransformed mesh to linear * p + translation
+    vmath::mat3 linear;
+    vmath::vec3 translation;
+};
+
+struct RigidMeshLevelSetCache {
+    // Pose and expanded mesh islands that the level set was computed in
+    MeshTransform transform;
+    TriangleMesh mesh;
+    size_t numVertices = 0;
+    size_t numTriangles = 0;
+
+    bool isLevelSetValid = false;
+    MeshLevelSet levelset;
+    float meshExpansion = 0.0f;
+    int exactBand = 0;
+};
+
 struct MeshIslandWorkItem {
     MeshIslandWorkItem() {}
     MeshIslandWorkItem(TriangleMesh m, std::vector<vmath::vec3> velocities) :
@@ -85,6 +104,26 @@ public:
     void getMeshLevelSet(double dt, float frameInterpolation, int exactBand, 
                          MeshLevelSet &levelset);
 
+    /*
+        Same as above for a mesh that was already retrieved with 
+        getMesh(frameInterpolation). The mesh may be modified.
+    */
+    void getMeshLevelSet(TriangleMesh &mesh, 
+                         double dt, 
+                         float frameInterpolation, 
+                         int exactBand, 
+                         MeshLevelSet &levelset);
+
+    /*
+        Range of grid cells [gmin, gmax) that a level set must cover to 
+        hold all values written by getMeshLevelSet. Returns false if the 
+        mesh does not overlap the grid.
+    */
+    bool getMeshLevelSetGridBounds(float frameInterpolation, int exactBand, 
+                                   GridIndex *gmin, GridIndex *gmax);
+    bool getMeshLevelSetGridBounds(TriangleMesh &mesh, int exactBand, 
+                                   GridIndex *gmin, GridIndex *gmax);
+
     void enable();
     void disable();
     bool isEnabled();
@@ -107,6 +146,26 @@ public:
     void setObjectVelocityInfluence(float value);
     float getObjectVelocityInfluence();
 
+    /*
+        When enabled, an animated mesh with transforms set by 
+        setMeshTransforms has its level set computed once and resampled 
+        into later poses for as long as the transforms stay rigid. Other 
+        meshes fall back to computing the full level set. Disabled by 
+        default.
+    */
+    void enableRigidMeshLevelSetCache();
+    void disableRigidMeshLevelSetCache();
+    bool isRigidMeshLevelSetCacheEnabled();
+
+    /*
+        Transforms that map a single untransformed mesh onto the previous, 
+        current, and next meshes of the last updateMeshAnimated call. 
+        Cleared by the next mesh update.
+    */
+    void setMeshTransforms(MeshTransform previous, 
+                           MeshTransform current, 
+                           MeshTransform next);
+
     MeshObjectStatus getStatus();
 
 private:
@@ -121,6 +180,20 @@ private:
                                         std::vector<vmath::vec3> &velocities, 
                                         MeshLevelSet &domainLevelSet,
                                         int exactBand);
+    void _getMeshGridBounds(TriangleMesh &m, int exactBand, 
+                            GridIndex *gmin, GridIndex *gmax);
+    bool _getRigidMeshLevelSet(double dt, 
+                               float frameInterpolation, 
+                               int exactBand, 
+                               MeshLevelSet &levelset);
+    void _initializeRigidMeshLevelSetCache(float frameInterpolation, int exactBand);
+    MeshTransform _getMeshTransform(float frameInterpolation);
+    bool _isRigidMotion(MeshTransform &from, MeshTransform &to, int exactBand);
+    void _getMeshIslandGridBounds(TriangleMesh &m, 
+                                  MeshLevelSet &levelset,
+                                  int exactBand,
+                                  GridIndex *gmin, 
+                                  GridIndex *gmax);
     void _expandMeshIslands(std::vector<TriangleMesh> &islands);
     void _expandMeshIsland(TriangleMesh &m);
     void _addMeshIslandsToLevelSet(std::vector<TriangleMesh> &islands,
@@ -166,6 +239,16 @@ private:
     bool _isAppendObjectVelocityEnabled = false;
     float _objectVelocityInfluence = 1.0f;
     bool _isObjectStateChanged = false;
+    bool _isRigidMeshLevelSetCacheEnabled = false;
+    RigidMeshLevelSetCache _rigidCache;
+    bool _isMeshTransformSet = false;
+    MeshTransform _transformPrevious;
+    MeshTransform _transformCurrent;
+    MeshTransform _transformNext;
+
+    // Largest distance error within the exact band of the level set, as a 
+    // fraction of the cell size, for the mesh motion to be treated as rigid
+    float _rigidTransformTolerance = 0.05f;
 
 
     int _numIslandsForFractureOptimizationTrigger = 25;
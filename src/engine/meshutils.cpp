@@ -25,6 +25,7 @@ SOFTWARE.
 #include "meshutils.h"
 
 #include <limits>
+#include <algorithm>
 
 #include "grid3d.h"
 #include "collision.h"
@@ -112,19 +113,9 @@ void _getCollisionGridZ(TriangleMesh &m, double dx, Array3d<std::vector<float> >
                        _randomDouble(jit, -jit));
 
     int gridsize = ztrigrid.width * ztrigrid.height;
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, gridsize);
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, gridsize, numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&_getCollisionGridZThread,
-                                 intervals[i], intervals[i + 1], 
-                                 dx, jitter, &m, &ztrigrid, &zcollisions);
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, gridsize, [&](int startidx, int endidx) {
+        _getCollisionGridZThread(startidx, endidx, dx, jitter, &m, &ztrigrid, &zcollisions);
+    });
     
 }
 
@@ -161,22 +152,18 @@ void getCellsInsideTriangleMesh(
     _getCollisionGridZ(m, dx, zcollisions);
 
     int gridsize = isize * jsize * ksize;
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, gridsize);
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, gridsize, numthreads);
-    std::vector<std::vector<GridIndex> > threadResults(numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&_getCellsInsideTriangleMeshThread,
-                                 intervals[i], intervals[i + 1], 
-                                 isize, jsize, ksize, dx,
-                                 &zcollisions,
-                                 &(threadResults[i]));
-    }
+    int grainsize = ThreadUtils::getGrainSize(0, gridsize, 0);
+    int numchunks = ThreadUtils::getNumChunks(0, gridsize, grainsize);
+    std::vector<std::vector<GridIndex> > threadResults(numchunks);
+    ThreadUtils::parallelFor(0, gridsize, grainsize, [&](int startidx, int endidx) {
+        _getCellsInsideTriangleMeshThread(startidx, endidx, 
+                                          isize, jsize, ksize, dx,
+                                          &zcollisions,
+                                          &(threadResults[startidx / grainsize]));
+    });
 
     int numcells = 0;
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
+    for (size_t i = 0; i < threadResults.size(); i++) {
         numcells += threadResults[i].size();
     }
 
@@ -370,84 +357,298 @@ void getGridNodesInsideTriangleMesh(TriangleMesh mesh, double dx,
     }
 }
 
-void getGridNodesInsideTriangleMesh(TriangleMesh mesh, double dx, 
+void getGridNodesInsideTriangleMesh(TriangleMesh &mesh, double dx, 
                                     Array3d<bool> &nodes) {
     nodes.fill(false);
+    GridIndex gmin(0, 0, 0);
+    GridIndex gmax(nodes.width - 1, nodes.height - 1, nodes.depth - 1);
+    getGridNodesInsideTriangleMesh(mesh, vmath::vec3(), dx, gmin, gmax, nodes);
+}
 
-    int isize = nodes.width - 1;
-    int jsize = nodes.height - 1;
-    int ksize = nodes.depth - 1;
-    AABB gridAABB(0.0, 0.0, 0.0, isize * dx, jsize * dx, ksize * dx);
+void getGridNodesInsideTriangleMesh(TriangleMesh &mesh, vmath::vec3 offset, double dx,
+                                    GridIndex gmin, GridIndex gmax,
+                                    Array3d<bool> &nodes) {
+    gmin = GridIndex(std::max(gmin.i, 0), std::max(gmin.j, 0), std::max(gmin.k, 0));
+    gmax = GridIndex(std::min(gmax.i, nodes.width - 1), 
+                     std::min(gmax.j, nodes.height - 1), 
+                     std::min(gmax.k, nodes.depth - 1));
+    if (gmin.i > gmax.i || gmin.j > gmax.j || gmin.k > gmax.k) {
+        return;
+    }
+
+    /* Rays are jittered for the same reason as in _getCollisionGridZ: a ray 
+       passing exactly through an edge shared by two triangles may report 
+       two collisions.
+    */
+    double jit = 0.001 * dx;
+    vmath::vec3 jitter(_randomDouble(jit, -jit), 
+                       _randomDouble(jit, -jit), 
+                       _randomDouble(jit, -jit));
+    jitter.z = 0.0;
+
+    AABB gridAABB(offset, (nodes.width - 1) * dx, 
+                          (nodes.height - 1) * dx, 
+                          (nodes.depth - 1) * dx);
+    std::vector<int> triangleGroups;
+    _getTriangleClassificationGroups(mesh, gridAABB, triangleGroups);
+
+    std::vector<int> columnStart;
+    std::vector<int> columnTriangles;
+    _getTriangleColumnIndex(
+        mesh, offset + jitter, dx, gmin, gmax, triangleGroups, 
+        columnStart, columnTriangles
+    );
+
+    int numColumns = (gmax.i - gmin.i + 1) * (gmax.j - gmin.j + 1);
+    ThreadUtils::parallelFor(0, numColumns, [&](int startidx, int endidx) {
+        _getGridNodesInsideTriangleMeshThread(startidx, endidx, 
+                                              &mesh, offset, jitter, dx, 
+                                              gmin, gmax, &triangleGroups,
+                                              &columnStart, &columnTriangles,
+                                              &nodes);
+    });
+}
+
+void _getTriangleClassificationGroups(TriangleMesh &m, AABB gridAABB, 
+                                      std::vector<int> &triangleGroups) {
+    triangleGroups.clear();
 
     bool isMeshContainedInGrid = true;
-    for (size_t i = 0; i < mesh.vertices.size(); i++) {
-        if (!gridAABB.isPointInside(mesh.vertices[i])) {
+    for (size_t i = 0; i < m.vertices.size(); i++) {
+        if (!gridAABB.isPointInside(m.vertices[i])) {
             isMeshContainedInGrid = false;
             break;
         }
     }
 
-    std::vector<GridIndex> nodeVector;
     if (isMeshContainedInGrid) {
-        getGridNodesInsideTriangleMesh(mesh, dx, nodeVector);
+        return;
+    }
 
-        GridIndex g;
-        for (size_t i = 0; i < nodeVector.size(); i++) {
-            if (nodes.isIndexInRange(nodeVector[i])) {
-                nodes.set(nodeVector[i], true);
-            }
+    // Connected islands are found by joining the vertices of each triangle
+    std::vector<int> parents(m.vertices.size());
+    for (size_t i = 0; i < parents.size(); i++) {
+        parents[i] = (int)i;
+    }
+
+    auto findRoot = [&parents](int v) {
+        while (parents[v] != v) {
+            parents[v] = parents[parents[v]];
+            v = parents[v];
+        }
+        return v;
+    };
+
+    for (size_t i = 0; i < m.triangles.size(); i++) {
+        Triangle t = m.triangles[i];
+        int r0 = findRoot(t.tri[0]);
+        int r1 = findRoot(t.tri[1]);
+        int r2 = findRoot(t.tri[2]);
+        parents[r1] = r0;
+        parents[findRoot(r2)] = r0;
+    }
+
+    std::vector<vmath::vec3> islandMin(m.vertices.size());
+    std::vector<vmath::vec3> islandMax(m.vertices.size());
+    std::vector<bool> isIslandInitialized(m.vertices.size(), false);
+    for (size_t i = 0; i < m.vertices.size(); i++) {
+        int r = findRoot((int)i);
+        vmath::vec3 v = m.vertices[i];
+        if (!isIslandInitialized[r]) {
+            islandMin[r] = v;
+            islandMax[r] = v;
+            isIslandInitialized[r] = true;
+            continue;
         }
 
-        return;
+        islandMin[r] = vmath::vec3(fmin(islandMin[r].x, v.x), 
+                                   fmin(islandMin[r].y, v.y), 
+                                   fmin(islandMin[r].z, v.z));
+        islandMax[r] = vmath::vec3(fmax(islandMax[r].x, v.x), 
+                                   fmax(islandMax[r].y, v.y), 
+                                   fmax(islandMax[r].z, v.z));
+    }
+
+    // Islands inside of the grid are classified together as group 0. Each
+    // island that crosses the grid boundary is classified on its own so
+    // that crossings of overlapping islands cannot cancel. Islands that 
+    // miss the grid are skipped (group -1).
+    std::vector<int> islandGroups(m.vertices.size(), -1);
+    int numGroups = 1;
+    for (size_t i = 0; i < m.vertices.size(); i++) {
+        if (!isIslandInitialized[i]) {
+            continue;
+        }
+
+        vmath::vec3 minp = islandMin[i];
+        vmath::vec3 maxp = islandMax[i];
+        if (gridAABB.isPointInside(minp) && gridAABB.isPointInside(maxp)) {
+            islandGroups[i] = 0;
+        } else {
+            AABB islandAABB(minp, maxp);
+            AABB inter = gridAABB.getIntersection(islandAABB);
+            if (inter.width > 0.0 || inter.height > 0.0 || inter.depth > 0.0) {
+                islandGroups[i] = numGroups;
+                numGroups++;
+            }
+        }
     }
 
-    TriangleMesh insideMesh;
-    std::vector<TriangleMesh> outsideMeshes;
-    _splitInsideOutsideMesh(mesh, gridAABB, insideMesh, outsideMeshes);
+    triangleGroups = std::vector<int>(m.triangles.size());
+    for (size_t i = 0; i < m.triangles.size(); i++) {
+        triangleGroups[i] = islandGroups[findRoot(m.triangles[i].tri[0])];
+    }
+}
 
-    getGridNodesInsideTriangleMesh(insideMesh, dx, nodeVector);
+void _getTriangleColumnIndex(TriangleMesh &m, vmath::vec3 offset, double dx,
+                             GridIndex gmin, GridIndex gmax,
+                             std::vector<int> &triangleGroups,
+                             std::vector<int> &columnStart, 
+                             std::vector<int> &columnTriangles) {
+
+    // Column (i, j) contains the ray through offset + (i * dx, j * dx, 0).
+    // Triangle column bounds are stored as (imin, jmin) and (imax, jmax),
+    // with imin > imax marking a triangle that misses the sub-box.
+    int numTriangles = (int)m.triangles.size();
+    std::vector<GridIndex> triangleColumnMin(numTriangles);
+    std::vector<GridIndex> triangleColumnMax(numTriangles);
+    ThreadUtils::parallelFor(0, numTriangles, [&](int startidx, int endidx) {
+        double invdx = 1.0 / dx;
+        double eps = 1e-6;
+        for (int tidx = startidx; tidx < endidx; tidx++) {
+            Triangle t = m.triangles[tidx];
+            vmath::vec3 v1 = m.vertices[t.tri[0]];
+            vmath::vec3 v2 = m.vertices[t.tri[1]];
+            vmath::vec3 v3 = m.vertices[t.tri[2]];
+            double xmin = fmin(fmin(v1.x, v2.x), v3.x);
+            double xmax = fmax(fmax(v1.x, v2.x), v3.x);
+            double ymin = fmin(fmin(v1.y, v2.y), v3.y);
+            double ymax = fmax(fmax(v1.y, v2.y), v3.y);
+
+            int imin = (int)fmax(ceil((xmin - offset.x) * invdx - eps), gmin.i);
+            int imax = (int)fmin(floor((xmax - offset.x) * invdx + eps), gmax.i);
+            int jmin = (int)fmax(ceil((ymin - offset.y) * invdx - eps), gmin.j);
+            int jmax = (int)fmin(floor((ymax - offset.y) * invdx + eps), gmax.j);
+            bool isSkipped = !triangleGroups.empty() && triangleGroups[tidx] < 0;
+            if (imin > imax || jmin > jmax || isSkipped) {
+                imin = 1;
+                imax = 0;
+            }
 
-    GridIndex g;
-    for (size_t i = 0; i < nodeVector.size(); i++) {
-        if (nodes.isIndexInRange(nodeVector[i])) {
-            nodes.set(nodeVector[i], true);
+            triangleColumnMin[tidx] = GridIndex(imin, jmin, 0);
+            triangleColumnMax[tidx] = GridIndex(imax, jmax, 0);
+        }
+    });
+
+    int isize = gmax.i - gmin.i + 1;
+    int jsize = gmax.j - gmin.j + 1;
+    columnStart = std::vector<int>(isize * jsize + 1, 0);
+    for (int tidx = 0; tidx < numTriangles; tidx++) {
+        GridIndex tmin = triangleColumnMin[tidx];
+        GridIndex tmax = triangleColumnMax[tidx];
+        for (int j = tmin.j; j <= tmax.j; j++) {
+            for (int i = tmin.i; i <= tmax.i; i++) {
+                columnStart[(i - gmin.i) + (j - gmin.j) * isize + 1]++;
+            }
         }
     }
 
-    for (size_t i = 0; i < outsideMeshes.size(); i++) {
-        nodeVector.clear();
-        getGridNodesInsideTriangleMesh(outsideMeshes[i], dx, nodeVector);
+    for (size_t i = 1; i < columnStart.size(); i++) {
+        columnStart[i] += columnStart[i - 1];
+    }
 
-        GridIndex g;
-        for (size_t i = 0; i < nodeVector.size(); i++) {
-            if (nodes.isIndexInRange(nodeVector[i])) {
-                nodes.set(nodeVector[i], true);
+    std::vector<int> columnCount(isize * jsize, 0);
+    columnTriangles = std::vector<int>(columnStart.back());
+    for (int tidx = 0; tidx < numTriangles; tidx++) {
+        GridIndex tmin = triangleColumnMin[tidx];
+        GridIndex tmax = triangleColumnMax[tidx];
+        for (int j = tmin.j; j <= tmax.j; j++) {
+            for (int i = tmin.i; i <= tmax.i; i++) {
+                int cidx = (i - gmin.i) + (j - gmin.j) * isize;
+                columnTriangles[columnStart[cidx] + columnCount[cidx]] = tidx;
+                columnCount[cidx]++;
             }
         }
     }
 }
 
-void _splitInsideOutsideMesh(TriangleMesh &mesh, AABB bbox, 
-                             TriangleMesh &insideMesh, 
-                             std::vector<TriangleMesh> &outsideMeshes) {
+void _getGridNodesInsideTriangleMeshThread(int startidx, int endidx, 
+                                           TriangleMesh *m, 
+                                           vmath::vec3 offset, 
+                                           vmath::vec3 jitter, 
+                                           double dx,
+                                           GridIndex gmin, GridIndex gmax,
+                                           std::vector<int> *triangleGroups,
+                                           std::vector<int> *columnStart, 
+                                           std::vector<int> *columnTriangles,
+                                           Array3d<bool> *nodes) {
+
+    int isize = gmax.i - gmin.i + 1;
+    vmath::vec3 dir(0.0, 0.0, 1.0);
+    vmath::vec3 v1, v2, v3, coll;
+    Triangle t;
+    std::vector<std::pair<int, double> > zvals;
+    for (int cidx = startidx; cidx < endidx; cidx++) {
+        int start = columnStart->at(cidx);
+        int end = columnStart->at(cidx + 1);
+        if (end - start < 2) {
+            continue;
+        }
+
+        int i = gmin.i + cidx % isize;
+        int j = gmin.j + cidx / isize;
+        vmath::vec3 origin = offset + jitter + vmath::vec3(i * dx, j * dx, 0.0);
+
+        zvals.clear();
+        for (int idx = start; idx < end; idx++) {
+            int tidx = columnTriangles->at(idx);
+            t = m->triangles[tidx];
+            v1 = m->vertices[t.tri[0]];
+            v2 = m->vertices[t.tri[1]];
+            v3 = m->vertices[t.tri[2]];
+            if (Collision::lineIntersectsTriangle(origin, dir, v1, v2, v3, &coll)) {
+                int group = triangleGroups->empty() ? 0 : triangleGroups->at(tidx);
+                zvals.push_back(std::make_pair(group, (double)coll.z));
+            }
+        }
 
-    std::vector<TriangleMesh> meshIslands;
-    std::vector<int> vertexToGroupID;
-    std::vector<int> vertexTranslationTable;
-    _splitIntoMeshIslands(mesh, meshIslands, vertexToGroupID, vertexTranslationTable);
+        // Crossings are sorted by group and then by z. Each group is 
+        // classified on its own and a node is inside if it is inside of any
+        // group.
+        std::sort(zvals.begin(), zvals.end());
+
+        size_t groupStart = 0;
+        while (groupStart < zvals.size()) {
+            size_t groupEnd = groupStart + 1;
+            while (groupEnd < zvals.size() && 
+                    zvals[groupEnd].first == zvals[groupStart].first) {
+                groupEnd++;
+            }
 
-    for (size_t i = 0; i < meshIslands.size(); i++) {
-        AABB meshAABB(meshIslands[i].vertices);
-        vmath::vec3 minp = meshAABB.getMinPoint();
-        vmath::vec3 maxp = meshAABB.getMaxPoint();
+            // An odd number of crossings means the ray grazed an edge or the 
+            // group is not closed. The group is left outside in this column.
+            if ((groupEnd - groupStart) % 2 != 0) {
+                groupStart = groupEnd;
+                continue;
+            }
 
-        if (bbox.isPointInside(minp) && bbox.isPointInside(maxp)) {
-            insideMesh.append(meshIslands[i]);
-        } else {
-            AABB inter = bbox.getIntersection(meshAABB);
-            if (inter.width > 0.0 || inter.height > 0.0 || inter.depth > 0.0) {
-                outsideMeshes.push_back(meshIslands[i]);
+            // Nodes with an odd number of crossings below them are inside, 
+            // which are the nodes with z in (zvals[idx], zvals[idx + 1]]
+            for (size_t idx = groupStart; idx < groupEnd; idx += 2) {
+                double zmin = zvals[idx].second;
+                double zmax = zvals[idx + 1].second;
+                int k = (int)fmax(floor((zmin - offset.z) / dx) - 1, gmin.k);
+                while (k <= gmax.k && offset.z + k * dx <= zmin) {
+                    k++;
+                }
+
+                while (k <= gmax.k && offset.z + k * dx <= zmax) {
+                    nodes->set(i, j, k, true);
+                    k++;
+                }
             }
+
+            groupStart = groupEnd;
         }
     }
 }
@@ -84,15 +84,35 @@ namespace MeshUtils {
         GridIndex g, double dx, Array3d<std::vector<double> > &zsubcollisions);
 
 
-    void getGridNodesInsideTriangleMesh(TriangleMesh mesh, double dx, 
+    void getGridNodesInsideTriangleMesh(TriangleMesh &mesh, double dx, 
+                                        Array3d<bool> &nodes);
+
+    void getGridNodesInsideTriangleMesh(TriangleMesh &mesh, vmath::vec3 offset, double dx,
+                                        GridIndex gmin, GridIndex gmax,
                                         Array3d<bool> &nodes);
 
     void getGridNodesInsideTriangleMesh(TriangleMesh mesh, double dx, 
                                         std::vector<GridIndex> &nodes);
 
-    void _splitInsideOutsideMesh(TriangleMesh &mesh, AABB bbox, 
-                                 TriangleMesh &insideMesh, 
-                                 std::vector<TriangleMesh> &outsideMeshes);
+    void _getTriangleClassificationGroups(TriangleMesh &m, AABB gridAABB, 
+                                          std::vector<int> &triangleGroups);
+
+    void _getTriangleColumnIndex(TriangleMesh &m, vmath::vec3 offset, double dx,
+                                 GridIndex gmin, GridIndex gmax,
+                                 std::vector<int> &triangleGroups,
+                                 std::vector<int> &columnStart, 
+                                 std::vector<int> &columnTriangles);
+
+    void _getGridNodesInsideTriangleMeshThread(int startidx, int endidx, 
+                                               TriangleMesh *m, 
+                                               vmath::vec3 offset, 
+                                               vmath::vec3 jitter, 
+                                               double dx,
+                                               GridIndex gmin, GridIndex gmax,
+                                               std::vector<int> *triangleGroups,
+                                               std::vector<int> *columnStart, 
+                                               std::vector<int> *columnTriangles,
+                                               Array3d<bool> *nodes);
 
     void _splitIntoMeshIslands(TriangleMesh &mesh, 
                                std::vector<TriangleMesh> &islands,
@@ -0,0 +1,483 @@
+/*
+MIT License
+
+Copyright (c) 2019 Ryan L. Guy
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "multigridpreconditioner.h"
+
+#include "threadutils.h"
+#include "grid3d.h"
+#include "gridindexvector.h"
+#include "gridindexkeymap.h"
+#include "pressuresolver.h"
+#include "profiler.h"
+
+MultigridPreconditioner::MultigridPreconditioner() {
+}
+
+MultigridPreconditioner::~MultigridPreconditioner() {
+}
+
+void MultigridPreconditioner::initialize(MultigridPreconditionerParameters params) {
+    FLUIDSIM_PROFILE_SCOPE("Multigrid Initialize");
+    _isize = params.isize;
+    _jsize = params.jsize;
+    _ksize = params.ksize;
+    _factor = params.deltaTime / (params.cellwidth * params.cellwidth);
+    _pressureCells = params.pressureCells;
+    _keymap = params.keymap;
+    _weightGrid = params.weightGrid;
+    _diagonal = *(params.diagonal);
+    _residual.resize(_diagonal.size());
+
+    _initializeFineLevel();
+
+    int isize = _isize;
+    int jsize = _jsize;
+    int ksize = _ksize;
+    int numLevels = 1;
+    while (std::min(isize, std::min(jsize, ksize)) > _minGridWidth && 
+                numLevels < _maxLevels) {
+        isize = (isize + 1) / 2;
+        jsize = (jsize + 1) / 2;
+        ksize = (ksize + 1) / 2;
+        numLevels++;
+    }
+
+    _levels.clear();
+    _levels.resize(numLevels - 1);
+    for (int level = 1; level < numLevels; level++) {
+        _initializeCoarseLevel(level);
+    }
+}
+
+void MultigridPreconditioner::apply(const std::vector<double> &x, std::vector<double> &result) {
+    FLUIDSIM_ASSERT(x.size() == _diagonal.size());
+    FLUIDSIM_ASSERT(result.size() == _diagonal.size());
+
+    std::fill(result.begin(), result.end(), 0.0);
+    if (_levels.empty()) {
+        _smoothFine(x, result, _numCoarsestIterations, false);
+        _smoothFine(x, result, _numCoarsestIterations, true);
+        return;
+    }
+
+    _smoothFine(x, result, _numSmoothingIterations, false);
+    _calculateFineResidual(x, result);
+    _restrict(0);
+    _vcycle(1);
+    _prolongateToFine(result);
+    _smoothFine(x, result, _numSmoothingIterations, true);
+}
+
+void MultigridPreconditioner::apply(const std::vector<float> &x, std::vector<float> &result) {
+    _mixedInput.assign(x.begin(), x.end());
+    _mixedResult.resize(x.size());
+    apply(_mixedInput, _mixedResult);
+    result.assign(_mixedResult.begin(), _mixedResult.end());
+}
+
+int MultigridPreconditioner::getNumLevels() {
+    return (int)_levels.size() + 1;
+}
+
+void MultigridPreconditioner::_initializeFineLevel() {
+    _fineCells[0].clear();
+    _fineCells[1].clear();
+    for (size_t idx = 0; idx < _pressureCells->size(); idx++) {
+        GridIndex g = _pressureCells->at(idx);
+        _fineCells[_getColor(g.i, g.j, g.k)].push_back((int)idx);
+    }
+}
+
+void MultigridPreconditioner::_initializeCoarseLevel(int level) {
+    int finei, finej, finek;
+    double finefactor;
+    if (level == 1) {
+        finei = _isize;
+        finej = _jsize;
+        finek = _ksize;
+        finefactor = _factor;
+    } else {
+        GridLevel &fine = _levels[level - 2];
+        finei = fine.isize;
+        finej = fine.jsize;
+        finek = fine.ksize;
+        finefactor = fine.factor;
+    }
+
+    GridLevel &coarse = _levels[level - 1];
+    coarse.isize = (finei + 1) / 2;
+    coarse.jsize = (finej + 1) / 2;
+    coarse.ksize = (finek + 1) / 2;
+    coarse.factor = 0.25 * finefactor;
+
+    int ni = coarse.isize;
+    int nj = coarse.jsize;
+    int nk = coarse.ksize;
+    coarse.cellType = Array3d<CellType>(ni, nj, nk, CellType::solid);
+    coarse.U = Array3d<float>(ni + 1, nj, nk, 0.0f);
+    coarse.V = Array3d<float>(ni, nj + 1, nk, 0.0f);
+    coarse.W = Array3d<float>(ni, nj, nk + 1, 0.0f);
+    coarse.diagonal = Array3d<float>(ni, nj, nk, 0.0f);
+    coarse.x = Array3d<float>(ni, nj, nk, 0.0f);
+    coarse.b = Array3d<float>(ni, nj, nk, 0.0f);
+    coarse.r = Array3d<float>(ni, nj, nk, 0.0f);
+    coarse.cellType.setOutOfRangeValue(CellType::solid);
+    coarse.x.setOutOfRangeValue(0.0f);
+    coarse.r.setOutOfRangeValue(0.0f);
+
+    _initializeCoarseLevelCellTypes(coarse, level);
+    _initializeCoarseLevelFaceWeights(coarse, level);
+    _initializeCoarseLevelDiagonal(coarse);
+}
+
+void MultigridPreconditioner::_initializeCoarseLevelCellTypes(GridLevel &coarse, int level) {
+    int gridsize = coarse.isize * coarse.jsize * coarse.ksize;
+    ThreadUtils::parallelFor(0, gridsize, [&](int startidx, int endidx) {
+        for (int idx = startidx; idx < endidx; idx++) {
+            GridIndex g = Grid3d::getUnflattenedIndex(idx, coarse.isize, coarse.jsize);
+            CellType type = CellType::solid;
+            for (int c = 0; c < 8; c++) {
+                int i = 2 * g.i + (c & 1);
+                int j = 2 * g.j + ((c >> 1) & 1);
+                int k = 2 * g.k + ((c >> 2) & 1);
+                CellType childType = _getCellType(level - 1, i, j, k);
+                if (childType == CellType::air) {
+                    type = CellType::air;
+                    break;
+                } else if (childType == CellType::fluid) {
+                    type = CellType::fluid;
+                }
+            }
+            coarse.cellType.set(g, type);
+        }
+    });
+
+    coarse.cells[0].clear();
+    coarse.cells[1].clear();
+    for (int k = 0; k < coarse.ksize; k++) {
+        for (int j = 0; j < coarse.jsize; j++) {
+            for (int i = 0; i < coarse.isize; i++) {
+                if (coarse.cellType(i, j, k) == CellType::fluid) {
+                    coarse.cells[_getColor(i, j, k)].push_back(GridIndex(i, j, k));
+                }
+            }
+        }
+    }
+}
+
+void MultigridPreconditioner::_initializeCoarseLevelFaceWeights(GridLevel &coarse, int level) {
+    Array3d<float> *faces[3] = {&(coarse.U), &(coarse.V), &(coarse.W)};
+    for (int dir = 0; dir < 3; dir++) {
+        Array3d<float> *face = faces[dir];
+        int gridsize = face->width * face->height * face->depth;
+        ThreadUtils::parallelFor(0, gridsize, [&](int startidx, int endidx) {
+            for (int idx = startidx; idx < endidx; idx++) {
+                GridIndex g = Grid3d::getUnflattenedIndex(idx, face->width, face->height);
+
+                // average of the four finer faces covering the coarse face
+                float sum = 0.0f;
+                for (int c = 0; c < 4; c++) {
+                    int a = c & 1;
+                    int b = (c >> 1) & 1;
+                    int i = 2 * g.i + (dir == 0 ? 0 : a);
+                    int j = 2 * g.j + (dir == 1 ? 0 : (dir == 0 ? a : b));
+                    int k = 2 * g.k + (dir == 2 ? 0 : b);
+                    sum += _getFaceWeight(level - 1, dir, i, j, k);
+                }
+                face->set(g, 0.25f * sum);
+            }
+        });
+    }
+}
+
+void MultigridPreconditioner::_initializeCoarseLevelDiagonal(GridLevel &coarse) {
+    for (int color = 0; color < 2; color++) {
+        std::vector<GridIndex> &cells = coarse.cells[color];
+        ThreadUtils::parallelFor(0, cells.size(), [&](int startidx, int endidx) {
+            for (int idx = startidx; idx < endidx; idx++) {
+                GridIndex g = cells[idx];
+                int i = g.i;
+                int j = g.j;
+                int k = g.k;
+                double vol = (double)coarse.U(i + 1, j, k) + (double)coarse.U(i, j, k) + 
+                             (double)coarse.V(i, j + 1, k) + (double)coarse.V(i, j, k) + 
+                             (double)coarse.W(i, j, k + 1) + (double)coarse.W(i, j, k);
+                coarse.diagonal.set(g, (float)(vol * coarse.factor));
+            }
+        });
+    }
+}
+
+MultigridPreconditioner::CellType MultigridPreconditioner::_getCellType(int level, int i, int j, int k) {
+    if (level > 0) {
+        return _levels[level - 1].cellType(i, j, k);
+    }
+
+    if (!Grid3d::isGridIndexInRange(i, j, k, _isize, _jsize, _ksize)) {
+        return CellType::solid;
+    }
+    if (_keymap->find(i, j, k) != -1) {
+        return CellType::fluid;
+    }
+    return _weightGrid->center(i, j, k) > 0.0f ? CellType::air : CellType::solid;
+}
+
+float MultigridPreconditioner::_getFaceWeight(int level, int dir, int i, int j, int k) {
+    Array3d<float> *face;
+    if (level == 0) {
+        face = dir == 0 ? &(_weightGrid->U) : (dir == 1 ? &(_weightGrid->V) : &(_weightGrid->W));
+    } else {
+        GridLevel &grid = _levels[level - 1];
+        face = dir == 0 ? &(grid.U) : (dir == 1 ? &(grid.V) : &(grid.W));
+    }
+
+    if (!face->isIndexInRange(i, j, k)) {
+        return 0.0f;
+    }
+    return face->get(i, j, k);
+}
+
+void MultigridPreconditioner::_vcycle(int level) {
+    GridLevel &grid = _levels[level - 1];
+    for (int color = 0; color < 2; color++) {
+        for (size_t i = 0; i < grid.cells[color].size(); i++) {
+            grid.x.set(grid.cells[color][i], 0.0f);
+        }
+    }
+
+    if (level == (int)_levels.size()) {
+        _smooth(grid, _numCoarsestIterations, false);
+        _smooth(grid, _numCoarsestIterations, true);
+        return;
+    }
+
+    _smooth(grid, _numSmoothingIterations, false);
+    _calculateResidual(grid);
+    _restrict(level);
+    _vcycle(level + 1);
+    _prolongate(_levels[level], grid);
+    _smooth(grid, _numSmoothingIterations, true);
+}
+
+double MultigridPreconditioner::_multiplyFineRow(int idx, const std::vector<double> &x) {
+    GridIndex g = _pressureCells->at(idx);
+    int i = g.i;
+    int j = g.j;
+    int k = g.k;
+
+    GridIndex nbs[6] = {
+        GridIndex(i + 1, j, k), GridIndex(i - 1, j, k),
+        GridIndex(i, j + 1, k), GridIndex(i, j - 1, k),
+        GridIndex(i, j, k + 1), GridIndex(i, j, k - 1)
+    };
+
+    double vols[6] = {
+        _weightGrid->U(i + 1, j, k), _weightGrid->U(i, j, k),
+        _weightGrid->V(i, j + 1, k), _weightGrid->V(i, j, k),
+        _weightGrid->W(i, j, k + 1), _weightGrid->W(i, j, k)
+    };
+
+    double sum = _diagonal[idx] * x[idx];
+    for (int nidx = 0; nidx < 6; nidx++) {
+        int nb = _keymap->find(nbs[nidx]);
+        if (nb != -1) {
+            sum -= vols[nidx] * _factor * x[nb];
+        }
+    }
+
+    return sum;
+}
+
+void MultigridPreconditioner::_calculateFineResidual(const std::vector<double> &b, 
+                                                     std::vector<double> &x) {
+    ThreadUtils::parallelFor(0, _diagonal.size(), [&](int startidx, int endidx) {
+        for (int idx = startidx; idx < endidx; idx++) {
+            _residual[idx] = b[idx] - _multiplyFineRow(idx, x);
+        }
+    });
+}
+
+void MultigridPreconditioner::_smoothFine(const std::vector<double> &b, 
+                                          std::vector<double> &x, 
+                                          int iterations, bool isReverse) {
+    for (int n = 0; n < iterations; n++) {
+        for (int c = 0; c < 2; c++) {
+            std::vector<int> &cells = _fineCells[isReverse ? 1 - c : c];
+            ThreadUtils::parallelFor(0, cells.size(), [&](int startidx, int endidx) {
+                for (int i = startidx; i < endidx; i++) {
+                    int idx = cells[i];
+                    if (_diagonal[idx] > 0.0) {
+                        x[idx] += (b[idx] - _multiplyFineRow(idx, x)) / _diagonal[idx];
+                    }
+                }
+            });
+        }
+    }
+}
+
+void MultigridPreconditioner::_prolongateToFine(std::vector<double> &x) {
+    GridLevel &coarse = _levels[0];
+    ThreadUtils::parallelFor(0, _diagonal.size(), [&](int startidx, int endidx) {
+        for (int idx = startidx; idx < endidx; idx++) {
+            GridIndex g = _pressureCells->at(idx);
+            x[idx] += _prolongateCell(coarse, g.i, g.j, g.k);
+        }
+    });
+}
+
+float MultigridPreconditioner::_multiplyRow(GridLevel &grid, GridIndex g) {
+    int i = g.i;
+    int j = g.j;
+    int k = g.k;
+    float f = (float)grid.factor;
+    float sum = grid.diagonal(g) * grid.x(g);
+    sum -= grid.U(i + 1, j, k) * f * grid.x(i + 1, j, k);
+    sum -= grid.U(i,     j, k) * f * grid.x(i - 1, j, k);
+    sum -= grid.V(i, j + 1, k) * f * grid.x(i, j + 1, k);
+    sum -= grid.V(i, j,     k) * f * grid.x(i, j - 1, k);
+    sum -= grid.W(i, j, k + 1) * f * grid.x(i, j, k + 1);
+    sum -= grid.W(i, j, k    ) * f * grid.x(i, j, k - 1);
+    return sum;
+}
+
+void MultigridPreconditioner::_calculateResidual(GridLevel &grid) {
+    for (int color = 0; color < 2; color++) {
+        std::vector<GridIndex> &cells = grid.cells[color];
+        ThreadUtils::parallelFor(0, cells.size(), [&](int startidx, int endidx) {
+            for (int idx = startidx; idx < endidx; idx++) {
+                GridIndex g = cells[idx];
+                grid.r.set(g, grid.b(g) - _multiplyRow(grid, g));
+            }
+        });
+    }
+}
+
+void MultigridPreconditioner::_smooth(GridLevel &grid, int iterations, bool isReverse) {
+    for (int n = 0; n < iterations; n++) {
+        for (int c = 0; c < 2; c++) {
+            std::vector<GridIndex> &cells = grid.cells[isReverse ? 1 - c : c];
+            ThreadUtils::parallelFor(0, cells.size(), [&](int startidx, int endidx) {
+                for (int idx = startidx; idx < endidx; idx++) {
+                    GridIndex g = cells[idx];
+                    float diag = grid.diagonal(g);
+                    if (diag > 0.0f) {
+                        grid.x.add(g, (grid.b(g) - _multiplyRow(grid, g)) / diag);
+                    }
+                }
+            });
+        }
+    }
+}
+
+/*
+    Restricts the residual of a level into the right hand side of the next
+    coarser level
+*/
+void MultigridPreconditioner::_restrict(int level) {
+    GridLevel &coarse = _levels[level];
+    for (int color = 0; color < 2; color++) {
+        std::vector<GridIndex> &cells = coarse.cells[color];
+        ThreadUtils::parallelFor(0, cells.size(), [&](int startidx, int endidx) {
+            for (int idx = startidx; idx < endidx; idx++) {
+                GridIndex g = cells[idx];
+                coarse.b.set(g, _restrictCell(g.i, g.j, g.k, level));
+            }
+        });
+    }
+}
+
+void MultigridPreconditioner::_prolongate(GridLevel &coarse, GridLevel &fine) {
+    for (int color = 0; color < 2; color++) {
+        std::vector<GridIndex> &cells = fine.cells[color];
+        ThreadUtils::parallelFor(0, cells.size(), [&](int startidx, int endidx) {
+            for (int idx = startidx; idx < endidx; idx++) {
+                GridIndex g = cells[idx];
+                fine.x.add(g, _prolongateCell(coarse, g.i, g.j, g.k));
+            }
+        });
+    }
+}
+
+/*
+    Full weighting restriction, the transpose of trilinear prolongation 
+    scaled by 1/8. Gathers the 4x4x4 block of finer cells that receive
+    a contribution from coarse cell (i, j, k).
+*/
+float MultigridPreconditioner::_restrictCell(int i, int j, int k, int level) {
+    const double weights[4] = {0.25, 0.75, 0.75, 0.25};
+
+    double sum = 0.0;
+    for (int kk = 0; kk < 4; kk++) {
+        int fk = 2 * k - 1 + kk;
+        for (int jj = 0; jj < 4; jj++) {
+            int fj = 2 * j - 1 + jj;
+            for (int ii = 0; ii < 4; ii++) {
+                int fi = 2 * i - 1 + ii;
+
+                double r = 0.0;
+                if (level == 0) {
+                    if (Grid3d::isGridIndexInRange(fi, fj, fk, _isize, _jsize, _ksize)) {
+                        int vidx = _keymap->find(fi, fj, fk);
+                        if (vidx != -1) {
+                            r = _residual[vidx];
+                        }
+                    }
+                } else {
+                    r = _levels[level - 1].r(fi, fj, fk);
+                }
+
+                sum += weights[ii] * weights[jj] * weights[kk] * r;
+            }
+        }
+    }
+
+    return (float)(0.125 * sum);
+}
+
+/*
+    Trilinear interpolation of the coarse correction at the center of
+    finer cell (i, j, k). Non-fluid coarse cells hold a zero correction.
+*/
+float MultigridPreconditioner::_prolongateCell(GridLevel &coarse, int i, int j, int k) {
+    int ci = i / 2;
+    int cj = j / 2;
+    int ck = k / 2;
+    int is[2] = {ci, (i % 2 == 0) ? ci - 1 : ci + 1};
+    int js[2] = {cj, (j % 2 == 0) ? cj - 1 : cj + 1};
+    int ks[2] = {ck, (k % 2 == 0) ? ck - 1 : ck + 1};
+    const float weights[2] = {0.75f, 0.25f};
+
+    float sum = 0.0f;
+    for (int kk = 0; kk < 2; kk++) {
+        for (int jj = 0; jj < 2; jj++) {
+            for (int ii = 0; ii < 2; ii++) {
+                float w = weights[ii] * weights[jj] * weights[kk];
+                sum += w * coarse.x(is[ii], js[jj], ks[kk]);
+            }
+        }
+    }
+
+    return sum;
+}
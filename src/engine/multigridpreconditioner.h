@@ -0,0 +1,159 @@
+/*
+MIT License
+
+Copyright (c) 2019 Ryan L. Guy
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+/*
+    Geometric multigrid preconditioner for the pressure system based on:
+
+    A Parallel Multigrid Poisson Solver for Fluids Simulation on Large Grids
+     - A. McAdams, E. Sifakis, J. Teran
+
+    The finest level applies the exact pressure matrix over the pressure cells.
+    Coarser levels are rediscretized on cell-centered grids of half resolution
+    with face weights averaged from the finer level. A coarse cell is air if
+    any of its children is air, otherwise fluid if any child is fluid, 
+    otherwise solid.
+
+    Each application runs a single V-cycle with red-black Gauss-Seidel 
+    smoothing, trilinear prolongation and full weighting restriction. The
+    post-smoothing sweeps run in reverse colour order so that the 
+    preconditioner is symmetric. All stages run in parallel.
+*/
+#ifndef FLUIDENGINE_MULTIGRIDPRECONDITIONER_H
+#define FLUIDENGINE_MULTIGRIDPRECONDITIONER_H
+
+#include "pcgsolver/pcgsolver.h"
+#include "array3d.h"
+
+class GridIndexVector;
+class GridIndexKeyMap;
+struct WeightGrid;
+
+struct MultigridPreconditionerParameters {
+    int isize;
+    int jsize;
+    int ksize;
+    double cellwidth;
+    double deltaTime;
+
+    GridIndexVector *pressureCells;
+    GridIndexKeyMap *keymap;
+    WeightGrid *weightGrid;
+    std::vector<double> *diagonal;
+};
+
+class MultigridPreconditioner : public PCGPreconditioner<double>,
+                                public PCGPreconditioner<float>
+{
+public:
+    MultigridPreconditioner();
+    ~MultigridPreconditioner();
+
+    void initialize(MultigridPreconditionerParameters params);
+    void apply(const std::vector<double> &x, std::vector<double> &result);
+
+    // Single precision interface for the mixed precision solver. The V-cycle
+    // itself is always computed in double on the fine level.
+    void apply(const std::vector<float> &x, std::vector<float> &result);
+    int getNumLevels();
+
+private:
+
+    enum class CellType : char { 
+        solid = 0x00, 
+        fluid = 0x01,
+        air   = 0x02
+    };
+
+    struct GridLevel {
+        int isize = 0;
+        int jsize = 0;
+        int ksize = 0;
+        double factor = 0.0;
+
+        std::vector<GridIndex> cells[2];    // fluid cells split by colour
+        Array3d<CellType> cellType;
+        Array3d<float> U;
+        Array3d<float> V;
+        Array3d<float> W;
+        Array3d<float> diagonal;
+        Array3d<float> x;
+        Array3d<float> b;
+        Array3d<float> r;
+    };
+
+    inline int _getColor(int i, int j, int k) {
+        return (i + j + k) & 1;
+    }
+
+    void _initializeFineLevel();
+    void _initializeCoarseLevel(int level);
+    void _initializeCoarseLevelCellTypes(GridLevel &coarse, int level);
+    void _initializeCoarseLevelFaceWeights(GridLevel &coarse, int level);
+    void _initializeCoarseLevelDiagonal(GridLevel &coarse);
+    CellType _getCellType(int level, int i, int j, int k);
+    float _getFaceWeight(int level, int dir, int i, int j, int k);
+
+    void _vcycle(int level);
+
+    double _multiplyFineRow(int idx, const std::vector<double> &x);
+    void _calculateFineResidual(const std::vector<double> &b, std::vector<double> &x);
+    void _smoothFine(const std::vector<double> &b, std::vector<double> &x, 
+                     int iterations, bool isReverse);
+    void _prolongateToFine(std::vector<double> &x);
+
+    float _multiplyRow(GridLevel &grid, GridIndex g);
+    void _calculateResidual(GridLevel &grid);
+    void _smooth(GridLevel &grid, int iterations, bool isReverse);
+    void _restrict(int level);
+    void _prolongate(GridLevel &coarse, GridLevel &fine);
+
+    float _restrictCell(int i, int j, int k, int level);
+    float _prolongateCell(GridLevel &coarse, int i, int j, int k);
+
+    int _isize = 0;
+    int _jsize = 0;
+    int _ksize = 0;
+    double _factor = 0.0;
+    GridIndexVector *_pressureCells = nullptr;
+    GridIndexKeyMap *_keymap = nullptr;
+    WeightGrid *_weightGrid = nullptr;
+    std::vector<double> _diagonal;
+    std::vector<double> _residual;
+    std::vector<double> _mixedInput;
+    std::vector<double> _mixedResult;
+    std::vector<int> _fineCells[2];     // pressure cell indices split by colour
+
+    // _levels[0] is the first coarse level, the finest level is stored
+    // in compact form over the pressure cells
+    std::vector<GridLevel> _levels;
+
+    int _minGridWidth = 4;
+    int _maxLevels = 8;
+    int _numSmoothingIterations = 2;
+    int _numCoarsestIterations = 8;
+
+};
+
+#endif
@@ -0,0 +1,519 @@
+/*
+MIT License
+
+Copyright (c) 2019 Ryan L. Guy
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "particleadvectionkernels.h"
+
+#include <cmath>
+#include <atomic>
+#include <algorithm>
+
+#include "grid3d.h"
+#include "interpolation.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #define FLUIDSIM_ADVECTION_X86 1
+    #include <immintrin.h>
+    #if defined(_MSC_VER) && !defined(__clang__)
+        #include <intrin.h>
+        #define FLUIDSIM_TARGET_AVX2
+        #define FLUIDSIM_TARGET_AVX512
+    #else
+        #define FLUIDSIM_TARGET_AVX2 __attribute__((target("avx2")))
+        #define FLUIDSIM_TARGET_AVX512 __attribute__((target("avx2,avx512f")))
+    #endif
+#else
+    #define FLUIDSIM_ADVECTION_X86 0
+#endif
+
+namespace ParticleAdvectionKernels {
+
+typedef void (*EvaluateFunction)(VelocityFieldData &, 
+                                 const float *, const float *, const float *, 
+                                 int, 
+                                 float *, float *, float *);
+
+static std::atomic<int> _instructionSet(-1);
+
+/********************************************************************************
+    Scalar
+********************************************************************************/
+
+static double _interpolateComponentScalar(const float *data, 
+                                          int isize, int jsize, int ksize, 
+                                          double x, double y, double z, 
+                                          double dx) {
+    int i, j, k;
+    double gx, gy, gz;
+    Grid3d::positionToGridIndex(x, y, z, dx, &i, &j, &k);
+    Grid3d::GridIndexToPosition(i, j, k, dx, &gx, &gy, &gz);
+
+    double inv_dx = 1 / dx;
+    double ix = (x - gx)*inv_dx;
+    double iy = (y - gy)*inv_dx;
+    double iz = (z - gz)*inv_dx;
+
+    int corners[8][3] = {
+        {0, 0, 0}, {1, 0, 0}, {0, 1, 0}, {0, 0, 1}, 
+        {1, 0, 1}, {0, 1, 1}, {1, 1, 0}, {1, 1, 1}
+    };
+
+    double points[8] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    for (int cidx = 0; cidx < 8; cidx++) {
+        int ci = i + corners[cidx][0];
+        int cj = j + corners[cidx][1];
+        int ck = k + corners[cidx][2];
+        if (Grid3d::isGridIndexInRange(ci, cj, ck, isize, jsize, ksize)) {
+            points[cidx] = data[ci + isize * (cj + jsize * ck)];
+        }
+    }
+
+    return Interpolation::trilinearInterpolate(points, ix, iy, iz);
+}
+
+static void _evaluateVelocityLinearScalar(VelocityFieldData &field, 
+                                          const float *px, const float *py, const float *pz, 
+                                          int n, 
+                                          float *vx, float *vy, float *vz) {
+    int isize = field.isize;
+    int jsize = field.jsize;
+    int ksize = field.ksize;
+    double dx = field.dx;
+    double hdx = 0.5*dx;
+    for (int i = 0; i < n; i++) {
+        double x = px[i];
+        double y = py[i];
+        double z = pz[i];
+        if (!Grid3d::isPositionInGrid(x, y, z, dx, isize, jsize, ksize)) {
+            vx[i] = 0.0f;
+            vy[i] = 0.0f;
+            vz[i] = 0.0f;
+            continue;
+        }
+
+        vx[i] = (float)_interpolateComponentScalar(field.u, isize + 1, jsize, ksize, 
+                                                   x, y - hdx, z - hdx, dx);
+        vy[i] = (float)_interpolateComponentScalar(field.v, isize, jsize + 1, ksize, 
+                                                   x - hdx, y, z - hdx, dx);
+        vz[i] = (float)_interpolateComponentScalar(field.w, isize, jsize, ksize + 1, 
+                                                   x - hdx, y - hdx, z, dx);
+    }
+}
+
+#if FLUIDSIM_ADVECTION_X86
+
+/********************************************************************************
+    AVX2
+********************************************************************************/
+
+// Lanes with a corner index outside of the grid gather a value of zero
+FLUIDSIM_TARGET_AVX2
+static inline __m256d _gatherCornerAVX2(const float *data, 
+                                        __m128i i, __m128i j, __m128i k,
+                                        __m128i isize, __m128i jsize, __m128i ksize) {
+    __m128i minusOne = _mm_set1_epi32(-1);
+    __m128i mask = _mm_and_si128(_mm_cmpgt_epi32(i, minusOne), _mm_cmplt_epi32(i, isize));
+    mask = _mm_and_si128(mask, _mm_and_si128(_mm_cmpgt_epi32(j, minusOne), _mm_cmplt_epi32(j, jsize)));
+    mask = _mm_and_si128(mask, _mm_and_si128(_mm_cmpgt_epi32(k, minusOne), _mm_cmplt_epi32(k, ksize)));
+    __m128i flat = _mm_add_epi32(i, _mm_mullo_epi32(isize, _mm_add_epi32(j, _mm_mullo_epi32(jsize, k))));
+    __m128 vals = _mm_mask_i32gather_ps(_mm_setzero_ps(), data, flat, _mm_castsi128_ps(mask), 4);
+    return _mm256_cvtps_pd(vals);
+}
+
+FLUIDSIM_TARGET_AVX2
+static inline __m256d _interpolateComponentAVX2(const float *data, 
+                                                int isize, int jsize, int ksize,
+                                                __m256d x, __m256d y, __m256d z, 
+                                                __m256d dx, __m256d invdx) {
+    __m256d fi = _mm256_floor_pd(_mm256_mul_pd(x, invdx));
+    __m256d fj = _mm256_floor_pd(_mm256_mul_pd(y, invdx));
+    __m256d fk = _mm256_floor_pd(_mm256_mul_pd(z, invdx));
+    __m128i i = _mm256_cvttpd_epi32(fi);
+    __m128i j = _mm256_cvttpd_epi32(fj);
+    __m128i k = _mm256_cvttpd_epi32(fk);
+
+    __m256d ix = _mm256_mul_pd(_mm256_sub_pd(x, _mm256_mul_pd(_mm256_cvtepi32_pd(i), dx)), invdx);
+    __m256d iy = _mm256_mul_pd(_mm256_sub_pd(y, _mm256_mul_pd(_mm256_cvtepi32_pd(j), dx)), invdx);
+    __m256d iz = _mm256_mul_pd(_mm256_sub_pd(z, _mm256_mul_pd(_mm256_cvtepi32_pd(k), dx)), invdx);
+
+    __m128i is = _mm_set1_epi32(isize);
+    __m128i js = _mm_set1_epi32(jsize);
+    __m128i ks = _mm_set1_epi32(ksize);
+    __m128i one = _mm_set1_epi32(1);
+    __m128i i1 = _mm_add_epi32(i, one);
+    __m128i j1 = _mm_add_epi32(j, one);
+    __m128i k1 = _mm_add_epi32(k, one);
+    __m256d p0 = _gatherCornerAVX2(data, i,  j,  k,  is, js, ks);
+    __m256d p1 = _gatherCornerAVX2(data, i1, j,  k,  is, js, ks);
+    __m256d p2 = _gatherCornerAVX2(data, i,  j1, k,  is, js, ks);
+    __m256d p3 = _gatherCornerAVX2(data, i,  j,  k1, is, js, ks);
+    __m256d p4 = _gatherCornerAVX2(data, i1, j,  k1, is, js, ks);
+    __m256d p5 = _gatherCornerAVX2(data, i,  j1, k1, is, js, ks);
+    __m256d p6 = _gatherCornerAVX2(data, i1, j1, k,  is, js, ks);
+    __m256d p7 = _gatherCornerAVX2(data, i1, j1, k1, is, js, ks);
+
+    // Same operation order as Interpolation::trilinearInterpolate
+    __m256d ones = _mm256_set1_pd(1.0);
+    __m256d nx = _mm256_sub_pd(ones, ix);
+    __m256d ny = _mm256_sub_pd(ones, iy);
+    __m256d nz = _mm256_sub_pd(ones, iz);
+    __m256d r =            _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(p0, nx), ny), nz);
+    r = _mm256_add_pd(r, _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(p1, ix), ny), nz));
+    r = _mm256_add_pd(r, _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(p2, nx), iy), nz));
+    r = _mm256_add_pd(r, _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(p3, nx), ny), iz));
+    r = _mm256_add_pd(r, _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(p4, ix), ny), iz));
+    r = _mm256_add_pd(r, _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(p5, nx), iy), iz));
+    r = _mm256_add_pd(r, _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(p6, ix), iy), nz));
+    r = _mm256_add_pd(r, _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(p7, ix), iy), iz));
+
+    return r;
+}
+
+FLUIDSIM_TARGET_AVX2
+static void _evaluateVelocityLinearAVX2(VelocityFieldData &field, 
+                                        const float *px, const float *py, const float *pz, 
+                                        int n, 
+                                        float *vx, float *vy, float *vz) {
+    const int width = 4;
+    int isize = field.isize;
+    int jsize = field.jsize;
+    int ksize = field.ksize;
+    __m256d dx = _mm256_set1_pd(field.dx);
+    __m256d invdx = _mm256_set1_pd(1.0 / field.dx);
+    __m256d hdx = _mm256_set1_pd(0.5*field.dx);
+    __m256d zero = _mm256_setzero_pd();
+    __m256d xmax = _mm256_set1_pd(field.dx*isize);
+    __m256d ymax = _mm256_set1_pd(field.dx*jsize);
+    __m256d zmax = _mm256_set1_pd(field.dx*ksize);
+
+    int i = 0;
+    for (; i + width <= n; i += width) {
+        __m256d x = _mm256_cvtps_pd(_mm_loadu_ps(px + i));
+        __m256d y = _mm256_cvtps_pd(_mm_loadu_ps(py + i));
+        __m256d z = _mm256_cvtps_pd(_mm_loadu_ps(pz + i));
+
+        __m256d inGrid = _mm256_and_pd(_mm256_cmp_pd(x, zero, _CMP_GE_OQ), _mm256_cmp_pd(x, xmax, _CMP_LT_OQ));
+        inGrid = _mm256_and_pd(inGrid, _mm256_and_pd(_mm256_cmp_pd(y, zero, _CMP_GE_OQ), _mm256_cmp_pd(y, ymax, _CMP_LT_OQ)));
+        inGrid = _mm256_and_pd(inGrid, _mm256_and_pd(_mm256_cmp_pd(z, zero, _CMP_GE_OQ), _mm256_cmp_pd(z, zmax, _CMP_LT_OQ)));
+
+        __m256d xh = _mm256_sub_pd(x, hdx);
+        __m256d yh = _mm256_sub_pd(y, hdx);
+        __m256d zh = _mm256_sub_pd(z, hdx);
+        __m256d u = _interpolateComponentAVX2(field.u, isize + 1, jsize, ksize, x, yh, zh, dx, invdx);
+        __m256d v = _interpolateComponentAVX2(field.v, isize, jsize + 1, ksize, xh, y, zh, dx, invdx);
+        __m256d w = _interpolateComponentAVX2(field.w, isize, jsize, ksize + 1, xh, yh, z, dx, invdx);
+
+        _mm_storeu_ps(vx + i, _mm256_cvtpd_ps(_mm256_and_pd(u, inGrid)));
+        _mm_storeu_ps(vy + i, _mm256_cvtpd_ps(_mm256_and_pd(v, inGrid)));
+        _mm_storeu_ps(vz + i, _mm256_cvtpd_ps(_mm256_and_pd(w, inGrid)));
+    }
+
+    _evaluateVelocityLinearScalar(field, px + i, py + i, pz + i, n - i, vx + i, vy + i, vz + i);
+}
+
+/********************************************************************************
+    AVX-512
+********************************************************************************/
+
+// The GCC AVX-512 conversion intrinsics start from _mm512_undefined values,
+// which triggers false positive uninitialized warnings
+#if defined(__GNUC__) && !defined(__clang__)
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+FLUIDSIM_TARGET_AVX512
+static inline __m512d _gatherCornerAVX512(const float *data, 
+                                          __m256i i, __m256i j, __m256i k,
+                                          __m256i isize, __m256i jsize, __m256i ksize) {
+    __m256i minusOne = _mm256_set1_epi32(-1);
+    __m256i mask = _mm256_and_si256(_mm256_cmpgt_epi32(i, minusOne), _mm256_cmpgt_epi32(isize, i));
+    mask = _mm256_and_si256(mask, _mm256_and_si256(_mm256_cmpgt_epi32(j, minusOne), _mm256_cmpgt_epi32(jsize, j)));
+    mask = _mm256_and_si256(mask, _mm256_and_si256(_mm256_cmpgt_epi32(k, minusOne), _mm256_cmpgt_epi32(ksize, k)));
+    __m256i flat = _mm256_add_epi32(i, _mm256_mullo_epi32(isize, _mm256_add_epi32(j, _mm256_mullo_epi32(jsize, k))));
+    __m256 vals = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), data, flat, _mm256_castsi256_ps(mask), 4);
+    return _mm512_cvtps_pd(vals);
+}
+
+FLUIDSIM_TARGET_AVX512
+static inline __m512d _interpolateComponentAVX512(const float *data, 
+                                                  int isize, int jsize, int ksize,
+                                                  __m512d x, __m512d y, __m512d z, 
+                                                  __m512d dx, __m512d invdx) {
+    const int floorMode = _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC;
+    __m512d fi = _mm512_roundscale_pd(_mm512_mul_pd(x, invdx), floorMode);
+    __m512d fj = _mm512_roundscale_pd(_mm512_mul_pd(y, invdx), floorMode);
+    __m512d fk = _mm512_roundscale_pd(_mm512_mul_pd(z, invdx), floorMode);
+    __m256i i = _mm512_cvttpd_epi32(fi);
+    __m256i j = _mm512_cvttpd_epi32(fj);
+    __m256i k = _mm512_cvttpd_epi32(fk);
+
+    __m512d ix = _mm512_mul_pd(_mm512_sub_pd(x, _mm512_mul_pd(_mm512_cvtepi32_pd(i), dx)), invdx);
+    __m512d iy = _mm512_mul_pd(_mm512_sub_pd(y, _mm512_mul_pd(_mm512_cvtepi32_pd(j), dx)), invdx);
+    __m512d iz = _mm512_mul_pd(_mm512_sub_pd(z, _mm512_mul_pd(_mm512_cvtepi32_pd(k), dx)), invdx);
+
+    __m256i is = _mm256_set1_epi32(isize);
+    __m256i js = _mm256_set1_epi32(jsize);
+    __m256i ks = _mm256_set1_epi32(ksize);
+    __m256i one = _mm256_set1_epi32(1);
+    __m256i i1 = _mm256_add_epi32(i, one);
+    __m256i j1 = _mm256_add_epi32(j, one);
+    __m256i k1 = _mm256_add_epi32(k, one);
+    __m512d p0 = _gatherCornerAVX512(data, i,  j,  k,  is, js, ks);
+    __m512d p1 = _gatherCornerAVX512(data, i1, j,  k,  is, js, ks);
+    __m512d p2 = _gatherCornerAVX512(data, i,  j1, k,  is, js, ks);
+    __m512d p3 = _gatherCornerAVX512(data, i,  j,  k1, is, js, ks);
+    __m512d p4 = _gatherCornerAVX512(data, i1, j,  k1, is, js, ks);
+    __m512d p5 = _gatherCornerAVX512(data, i,  j1, k1, is, js, ks);
+    __m512d p6 = _gatherCornerAVX512(data, i1, j1, k,  is, js, ks);
+    __m512d p7 = _gatherCornerAVX512(data, i1, j1, k1, is, js, ks);
+
+    // Same operation order as Interpolation::trilinearInterpolate
+    __m512d ones = _mm512_set1_pd(1.0);
+    __m512d nx = _mm512_sub_pd(ones, ix);
+    __m512d ny = _mm512_sub_pd(ones, iy);
+    __m512d nz = _mm512_sub_pd(ones, iz);
+    __m512d r =            _mm512_mul_pd(_mm512_mul_pd(_mm512_mul_pd(p0, nx), ny), nz);
+    r = _mm512_add_pd(r, _mm512_mul_pd(_mm512_mul_pd(_mm512_mul_pd(p1, ix), ny), nz));
+    r = _mm512_add_pd(r, _mm512_mul_pd(_mm512_mul_pd(_mm512_mul_pd(p2, nx), iy), nz));
+    r = _mm512_add_pd(r, _mm512_mul_pd(_mm512_mul_pd(_mm512_mul_pd(p3, nx), ny), iz));
+    r = _mm512_add_pd(r, _mm512_mul_pd(_mm512_mul_pd(_mm512_mul_pd(p4, ix), ny), iz));
+    r = _mm512_add_pd(r, _mm512_mul_pd(_mm512_mul_pd(_mm512_mul_pd(p5, nx), iy), iz));
+    r = _mm512_add_pd(r, _mm512_mul_pd(_mm512_mul_pd(_mm512_mul_pd(p6, ix), iy), nz));
+    r = _mm512_add_pd(r, _mm512_mul_pd(_mm512_mul_pd(_mm512_mul_pd(p7, ix), iy), iz));
+
+    return r;
+}
+
+FLUIDSIM_TARGET_AVX512
+static void _evaluateVelocityLinearAVX512(VelocityFieldData &field, 
+                                          const float *px, const float *py, const float *pz, 
+                                          int n, 
+                                          float *vx, float *vy, float *vz) {
+    const int width = 8;
+    int isize = field.isize;
+    int jsize = field.jsize;
+    int ksize = field.ksize;
+    __m512d dx = _mm512_set1_pd(field.dx);
+    __m512d invdx = _mm512_set1_pd(1.0 / field.dx);
+    __m512d hdx = _mm512_set1_pd(0.5*field.dx);
+    __m512d zero = _mm512_setzero_pd();
+    __m512d xmax = _mm512_set1_pd(field.dx*isize);
+    __m512d ymax = _mm512_set1_pd(field.dx*jsize);
+    __m512d zmax = _mm512_set1_pd(field.dx*ksize);
+
+    int i = 0;
+    for (; i + width <= n; i += width) {
+        __m512d x = _mm512_cvtps_pd(_mm256_loadu_ps(px + i));
+        __m512d y = _mm512_cvtps_pd(_mm256_loadu_ps(py + i));
+        __m512d z = _mm512_cvtps_pd(_mm256_loadu_ps(pz + i));
+
+        __mmask8 inGrid = _mm512_cmp_pd_mask(x, zero, _CMP_GE_OQ) & _mm512_cmp_pd_mask(x, xmax, _CMP_LT_OQ) &
+                          _mm512_cmp_pd_mask(y, zero, _CMP_GE_OQ) & _mm512_cmp_pd_mask(y, ymax, _CMP_LT_OQ) &
+                          _mm512_cmp_pd_mask(z, zero, _CMP_GE_OQ) & _mm512_cmp_pd_mask(z, zmax, _CMP_LT_OQ);
+
+        __m512d xh = _mm512_sub_pd(x, hdx);
+        __m512d yh = _mm512_sub_pd(y, hdx);
+        __m512d zh = _mm512_sub_pd(z, hdx);
+        __m512d u = _interpolateComponentAVX512(field.u, isize + 1, jsize, ksize, x, yh, zh, dx, invdx);
+        __m512d v = _interpolateComponentAVX512(field.v, isize, jsize + 1, ksize, xh, y, zh, dx, invdx);
+        __m512d w = _interpolateComponentAVX512(field.w, isize, jsize, ksize + 1, xh, yh, z, dx, invdx);
+
+        _mm256_storeu_ps(vx + i, _mm512_cvtpd_ps(_mm512_maskz_mov_pd(inGrid, u)));
+        _mm256_storeu_ps(vy + i, _mm512_cvtpd_ps(_mm512_maskz_mov_pd(inGrid, v)));
+        _mm256_storeu_ps(vz + i, _mm512_cvtpd_ps(_mm512_maskz_mov_pd(inGrid, w)));
+    }
+
+    _evaluateVelocityLinearScalar(field, px + i, py + i, pz + i, n - i, vx + i, vy + i, vz + i);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+    #pragma GCC diagnostic pop
+#endif
+
+/********************************************************************************
+    CPU Detection
+********************************************************************************/
+
+#if defined(_MSC_VER) && !defined(__clang__)
+
+static InstructionSet _detectInstructionSet() {
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    if (maxLeaf < 7) {
+        return InstructionSet::scalar;
+    }
+
+    __cpuid(info, 1);
+    bool isOSXSAVE = (info[2] & (1 << 27)) != 0;
+    bool isAVX = (info[2] & (1 << 28)) != 0;
+    if (!isOSXSAVE || !isAVX) {
+        return InstructionSet::scalar;
+    }
+
+    unsigned long long xcr0 = _xgetbv(0);
+    bool isYMMEnabled = (xcr0 & 0x06) == 0x06;
+    bool isZMMEnabled = (xcr0 & 0xe6) == 0xe6;
+
+    __cpuidex(info, 7, 0);
+    bool isAVX2 = (info[1] & (1 << 5)) != 0;
+    bool isAVX512F = (info[1] & (1 << 16)) != 0;
+    if (isAVX512F && isAVX2 && isZMMEnabled) {
+        return InstructionSet::avx512;
+    }
+    if (isAVX2 && isYMMEnabled) {
+        return InstructionSet::avx2;
+    }
+
+    return InstructionSet::scalar;
+}
+
+#else
+
+static InstructionSet _detectInstructionSet() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2")) {
+        return InstructionSet::avx512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return InstructionSet::avx2;
+    }
+
+    return InstructionSet::scalar;
+}
+
+#endif
+
+#else
+
+static InstructionSet _detectInstructionSet() {
+    return InstructionSet::scalar;
+}
+
+#endif
+
+/********************************************************************************
+    Dispatch
+********************************************************************************/
+
+InstructionSet getSupportedInstructionSet() {
+    static InstructionSet supportedInstructionSet = _detectInstructionSet();
+    return supportedInstructionSet;
+}
+
+InstructionSet getInstructionSet() {
+    int isa = _instructionSet.load();
+    if (isa == -1) {
+        return getSupportedInstructionSet();
+    }
+    return (InstructionSet)isa;
+}
+
+void setInstructionSet(InstructionSet isa) {
+    InstructionSet supported = getSupportedInstructionSet();
+    if ((int)isa > (int)supported) {
+        isa = supported;
+    }
+    _instructionSet.store((int)isa);
+}
+
+std::string getInstructionSetName(InstructionSet isa) {
+    if (isa == InstructionSet::avx512) {
+        return "AVX-512";
+    } else if (isa == InstructionSet::avx2) {
+        return "AVX2";
+    }
+    return "Scalar";
+}
+
+static EvaluateFunction _getEvaluateFunction() {
+    #if FLUIDSIM_ADVECTION_X86
+    InstructionSet isa = getInstructionSet();
+    if (isa == InstructionSet::avx512) {
+        return _evaluateVelocityLinearAVX512;
+    } else if (isa == InstructionSet::avx2) {
+        return _evaluateVelocityLinearAVX2;
+    }
+    #endif
+    return _evaluateVelocityLinearScalar;
+}
+
+void evaluateVelocityLinear(VelocityFieldData &field, 
+                            const float *px, const float *py, const float *pz, 
+                            int n, 
+                            float *vx, float *vy, float *vz) {
+    EvaluateFunction evaluate = _getEvaluateFunction();
+    evaluate(field, px, py, pz, n, vx, vy, vz);
+}
+
+void advectRK3(VelocityFieldData &field, double dt,
+               const float *px, const float *py, const float *pz, 
+               int n, 
+               float *outx, float *outy, float *outz) {
+    EvaluateFunction evaluate = _getEvaluateFunction();
+
+    // Same float arithmetic as p0 + (dt/9)*(2*k1 + 3*k2 + 4*k3) evaluated
+    // with vmath::vec3
+    float h1 = (float)(0.5*dt);
+    float h2 = (float)(0.75*dt);
+    float h3 = (float)(dt/9.0f);
+
+    float k1x[batchSize], k1y[batchSize], k1z[batchSize];
+    float k2x[batchSize], k2y[batchSize], k2z[batchSize];
+    float k3x[batchSize], k3y[batchSize], k3z[batchSize];
+    float tx[batchSize], ty[batchSize], tz[batchSize];
+    for (int batchStart = 0; batchStart < n; batchStart += batchSize) {
+        int count = std::min(batchSize, n - batchStart);
+        const float *bx = px + batchStart;
+        const float *by = py + batchStart;
+        const float *bz = pz + batchStart;
+
+        evaluate(field, bx, by, bz, count, k1x, k1y, k1z);
+        for (int i = 0; i < count; i++) {
+            tx[i] = bx[i] + h1 * k1x[i];
+            ty[i] = by[i] + h1 * k1y[i];
+            tz[i] = bz[i] + h1 * k1z[i];
+        }
+
+        evaluate(field, tx, ty, tz, count, k2x, k2y, k2z);
+        for (int i = 0; i < count; i++) {
+            tx[i] = bx[i] + h2 * k2x[i];
+            ty[i] = by[i] + h2 * k2y[i];
+            tz[i] = bz[i] + h2 * k2z[i];
+        }
+
+        evaluate(field, tx, ty, tz, count, k3x, k3y, k3z);
+        float *ox = outx + batchStart;
+        float *oy = outy + batchStart;
+        float *oz = outz + batchStart;
+        for (int i = 0; i < count; i++) {
+            ox[i] = bx[i] + h3 * (2.0f * k1x[i] + 3.0f * k2x[i] + 4.0f * k3x[i]);
+            oy[i] = by[i] + h3 * (2.0f * k1y[i] + 3.0f * k2y[i] + 4.0f * k3y[i]);
+            oz[i] = bz[i] + h3 * (2.0f * k1z[i] + 3.0f * k2z[i] + 4.0f * k3z[i]);
+        }
+    }
+}
+
+}
@@ -0,0 +1,94 @@
+/*
+MIT License
+
+Copyright (c) 2019 Ryan L. Guy
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef FLUIDENGINE_PARTICLEADVECTIONKERNELS_H
+#define FLUIDENGINE_PARTICLEADVECTIONKERNELS_H
+
+#include <string>
+
+/*
+    Batched particle advection through a MAC velocity field
+
+    Velocities are interpolated for several particles at once by gathering
+    directly from the raw U, V and W arrays. The widest instruction set 
+    supported by the CPU is selected at runtime: AVX-512 (8 particles), 
+    AVX2 (4 particles) or a scalar fallback. Interpolation is computed in 
+    double precision with the same operation order as 
+    MACVelocityField::evaluateVelocityAtPositionLinear so that every 
+    instruction set produces identical results.
+*/
+namespace ParticleAdvectionKernels {
+
+    enum class InstructionSet : char { 
+        scalar = 0x00, 
+        avx2   = 0x01,
+        avx512 = 0x02
+    };
+
+    struct VelocityFieldData {
+        float *u = nullptr;
+        float *v = nullptr;
+        float *w = nullptr;
+        int isize = 0;
+        int jsize = 0;
+        int ksize = 0;
+        double dx = 0.0;
+    };
+
+    // Number of particles evaluated per stage in advectRK3
+    const int batchSize = 256;
+
+    /*
+        The instruction set in use defaults to the widest set supported by
+        the CPU and operating system. Setting an unsupported instruction 
+        set selects the widest supported set below it.
+    */
+    InstructionSet getSupportedInstructionSet();
+    InstructionSet getInstructionSet();
+    void setInstructionSet(InstructionSet isa);
+    std::string getInstructionSetName(InstructionSet isa);
+
+    /*
+        Linearly interpolated velocity at n positions. Positions outside of
+        the grid evaluate to a velocity of zero.
+    */
+    void evaluateVelocityLinear(VelocityFieldData &field, 
+                                const float *px, const float *py, const float *pz, 
+                                int n, 
+                                float *vx, float *vy, float *vz);
+
+    /*
+        Advects n positions through the velocity field over a time step dt
+        with third order Runge-Kutta. Each stage is evaluated for a batch 
+        of positions before the next stage begins. The output arrays must 
+        not overlap the input arrays.
+    */
+    void advectRK3(VelocityFieldData &field, double dt,
+                   const float *px, const float *py, const float *pz, 
+                   int n, 
+                   float *outx, float *outy, float *outz);
+}
+
+#endif
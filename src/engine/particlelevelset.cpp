@@ -29,7 +29,7 @@ SOFTWARE.
 #include "polygonizer3d.h"
 #include "gridutils.h"
 #include "threadutils.h"
-#include "markerparticle.h"
+#include "markerparticlestore.h"
 #include "grid3d.h"
 #include "meshlevelset.h"
 #include "scalarfield.h"
@@ -158,15 +158,13 @@ float ParticleLevelSet::getDistanceAtNode(GridIndex g) {
     return getDistanceAtNode(g.i, g.j, g.k);
 }
 
-void ParticleLevelSet::calculateSignedDistanceField(FragmentedVector<MarkerParticle> &particles, 
-                                                    double radius) {
-    std::vector<vmath::vec3> points;
-    points.reserve(particles.size());
-    for (size_t i = 0; i < particles.size(); i++) {
-        points.push_back(particles[i].position);
-    }
+void ParticleLevelSet::setScatterMethod(ParticleScatterMethod method) {
+    _scatterMethod = method;
+}
 
-    _computeSignedDistanceFromParticles(points, radius);
+void ParticleLevelSet::calculateSignedDistanceField(MarkerParticleStore &particles, 
+                                                    double radius) {
+    _computeSignedDistanceFromParticles(particles, radius);
 }
 
 void ParticleLevelSet::postProcessSignedDistanceField(MeshLevelSet &solidPhi) {
@@ -232,7 +230,7 @@ void ParticleLevelSet::calculateCurvatureGrid(Array3d<float> &surfacePhi,
             }
         }
     }
-    GridUtils::featherGrid6(&validBlocks, ThreadUtils::getMaxThreadCount());
+    GridUtils::featherGrid6(&validBlocks);
 
     int numValid = 0;
     for (int k = 0; k < _ksize; k++) {
@@ -285,7 +283,7 @@ float ParticleLevelSet::_getMaxDistance() {
     return 3.0 * _dx;
 }
 
-void ParticleLevelSet::_computeSignedDistanceFromParticles(std::vector<vmath::vec3> &particles, 
+void ParticleLevelSet::_computeSignedDistanceFromParticles(MarkerParticleStore &particles, 
                                                            double radius) {
     _phi.fill(_getMaxDistance());
 
@@ -296,6 +294,15 @@ void ParticleLevelSet::_computeSignedDistanceFromParticles(std::vector<vmath::ve
     BlockArray3d<float> blockphi;
     _initializeBlockGrid(particles, blockphi);
 
+    // Footprints extend past the containing block by the search radius plus
+    // a cell of margin for rounding
+    int reach = (int)std::ceil(_searchRadiusFactor * radius / _dx) + 1;
+    int colorStride = ScatterUtils::getColorStride(reach, _blockwidth);
+    if (_scatterMethod == ParticleScatterMethod::colored && colorStride > 0) {
+        _computeExactBandColored(particles, radius, blockphi, colorStride);
+        return;
+    }
+
     ParticleGridCountData gridCountData;
     _computeGridCountData(particles, radius, blockphi, gridCountData);
 
@@ -336,21 +343,7 @@ void ParticleLevelSet::_computeSignedDistanceFromParticles(std::vector<vmath::ve
         std::vector<ComputeBlock> finishedBlocks;
         finishedComputeBlockQueue.popAll(finishedBlocks);
         for (size_t i = 0; i < finishedBlocks.size(); i++) {
-            ComputeBlock block = finishedBlocks[i];
-            GridIndex gridOffset(block.gridBlock.index.i * _blockwidth,
-                                 block.gridBlock.index.j * _blockwidth,
-                                 block.gridBlock.index.k * _blockwidth);
-
-            int datasize = _blockwidth * _blockwidth * _blockwidth;
-            for (int vidx = 0; vidx < datasize; vidx++) {
-                GridIndex localidx = Grid3d::getUnflattenedIndex(vidx, _blockwidth, _blockwidth);
-                GridIndex phiidx = GridIndex(localidx.i + gridOffset.i,
-                                             localidx.j + gridOffset.j,
-                                             localidx.k + gridOffset.k);
-                if (_phi.isIndexInRange(phiidx)) {
-                    _phi.set(phiidx, block.gridBlock.data[vidx]);
-                }
-            }
+            _applyBlockToPhi(finishedBlocks[i].gridBlock);
         }
 
         numComputeBlocksProcessed += finishedBlocks.size();
@@ -363,7 +356,131 @@ void ParticleLevelSet::_computeSignedDistanceFromParticles(std::vector<vmath::ve
     }
 }
 
-void ParticleLevelSet::_initializeBlockGrid(std::vector<vmath::vec3> &particles,
+void ParticleLevelSet::_computeExactBandColored(MarkerParticleStore &particles, 
+                                                double radius,
+                                                BlockArray3d<float> &blockphi, 
+                                                int colorStride) {
+    Dims3d blockdims = blockphi.blockdims;
+    int numBlocks = blockdims.i * blockdims.j * blockdims.k;
+    int numParticles = (int)particles.size();
+    float blockdx = _blockwidth * _dx;
+
+    std::vector<uint64_t> blockKeys(numParticles);
+    ThreadUtils::parallelFor(0, numParticles, [&](int startidx, int endidx) {
+        for (int i = startidx; i < endidx; i++) {
+            GridIndex b = Grid3d::positionToGridIndex(particles.getPosition(i), blockdx);
+            b.i = std::min(std::max(b.i, 0), blockdims.i - 1);
+            b.j = std::min(std::max(b.j, 0), blockdims.j - 1);
+            b.k = std::min(std::max(b.k, 0), blockdims.k - 1);
+            blockKeys[i] = Grid3d::getFlatIndex(b, blockdims.i, blockdims.j);
+        }
+    });
+
+    std::vector<int> order;
+    std::vector<int> blockStart;
+    ScatterUtils::sortPointsIntoBlocks(blockKeys, numBlocks, order, blockStart);
+    std::vector<uint64_t>().swap(blockKeys);
+
+    std::vector<vmath::vec3> particleData(numParticles);
+    ThreadUtils::parallelFor(0, numParticles, [&](int startidx, int endidx) {
+        for (int i = startidx; i < endidx; i++) {
+            particleData[i] = particles.getPosition(order[i]);
+        }
+    });
+
+    std::vector<std::vector<int> > colorGroups;
+    ScatterUtils::getBlockColorGroups(blockdims, blockStart, colorStride, colorGroups);
+
+    float r = radius;
+    float sr = _searchRadiusFactor * r;
+    ScatterUtils::parallelForEachColor(colorGroups, [&](int bidx) {
+        for (int pidx = blockStart[bidx]; pidx < blockStart[bidx + 1]; pidx++) {
+            // Same blocks as the queue method so that both methods produce
+            // identical fields
+            vmath::vec3 p = particleData[pidx];
+            GridIndex bmin = Grid3d::positionToGridIndex(p.x - sr, p.y - sr, p.z - sr, blockdx);
+            GridIndex bmax = Grid3d::positionToGridIndex(p.x + sr, p.y + sr, p.z + sr, blockdx);
+            bmin = GridIndex(std::max(bmin.i, 0), std::max(bmin.j, 0), std::max(bmin.k, 0));
+            bmax = GridIndex(std::min(bmax.i, blockdims.i - 1), 
+                             std::min(bmax.j, blockdims.j - 1), 
+                             std::min(bmax.k, blockdims.k - 1));
+
+            for (int bk = bmin.k; bk <= bmax.k; bk++) {
+                for (int bj = bmin.j; bj <= bmax.j; bj++) {
+                    for (int bi = bmin.i; bi <= bmax.i; bi++) {
+                        GridBlock<float> block = blockphi.getGridBlock(bi, bj, bk);
+                        if (block.id != -1) {
+                            _splatParticle(p, block, r);
+                        }
+                    }
+                }
+            }
+        }
+    });
+
+    // Blocks cover disjoint parts of the distance field
+    std::vector<GridBlock<float> > gridBlocks;
+    blockphi.getActiveGridBlocks(gridBlocks);
+    ThreadUtils::parallelFor(0, (int)gridBlocks.size(), 1, [&](int startidx, int endidx) {
+        for (int i = startidx; i < endidx; i++) {
+            _applyBlockToPhi(gridBlocks[i]);
+        }
+    });
+}
+
+/*
+    Lowers the distance of the block cells within the search radius of the
+    particle. Cells outside of the block are skipped.
+*/
+void ParticleLevelSet::_splatParticle(vmath::vec3 p, GridBlock<float> &block, float radius) {
+    float r = radius;
+    float sr = _searchRadiusFactor * r;
+    vmath::vec3 blockPositionOffset = Grid3d::GridIndexToPosition(block.index, _blockwidth * _dx);
+    p -= blockPositionOffset;
+
+    vmath::vec3 pmin(p.x - sr, p.y - sr, p.z - sr);
+    vmath::vec3 pmax(p.x + sr, p.y + sr, p.z + sr);
+    GridIndex gmin = Grid3d::positionToGridIndex(pmin, _dx);
+    GridIndex gmax = Grid3d::positionToGridIndex(pmax, _dx);
+    gmin.i = std::max(gmin.i, 0);
+    gmin.j = std::max(gmin.j, 0);
+    gmin.k = std::max(gmin.k, 0);
+    gmax.i = std::min(gmax.i, _blockwidth - 1);
+    gmax.j = std::min(gmax.j, _blockwidth - 1);
+    gmax.k = std::min(gmax.k, _blockwidth - 1);
+
+    for (int k = gmin.k; k <= gmax.k; k++) {
+        for (int j = gmin.j; j <= gmax.j; j++) {
+            for (int i = gmin.i; i <= gmax.i; i++) {
+                vmath::vec3 gpos = Grid3d::GridIndexToCellCenter(i, j, k, _dx);
+                float dist = vmath::length(gpos - p) - r;
+                int flatidx = Grid3d::getFlatIndex(i, j, k, _blockwidth, _blockwidth);
+                if (dist < block.data[flatidx]) {
+                     block.data[flatidx] = dist;
+                }
+            }
+        }
+    }
+}
+
+void ParticleLevelSet::_applyBlockToPhi(GridBlock<float> &block) {
+    GridIndex gridOffset(block.index.i * _blockwidth,
+                         block.index.j * _blockwidth,
+                         block.index.k * _blockwidth);
+
+    int datasize = _blockwidth * _blockwidth * _blockwidth;
+    for (int vidx = 0; vidx < datasize; vidx++) {
+        GridIndex localidx = Grid3d::getUnflattenedIndex(vidx, _blockwidth, _blockwidth);
+        GridIndex phiidx = GridIndex(localidx.i + gridOffset.i,
+                                     localidx.j + gridOffset.j,
+                                     localidx.k + gridOffset.k);
+        if (_phi.isIndexInRange(phiidx)) {
+            _phi.set(phiidx, block.data[vidx]);
+        }
+    }
+}
+
+void ParticleLevelSet::_initializeBlockGrid(MarkerParticleStore &particles,
                                             BlockArray3d<float> &blockphi) {
     BlockArray3dParameters params;
     params.isize = _isize;
@@ -374,21 +491,11 @@ void ParticleLevelSet::_initializeBlockGrid(std::vector<vmath::vec3> &particles,
 
     Array3d<bool> activeBlocks(dims.i, dims.j, dims.k, false);
 
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, particles.size());
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, particles.size(), numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&ParticleLevelSet::_initializeActiveBlocksThread, this,
-                                 intervals[i], intervals[i + 1], 
-                                 &particles, &activeBlocks);
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, particles.size(), [&](int startidx, int endidx) {
+        _initializeActiveBlocksThread(startidx, endidx, &particles, &activeBlocks);
+    });
 
-    GridUtils::featherGrid26(&activeBlocks, numthreads);
+    GridUtils::featherGrid26(&activeBlocks);
 
     for (int k = 0; k < dims.k; k++) {
         for (int j = 0; j < dims.j; j++) {
@@ -405,11 +512,11 @@ void ParticleLevelSet::_initializeBlockGrid(std::vector<vmath::vec3> &particles,
 }
 
 void ParticleLevelSet::_initializeActiveBlocksThread(int startidx, int endidx, 
-                                                     std::vector<vmath::vec3> *particles,
+                                                     MarkerParticleStore *particles,
                                                      Array3d<bool> *activeBlocks) {
     float blockdx = _blockwidth * _dx;
     for (int i = startidx; i < endidx; i++) {
-        vmath::vec3 p = particles->at(i);
+        vmath::vec3 p = particles->getPosition(i);
         GridIndex g = Grid3d::positionToGridIndex(p, blockdx);
         if (activeBlocks->isIndexInRange(g)) {
             activeBlocks->set(g, true);
@@ -417,7 +524,7 @@ void ParticleLevelSet::_initializeActiveBlocksThread(int startidx, int endidx,
     }
 }
 
-void ParticleLevelSet::_computeGridCountData(std::vector<vmath::vec3> &particles,
+void ParticleLevelSet::_computeGridCountData(MarkerParticleStore &particles,
                                              double radius,
                                              BlockArray3d<float> &blockphi, 
                                              ParticleGridCountData &countdata) {
@@ -425,20 +532,15 @@ void ParticleLevelSet::_computeGridCountData(std::vector<vmath::vec3> &particles
     _initializeGridCountData(particles, blockphi, countdata);
 
     int numthreads = countdata.numthreads;
-    std::vector<std::thread> threads(numthreads);
     std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, particles.size(), numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&ParticleLevelSet::_computeGridCountDataThread, this,
-                                 intervals[i], intervals[i + 1], 
-                                 &particles,
-                                 radius, 
-                                 &blockphi, 
-                                 &(countdata.threadGridCountData[i]));
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, numthreads, 1, [&](int tidx, int) {
+        _computeGridCountDataThread(intervals[tidx],
+                                    intervals[tidx + 1],
+                                    &particles,
+                                    radius,
+                                    &blockphi,
+                                    &(countdata.threadGridCountData[tidx]));
+    });
 
     for (int tidx = 0; tidx < countdata.numthreads; tidx++) {
         std::vector<int> *threadGridCount = &(countdata.threadGridCountData[tidx].gridCount);
@@ -448,7 +550,7 @@ void ParticleLevelSet::_computeGridCountData(std::vector<vmath::vec3> &particles
     }
 }
 
-void ParticleLevelSet::_initializeGridCountData(std::vector<vmath::vec3> &particles,
+void ParticleLevelSet::_initializeGridCountData(MarkerParticleStore &particles,
                                                 BlockArray3d<float> &blockphi, 
                                                 ParticleGridCountData &countdata) {
     int numCPU = ThreadUtils::getMaxThreadCount();
@@ -464,7 +566,7 @@ void ParticleLevelSet::_initializeGridCountData(std::vector<vmath::vec3> &partic
 }
 
 void ParticleLevelSet::_computeGridCountDataThread(int startidx, int endidx, 
-                                                   std::vector<vmath::vec3> *particles,
+                                                   MarkerParticleStore *particles,
                                                    double radius,
                                                    BlockArray3d<float> *blockphi, 
                                                    GridCountData *countdata) {
@@ -477,7 +579,7 @@ void ParticleLevelSet::_computeGridCountDataThread(int startidx, int endidx,
     float sr = _searchRadiusFactor * (float)radius;
     float blockdx = _blockwidth * _dx;
     for (int i = startidx; i < endidx; i++) {
-        vmath::vec3 p = particles->at(i);
+        vmath::vec3 p = particles->getPosition(i);
         GridIndex blockIndex = Grid3d::positionToGridIndex(p, blockdx);
         vmath::vec3 blockPosition = Grid3d::GridIndexToPosition(blockIndex, blockdx);
 
@@ -521,7 +623,7 @@ void ParticleLevelSet::_computeGridCountDataThread(int startidx, int endidx,
     }
 }
 
-void ParticleLevelSet::_sortParticlesIntoBlocks(std::vector<vmath::vec3> &particles,
+void ParticleLevelSet::_sortParticlesIntoBlocks(MarkerParticleStore &particles,
                                                 ParticleGridCountData &countdata, 
                                                 std::vector<vmath::vec3> &sortedParticleData, 
                                                 std::vector<int> &blockToParticleIndex) {
@@ -546,7 +648,7 @@ void ParticleLevelSet::_sortParticlesIntoBlocks(std::vector<vmath::vec3> &partic
                 continue;
             }
 
-            vmath::vec3 p = particles[i + indexOffset];
+            vmath::vec3 p = particles.getPosition(i + indexOffset);
             if (countData->simpleGridIndices[i] >= 0) {
                 int blockid = countData->simpleGridIndices[i];
                 int sortedIndex = blockToParticleIndexCurrent[blockid];
@@ -579,38 +681,8 @@ void ParticleLevelSet::_computeExactBandProducerThread(BoundedBuffer<ComputeBloc
 
         for (size_t bidx = 0; bidx < computeBlocks.size(); bidx++) {
             ComputeBlock block = computeBlocks[bidx];
-            float r = block.radius;
-            float sr = _searchRadiusFactor * r;
-            GridIndex blockIndex = block.gridBlock.index;
-            vmath::vec3 blockPositionOffset = Grid3d::GridIndexToPosition(blockIndex, _blockwidth * _dx);
-
             for (int pidx = 0; pidx < block.numParticles; pidx++) {
-                vmath::vec3 p = block.particleData[pidx];
-                p -= blockPositionOffset;
-
-                vmath::vec3 pmin(p.x - sr, p.y - sr, p.z - sr);
-                vmath::vec3 pmax(p.x + sr, p.y + sr, p.z + sr);
-                GridIndex gmin = Grid3d::positionToGridIndex(pmin, _dx);
-                GridIndex gmax = Grid3d::positionToGridIndex(pmax, _dx);
-                gmin.i = std::max(gmin.i, 0);
-                gmin.j = std::max(gmin.j, 0);
-                gmin.k = std::max(gmin.k, 0);
-                gmax.i = std::min(gmax.i, _blockwidth - 1);
-                gmax.j = std::min(gmax.j, _blockwidth - 1);
-                gmax.k = std::min(gmax.k, _blockwidth - 1);
-
-                for (int k = gmin.k; k <= gmax.k; k++) {
-                    for (int j = gmin.j; j <= gmax.j; j++) {
-                        for (int i = gmin.i; i <= gmax.i; i++) {
-                            vmath::vec3 gpos = Grid3d::GridIndexToCellCenter(i, j, k, _dx);
-                            float dist = vmath::length(gpos - p) - r;
-                            int flatidx = Grid3d::getFlatIndex(i, j, k, _blockwidth, _blockwidth);
-                            if (dist < block.gridBlock.data[flatidx]) {
-                                 block.gridBlock.data[flatidx] = dist;
-                            }
-                        }
-                    }
-                }
+                _splatParticle(block.particleData[pidx], block.gridBlock, block.radius);
             }
 
             finishedComputeBlockQueue->push(block);
@@ -620,18 +692,9 @@ void ParticleLevelSet::_computeExactBandProducerThread(BoundedBuffer<ComputeBloc
 
 void ParticleLevelSet::_initializeCurvatureGridScalarField(ScalarField &field) {
     int gridsize = (_isize + 1) * (_jsize + 1) * (_ksize + 1);
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, gridsize);
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, gridsize, numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&ParticleLevelSet::_initializeCurvatureGridScalarFieldThread, this,
-                                 intervals[i], intervals[i + 1], &field);
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, gridsize, [&](int startidx, int endidx) {
+        _initializeCurvatureGridScalarFieldThread(startidx, endidx, &field);
+    });
 }
 
 void ParticleLevelSet::_initializeCurvatureGridScalarFieldThread(int startidx, int endidx, 
@@ -36,10 +36,11 @@ SOFTWARE.
 #include "vmath.h"
 #include "blockarray3d.h"
 #include "boundedbuffer.h"
+#include "scatterutils.h"
 
 class MeshLevelSet;
 class ScalarField;
-struct MarkerParticle;
+class MarkerParticleStore;
 
 class ParticleLevelSet {
 
@@ -63,8 +64,9 @@ public:
     float getDistanceAtNode(int i, int j, int k);
     float getDistanceAtNode(GridIndex g);
 
-    void calculateSignedDistanceField(FragmentedVector<MarkerParticle> &particles, 
+    void calculateSignedDistanceField(MarkerParticleStore &particles, 
                                       double radius);
+    void setScatterMethod(ParticleScatterMethod method);
     void postProcessSignedDistanceField(MeshLevelSet &solidPhi);
     void calculateCurvatureGrid(Array3d<float> &surfacePhi, Array3d<float> &kgrid);
 
@@ -95,31 +97,35 @@ private:
 
     float _getMaxDistance();
 
-    void _computeSignedDistanceFromParticles(std::vector<vmath::vec3> &particles, 
+    void _computeSignedDistanceFromParticles(MarkerParticleStore &particles, 
                                              double radius);
-    void _initializeBlockGrid(std::vector<vmath::vec3> &particles,
+    void _initializeBlockGrid(MarkerParticleStore &particles,
                               BlockArray3d<float> &blockphi);
     void _initializeActiveBlocksThread(int startidx, int endidx, 
-                                       std::vector<vmath::vec3> *particles,
+                                       MarkerParticleStore *particles,
                                        Array3d<bool> *activeBlocks);
-    void _computeGridCountData(std::vector<vmath::vec3> &particles,
+    void _computeGridCountData(MarkerParticleStore &particles,
                                double radius,
                                BlockArray3d<float> &blockphi, 
                                ParticleGridCountData &countdata);
-    void _initializeGridCountData(std::vector<vmath::vec3> &particles,
+    void _initializeGridCountData(MarkerParticleStore &particles,
                                   BlockArray3d<float> &blockphi, 
                                   ParticleGridCountData &countdata);
     void _computeGridCountDataThread(int startidx, int endidx, 
-                                     std::vector<vmath::vec3> *particles,
+                                     MarkerParticleStore *particles,
                                      double radius,
                                      BlockArray3d<float> *blockphi, 
                                      GridCountData *countdata);
-    void _sortParticlesIntoBlocks(std::vector<vmath::vec3> &particles,
+    void _sortParticlesIntoBlocks(MarkerParticleStore &particles,
                                   ParticleGridCountData &countdata, 
                                   std::vector<vmath::vec3> &sortedParticleData, 
                                   std::vector<int> &blockToParticleDataIndex);
     void _computeExactBandProducerThread(BoundedBuffer<ComputeBlock> *computeBlockQueue,
                                          BoundedBuffer<ComputeBlock> *finishedComputeBlockQueue);
+    void _computeExactBandColored(MarkerParticleStore &particles, double radius,
+                                  BlockArray3d<float> &blockphi, int colorStride);
+    void _splatParticle(vmath::vec3 p, GridBlock<float> &block, float radius);
+    void _applyBlockToPhi(GridBlock<float> &block);
 
     void _initializeCurvatureGridScalarField(ScalarField &field);
     void _initializeCurvatureGridScalarFieldThread(int startidx, int endidx, 
@@ -139,6 +145,7 @@ private:
     int _blockwidth = 10;
     int _numComputeBlocksPerJob = 10;
     float _searchRadiusFactor = 2.0f;
+    ParticleScatterMethod _scatterMethod = ParticleScatterMethod::queue;
 };
 
 #endif
@@ -28,12 +28,14 @@ SOFTWARE.
 #include "polygonizer3d.h"
 #include "threadutils.h"
 #include "gridutils.h"
+#include "profiler.h"
 
 
 ParticleMesher::ParticleMesher() {
 }
 
 TriangleMesh ParticleMesher::meshParticles(ParticleMesherParameters params) {
+    FLUIDSIM_PROFILE_SCOPE("Mesh Particles");
     _initialize(params);
 
     MesherComputeChunkData data;
@@ -76,6 +78,7 @@ void ParticleMesher::_initialize(ParticleMesherParameters params) {
     _subdivisions = params.subdivisions;
     _computechunks = params.computechunks;
     _radius = params.radius;
+    _scatterMethod = params.scatterMethod;
 
     _isPreviewMesherEnabled = params.isPreviewMesherEnabled;
     if (_isPreviewMesherEnabled) {
@@ -133,8 +136,7 @@ void ParticleMesher::_initializeComputeChunkDataActiveBlocks(MesherComputeChunkD
         data.activeBlocks.set(g, true);
     }
 
-    int numthreads = ThreadUtils::getMaxThreadCount();
-    GridUtils::featherGrid26(&(data.activeBlocks), numthreads);
+    GridUtils::featherGrid26(&(data.activeBlocks));
 }
 
 void ParticleMesher::_initializeComputeChunkDataComputeChunks(MesherComputeChunkData &data) {
@@ -278,6 +280,7 @@ void ParticleMesher::_initializeComputeChunkDataComputeChunks(MesherComputeChunk
 
 TriangleMesh ParticleMesher::_polygonizeComputeChunk(MesherComputeChunk chunk, 
                                                      MesherComputeChunkData &data) {
+    FLUIDSIM_PROFILE_SCOPE("Polygonize Compute Chunk");
     
     ScalarFieldData fieldData;
     _initializeScalarFieldData(chunk, data, fieldData);
@@ -358,6 +361,17 @@ float ParticleMesher::_getMaxDistanceValue() {
 }
 
 void ParticleMesher::_computeScalarField(ScalarFieldData &fieldData) {
+    FLUIDSIM_PROFILE_SCOPE("Compute Scalar Field");
+
+    // Footprints extend past the containing block by the search radius, the
+    // extra node on the upper side and a node of margin for rounding
+    int reach = (int)std::ceil(_searchRadiusFactor * _radius / _subdx) + 2;
+    int colorStride = ScatterUtils::getColorStride(reach, _blockwidth);
+    if (_scatterMethod == ParticleScatterMethod::colored && colorStride > 0) {
+        _computeScalarFieldColored(fieldData, colorStride);
+        return;
+    }
+
     ParticleGridCountData gridCountData;
     _computeGridCountData(fieldData, gridCountData);
 
@@ -399,21 +413,7 @@ void ParticleMesher::_computeScalarField(ScalarFieldData &fieldData) {
         std::vector<ComputeBlock> finishedBlocks;
         finishedComputeBlockQueue.popAll(finishedBlocks);
         for (size_t i = 0; i < finishedBlocks.size(); i++) {
-            ComputeBlock block = finishedBlocks[i];
-            GridIndex gridOffset(block.gridBlock.index.i * _blockwidth,
-                                 block.gridBlock.index.j * _blockwidth,
-                                 block.gridBlock.index.k * _blockwidth);
-
-            int datasize = _blockwidth * _blockwidth * _blockwidth;
-            for (int vidx = 0; vidx < datasize; vidx++) {
-                GridIndex localidx = Grid3d::getUnflattenedIndex(vidx, _blockwidth, _blockwidth);
-                GridIndex fieldidx = GridIndex(localidx.i + gridOffset.i,
-                                               localidx.j + gridOffset.j,
-                                               localidx.k + gridOffset.k);
-                if (fieldValues->isIndexInRange(fieldidx)) {
-                    fieldValues->set(fieldidx, block.gridBlock.data[vidx]);
-                }
-            }
+            _applyBlockToScalarField(finishedBlocks[i].gridBlock, fieldValues);
         }
 
         numComputeBlocksProcessed += finishedBlocks.size();
@@ -444,17 +444,13 @@ void ParticleMesher::_computeGridCountData(ScalarFieldData &fieldData,
     _initializeGridCountData(fieldData, gridCountData);
 
     int numthreads = gridCountData.numthreads;
-    std::vector<std::thread> threads(numthreads);
     std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, fieldData.particles.size(), numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&ParticleMesher::_computeGridCountDataThread, this,
-                                 intervals[i], intervals[i + 1], &fieldData, 
-                                 &(gridCountData.threadGridCountData[i]));
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, numthreads, 1, [&](int tidx, int) {
+        _computeGridCountDataThread(intervals[tidx],
+                                    intervals[tidx + 1],
+                                    &fieldData,
+                                    &(gridCountData.threadGridCountData[tidx]));
+    });
 
     for (int tidx = 0; tidx < gridCountData.numthreads; tidx++) {
         std::vector<int> *threadGridCount = &(gridCountData.threadGridCountData[tidx].gridCount);
@@ -582,10 +578,8 @@ void ParticleMesher::_sortParticlesIntoBlocks(ScalarFieldData &fieldData,
 
 void ParticleMesher::_scalarFieldProducerThread(BoundedBuffer<ComputeBlock> *computeBlockQueue,
                                                 BoundedBuffer<ComputeBlock> *finishedComputeBlockQueue) {
+    Profiler::setThreadName("Scalar Field Worker");
     
-    float r = _radius;
-    float sr = _searchRadiusFactor * r;
-
     while (computeBlockQueue->size() > 0) {
         std::vector<ComputeBlock> computeBlocks;
         int numBlocks = computeBlockQueue->pop(_numComputeBlocksPerJob, computeBlocks);
@@ -593,43 +587,147 @@ void ParticleMesher::_scalarFieldProducerThread(BoundedBuffer<ComputeBlock> *com
             continue;
         }
 
+        FLUIDSIM_PROFILE_SCOPE("Scalar Field Blocks");
+
         for (size_t bidx = 0; bidx < computeBlocks.size(); bidx++) {
             ComputeBlock block = computeBlocks[bidx];
-            GridIndex blockIndex = block.gridBlock.index;
-            vmath::vec3 blockPositionOffset = Grid3d::GridIndexToPosition(blockIndex, _blockwidth * _subdx);
-
             for (int pidx = 0; pidx < block.numParticles; pidx++) {
-                vmath::vec3 p = block.particleData[pidx];
-                p -= blockPositionOffset;
-
-                vmath::vec3 pmin(p.x - sr, p.y - sr, p.z - sr);
-                vmath::vec3 pmax(p.x + sr, p.y + sr, p.z + sr);
-                GridIndex gmin = Grid3d::positionToGridIndex(pmin, _subdx);
-                GridIndex gmax = Grid3d::positionToGridIndex(pmax, _subdx);
-                gmax.i++;
-                gmax.j++;
-                gmax.k++;
-
-                for (int k = gmin.k; k <= gmax.k; k++) {
-                    for (int j = gmin.j; j <= gmax.j; j++) {
-                        for (int i = gmin.i; i <= gmax.i; i++) {
-                            if (i < 0 || j < 0 || k < 0 ||
-                                    i >= _blockwidth || j >= _blockwidth || k >= _blockwidth) {
-                                continue;
-                            }
-
-                            vmath::vec3 gpos = Grid3d::GridIndexToPosition(i, j, k, _subdx);
-                            float dist = vmath::length(gpos - p) - r;
-                            int flatidx = Grid3d::getFlatIndex(i, j, k, _blockwidth, _blockwidth);
-                            if (dist < block.gridBlock.data[flatidx]) {
-                                 block.gridBlock.data[flatidx] = dist;
-                            }
+                _splatParticle(block.particleData[pidx], block.gridBlock);
+            }
+
+            finishedComputeBlockQueue->push(block);
+        }
+    }
+}
+
+void ParticleMesher::_computeScalarFieldColored(ScalarFieldData &fieldData, int colorStride) {
+    BlockArray3d<float> *scalarField = &(fieldData.scalarField);
+    Dims3d blockdims = scalarField->blockdims;
+    int numBlocks = blockdims.i * blockdims.j * blockdims.k;
+    int numParticles = (int)fieldData.particles.size();
+    float blockdx = _blockwidth * _subdx;
+
+    std::vector<uint64_t> blockKeys(numParticles);
+    ThreadUtils::parallelFor(0, numParticles, [&](int startidx, int endidx) {
+        for (int i = startidx; i < endidx; i++) {
+            GridIndex b = Grid3d::positionToGridIndex(fieldData.particles[i], blockdx);
+            b.i = std::min(std::max(b.i, 0), blockdims.i - 1);
+            b.j = std::min(std::max(b.j, 0), blockdims.j - 1);
+            b.k = std::min(std::max(b.k, 0), blockdims.k - 1);
+            blockKeys[i] = Grid3d::getFlatIndex(b, blockdims.i, blockdims.j);
+        }
+    });
+
+    std::vector<int> order;
+    std::vector<int> blockStart;
+    ScatterUtils::sortPointsIntoBlocks(blockKeys, numBlocks, order, blockStart);
+    std::vector<uint64_t>().swap(blockKeys);
+
+    std::vector<std::vector<int> > colorGroups;
+    ScatterUtils::getBlockColorGroups(blockdims, blockStart, colorStride, colorGroups);
+
+    float sr = _searchRadiusFactor * (float)_radius;
+    ScatterUtils::parallelForEachColor(colorGroups, [&](int bidx) {
+        FLUIDSIM_PROFILE_SCOPE("Scalar Field Blocks");
+
+        for (int pidx = blockStart[bidx]; pidx < blockStart[bidx + 1]; pidx++) {
+            // Same blocks as the queue method so that both methods produce
+            // identical fields
+            vmath::vec3 p = fieldData.particles[order[pidx]];
+            GridIndex bmin = Grid3d::positionToGridIndex(p.x - sr, p.y - sr, p.z - sr, blockdx);
+            GridIndex bmax = Grid3d::positionToGridIndex(p.x + sr, p.y + sr, p.z + sr, blockdx);
+            bmin = GridIndex(std::max(bmin.i, 0), std::max(bmin.j, 0), std::max(bmin.k, 0));
+            bmax = GridIndex(std::min(bmax.i, blockdims.i - 1), 
+                             std::min(bmax.j, blockdims.j - 1), 
+                             std::min(bmax.k, blockdims.k - 1));
+
+            for (int bk = bmin.k; bk <= bmax.k; bk++) {
+                for (int bj = bmin.j; bj <= bmax.j; bj++) {
+                    for (int bi = bmin.i; bi <= bmax.i; bi++) {
+                        GridBlock<float> block = scalarField->getGridBlock(bi, bj, bk);
+                        if (block.id != -1) {
+                            _splatParticle(p, block);
                         }
                     }
                 }
             }
+        }
+    });
 
-            finishedComputeBlockQueue->push(block);
+    // Blocks cover disjoint parts of the scalar field
+    Array3d<float>* fieldValues = fieldData.fieldValues.getPointerToScalarField();
+    std::vector<GridBlock<float> > gridBlocks;
+    scalarField->getActiveGridBlocks(gridBlocks);
+    ThreadUtils::parallelFor(0, (int)gridBlocks.size(), 1, [&](int startidx, int endidx) {
+        for (int i = startidx; i < endidx; i++) {
+            _applyBlockToScalarField(gridBlocks[i], fieldValues);
+        }
+    });
+
+    for (int k = 0; k < fieldValues->depth; k++) {
+        for (int j = 0; j < fieldValues->height; j++) {
+            for (int i = 0; i < fieldValues->width; i++) {
+                fieldValues->set(i, j, k, -fieldValues->get(i, j, k));
+            }
+        }
+    }
+
+    if (_isPreviewMesherEnabled) {
+        _addComputeChunkScalarFieldToPreviewField(fieldData);
+    }
+}
+
+/*
+    Lowers the distance of the block nodes within the search radius of the
+    particle. Nodes outside of the block are skipped.
+*/
+void ParticleMesher::_splatParticle(vmath::vec3 p, GridBlock<float> &block) {
+    float r = _radius;
+    float sr = _searchRadiusFactor * r;
+    vmath::vec3 blockPositionOffset = Grid3d::GridIndexToPosition(block.index, _blockwidth * _subdx);
+    p -= blockPositionOffset;
+
+    vmath::vec3 pmin(p.x - sr, p.y - sr, p.z - sr);
+    vmath::vec3 pmax(p.x + sr, p.y + sr, p.z + sr);
+    GridIndex gmin = Grid3d::positionToGridIndex(pmin, _subdx);
+    GridIndex gmax = Grid3d::positionToGridIndex(pmax, _subdx);
+    gmax.i++;
+    gmax.j++;
+    gmax.k++;
+
+    for (int k = gmin.k; k <= gmax.k; k++) {
+        for (int j = gmin.j; j <= gmax.j; j++) {
+            for (int i = gmin.i; i <= gmax.i; i++) {
+                if (i < 0 || j < 0 || k < 0 ||
+                        i >= _blockwidth || j >= _blockwidth || k >= _blockwidth) {
+                    continue;
+                }
+
+                vmath::vec3 gpos = Grid3d::GridIndexToPosition(i, j, k, _subdx);
+                float dist = vmath::length(gpos - p) - r;
+                int flatidx = Grid3d::getFlatIndex(i, j, k, _blockwidth, _blockwidth);
+                if (dist < block.data[flatidx]) {
+                     block.data[flatidx] = dist;
+                }
+            }
+        }
+    }
+}
+
+void ParticleMesher::_applyBlockToScalarField(GridBlock<float> &block, 
+                                              Array3d<float> *fieldValues) {
+    GridIndex gridOffset(block.index.i * _blockwidth,
+                         block.index.j * _blockwidth,
+                         block.index.k * _blockwidth);
+
+    int datasize = _blockwidth * _blockwidth * _blockwidth;
+    for (int vidx = 0; vidx < datasize; vidx++) {
+        GridIndex localidx = Grid3d::getUnflattenedIndex(vidx, _blockwidth, _blockwidth);
+        GridIndex fieldidx = GridIndex(localidx.i + gridOffset.i,
+                                       localidx.j + gridOffset.j,
+                                       localidx.k + gridOffset.k);
+        if (fieldValues->isIndexInRange(fieldidx)) {
+            fieldValues->set(fieldidx, block.data[vidx]);
         }
     }
 }
@@ -32,6 +32,7 @@ SOFTWARE.
 #include "blockarray3d.h"
 #include "scalarfield.h"
 #include "boundedbuffer.h"
+#include "scatterutils.h"
 
 class TriangleMesh;
 class MeshLevelSet;
@@ -48,6 +49,8 @@ struct ParticleMesherParameters {
 
     bool isPreviewMesherEnabled = false;
     double previewdx = 0.0;
+
+    ParticleScatterMethod scatterMethod = ParticleScatterMethod::queue;
     
     std::vector<vmath::vec3> *particles;
     MeshLevelSet *solidSDF;
@@ -152,6 +155,9 @@ private:
                                   std::vector<int> &blockToParticleIndex);
     void _scalarFieldProducerThread(BoundedBuffer<ComputeBlock> *computeBlockQueue,
                                     BoundedBuffer<ComputeBlock> *finishedComputeBlockQueue);
+    void _computeScalarFieldColored(ScalarFieldData &fieldData, int colorStride);
+    void _splatParticle(vmath::vec3 p, GridBlock<float> &block);
+    void _applyBlockToScalarField(GridBlock<float> &block, Array3d<float> *fieldValues);
 
     void _setScalarFieldSolidBorders(ScalarField &field);
     void _addComputeChunkScalarFieldToPreviewField(ScalarFieldData &fieldData);
@@ -175,6 +181,7 @@ private:
     int _subdivisions = 1;
     int _computechunks = 1;
     double _radius = 0.0;
+    ParticleScatterMethod _scatterMethod = ParticleScatterMethod::queue;
 
     bool _isPreviewMesherEnabled = false;
     int _pisize = 0;
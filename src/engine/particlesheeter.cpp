@@ -86,7 +86,7 @@ void ParticleSheeter::_initializeParameters(ParticleSheeterParameters params) {
 
 void ParticleSheeter::_getMarkerParticleCellCounts(Array3d<unsigned char> &countGrid) {
     for (size_t i = 0; i < _particles->size(); i++) {
-        vmath::vec3 p = _particles->at(i).position;
+        vmath::vec3 p = _particles->getPosition(i);
         GridIndex g = Grid3d::positionToGridIndex(p, _dx);
         if ((int)(countGrid(g)) == 255) {
             continue;
@@ -97,18 +97,16 @@ void ParticleSheeter::_getMarkerParticleCellCounts(Array3d<unsigned char> &count
 
 void ParticleSheeter::_identifySheetParticlesPhase1(Array3d<unsigned char> &countGrid, 
                                                     std::vector<vmath::vec3> &sheetParticles) {
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, _particles->size());
-    std::vector<std::vector<vmath::vec3> > threadResults(numthreads);
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, _particles->size(), numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&ParticleSheeter::_identifySheetParticlesPhase1Thread, this,
-                                 intervals[i], intervals[i + 1], &countGrid, &(threadResults[i]));
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
+    int grainsize = ThreadUtils::getGrainSize(0, _particles->size(), 0);
+    int numchunks = ThreadUtils::getNumChunks(0, _particles->size(), grainsize);
+    std::vector<std::vector<vmath::vec3> > threadResults(numchunks);
+    ThreadUtils::parallelFor(0, _particles->size(), grainsize, [&](int startidx, int endidx) {
+        _identifySheetParticlesPhase1Thread(startidx, endidx,
+                                            &countGrid,
+                                            &(threadResults[startidx / grainsize]));
+    });
+
+    for (int i = 0; i < numchunks; i++) {
         sheetParticles.insert(sheetParticles.end(), threadResults[i].begin(), threadResults[i].end());
     }
 }
@@ -123,7 +121,7 @@ void ParticleSheeter::_identifySheetParticlesPhase1Thread(int startidx, int endi
     vmath::vec3 hdx(0.5*_dx, 0.5*_dx, 0.5*_dx);
 
     for (int i = startidx; i < endidx; i++) {
-        vmath::vec3 p = _particles->at(i).position;
+        vmath::vec3 p = _particles->getPosition(i);
         GridIndex g = Grid3d::positionToGridIndex(p, _dx);
         if ((int)(countGrid->get(g)) >= _maxParticlesPerCell) {
             // too dense to be a sheet that needs reseeding
@@ -171,21 +169,12 @@ void ParticleSheeter::_identifySheetParticlesPhase1Thread(int startidx, int endi
 void ParticleSheeter::_getSheetCells(std::vector<vmath::vec3> &sheetParticles, 
                                      Array3d<bool> &sheetCells) {
 
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, sheetParticles.size());
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, sheetParticles.size(), numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&ParticleSheeter::_getSheetCellsThread, this,
-                                 intervals[i], intervals[i + 1], &sheetParticles, &sheetCells);
-    }
+    ThreadUtils::parallelFor(0, sheetParticles.size(), [&](int startidx, int endidx) {
+        _getSheetCellsThread(startidx, endidx, &sheetParticles, &sheetCells);
+    });
 
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
-
-    GridUtils::featherGrid6(&sheetCells, ThreadUtils::getMaxThreadCount());
-    GridUtils::featherGrid6(&sheetCells, ThreadUtils::getMaxThreadCount());
+    GridUtils::featherGrid6(&sheetCells);
+    GridUtils::featherGrid6(&sheetCells);
 
     int buffer = 3;
     for (int k = 0; k < sheetCells.depth; k++) {
@@ -214,22 +203,18 @@ void ParticleSheeter::_getSheetCellsThread(int startidx, int endidx,
 void ParticleSheeter::_identifySheetParticlesPhase2(Array3d<bool> &sheetCells,
                                                     Array3d<unsigned char> &countGrid, 
                                                     std::vector<vmath::vec3> &sheetParticles) {
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, _particles->size());
-    std::vector<std::vector<vmath::vec3> > threadResults(numthreads);
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, _particles->size(), numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&ParticleSheeter::_identifySheetParticlesPhase2Thread, this,
-                                 intervals[i], intervals[i + 1], &sheetCells, &countGrid, &(threadResults[i]));
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    int grainsize = ThreadUtils::getGrainSize(0, _particles->size(), 0);
+    int numchunks = ThreadUtils::getNumChunks(0, _particles->size(), grainsize);
+    std::vector<std::vector<vmath::vec3> > threadResults(numchunks);
+    ThreadUtils::parallelFor(0, _particles->size(), grainsize, [&](int startidx, int endidx) {
+        _identifySheetParticlesPhase2Thread(startidx, endidx,
+                                            &sheetCells,
+                                            &countGrid,
+                                            &(threadResults[startidx / grainsize]));
+    });
 
     countGrid.fill((unsigned char)0);
-    for (int i = 0; i < numthreads; i++) {
+    for (int i = 0; i < numchunks; i++) {
         for (size_t j = 0; j < threadResults[i].size(); j++) {
             vmath::vec3 p = threadResults[i][j];
             GridIndex g = Grid3d::positionToGridIndex(p, _dx);
@@ -250,7 +235,7 @@ void ParticleSheeter::_identifySheetParticlesPhase2Thread(int startidx, int endi
     vmath::vec3 hdx(0.5*_dx, 0.5*_dx, 0.5*_dx);
     float maxdepth = _maxSheetDepth * _dx;
     for (int i = startidx; i < endidx; i++) {
-        vmath::vec3 p = _particles->at(i).position;
+        vmath::vec3 p = _particles->getPosition(i);
         GridIndex g = Grid3d::positionToGridIndex(p, _dx);
         if (!sheetCells->get(g)) {
             continue;
@@ -276,7 +261,7 @@ void ParticleSheeter::_identifySheetParticlesPhase2Thread(int startidx, int endi
 
 void ParticleSheeter::_initializeMaskGrid(ParticleMaskGrid &maskgrid) {
     for (size_t i = 0; i < _particles->size(); i++) {
-        maskgrid.addParticle(_particles->at(i).position);
+        maskgrid.addParticle(_particles->getPosition(i));
     }
 }
 
@@ -294,18 +279,16 @@ void ParticleSheeter::_getSheetSeedCandidates(Array3d<bool> &sheetCells,
         }
     }
 
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, sheetCellVector.size());
-    std::vector<std::vector<vmath::vec3> > threadResults(numthreads);
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, sheetCellVector.size(), numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&ParticleSheeter::_getSheetSeedCandidatesThread, this,
-                                 intervals[i], intervals[i + 1], &sheetCellVector, &(threadResults[i]));
-    }
+    int grainsize = ThreadUtils::getGrainSize(0, sheetCellVector.size(), 0);
+    int numchunks = ThreadUtils::getNumChunks(0, sheetCellVector.size(), grainsize);
+    std::vector<std::vector<vmath::vec3> > threadResults(numchunks);
+    ThreadUtils::parallelFor(0, sheetCellVector.size(), grainsize, [&](int startidx, int endidx) {
+        _getSheetSeedCandidatesThread(startidx, endidx,
+                                      &sheetCellVector,
+                                      &(threadResults[startidx / grainsize]));
+    });
 
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
+    for (int i = 0; i < numchunks; i++) {
         sheetSeedCandidates.insert(sheetSeedCandidates.end(), threadResults[i].begin(), threadResults[i].end());
     }
 
@@ -415,18 +398,9 @@ void ParticleSheeter::_initializeSortDataValidCells(std::vector<vmath::vec3> &pa
             sortData.isize, sortData.jsize, sortData.ksize, false
             );
 
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, particles.size());
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, particles.size(), numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&ParticleSheeter::_initializeSortDataValidCellsThread, this,
-                                 intervals[i], intervals[i + 1], &particles, &sortData);
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, particles.size(), [&](int startidx, int endidx) {
+        _initializeSortDataValidCellsThread(startidx, endidx, &particles, &sortData);
+    });
 
     int numValidCells = 0;
     for (int k = 0; k < sortData.ksize; k++) {
@@ -467,20 +441,19 @@ void ParticleSheeter::_selectSeedParticles(SortedParticleData &sheetCandidatePar
         }
     }
 
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, candidateCells.size());
-    std::vector<std::vector<vmath::vec3> > threadResults(numthreads);
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, candidateCells.size(), numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&ParticleSheeter::_selectSeedParticlesThread, this,
-                                 intervals[i], intervals[i + 1], 
-                                 &candidateCells, &maskgrid, &sheetCandidateParticleData, &sheetParticleData, 
-                                 &(threadResults[i]));
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
+    int grainsize = ThreadUtils::getGrainSize(0, candidateCells.size(), 0);
+    int numchunks = ThreadUtils::getNumChunks(0, candidateCells.size(), grainsize);
+    std::vector<std::vector<vmath::vec3> > threadResults(numchunks);
+    ThreadUtils::parallelFor(0, candidateCells.size(), grainsize, [&](int startidx, int endidx) {
+        _selectSeedParticlesThread(startidx, endidx,
+                                   &candidateCells,
+                                   &maskgrid,
+                                   &sheetCandidateParticleData,
+                                   &sheetParticleData,
+                                   &(threadResults[startidx / grainsize]));
+    });
+
+    for (int i = 0; i < numchunks; i++) {
         generatedParticles.insert(generatedParticles.end(), threadResults[i].begin(), threadResults[i].end());
     }
 
@@ -25,7 +25,7 @@ SOFTWARE.
 #ifndef FLUIDENGINE_PARTICLESHEETER_H
 #define FLUIDENGINE_PARTICLESHEETER_H
 
-#include "markerparticle.h"
+#include "markerparticlestore.h"
 #include "fragmentedvector.h"
 #include "meshlevelset.h"
 #include "particlemaskgrid.h"
@@ -33,7 +33,7 @@ SOFTWARE.
 
 
 struct ParticleSheeterParameters {
-    FragmentedVector<MarkerParticle> *particles;
+    MarkerParticleStore *particles;
     Array3d<float> *fluidSurfaceLevelSet;
 
     int isize = 0;
@@ -118,7 +118,7 @@ private:
                                     std::vector<vmath::vec3> *result);
 
     // External parameters
-    FragmentedVector<MarkerParticle> *_particles;
+    MarkerParticleStore *_particles;
     Array3d<float> *_fluidSurfaceLevelSet;
 
     int _isize = 0;
@@ -16,60 +16,88 @@ purposes, all without asking permission. See Other Information below.
 // Simple placeholder code for BLAS calls - replace with calls to a real BLAS library
 
 #include <vector>
+#include <cmath>
 
 #include "../threadutils.h"
+#include "../fluidsimassert.h"
 
-#define ELEMENTS_PER_THREAD 500000
+// Vectors are processed in fixed size blocks. Each block is reduced with
+// BLAS_SIMD_WIDTH independent accumulators and the block results are combined
+// with pairwise summation. Block boundaries do not depend on the thread
+// count, so reductions give identical results for any number of threads.
+#define BLAS_BLOCK_SIZE 32768
+#define BLAS_SIMD_WIDTH 8
 
 namespace BLAS{
 
-// dot products ==============================================================
-
-template<class T>
-void dotThread(int startidx, int endidx, std::vector<T> *x, std::vector<T> *y, T *result) {
-    for (int i = startidx; i < endidx; i++) {
-        *result += x->at(i) * y->at(i);
-    }
+inline int numBlocks(size_t n) {
+    return (int)((n + BLAS_BLOCK_SIZE - 1) / BLAS_BLOCK_SIZE);
 }
 
 template<class T>
-inline T dot(std::vector<T> &x, std::vector<T> &y) { 
-    //return cblas_ddot((int)x.size(), &x[0], 1, &y[0], 1); 
-
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, std::ceil((float)x.size() / (float)ELEMENTS_PER_THREAD));
-    if (numthreads == 1) {
+inline T pairwiseSum(const T *values, int n) {
+    if (n <= BLAS_SIMD_WIDTH) {
         T sum = 0;
-        for(size_t i = 0; i < x.size(); i++) {
-            sum += x[i] * y[i];
+        for (int i = 0; i < n; i++) {
+            sum += values[i];
         }
         return sum;
     }
 
-    std::vector<std::thread> threads(numthreads);
-    std::vector<T> results(numthreads, 0);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, x.size(), numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&dotThread<T>,
-                                 intervals[i], intervals[i + 1], &x, &y, &(results[i]));
-    }
+    int half = n / 2;
+    return pairwiseSum(values, half) + pairwiseSum(values + half, n - half);
+}
+
+// dot products ==============================================================
 
-    T sum = 0;
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-        sum += results[i];
+template<class A, class T>
+inline A dotBlock(const T *x, const T *y, int startidx, int endidx) {
+    A lanes[BLAS_SIMD_WIDTH] = {0};
+    int i = startidx;
+    for (; i + BLAS_SIMD_WIDTH <= endidx; i += BLAS_SIMD_WIDTH) {
+        for (int lane = 0; lane < BLAS_SIMD_WIDTH; lane++) {
+            lanes[lane] += (A)x[i + lane] * (A)y[i + lane];
+        }
+    }
+    for (int lane = 0; i < endidx; i++, lane++) {
+        lanes[lane] += (A)x[i] * (A)y[i];
     }
 
-    return sum;
+    return pairwiseSum(lanes, BLAS_SIMD_WIDTH);
+}
+
+// dot product accumulated in type A, e.g. float vectors summed in double
+template<class A, class T>
+inline A dotAccumulate(std::vector<T> &x, std::vector<T> &y) { 
+    int n = (int)x.size();
+    int numblocks = numBlocks(x.size());
+    std::vector<A> blockSums(numblocks, 0);
+    const T *xdata = x.data();
+    const T *ydata = y.data();
+    ThreadUtils::parallelFor(0, numblocks, 1, [&](int bstart, int bend) {
+        for (int b = bstart; b < bend; b++) {
+            int startidx = b * BLAS_BLOCK_SIZE;
+            int endidx = (int)fmin(startidx + BLAS_BLOCK_SIZE, n);
+            blockSums[b] = dotBlock<A>(xdata, ydata, startidx, endidx);
+        }
+    });
+
+    return pairwiseSum(blockSums.data(), numblocks);
+}
+
+template<class T>
+inline T dot(std::vector<T> &x, std::vector<T> &y) { 
+    //return cblas_ddot((int)x.size(), &x[0], 1, &y[0], 1); 
+    return dotAccumulate<T>(x, y);
 }
 
 // inf-norm (maximum absolute value: index of max returned) ==================
 
 template<class T>
-void indexAbsMaxThread(int startidx, int endidx, std::vector<T> *x, T *maxval, int *maxidx) {
+inline void indexAbsMaxBlock(const T *x, int startidx, int endidx, T *maxval, int *maxidx) {
     for (int i = startidx; i < endidx; i++) {
-        if (std::abs(x->at(i)) > *maxval) {
-            *maxval = std::abs(x->at(i));
+        if (std::abs(x[i]) > *maxval) {
+            *maxval = std::abs(x[i]);
             *maxidx = i;
         }
     }
@@ -79,36 +107,27 @@ template<class T>
 inline int indexAbsMax(std::vector<T> &x) { 
     //return cblas_idamax((int)x.size(), &x[0], 1); 
 
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, std::ceil((float)x.size() / (float)ELEMENTS_PER_THREAD));
-    if (numthreads == 1) {
-        int maxind = 0;
-        T maxvalue = 0;
-        for(size_t i = 0; i < x.size(); i++) {
-            if (fabs(x[i]) > maxvalue) {
-                maxvalue = fabs(x[i]);
-                maxind = (int)i;
-            }
+    int n = (int)x.size();
+    int numblocks = numBlocks(x.size());
+    std::vector<T> maxvals(numblocks, 0);
+    std::vector<int> maxinds(numblocks, 0);
+    const T *xdata = x.data();
+    ThreadUtils::parallelFor(0, numblocks, 1, [&](int bstart, int bend) {
+        for (int b = bstart; b < bend; b++) {
+            int startidx = b * BLAS_BLOCK_SIZE;
+            int endidx = (int)fmin(startidx + BLAS_BLOCK_SIZE, n);
+            maxinds[b] = startidx;
+            indexAbsMaxBlock(xdata, startidx, endidx, &(maxvals[b]), &(maxinds[b]));
         }
-        return maxind;
-    }
-
-    std::vector<std::thread> threads(numthreads);
-    std::vector<T> maxvals(numthreads, 0);
-    std::vector<int> maxinds(numthreads, -1);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, x.size(), numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&indexAbsMaxThread<T>,
-                                 intervals[i], intervals[i + 1], &x, &(maxvals[i]), &(maxinds[i]));
-    }
+    });
 
+    // Ties resolve to the lowest index, as in the serial loop
     int maxindex = 0;
     T maxvalue = 0;
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-        if (maxvals[i] > maxvalue) {
-            maxvalue = maxvals[i];
-            maxindex = maxinds[i];
+    for (int b = 0; b < numblocks; b++) {
+        if (maxvals[b] > maxvalue) {
+            maxvalue = maxvals[b];
+            maxindex = maxinds[b];
         }
     }
 
@@ -118,43 +137,114 @@ inline int indexAbsMax(std::vector<T> &x) {
 // inf-norm (maximum absolute value) =========================================
 // technically not part of BLAS, but useful
 
+template<class T>
+inline T absMaxBlock(const T *x, int startidx, int endidx) {
+    T lanes[BLAS_SIMD_WIDTH] = {0};
+    int i = startidx;
+    for (; i + BLAS_SIMD_WIDTH <= endidx; i += BLAS_SIMD_WIDTH) {
+        for (int lane = 0; lane < BLAS_SIMD_WIDTH; lane++) {
+            T v = std::abs(x[i + lane]);
+            lanes[lane] = v > lanes[lane] ? v : lanes[lane];
+        }
+    }
+    for (int lane = 0; i < endidx; i++, lane++) {
+        T v = std::abs(x[i]);
+        lanes[lane] = v > lanes[lane] ? v : lanes[lane];
+    }
+
+    T maxval = 0;
+    for (int lane = 0; lane < BLAS_SIMD_WIDTH; lane++) {
+        maxval = lanes[lane] > maxval ? lanes[lane] : maxval;
+    }
+    return maxval;
+}
+
 template<class T>
 inline T absMax(std::vector<T> &x) { 
-    return std::fabs(x[indexAbsMax(x)]); 
+    int n = (int)x.size();
+    int numblocks = numBlocks(x.size());
+    std::vector<T> maxvals(numblocks, 0);
+    const T *xdata = x.data();
+    ThreadUtils::parallelFor(0, numblocks, 1, [&](int bstart, int bend) {
+        for (int b = bstart; b < bend; b++) {
+            int startidx = b * BLAS_BLOCK_SIZE;
+            int endidx = (int)fmin(startidx + BLAS_BLOCK_SIZE, n);
+            maxvals[b] = absMaxBlock(xdata, startidx, endidx);
+        }
+    });
+
+    T maxval = 0;
+    for (int b = 0; b < numblocks; b++) {
+        maxval = maxvals[b] > maxval ? maxvals[b] : maxval;
+    }
+    return maxval;
 }
 
 // saxpy (y=alpha*x+y) =======================================================
 
-template<class T>
-void addScaledThread(int startidx, int endidx, float alpha, std::vector<T> *x, std::vector<T> *y) {
+template<class T, class R>
+inline void addScaledBlock(R alpha, const T *x, R *y, int startidx, int endidx) {
     for (int i = startidx; i < endidx; i++) {
-        (*y)[i] += alpha * x->at(i);
+        y[i] += alpha * (R)x[i];
     }
 }
 
-template<class T>
-inline void addScaled(float alpha, std::vector<T> &x, std::vector<T> &y) { 
+// y may be stored in a higher precision than x
+template<class T, class R>
+inline void addScaled(R alpha, std::vector<T> &x, std::vector<R> &y) { 
     //cblas_daxpy((int)x.size(), alpha, &x[0], 1, &y[0], 1); 
 
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, std::ceil((float)x.size() / (float)ELEMENTS_PER_THREAD));
-    if (numthreads == 1) {
-        for (size_t i = 0; i < x.size(); i++) {
-            y[i] += alpha * x[i];
+    int n = (int)x.size();
+    int numblocks = numBlocks(x.size());
+    const T *xdata = x.data();
+    R *ydata = y.data();
+    ThreadUtils::parallelFor(0, numblocks, 1, [&](int bstart, int bend) {
+        for (int b = bstart; b < bend; b++) {
+            int startidx = b * BLAS_BLOCK_SIZE;
+            int endidx = (int)fmin(startidx + BLAS_BLOCK_SIZE, n);
+            addScaledBlock(alpha, xdata, ydata, startidx, endidx);
         }
-        return;
-    }
+    });
+}
 
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, x.size(), numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&addScaledThread<T>,
-                                 intervals[i], intervals[i + 1], alpha, &x, &y);
-    }
+// fused update (y=alpha*x+y, w=-alpha*z+w) returning the inf-norm of w ======
+// technically not part of BLAS, but saves two passes per PCG iteration
+
+template<class T, class R>
+inline T addScaledPairAbsMax(R alpha, std::vector<T> &x, std::vector<R> &y,
+                             std::vector<T> &z, std::vector<T> &w) { 
+    FLUIDSIM_ASSERT(x.size() == y.size() && z.size() == w.size() && x.size() == z.size());
+
+    int n = (int)x.size();
+    int numblocks = numBlocks(x.size());
+    std::vector<T> maxvals(numblocks, 0);
+    T a = (T)alpha;
+    R ya = alpha;
+    const T *xdata = x.data();
+    R *ydata = y.data();
+    const T *zdata = z.data();
+    T *wdata = w.data();
+    ThreadUtils::parallelFor(0, numblocks, 1, [&](int bstart, int bend) {
+        for (int b = bstart; b < bend; b++) {
+            int startidx = b * BLAS_BLOCK_SIZE;
+            int endidx = (int)fmin(startidx + BLAS_BLOCK_SIZE, n);
+
+            T maxval = 0;
+            for (int i = startidx; i < endidx; i++) {
+                ydata[i] += ya * (R)xdata[i];
+                wdata[i] += -a * zdata[i];
+                T v = std::abs(wdata[i]);
+                maxval = v > maxval ? v : maxval;
+            }
+            maxvals[b] = maxval;
+        }
+    });
 
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
+    T maxval = 0;
+    for (int b = 0; b < numblocks; b++) {
+        maxval = maxvals[b] > maxval ? maxvals[b] : maxval;
     }
+    return maxval;
 }
 
 }
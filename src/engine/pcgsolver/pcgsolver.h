@@ -20,9 +20,11 @@ purposes, all without asking permission. See Other Information below.
 // non-positive, and row sums are non-negative).
 
 #include <cmath>
+#include <type_traits>
 #include "sparsematrix.h"
 #include "blaswrapper.h"
 #include "../fluidsimassert.h"
+#include "../profiler.h"
 
 //============================================================================
 // A simple compressed sparse column data structure (with separate diagonal)
@@ -67,12 +69,8 @@ struct SparseColumnLowerFactor {
 // entry from the original matrix, the original matrix entry is used instead.
 
 template<class T>
-void factorModifiedIncompleteColesky0(const SparseMatrix<T> &matrix, 
-                                      SparseColumnLowerFactor<T> &factor,
-                                      T modificationParameter = 0.97, 
-                                      T minDiagonalRatio = 0.25) {
-
-    // first copy lower triangle of matrix into factor (Note: assuming A is symmetric of course!)
+void copyLowerTriangle(const FixedSparseMatrix<T> &matrix, SparseColumnLowerFactor<T> &factor) {
+    // copy lower triangle of matrix into factor (Note: assuming A is symmetric of course!)
     factor.resize(matrix.n);
     std::fill(factor.invdiag.begin(), factor.invdiag.end(), 0); // important: eliminate old values from previous solves!
     factor.value.resize(0);
@@ -81,16 +79,80 @@ void factorModifiedIncompleteColesky0(const SparseMatrix<T> &matrix,
 
     for (unsigned int i = 0; i < matrix.n; i++) {
         factor.colstart[i] = (unsigned int)factor.rowindex.size();
-        for (size_t j = 0; j < matrix.index[i].size(); j++) {
-            if (matrix.index[i][j] > i) {
-                factor.rowindex.push_back(matrix.index[i][j]);
-                factor.value.push_back(matrix.value[i][j]);
-            } else if (matrix.index[i][j] == i) {
-                factor.invdiag[i] = factor.adiag[i] = matrix.value[i][j];
+        for (unsigned int j = matrix.rowstart[i]; j < matrix.rowstart[i + 1]; j++) {
+            if (matrix.colindex[j] > i) {
+                factor.rowindex.push_back(matrix.colindex[j]);
+                factor.value.push_back(matrix.value[j]);
+            } else if (matrix.colindex[j] == i) {
+                factor.invdiag[i] = factor.adiag[i] = matrix.value[j];
             }
         }
     }
     factor.colstart[matrix.n] = (unsigned int)factor.rowindex.size();
+}
+
+// returns true if row j is in the sparsity pattern of column i of the
+// original lower triangle (equivalently, A(j,i) != 0 for a symmetric A)
+template<class T>
+inline bool _isInLowerColumnPattern(const SparseColumnLowerFactor<T> &factor, 
+                                    unsigned int i, unsigned int j) {
+    for (unsigned int p = factor.colstart[i]; p < factor.colstart[i + 1]; p++) {
+        if (factor.rowindex[p] == j) {
+            return true;
+        } else if (factor.rowindex[p] > j) {
+            return false;
+        }
+    }
+    return false;
+}
+
+// Removes the entries of the lower triangle that couple different diagonal
+// blocks. Block b spans rows/columns [blockStarts[b], blockStarts[b + 1]).
+// The remaining factor is block diagonal (block Jacobi), so each block can
+// be factored and solved independently. A fraction lumpingParameter of each
+// dropped entry is added to the diagonals of its row and column, in the
+// spirit of the modified factorization preserving row sums. Half lumping 
+// gives the fewest iterations on Poisson problems, full lumping can make
+// the blocks close to singular.
+template<class T>
+void dropOffBlockEntries(SparseColumnLowerFactor<T> &factor, 
+                         const std::vector<unsigned int> &blockStarts,
+                         T lumpingParameter = 0.5) {
+    unsigned int dst = 0;
+    for (size_t b = 0; b + 1 < blockStarts.size(); b++) {
+        unsigned int blockEnd = blockStarts[b + 1];
+        for (unsigned int k = blockStarts[b]; k < blockEnd; k++) {
+            unsigned int src = factor.colstart[k];
+            unsigned int srcEnd = factor.colstart[k + 1];
+            factor.colstart[k] = dst;
+            for (; src < srcEnd && factor.rowindex[src] < blockEnd; src++) {
+                factor.rowindex[dst] = factor.rowindex[src];
+                factor.value[dst] = factor.value[src];
+                dst++;
+            }
+            for (; src < srcEnd; src++) {
+                T dropped = lumpingParameter * factor.value[src];
+                factor.invdiag[k] += dropped;
+                factor.invdiag[factor.rowindex[src]] += dropped;
+            }
+        }
+    }
+    factor.colstart[factor.n] = dst;
+    factor.rowindex.resize(dst);
+    factor.value.resize(dst);
+}
+
+// Factors columns [begin, end) in place. The factor must hold the diagonal 
+// (in invdiag and adiag) and the strictly lower triangle of the matrix, as set
+// by copyLowerTriangle. Columns in the range must not have entries in rows 
+// at or past end, see dropOffBlockEntries.
+template<class T>
+void factorModifiedIncompleteColesky0Block(SparseColumnLowerFactor<T> &factor,
+                                           unsigned int begin, 
+                                           unsigned int end,
+                                           T modificationParameter = 0.97, 
+                                           T minDiagonalRatio = 0.25) {
+
     // now do the incomplete factorization (figure out numerical values)
 
     // MATLAB code:
@@ -109,7 +171,7 @@ void factorModifiedIncompleteColesky0(const SparseMatrix<T> &matrix,
     //   end
     // end
 
-    for(unsigned int k = 0; k < matrix.n; k++) {
+    for(unsigned int k = begin; k < end; k++) {
         if (factor.adiag[k] == 0) { 
             // null row/column
             continue;
@@ -135,18 +197,10 @@ void factorModifiedIncompleteColesky0(const SparseMatrix<T> &matrix,
             T missing = 0;
             unsigned int a = factor.colstart[k];
             // first look for contributions to missing from dropped entries above the diagonal in column j
-            unsigned int b = 0;
             while (a < factor.colstart[k + 1] && factor.rowindex[a] < j) {
-                // look for factor.rowindex[a] in matrix.index[j] starting at b
-                while (b < matrix.index[j].size()) {
-                    if (matrix.index[j][b] < factor.rowindex[a]) {
-                        b++;
-                    } else if(matrix.index[j][b] == factor.rowindex[a]) {
-                        break;
-                    } else {
-                        missing += factor.value[a];
-                        break;
-                    }
+                // A(j, rowindex[a]) is nonzero if j is in column rowindex[a] of the lower triangle
+                if (!_isInLowerColumnPattern(factor, factor.rowindex[a], j)) {
+                    missing += factor.value[a];
                 }
                 a++;
             }
@@ -158,7 +212,7 @@ void factorModifiedIncompleteColesky0(const SparseMatrix<T> &matrix,
             a++;
 
             // and now eliminate from the nonzero entries below the diagonal in column j (or add to missing if we can't)
-            b = factor.colstart[j];
+            unsigned int b = factor.colstart[j];
             while (a < factor.colstart[k + 1] && b < factor.colstart[j + 1]) {
                 if (factor.rowindex[b] < factor.rowindex[a]) {
                     b++;
@@ -184,6 +238,24 @@ void factorModifiedIncompleteColesky0(const SparseMatrix<T> &matrix,
     }
 }
 
+// Factors in place, see factorModifiedIncompleteColesky0Block
+template<class T>
+void factorModifiedIncompleteColesky0(SparseColumnLowerFactor<T> &factor,
+                                      T modificationParameter = 0.97, 
+                                      T minDiagonalRatio = 0.25) {
+    factorModifiedIncompleteColesky0Block(factor, 0, factor.n, 
+                                          modificationParameter, minDiagonalRatio);
+}
+
+template<class T>
+void factorModifiedIncompleteColesky0(const FixedSparseMatrix<T> &matrix, 
+                                      SparseColumnLowerFactor<T> &factor,
+                                      T modificationParameter = 0.97, 
+                                      T minDiagonalRatio = 0.25) {
+    copyLowerTriangle(matrix, factor);
+    factorModifiedIncompleteColesky0(factor, modificationParameter, minDiagonalRatio);
+}
+
 //============================================================================
 // Solution routines with lower triangular matrix.
 
@@ -220,18 +292,78 @@ void solveLowerTransposeInPlace(const SparseColumnLowerFactor<T> &factor, std::v
     } while(i != 0);
 }
 
+// solve L*L^T*x=rhs in place over the diagonal block [begin, end). The 
+// block must not be coupled to other rows, see dropOffBlockEntries.
+template<class T>
+void solveBlockInPlace(const SparseColumnLowerFactor<T> &factor, std::vector<T> &x,
+                       unsigned int begin, unsigned int end) {
+    for (unsigned int i = begin; i < end; i++){
+        x[i] *= factor.invdiag[i];
+        for(unsigned int j = factor.colstart[i]; j < factor.colstart[i + 1]; j++){
+            x[factor.rowindex[j]] -= factor.value[j] * x[i];
+        }
+    }
+
+    unsigned int i = end;
+    while (i > begin) {
+        i--;
+        for (unsigned int j = factor.colstart[i]; j < factor.colstart[i + 1]; j++){
+            x[i] -= factor.value[j] * x[factor.rowindex[j]];
+        }
+        x[i] *= factor.invdiag[i];
+    }
+}
+
 //============================================================================
-// Encapsulates the Conjugate Gradient algorithm with incomplete Cholesky
-// factorization preconditioner.
+// Interface for a symmetric matrix that is applied on the fly instead of being
+// stored. Implementations must produce the same values as the equivalent
+// FixedSparseMatrix with columns of each row visited in ascending order.
+
+template <class T>
+class MatrixFreeOperator {
+public:
+    virtual ~MatrixFreeOperator() {}
+
+    virtual unsigned int size() = 0;
+
+    // perform result=A*x and return dot(x, result)
+    virtual T multiplyAndDot(std::vector<T> &x, std::vector<T> &result) = 0;
+
+    // fill factor with the diagonal and strictly lower triangle of A in the
+    // same layout as copyLowerTriangle
+    virtual void copyLowerTriangle(SparseColumnLowerFactor<T> &factor) = 0;
+};
+
+//============================================================================
+// Interface for a symmetric positive definite preconditioner that replaces
+// the incomplete Cholesky factorization. apply computes result=M^-1*x.
 
 template <class T>
+class PCGPreconditioner {
+public:
+    virtual ~PCGPreconditioner() {}
+
+    virtual void apply(const std::vector<T> &x, std::vector<T> &result) = 0;
+};
+
+//============================================================================
+// Encapsulates the Conjugate Gradient algorithm with incomplete Cholesky
+// factorization preconditioner.
+//
+// T is the storage type of the matrix, preconditioner and the s/z/r work
+// vectors. R is the type of the right hand side, the result, and of the dot
+// product reductions. PCGSolver<float, double> halves the memory traffic of 
+// an iteration while keeping the solution, its updates and the reductions in
+// double. The s/z/r updates are rounded to T.
+
+template <class T, class R = T>
 struct PCGSolver {
 
     PCGSolver() {
         setSolverParameters(1e-12, 100, 0.97, 0.25);
     }
 
-    void setSolverParameters(T tolerance, 
+    void setSolverParameters(R tolerance, 
                              int maxiter, 
                              T MICParameter = 0.97, 
                              T diagRatio = 0.25) {
@@ -245,80 +377,261 @@ struct PCGSolver {
         minDiagonalRatio = diagRatio;
     }
 
-    bool solve(const SparseMatrix<T> &matrix, const std::vector<T> &rhs, 
-               std::vector<T> &result, T &residualOut, int &iterationsOut) {
+    // When enabled, each iteration computes the matrix-vector product together
+    // with its dot product, and both vector updates together with the residual
+    // norm, which removes three full passes over the vectors per iteration.
+    // Results are identical to the unfused iteration.
+    void setFusedIterationEnabled(bool enabled) {
+        isFusedIterationEnabled = enabled;
+    }
+
+    // When enabled, the values in result passed to solve are used as the
+    // initial guess instead of zero. The tolerance stays relative to the
+    // right hand side, so a good guess reduces the number of iterations.
+    void setInitialGuessEnabled(bool enabled) {
+        isInitialGuessEnabled = enabled;
+    }
+
+    // Split the MIC(0) preconditioner into n diagonal blocks of contiguous
+    // rows (block Jacobi). Entries coupling different blocks are dropped, and
+    // the blocks are factored and solved in parallel. Iteration counts grow
+    // slowly with the number of blocks. A value of 1 uses the serial MIC(0).
+    void setNumPreconditionerBlocks(int n) {
+        numPreconditionerBlocks = n < 1 ? 1 : n;
+    }
+
+    // Iterative refinement. When the recursively updated residual reaches the
+    // tolerance (or stops improving at the iteration limit), the true 
+    // residual rhs-A*result is computed in type R. If it is still above the
+    // tolerance, the iteration restarts from the true residual, up to n times.
+    // The restarts share the maximum iteration count. This recovers the 
+    // accuracy lost to a low precision storage type T. A value of 0 disables
+    // refinement.
+    void setMaxRefinementSteps(int n) {
+        maxRefinementSteps = n < 0 ? 0 : n;
+    }
+
+    // Use an external preconditioner instead of the modified incomplete
+    // Cholesky factorization. Set to nullptr to restore the default. The
+    // preconditioner is not owned by the solver.
+    void setPreconditioner(PCGPreconditioner<T> *p) {
+        preconditioner = p;
+    }
+
+    bool solve(const SparseMatrix<T> &matrix, const std::vector<R> &rhs, 
+               std::vector<R> &result, R &residualOut, int &iterationsOut) {
+        fixedMatrix.fromMatrix(matrix);
+        return solve(fixedMatrix, rhs, result, residualOut, iterationsOut);
+    }
+
+    bool solve(const FixedSparseMatrix<T> &matrix, const std::vector<R> &rhs, 
+               std::vector<R> &result, R &residualOut, int &iterationsOut) {
+        return solveInternal(matrix, matrix.n, rhs, result, residualOut, iterationsOut);
+    }
+
+    bool solve(MatrixFreeOperator<T> &matrix, const std::vector<R> &rhs, 
+               std::vector<R> &result, R &residualOut, int &iterationsOut) {
+        return solveInternal(matrix, matrix.size(), rhs, result, residualOut, iterationsOut);
+    }
+
+protected:
+
+    template<class MatrixType>
+    bool solveInternal(MatrixType &matrix, unsigned int n, const std::vector<R> &rhs, 
+                std::vector<R> &result, R &residualOut, int &iterationsOut) {
+        FLUIDSIM_PROFILE_SCOPE("PCG Solve");
 
-        unsigned int n = matrix.n;
         if (m.size() != n) { 
             m.resize(n); 
             s.resize(n); 
             z.resize(n); 
             r.resize(n); 
         }
-        std::fill(result.begin(), result.end(), 0);
-
-        r = rhs;
+        r.assign(rhs.begin(), rhs.end());
         residualOut = BLAS::absMax(r);
         if(residualOut == 0) {
+            std::fill(result.begin(), result.end(), 0);
             iterationsOut = 0;
             return true;
         }
         double tol = toleranceFactor * residualOut;
 
-        formPreconditioner(matrix);
-        applyPreconditioner(r, z);
-        double rho = BLAS::dot(z, r);
-        if (rho == 0 || rho != rho) {
-            iterationsOut = 0;
-            return false;
+        if (isInitialGuessEnabled) {
+            applyResidual(matrix, result, rhs);
+            residualOut = BLAS::absMax(r);
+            if (residualOut <= tol) {
+                iterationsOut = 0;
+                return true;
+            }
+        } else {
+            std::fill(result.begin(), result.end(), 0);
         }
 
-        s = z;
-        fixedMatrix.fromMatrix(matrix);
+        if (preconditioner == nullptr) {
+            formPreconditioner(matrix);
+        }
 
-        int iteration;
-        for (iteration = 0; iteration < maxIterations; iteration++){
-            multiply(fixedMatrix, s, z);
-            double alpha = rho / BLAS::dot(s, z);
-            BLAS::addScaled(alpha, s, result);
-            BLAS::addScaled(-alpha, z, r);
+        int iteration = 0;
+        int numRefinements = 0;
+        for (;;) {
+            applyPreconditioner(r, z);
+            double rho = BLAS::dotAccumulate<R>(z, r);
+            if (rho == 0 || rho != rho) {
+                iterationsOut = iteration;
+                return false;
+            }
 
-            residualOut = BLAS::absMax(r);
-            if(residualOut <= tol) {
-                iterationsOut = iteration + 1;
-                return true; 
+            s = z;
+
+            bool isConverged = false;
+            for (; iteration < maxIterations; iteration++){
+                if (isFusedIterationEnabled) {
+                    double alpha = rho / applyMatrixAndDot(matrix, s, z);
+                    residualOut = BLAS::addScaledPairAbsMax((R)alpha, s, result, z, r);
+                } else {
+                    applyMatrix(matrix, s, z);
+                    double alpha = rho / BLAS::dotAccumulate<R>(s, z);
+                    BLAS::addScaled((R)alpha, s, result);
+                    BLAS::addScaled((T)-alpha, z, r);
+                    residualOut = BLAS::absMax(r);
+                }
+
+                if(residualOut <= tol) {
+                    iteration++;
+                    isConverged = true;
+                    break;
+                }
+
+                applyPreconditioner(r, z);
+                double rhoNew = BLAS::dotAccumulate<R>(z, r);
+                double beta = rhoNew / rho;
+                BLAS::addScaled((T)beta, s, z); 
+                s.swap(z); // s=beta*s+z
+                rho = rhoNew;
             }
 
-            applyPreconditioner(r, z);
-            double rhoNew = BLAS::dot(z, r);
-            double beta = rhoNew / rho;
-            BLAS::addScaled(beta, s, z); 
-            s.swap(z); // s=beta*s+z
-            rho = rhoNew;
-        }
+            if (numRefinements >= maxRefinementSteps) {
+                iterationsOut = iteration;
+                return isConverged;
+            }
 
-        iterationsOut = iteration;
-        return false;
+            applyResidual(matrix, result, rhs);
+            residualOut = BLAS::absMax(r);
+            if (residualOut <= tol) {
+                iterationsOut = iteration;
+                return true;
+            }
+            if (iteration >= maxIterations) {
+                iterationsOut = iteration;
+                return false;
+            }
+            numRefinements++;
+        }
     }
 
-protected:
-
     // internal structures
     SparseColumnLowerFactor<T> icfactor; // modified incomplete cholesky factor
     std::vector<T> m, z, s, r; // temporary vectors for PCG
-    FixedSparseMatrix<T> fixedMatrix; // used within loop
+    FixedSparseMatrix<T> fixedMatrix; // used when solving a SparseMatrix
 
     // parameters
-    T toleranceFactor;
+    R toleranceFactor;
     int maxIterations;
     T modifiedIncompleteCholeskyParameter;
     T minDiagonalRatio;
+    bool isFusedIterationEnabled = true;
+    bool isInitialGuessEnabled = false;
+    int numPreconditionerBlocks = 1;
+    int maxRefinementSteps = 0;
+    std::vector<unsigned int> blockStarts;
+    PCGPreconditioner<T> *preconditioner = nullptr;
+
+    void formPreconditioner(const FixedSparseMatrix<T> &matrix) {
+        copyLowerTriangle(matrix, icfactor);
+        factorPreconditioner();
+    }
+
+    void formPreconditioner(MatrixFreeOperator<T> &matrix) {
+        matrix.copyLowerTriangle(icfactor);
+        factorPreconditioner();
+    }
+
+    void factorPreconditioner() {
+        FLUIDSIM_PROFILE_SCOPE("PCG Factor Preconditioner");
+        unsigned int n = icfactor.n;
+        unsigned int numBlocks = std::min((unsigned int)numPreconditionerBlocks, std::max(n, 1u));
+        blockStarts.resize(numBlocks + 1);
+        for (unsigned int b = 0; b <= numBlocks; b++) {
+            blockStarts[b] = (unsigned int)(((unsigned long long)n * b) / numBlocks);
+        }
+
+        if (numBlocks == 1) {
+            factorModifiedIncompleteColesky0(icfactor);
+            return;
+        }
+
+        dropOffBlockEntries(icfactor, blockStarts);
+        ThreadUtils::parallelFor(0, numBlocks, 1, [&](int bstart, int bend) {
+            for (int b = bstart; b < bend; b++) {
+                factorModifiedIncompleteColesky0Block(icfactor, blockStarts[b], blockStarts[b + 1],
+                                                      (T)0.97, (T)0.25);
+            }
+        });
+    }
 
-    void formPreconditioner(const SparseMatrix<T> &matrix) {
-        factorModifiedIncompleteColesky0(matrix, icfactor);
+    void applyMatrix(const FixedSparseMatrix<T> &matrix, std::vector<T> &x, std::vector<T> &result) {
+        multiply(matrix, x, result);
+    }
+
+    void applyMatrix(MatrixFreeOperator<T> &matrix, std::vector<T> &x, std::vector<T> &result) {
+        matrix.multiplyAndDot(x, result);
+    }
+
+    R applyMatrixAndDot(const FixedSparseMatrix<T> &matrix, std::vector<T> &x, std::vector<T> &result) {
+        return multiplyAndDotAccumulate<R>(matrix, x, result);
+    }
+
+    R applyMatrixAndDot(MatrixFreeOperator<T> &matrix, std::vector<T> &x, std::vector<T> &result) {
+        return matrix.multiplyAndDot(x, result);
+    }
+
+    // r = rhs - A*x
+    void applyResidual(const FixedSparseMatrix<T> &matrix, std::vector<R> &x, const std::vector<R> &rhs) {
+        residual(matrix, x, rhs, r);
+    }
+
+    void applyResidual(MatrixFreeOperator<T> &matrix, std::vector<R> &x, const std::vector<R> &rhs) {
+        // The operator computes products in T. For T != R the true residual
+        // would be rounded to T, which undoes iterative refinement.
+        static_assert(std::is_same<T, R>::value, 
+                      "Matrix-free residual requires T == R");
+        s.assign(x.begin(), x.end());
+        matrix.multiplyAndDot(s, z);
+        ThreadUtils::parallelFor(0, (int)r.size(), [&](int startidx, int endidx) {
+            for (int i = startidx; i < endidx; i++) {
+                r[i] = (T)(rhs[i] - (R)z[i]);
+            }
+        });
     }
 
     void applyPreconditioner(const std::vector<T> &x, std::vector<T> &result) {
+        FLUIDSIM_PROFILE_SCOPE("PCG Apply Preconditioner");
+        if (preconditioner != nullptr) {
+            preconditioner->apply(x, result);
+            return;
+        }
+
+        if (blockStarts.size() > 2) {
+            result = x;
+            int numBlocks = (int)blockStarts.size() - 1;
+            ThreadUtils::parallelFor(0, numBlocks, 1, [&](int bstart, int bend) {
+                for (int b = bstart; b < bend; b++) {
+                    solveBlockInPlace(icfactor, result, blockStarts[b], blockStarts[b + 1]);
+                }
+            });
+            return;
+        }
+
         solveLower(icfactor, x, result);
         solveLowerTransposeInPlace(icfactor, result);
     }
@@ -17,6 +17,7 @@ purposes, all without asking permission. See Other Information below.
 #include <vector>
 #include <cmath>
 
+#include "blaswrapper.h"
 #include "../threadutils.h"
 #include "../fluidsimassert.h"
 
@@ -171,48 +172,215 @@ struct FixedSparseMatrix {
 typedef FixedSparseMatrix<float> FixedSparseMatrixf;
 typedef FixedSparseMatrix<double> FixedSparseMatrixd;
 
+//============================================================================
+// Builds a FixedSparseMatrix directly, without per-row heap allocations.
+// Each row has room for a fixed number of nonzeros (the stencil size), so
+// rows can be filled in parallel as long as each row is written by a single
+// thread. set/add behave like SparseMatrix::set/add. build() packs the rows
+// into compressed sparse row form in place and hands the storage over to
+// the matrix.
+
+template<class T>
+struct FixedSparseMatrixBuilder {
+
+    unsigned int n;                         // dimension
+    unsigned int maxRowSize;                // nonzero slots available per row
+    std::vector<unsigned int> rowsize;      // number of nonzeros used in each row
+    std::vector<unsigned int> colindex;     // sorted column indices, maxRowSize slots per row
+    std::vector<T> value;                   // values corresponding to colindex
+
+    FixedSparseMatrixBuilder(unsigned int size = 0, unsigned int maxNonZerosPerRow = 7)
+        : n(size), maxRowSize(maxNonZerosPerRow), 
+          rowsize(size, 0), 
+          colindex((size_t)size * maxNonZerosPerRow),
+          value((size_t)size * maxNonZerosPerRow)
+    {}
+
+    void set(int i, int j, T newValue) {
+        if (i == -1 || j == -1) {
+            return;
+        }
+
+        size_t k = _findOrInsert(i, j);
+        value[k] = newValue;
+    }
+
+    void add(int i, int j, T inc) {
+        if (i == -1 || j == -1) {
+            return;
+        }
+
+        size_t k = _findOrInsert(i, j);
+        value[k] += inc;
+    }
+
+    // The rows are compacted in place and the storage is moved into matrix,
+    // so no second copy of the nonzeros is allocated. The builder is empty
+    // afterwards.
+    void build(FixedSparseMatrix<T> &matrix) {
+        matrix.resize(n);
+        matrix.rowstart[0] = 0;
+        for (unsigned int i = 0; i < n; i++) {
+            matrix.rowstart[i + 1] = matrix.rowstart[i] + rowsize[i];
+        }
+
+        // Rows only move towards the front, so a forward pass never 
+        // overwrites a row that has not been moved yet
+        for (unsigned int i = 0; i < n; i++) {
+            size_t src = (size_t)i * maxRowSize;
+            size_t dst = matrix.rowstart[i];
+            if (src == dst) {
+                continue;
+            }
+            for (unsigned int k = 0; k < rowsize[i]; k++) {
+                colindex[dst + k] = colindex[src + k];
+                value[dst + k] = value[src + k];
+            }
+        }
+
+        colindex.resize(matrix.rowstart[n]);
+        value.resize(matrix.rowstart[n]);
+        matrix.colindex.swap(colindex);
+        matrix.value.swap(value);
+
+        n = 0;
+        std::vector<unsigned int>().swap(rowsize);
+        std::vector<unsigned int>().swap(colindex);
+        std::vector<T>().swap(value);
+    }
+
+private:
+
+    size_t _findOrInsert(int i, int j) {
+        FLUIDSIM_ASSERT(i >= 0 && i < (int)n && j >= 0 && j < (int)n);
+
+        size_t rowbegin = (size_t)i * maxRowSize;
+        unsigned int size = rowsize[i];
+        unsigned int k = 0;
+        while (k < size && colindex[rowbegin + k] < (unsigned int)j) {
+            k++;
+        }
+
+        if (k < size && colindex[rowbegin + k] == (unsigned int)j) {
+            return rowbegin + k;
+        }
+
+        FLUIDSIM_ASSERT(size < maxRowSize);
+        for (unsigned int m = size; m > k; m--) {
+            colindex[rowbegin + m] = colindex[rowbegin + m - 1];
+            value[rowbegin + m] = value[rowbegin + m - 1];
+        }
+        colindex[rowbegin + k] = j;
+        value[rowbegin + k] = 0;
+        rowsize[i]++;
+
+        return rowbegin + k;
+    }
+};
+
+typedef FixedSparseMatrixBuilder<float> FixedSparseMatrixBuilderf;
+typedef FixedSparseMatrixBuilder<double> FixedSparseMatrixBuilderd;
+
 // perform result=matrix*x
 template<class T>
-void _multiplyThread(int startidx, int endidx, 
-                     FixedSparseMatrix<T> *matrix, 
-                     std::vector<T> *x, std::vector<T> *result) {
-    for(int i = startidx; i < endidx; i++){
-        (*result)[i] = 0;
-        for (size_t j = matrix->rowstart[i]; j < matrix->rowstart[i + 1]; j++){
-            (*result)[i] += matrix->value[j] * (*x)[matrix->colindex[j]];
+inline void _multiplyBlock(const FixedSparseMatrix<T> &matrix, const T *x, T *result, 
+                           int startidx, int endidx) {
+    const unsigned int *rowstart = matrix.rowstart.data();
+    const unsigned int *colindex = matrix.colindex.data();
+    const T *value = matrix.value.data();
+    for (int i = startidx; i < endidx; i++) {
+        T sum = 0;
+        for (unsigned int j = rowstart[i]; j < rowstart[i + 1]; j++) {
+            sum += value[j] * x[colindex[j]];
         }
+        result[i] = sum;
     }
 }
 
 template<class T>
-void multiply(FixedSparseMatrix<T> &matrix, std::vector<T> &x, std::vector<T> &result) {
+void multiply(const FixedSparseMatrix<T> &matrix, std::vector<T> &x, std::vector<T> &result) {
     FLUIDSIM_ASSERT(matrix.n == x.size());
     result.resize(matrix.n);
 
-    int elementsPerThread = 500000;
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, std::ceil((float)matrix.n / (float)elementsPerThread));
-    if (numthreads == 1) {
-        for(size_t i = 0; i < result.size(); i++){
-            result[i] = 0;
-            for (size_t j = matrix.rowstart[i]; j < matrix.rowstart[i + 1]; j++){
-                result[i] += matrix.value[j] * x[matrix.colindex[j]];
+    int n = (int)matrix.n;
+    int numblocks = BLAS::numBlocks(matrix.n);
+    const T *xdata = x.data();
+    T *resultdata = result.data();
+    ThreadUtils::parallelFor(0, numblocks, 1, [&](int bstart, int bend) {
+        for (int b = bstart; b < bend; b++) {
+            int startidx = b * BLAS_BLOCK_SIZE;
+            int endidx = (int)fmin(startidx + BLAS_BLOCK_SIZE, n);
+            _multiplyBlock(matrix, xdata, resultdata, startidx, endidx);
+        }
+    });
+}
+
+// perform result=matrix*x and return dot(x, result) in the same pass. The
+// dot product uses the same blocks and lanes as BLAS::dot, so the value is
+// identical to calling multiply followed by BLAS::dot. The dot product is
+// accumulated in type A.
+template<class A, class T>
+A multiplyAndDotAccumulate(const FixedSparseMatrix<T> &matrix, std::vector<T> &x, std::vector<T> &result) {
+    FLUIDSIM_ASSERT(matrix.n == x.size());
+    result.resize(matrix.n);
+
+    int n = (int)matrix.n;
+    int numblocks = BLAS::numBlocks(matrix.n);
+    std::vector<A> blockSums(numblocks, 0);
+    const unsigned int *rowstart = matrix.rowstart.data();
+    const unsigned int *colindex = matrix.colindex.data();
+    const T *value = matrix.value.data();
+    const T *xdata = x.data();
+    T *resultdata = result.data();
+    ThreadUtils::parallelFor(0, numblocks, 1, [&](int bstart, int bend) {
+        for (int b = bstart; b < bend; b++) {
+            int startidx = b * BLAS_BLOCK_SIZE;
+            int endidx = (int)fmin(startidx + BLAS_BLOCK_SIZE, n);
+
+            A lanes[BLAS_SIMD_WIDTH] = {0};
+            for (int i = startidx; i < endidx; i++) {
+                T sum = 0;
+                for (unsigned int j = rowstart[i]; j < rowstart[i + 1]; j++) {
+                    sum += value[j] * xdata[colindex[j]];
+                }
+                resultdata[i] = sum;
+                lanes[(i - startidx) % BLAS_SIMD_WIDTH] += (A)xdata[i] * (A)sum;
             }
+            blockSums[b] = BLAS::pairwiseSum(lanes, BLAS_SIMD_WIDTH);
         }
+    });
 
-        return;
-    }
+    return BLAS::pairwiseSum(blockSums.data(), numblocks);
+}
 
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, matrix.n, numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&_multiplyThread<T>,
-                                 intervals[i], intervals[i + 1], &matrix, &x, &result);
-    }
+template<class T>
+T multiplyAndDot(const FixedSparseMatrix<T> &matrix, std::vector<T> &x, std::vector<T> &result) {
+    return multiplyAndDotAccumulate<T>(matrix, x, result);
+}
 
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+// perform residual=b-matrix*x with the products and sums evaluated in the
+// precision of x and b, which may be higher than the matrix storage
+template<class T, class R>
+void residual(const FixedSparseMatrix<T> &matrix, const std::vector<R> &x, const std::vector<R> &b, 
+              std::vector<T> &residual) {
+    FLUIDSIM_ASSERT(matrix.n == x.size() && matrix.n == b.size());
+    residual.resize(matrix.n);
+
+    const unsigned int *rowstart = matrix.rowstart.data();
+    const unsigned int *colindex = matrix.colindex.data();
+    const T *value = matrix.value.data();
+    const R *xdata = x.data();
+    const R *bdata = b.data();
+    T *residualdata = residual.data();
+    ThreadUtils::parallelFor(0, (int)matrix.n, [&](int startidx, int endidx) {
+        for (int i = startidx; i < endidx; i++) {
+            R sum = 0;
+            for (unsigned int j = rowstart[i]; j < rowstart[i + 1]; j++) {
+                sum += (R)value[j] * xdata[colindex[j]];
+            }
+            residualdata[i] = (T)(bdata[i] - sum);
+        }
+    });
 }
 
 #endif
@@ -391,29 +391,14 @@ void Polygonizer3d::_findSurfaceCells(Array3d<bool> &isSurfaceCell) {
                                       GridIndex(0, 1, 1),
                                       GridIndex(1, 1, 1)});
 
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, workQueue.size());
-    std::vector<std::thread> threads(numthreads);
-    FLUIDSIM_ASSERT(numthreads > 0);
-
     Array3d<bool> hasInsideNode(_isize, _jsize, _ksize, false);
     Array3d<bool> hasOutsideNode(_isize, _jsize, _ksize, false);
 
-    while (!workQueue.empty()) {
-
-        numthreads = (int)fmin(numCPU, workQueue.size());
-        for (int tidx = 0; tidx < numthreads; tidx++) {
-            GridIndex gridOffset = workQueue.back();
-            workQueue.pop_back();
-
-            threads[tidx] = std::thread(&Polygonizer3d::_getCellNodeStatusThread, this,
-                                        gridOffset, &hasInsideNode, &hasOutsideNode);
+    ThreadUtils::parallelFor(0, workQueue.size(), 1, [&](int startidx, int endidx) {
+        for (int idx = startidx; idx < endidx; idx++) {
+            _getCellNodeStatusThread(workQueue[idx], &hasInsideNode, &hasOutsideNode);
         }
-
-        for (int tidx = 0; tidx < numthreads; tidx++) {
-            threads[tidx].join();
-        }
-    }
+    });
 
     for (int k = 0; k < _ksize; k++) {
         for (int j = 0; j < _jsize; j++) {
@@ -30,6 +30,138 @@ SOFTWARE.
 #include "particlelevelset.h"
 #include "meshlevelset.h"
 #include "interpolation.h"
+#include "multigridpreconditioner.h"
+#include "stopwatch.h"
+#include "profiler.h"
+
+/********************************************************************************
+    PressureMatrixOperator
+********************************************************************************/
+
+/*
+    Applies the pressure matrix without storing it. Only the diagonal is
+    precomputed, off-diagonal coefficients are read from the weight grid and
+    the pressure cell keymap during each multiply. Columns of each row are
+    visited in ascending order (Z-, Y-, X-, center, X+, Y+, Z+) so that the
+    result is identical to multiplying by the assembled matrix.
+*/
+class PressureSolver::PressureMatrixOperator : public MatrixFreeOperator<double> {
+public:
+    PressureMatrixOperator(PressureSolver *solver) : _solver(solver) {
+        _factor = solver->_deltaTime / (solver->_dx * solver->_dx);
+        solver->_calculateMatrixDiagonal(_diagonal);
+    }
+
+    unsigned int size() {
+        return (unsigned int)_diagonal.size();
+    }
+
+    double multiplyAndDot(std::vector<double> &x, std::vector<double> &result) {
+        FLUIDSIM_ASSERT(x.size() == _diagonal.size());
+        result.resize(_diagonal.size());
+
+        int n = (int)_diagonal.size();
+        int numblocks = BLAS::numBlocks(n);
+        std::vector<double> blockSums(numblocks, 0.0);
+        const double *xdata = x.data();
+        double *resultdata = result.data();
+        ThreadUtils::parallelFor(0, numblocks, 1, [&](int bstart, int bend) {
+            for (int b = bstart; b < bend; b++) {
+                int startidx = b * BLAS_BLOCK_SIZE;
+                int endidx = (int)fmin(startidx + BLAS_BLOCK_SIZE, n);
+
+                double lanes[BLAS_SIMD_WIDTH] = {0};
+                for (int i = startidx; i < endidx; i++) {
+                    double sum = _multiplyRow(i, xdata);
+                    resultdata[i] = sum;
+                    lanes[(i - startidx) % BLAS_SIMD_WIDTH] += xdata[i] * sum;
+                }
+                blockSums[b] = BLAS::pairwiseSum(lanes, BLAS_SIMD_WIDTH);
+            }
+        });
+
+        return BLAS::pairwiseSum(blockSums.data(), numblocks);
+    }
+
+    void copyLowerTriangle(SparseColumnLowerFactor<double> &factor) {
+        unsigned int n = (unsigned int)_diagonal.size();
+        factor.resize(n);
+        factor.value.resize(0);
+        factor.rowindex.resize(0);
+
+        int neighbours[3];
+        double coefficients[3];
+        for (unsigned int idx = 0; idx < n; idx++) {
+            factor.colstart[idx] = (unsigned int)factor.rowindex.size();
+            factor.invdiag[idx] = factor.adiag[idx] = _diagonal[idx];
+
+            GridIndex g = _solver->_pressureCells[idx];
+            _getUpperNeighbours(g.i, g.j, g.k, neighbours, coefficients);
+            for (int nidx = 0; nidx < 3; nidx++) {
+                if (neighbours[nidx] != -1) {
+                    factor.rowindex.push_back(neighbours[nidx]);
+                    factor.value.push_back(coefficients[nidx]);
+                }
+            }
+        }
+        factor.colstart[n] = (unsigned int)factor.rowindex.size();
+    }
+
+private:
+
+    // X-, Y-, Z- neighbours in ascending column order
+    inline void _getLowerNeighbours(int i, int j, int k, 
+                                    int neighbours[3], double coefficients[3]) {
+        WeightGrid *w = _solver->_weightGrid;
+        neighbours[0] = _solver->_keymap.find(i, j, k - 1);
+        neighbours[1] = _solver->_keymap.find(i, j - 1, k);
+        neighbours[2] = _solver->_keymap.find(i - 1, j, k);
+        coefficients[0] = -(double)w->W(i, j, k) * _factor;
+        coefficients[1] = -(double)w->V(i, j, k) * _factor;
+        coefficients[2] = -(double)w->U(i, j, k) * _factor;
+    }
+
+    // X+, Y+, Z+ neighbours in ascending column order
+    inline void _getUpperNeighbours(int i, int j, int k, 
+                                    int neighbours[3], double coefficients[3]) {
+        WeightGrid *w = _solver->_weightGrid;
+        neighbours[0] = _solver->_keymap.find(i + 1, j, k);
+        neighbours[1] = _solver->_keymap.find(i, j + 1, k);
+        neighbours[2] = _solver->_keymap.find(i, j, k + 1);
+        coefficients[0] = -(double)w->U(i + 1, j, k) * _factor;
+        coefficients[1] = -(double)w->V(i, j + 1, k) * _factor;
+        coefficients[2] = -(double)w->W(i, j, k + 1) * _factor;
+    }
+
+    inline double _multiplyRow(int idx, const double *x) {
+        GridIndex g = _solver->_pressureCells[idx];
+        int neighbours[3];
+        double coefficients[3];
+
+        double sum = 0.0;
+        _getLowerNeighbours(g.i, g.j, g.k, neighbours, coefficients);
+        for (int nidx = 0; nidx < 3; nidx++) {
+            if (neighbours[nidx] != -1) {
+                sum += coefficients[nidx] * x[neighbours[nidx]];
+            }
+        }
+
+        sum += _diagonal[idx] * x[idx];
+
+        _getUpperNeighbours(g.i, g.j, g.k, neighbours, coefficients);
+        for (int nidx = 0; nidx < 3; nidx++) {
+            if (neighbours[nidx] != -1) {
+                sum += coefficients[nidx] * x[neighbours[nidx]];
+            }
+        }
+
+        return sum;
+    }
+
+    PressureSolver *_solver;
+    double _factor = 0.0;
+    std::vector<double> _diagonal;
+};
 
 /********************************************************************************
     PressureSolver
@@ -57,15 +189,28 @@ bool PressureSolver::solve(PressureSolverParameters params) {
     }
 
     if (maxAbsCoeff < _pressureSolveTolerance) {
+        if (_pressureGrid != nullptr) {
+            _pressureGrid->fill(0.0f);
+        }
         _solverStatus = "Pressure Solver Iterations: 0\nEstimated Error: 0.0";
         return true;
     }
 
     std::vector<double> soln(_matSize, 0);
-    SparseMatrixd matrix(_matSize, 7);
-    _calculateMatrixCoefficients(matrix);
-
-    bool success = _solveLinearSystem(matrix, rhs, soln);
+    _initializeSolutionVector(soln);
+    bool success;
+    if (_isMatrixFreeEnabled) {
+        PressureMatrixOperator matrix(this);
+        success = _solveLinearSystem<double>(matrix, rhs, soln);
+    } else if (_isMixedPrecisionEnabled) {
+        FixedSparseMatrixf matrix;
+        _calculateMatrixCoefficients(matrix);
+        success = _solveLinearSystem<float>(matrix, rhs, soln);
+    } else {
+        FixedSparseMatrixd matrix;
+        _calculateMatrixCoefficients(matrix);
+        success = _solveLinearSystem<double>(matrix, rhs, soln);
+    }
 
     if (!success) {
         return false;
@@ -97,6 +242,13 @@ void PressureSolver::_initialize(PressureSolverParameters params) {
     _isSurfaceTensionEnabled = params.isSurfaceTensionEnabled;
     _surfaceTensionConstant = params.surfaceTensionConstant;
     _curvatureGrid = params.curvatureGrid;
+    _isMatrixFreeEnabled = params.isMatrixFreeEnabled;
+    _preconditioner = params.preconditioner;
+    _isPreconditionerComparisonEnabled = params.isPreconditionerComparisonEnabled;
+    // The matrix-free operator computes its coefficients in double
+    _isMixedPrecisionEnabled = params.isMixedPrecisionEnabled && !params.isMatrixFreeEnabled;
+    _maxRefinementSteps = params.maxRefinementSteps;
+    _pressureGrid = params.pressureGrid;
 
     _pressureCells = GridIndexVector(_isize, _jsize, _ksize);
     for(int k = 1; k < _ksize - 1; k++) {
@@ -122,25 +274,16 @@ void PressureSolver::_initializeGridIndexKeyMap() {
 }
 
 void PressureSolver::_conditionSolidVelocityField() {
+    FLUIDSIM_PROFILE_SCOPE("Condition Solid Velocity Field");
     // This method detects isolated pockets of fluid surrounded by solids and 
     // sets the surrounding solid velocities to 0 in order to remove 
     // inconsistencies from the linear system.
 
     int gridsize = _isize * _jsize * _ksize;
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, gridsize);
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, gridsize, numthreads);
-
     Array3d<bool> bordersAir(_isize, _jsize, _ksize, false);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&PressureSolver::_computeBordersAirGridThread, this,
-                                 intervals[i], intervals[i + 1], &bordersAir);
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, gridsize, [&](int startidx, int endidx) {
+        _computeBordersAirGridThread(startidx, endidx, &bordersAir);
+    });
 
     std::vector<GridIndex> group;
     Array3d<bool> isProcessed(_isize, _jsize, _ksize, false);
@@ -282,18 +425,14 @@ void PressureSolver::_initializeSurfaceTensionClusterData() {
     */
     Array3d<char> blockstatus(bisize, bjsize, bksize, 0x00);
 
+    // Each block range scans every cell between its first and last block, so
+    // this pass is split into one large chunk per thread
     int gridsize = bisize * bjsize * bksize;
     int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, gridsize);
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, gridsize, numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&PressureSolver::_initializeBlockStatusGridThread, this,
-                                 intervals[i], intervals[i + 1], &blockstatus);
-    }
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    int blockgrainsize = (int)ceil((double)gridsize / (double)numCPU);
+    ThreadUtils::parallelFor(0, gridsize, blockgrainsize, [&](int startidx, int endidx) {
+        _initializeBlockStatusGridThread(startidx, endidx, &blockstatus);
+    });
 
     /*
     char UNSET       = 0x00;
@@ -306,32 +445,22 @@ void PressureSolver::_initializeSurfaceTensionClusterData() {
     _surfaceTensionClusterStatus = Array3d<char>(_isize, _jsize, _ksize, 0x00);
 
     gridsize = _isize * _jsize * _ksize;
-    numthreads = (int)fmin(numCPU, gridsize);
-    threads = std::vector<std::thread>(numthreads);
-    intervals = ThreadUtils::splitRangeIntoIntervals(0, gridsize, numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&PressureSolver::_initializeCellStatusGridThread, this,
-                                 intervals[i], intervals[i + 1], 
-                                 &blockstatus, &_surfaceTensionClusterStatus);
-    }
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
-
-    gridsize = _isize * _jsize * _ksize;
-    numthreads = (int)fmin(numCPU, gridsize);
-    threads = std::vector<std::thread>(numthreads);
-    intervals = ThreadUtils::splitRangeIntoIntervals(0, gridsize, numthreads);
-    std::vector<std::vector<GridIndex> > threadResults(numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&PressureSolver::_findSurfaceCellsThread, this,
-                                 intervals[i], intervals[i + 1], 
-                                 &_surfaceTensionClusterStatus, &(threadResults[i]));
-    }
+    ThreadUtils::parallelFor(0, gridsize, [&](int startidx, int endidx) {
+        _initializeCellStatusGridThread(startidx, endidx, 
+                                        &blockstatus, &_surfaceTensionClusterStatus);
+    });
+
+    int grainsize = ThreadUtils::getGrainSize(0, gridsize, 0);
+    int numchunks = ThreadUtils::getNumChunks(0, gridsize, grainsize);
+    std::vector<std::vector<GridIndex> > threadResults(numchunks);
+    ThreadUtils::parallelFor(0, gridsize, grainsize, [&](int startidx, int endidx) {
+        _findSurfaceCellsThread(startidx, endidx, 
+                                &_surfaceTensionClusterStatus, 
+                                &(threadResults[startidx / grainsize]));
+    });
 
     int cellcount = 0;
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
+    for (size_t i = 0; i < threadResults.size(); i++) {
         cellcount += threadResults[i].size();
     }
 
@@ -341,17 +470,14 @@ void PressureSolver::_initializeSurfaceTensionClusterData() {
         surfaceCells.insert(surfaceCells.end(), threadResults[i].begin(), threadResults[i].end());
     }
 
-    numthreads = (int)fmin(numCPU, surfaceCells.size());
-    threads = std::vector<std::thread>(numthreads);
-    intervals = ThreadUtils::splitRangeIntoIntervals(0, surfaceCells.size(), numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&PressureSolver::_calculateSurfaceCellStatusThread, this,
-                                 intervals[i], intervals[i + 1], 
-                                 &surfaceCells, &_surfaceTensionClusterStatus);
-    }
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    // Each chunk allocates a full size isProcessed grid, so keep one chunk
+    // per thread
+    int numthreads = (int)fmin(numCPU, surfaceCells.size());
+    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, surfaceCells.size(), numthreads);
+    ThreadUtils::parallelFor(0, numthreads, 1, [&](int tidx, int) {
+        _calculateSurfaceCellStatusThread(intervals[tidx], intervals[tidx + 1], 
+                                          &surfaceCells, &_surfaceTensionClusterStatus);
+    });
 }
 
 void PressureSolver::_initializeBlockStatusGridThread(int startidx, int endidx,
@@ -562,19 +688,10 @@ void PressureSolver::_calculateSurfaceCellStatusThread(int startidx, int endidx,
 }
 
 void PressureSolver::_calculateNegativeDivergenceVector(std::vector<double> &rhs) {
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, _pressureCells.size());
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, _pressureCells.size(), 
-                                                                      numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&PressureSolver::_calculateNegativeDivergenceVectorThread, this,
-                                 intervals[i], intervals[i + 1], &rhs);
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    FLUIDSIM_PROFILE_SCOPE("Calculate Divergence");
+    ThreadUtils::parallelFor(0, _pressureCells.size(), [&](int startidx, int endidx) {
+        _calculateNegativeDivergenceVectorThread(startidx, endidx, &rhs);
+    });
 }
 
 void PressureSolver::_calculateNegativeDivergenceVectorThread(int startidx, 
@@ -704,118 +821,187 @@ double PressureSolver::_getSurfaceTensionTerm(GridIndex g1, GridIndex g2) {
     return _surfaceTensionConstant * curvature;
 }
 
-void PressureSolver::_calculateMatrixCoefficients(SparseMatrixd &matrix) {
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, _pressureCells.size());
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, _pressureCells.size(), 
-                                                                      numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&PressureSolver::_calculateMatrixCoefficientsThread, this,
-                                 intervals[i], intervals[i + 1], &matrix);
-    }
+double PressureSolver::_calculateMatrixRow(int i, int j, int k, 
+                                           int neighbours[6], double coefficients[6]) {
+    double factor = _deltaTime / (_dx * _dx);
+    double eps = 1e-9;
 
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
+    GridIndex nbs[6] = {
+        GridIndex(i + 1, j,     k    ), GridIndex(i - 1, j,     k    ),
+        GridIndex(i,     j + 1, k    ), GridIndex(i,     j - 1, k    ),
+        GridIndex(i,     j,     k + 1), GridIndex(i,     j,     k - 1)
+    };
+
+    double vols[6] = {
+        _weightGrid->U(i + 1, j,     k    ), _weightGrid->U(i,     j,     k    ),
+        _weightGrid->V(i,     j + 1, k    ), _weightGrid->V(i,     j,     k    ),
+        _weightGrid->W(i,     j,     k + 1), _weightGrid->W(i,     j,     k    )
+    };
+
+    double phiCenter = _liquidSDF->get(i, j, k);
+    double diag = (vols[0] + vols[1] + vols[2] + vols[3] + vols[4] + vols[5]) * factor;
+
+    // X+, X-, Y+, Y-, Z+, Z- neighbours
+    for (int nidx = 0; nidx < 6; nidx++) {
+        double phi = _liquidSDF->get(nbs[nidx]);
+        if (phi < 0.0) {
+            neighbours[nidx] = _GridToVectorIndex(nbs[nidx]);
+            coefficients[nidx] = -vols[nidx] * factor;
+        } else {
+            double theta = phi / (phiCenter + eps);
+            theta = _clamp(theta, -_maxtheta, _maxtheta);
+            diag -= vols[nidx] * factor * theta;
+            neighbours[nidx] = -1;
+            coefficients[nidx] = 0.0;
+        }
     }
+
+    return std::max(diag, 0.0);
+}
+
+template<class T>
+void PressureSolver::_calculateMatrixCoefficients(FixedSparseMatrix<T> &matrix) {
+    FLUIDSIM_PROFILE_SCOPE("Build Pressure Matrix");
+    FixedSparseMatrixBuilder<T> builder(_matSize, 7);
+    ThreadUtils::parallelFor(0, _pressureCells.size(), [&](int startidx, int endidx) {
+        _calculateMatrixCoefficientsThread(startidx, endidx, &builder);
+    });
+    builder.build(matrix);
 }
 
+template<class T>
 void PressureSolver::_calculateMatrixCoefficientsThread(int startidx, int endidx,
-                                                        SparseMatrixd *matrix) {
-    double factor = _deltaTime / (_dx * _dx);
-    double eps = 1e-9;
+                                                        FixedSparseMatrixBuilder<T> *matrix) {
+    int neighbours[6];
+    double coefficients[6];
     for (int idx = startidx; idx < endidx; idx++) {
         GridIndex g = _pressureCells[idx];
-        int i = g.i;
-        int j = g.j;
-        int k = g.k;
-        int index = _GridToVectorIndex(i, j, k);
-
-        double volRight =  _weightGrid->U(i + 1, j,     k    );
-        double volLeft =   _weightGrid->U(i,     j,     k    );
-        double volTop =    _weightGrid->V(i,     j + 1, k    );
-        double volBottom = _weightGrid->V(i,     j,     k    );
-        double volFront =  _weightGrid->W(i,     j,     k + 1);
-        double volBack =   _weightGrid->W(i,     j,     k    );
-
-        double phiCenter = _liquidSDF->get(i,     j,     k    );
-        double phiRight =  _liquidSDF->get(i + 1, j,     k    );
-        double phiLeft =   _liquidSDF->get(i - 1,     j, k    );
-        double phiTop =    _liquidSDF->get(i,     j + 1, k    );
-        double phiBottom = _liquidSDF->get(i,     j - 1, k    );
-        double phiFront =  _liquidSDF->get(i,     j,     k + 1);
-        double phiBack =   _liquidSDF->get(i,     j,     k - 1);
-
-        double diag = (volRight + volLeft + volTop + volBottom + volFront + volBack) * factor;
-
-        // X+ neighbour
-        if (phiRight < 0.0) {
-            matrix->add(index, _GridToVectorIndex(i + 1, j, k), -volRight * factor);
-        } else {
-            double theta = phiRight / (phiCenter + eps);
-            theta = _clamp(theta, -_maxtheta, _maxtheta);
-            diag -= volRight * factor * theta;
+        int index = _GridToVectorIndex(g);
+        double diag = _calculateMatrixRow(g.i, g.j, g.k, neighbours, coefficients);
+        for (int nidx = 0; nidx < 6; nidx++) {
+            if (neighbours[nidx] != -1) {
+                matrix->add(index, neighbours[nidx], (T)coefficients[nidx]);
+            }
         }
+        matrix->set(index, index, (T)diag);
+    }
+}
 
-        // X- neighbour
-        if (phiLeft < 0.0) {
-            matrix->add(index, _GridToVectorIndex(i - 1, j, k), -volLeft * factor);
-        } else {
-            double theta = phiLeft / (phiCenter + eps);
-            theta = _clamp(theta, -_maxtheta, _maxtheta);
-            diag -= volLeft * factor * theta;
+void PressureSolver::_calculateMatrixDiagonal(std::vector<double> &diagonal) {
+    diagonal.resize(_matSize);
+    ThreadUtils::parallelFor(0, _pressureCells.size(), [&](int startidx, int endidx) {
+        int neighbours[6];
+        double coefficients[6];
+        for (int idx = startidx; idx < endidx; idx++) {
+            GridIndex g = _pressureCells[idx];
+            diagonal[idx] = _calculateMatrixRow(g.i, g.j, g.k, neighbours, coefficients);
         }
+    });
+}
 
-        // Y+ neighbour
-        if (phiTop < 0.0) {
-            matrix->add(index, _GridToVectorIndex(i, j + 1, k), -volTop * factor);
-        } else {
-            double theta = phiTop / (phiCenter + eps);
-            theta = _clamp(theta, -_maxtheta, _maxtheta);
-            diag -= volTop * factor * theta;
-        }
+template<class T, class MatrixType>
+bool PressureSolver::_solveLinearSystem(MatrixType &matrix, std::vector<double> &rhs, 
+                                        std::vector<double> &soln) {
+    StopWatch timer;
+    timer.start();
 
-        // Y- neighbour
-        if (phiBottom < 0.0) {
-            matrix->add(index, _GridToVectorIndex(i, j - 1, k), -volBottom * factor);
-        } else {
-            double theta = phiBottom / (phiCenter + eps);
-            theta = _clamp(theta, -_maxtheta, _maxtheta);
-            diag -= volBottom * factor * theta;
-        }
+    PCGSolver<T, double> solver;
+    MultigridPreconditioner multigrid;
+    _initializeLinearSolver(solver, multigrid);
 
-        // Z+ neighbour
-        if (phiFront < 0.0) {
-            matrix->add(index, _GridToVectorIndex(i, j, k + 1), -volFront * factor);
-        } else {
-            double theta = phiFront / (phiCenter + eps);
-            theta = _clamp(theta, -_maxtheta, _maxtheta);
-            diag -= volFront * factor * theta;
-        }
+    std::vector<double> initialGuess;
+    if (_isPreconditionerComparisonEnabled) {
+        initialGuess = soln;
+    }
 
-        // Z- neighbour
-        if (phiBack < 0.0) {
-            matrix->add(index, _GridToVectorIndex(i, j, k - 1), -volBack * factor);
-        } else {
-            double theta = phiBack / (phiCenter + eps);
-            theta = _clamp(theta, -_maxtheta, _maxtheta);
-            diag -= volBack * factor * theta;
-        }
+    double estimatedError;
+    int numIterations;
+    bool success = solver.solve(matrix, rhs, soln, estimatedError, numIterations);
+
+    timer.stop();
 
-        diag = std::max(diag, 0.0);
-        matrix->set(index, index, diag);
+    bool retval = _updateSolverStatus(success, numIterations, estimatedError, timer.getTime());
+    if (_isPreconditionerComparisonEnabled && _preconditioner != PressurePreconditioner::mic) {
+        _compareWithSerialPreconditioner<T>(matrix, rhs, initialGuess, numIterations, timer.getTime());
     }
+
+    return retval;
 }
 
-bool PressureSolver::_solveLinearSystem(SparseMatrixd &matrix, std::vector<double> &rhs, 
-                                        std::vector<double> &soln) {
-    PCGSolver<double> solver;
+/*
+    Solves the system again with the serial MIC(0) preconditioner and appends
+    its iteration count and solve time to the solver status. The solution of
+    the serial solve is discarded.
+*/
+template<class T, class MatrixType>
+void PressureSolver::_compareWithSerialPreconditioner(MatrixType &matrix, 
+                                                      std::vector<double> &rhs, 
+                                                      std::vector<double> &initialGuess,
+                                                      int numIterations, 
+                                                      double solveTime) {
+    StopWatch timer;
+    timer.start();
+
+    PCGSolver<T, double> solver;
     solver.setSolverParameters(_pressureSolveTolerance, _maxCGIterations);
+    solver.setInitialGuessEnabled(_pressureGrid != nullptr);
+    if (_isMixedPrecisionEnabled) {
+        solver.setMaxRefinementSteps(_maxRefinementSteps);
+    }
 
+    std::vector<double> serialSoln = initialGuess;
     double estimatedError;
-    int numIterations;
-    bool success = solver.solve(matrix, rhs, soln, estimatedError, numIterations);
+    int serialIterations;
+    solver.solve(matrix, rhs, serialSoln, estimatedError, serialIterations);
+
+    timer.stop();
 
+    double speedup = timer.getTime() / std::max(solveTime, 1e-9);
+
+    std::ostringstream ss;
+    ss << "\nSerial MIC(0) Iterations: " << serialIterations <<
+          "\nSerial MIC(0) Estimated Error: " << estimatedError <<
+          "\nSerial MIC(0) Solve Time: " << timer.getTime() << "s" <<
+          "\nIterations vs Serial: " << numIterations << " / " << serialIterations <<
+          "\nSpeedup vs Serial: " << speedup << "x";
+    _solverStatus += ss.str();
+}
+
+template<class T>
+void PressureSolver::_initializeLinearSolver(PCGSolver<T, double> &solver, 
+                                             MultigridPreconditioner &multigrid) {
+    solver.setSolverParameters(_pressureSolveTolerance, _maxCGIterations);
+    solver.setInitialGuessEnabled(_pressureGrid != nullptr);
+    if (_isMixedPrecisionEnabled) {
+        solver.setMaxRefinementSteps(_maxRefinementSteps);
+    }
+
+    if (_preconditioner == PressurePreconditioner::parallelMIC) {
+        _numPreconditionerBlocks = ThreadUtils::getMaxThreadCount();
+        solver.setNumPreconditionerBlocks(_numPreconditionerBlocks);
+    } else if (_preconditioner == PressurePreconditioner::multigrid) {
+        std::vector<double> diagonal;
+        _calculateMatrixDiagonal(diagonal);
+
+        MultigridPreconditionerParameters params;
+        params.isize = _isize;
+        params.jsize = _jsize;
+        params.ksize = _ksize;
+        params.cellwidth = _dx;
+        params.deltaTime = _deltaTime;
+        params.pressureCells = &_pressureCells;
+        params.keymap = &_keymap;
+        params.weightGrid = _weightGrid;
+        params.diagonal = &diagonal;
+        multigrid.initialize(params);
+        _numMultigridLevels = multigrid.getNumLevels();
+
+        solver.setPreconditioner(static_cast<PCGPreconditioner<T>*>(&multigrid));
+    }
+}
+
+bool PressureSolver::_updateSolverStatus(bool success, int numIterations, 
+                                         double estimatedError, double solveTime) {
     bool retval;
     std::ostringstream ss;
     if (success) {
@@ -834,13 +1020,60 @@ bool PressureSolver::_solveLinearSystem(SparseMatrixd &matrix, std::vector<doubl
         retval = false;
     }
 
+    ss << "\nPreconditioner: " << _getPreconditionerName() <<
+          "\nPrecision: " << (_isMixedPrecisionEnabled ? "Mixed (float/double)" : "Double") <<
+          "\nSolve Time: " << solveTime << "s";
+
     _solverStatus = ss.str();
 
     return retval;
 }
 
+std::string PressureSolver::_getPreconditionerName() {
+    if (_preconditioner == PressurePreconditioner::multigrid) {
+        std::ostringstream ss;
+        ss << "Multigrid (" << _numMultigridLevels << " levels)";
+        return ss.str();
+    } else if (_preconditioner == PressurePreconditioner::parallelMIC) {
+        std::ostringstream ss;
+        ss << "Block Jacobi MIC(0) (" << _numPreconditionerBlocks << " blocks)";
+        return ss.str();
+    }
+    return "MIC(0)";
+}
+
+/*
+    Remaps the pressure from the previous solve onto the current pressure
+    cells. Cells that were not liquid in the previous solve start at zero,
+    the air pressure.
+*/
+void PressureSolver::_initializeSolutionVector(std::vector<double> &soln) {
+    if (_pressureGrid == nullptr) {
+        return;
+    }
+
+    FLUIDSIM_ASSERT(_pressureGrid->width == _isize && 
+                    _pressureGrid->height == _jsize && 
+                    _pressureGrid->depth == _ksize);
+
+    for (int i = 0; i < (int)_pressureCells.size(); i++) {
+        soln[i] = _pressureGrid->get(_pressureCells.get(i));
+    }
+}
+
 void PressureSolver::_applySolutionToVelocityField(std::vector<double> &soln) {
-    Array3d<float> pressureGrid(_isize, _jsize, _ksize, 0.0);
+    FLUIDSIM_PROFILE_SCOPE("Apply Pressure");
+    if (_pressureGrid != nullptr) {
+        _pressureGrid->fill(0.0f);
+        _applySolutionToVelocityField(soln, *_pressureGrid);
+    } else {
+        Array3d<float> pressureGrid(_isize, _jsize, _ksize, 0.0f);
+        _applySolutionToVelocityField(soln, pressureGrid);
+    }
+}
+
+void PressureSolver::_applySolutionToVelocityField(std::vector<double> &soln, 
+                                                   Array3d<float> &pressureGrid) {
     for (int i = 0; i < (int)_pressureCells.size(); i++) {
         GridIndex g = _pressureCells.get(i);
         pressureGrid.set(g, soln[i]);
@@ -879,18 +1112,9 @@ void PressureSolver::_applyPressureToVelocityFieldMT(Array3d<float> &pressureGri
         gridsize = _isize * _jsize * (_ksize + 1);
     }
 
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, gridsize);
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, gridsize, numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&PressureSolver::_applyPressureToVelocityFieldThread, this,
-                                 intervals[i], intervals[i + 1], &pressureGrid, &mgrid, dir);
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, gridsize, [&](int startidx, int endidx) {
+        _applyPressureToVelocityFieldThread(startidx, endidx, &pressureGrid, &mgrid, dir);
+    });
 }
 
 void PressureSolver::_applyPressureToVelocityFieldThread(int startidx, int endidx, 
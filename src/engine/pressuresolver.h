@@ -41,6 +41,8 @@ SOFTWARE.
 #include "vmath.h"
 
 class MACVelocityField;
+class MultigridPreconditioner;
+template <class T, class R> struct PCGSolver;
 struct ValidVelocityComponentGrid;
 class ParticleLevelSet;
 class MeshLevelSet;
@@ -60,6 +62,12 @@ struct WeightGrid {
 };
 
 
+enum class PressurePreconditioner : char { 
+    mic         = 0x00, 
+    multigrid   = 0x01,
+    parallelMIC = 0x02
+};
+
 struct PressureSolverParameters {
     double cellwidth;
     double deltaTime;
@@ -76,6 +84,21 @@ struct PressureSolverParameters {
     bool isSurfaceTensionEnabled = false;
     double surfaceTensionConstant;
     Array3d<float> *curvatureGrid;
+
+    bool isMatrixFreeEnabled = false;
+    PressurePreconditioner preconditioner = PressurePreconditioner::mic;
+    bool isPreconditionerComparisonEnabled = false;
+
+    // Store the matrix, preconditioner and work vectors in float while the
+    // solution and reductions stay in double. Iterative refinement restarts
+    // the solve from the true residual up to maxRefinementSteps times to 
+    // reach the tolerance. Not used with the matrix-free operator.
+    bool isMixedPrecisionEnabled = false;
+    int maxRefinementSteps = 2;
+
+    // If set, the pressure stored in this grid is used as the initial guess
+    // and the grid is overwritten with the new pressure after the solve
+    Array3d<float> *pressureGrid = nullptr;
 };
 
 /********************************************************************************
@@ -93,6 +116,8 @@ public:
 
 private:
 
+    class PressureMatrixOperator;
+
     inline int _GridToVectorIndex(GridIndex g) {
         return _keymap.find(g);
     }
@@ -137,12 +162,31 @@ private:
     void _calculateNegativeDivergenceVectorThread(int startidx, 
                                                   int endidx, std::vector<double> *rhs);
     double _getSurfaceTensionTerm(GridIndex g1, GridIndex g2);
-    void _calculateMatrixCoefficients(SparseMatrixd &matrix);
+    double _calculateMatrixRow(int i, int j, int k, 
+                               int neighbours[6], double coefficients[6]);
+    template<class T>
+    void _calculateMatrixCoefficients(FixedSparseMatrix<T> &matrix);
+    template<class T>
     void _calculateMatrixCoefficientsThread(int startidx, int endidx,
-                                            SparseMatrixd *matrix);
-    bool _solveLinearSystem(SparseMatrixd &matrix, std::vector<double> &rhs, 
+                                            FixedSparseMatrixBuilder<T> *matrix);
+    void _calculateMatrixDiagonal(std::vector<double> &diagonal);
+    template<class T, class MatrixType>
+    bool _solveLinearSystem(MatrixType &matrix, std::vector<double> &rhs, 
                             std::vector<double> &soln);
+    template<class T, class MatrixType>
+    void _compareWithSerialPreconditioner(MatrixType &matrix, std::vector<double> &rhs, 
+                                          std::vector<double> &initialGuess, int numIterations, 
+                                          double solveTime);
+    template<class T>
+    void _initializeLinearSolver(PCGSolver<T, double> &solver, 
+                                 MultigridPreconditioner &multigrid);
+    bool _updateSolverStatus(bool success, int numIterations, 
+                             double estimatedError, double solveTime);
+    std::string _getPreconditionerName();
+    void _initializeSolutionVector(std::vector<double> &soln);
     void _applySolutionToVelocityField(std::vector<double> &soln);
+    void _applySolutionToVelocityField(std::vector<double> &soln, 
+                                       Array3d<float> &pressureGrid);
     void _applyPressureToVelocityFieldMT(Array3d<float> &pressureGrid, 
                                          FluidMaterialGrid &mgrid,
                                          int dir);
@@ -174,6 +218,15 @@ private:
     double _surfaceTensionConstant;
     Array3d<float> *_curvatureGrid;
 
+    bool _isMatrixFreeEnabled = false;
+    PressurePreconditioner _preconditioner = PressurePreconditioner::mic;
+    bool _isPreconditionerComparisonEnabled = false;
+    bool _isMixedPrecisionEnabled = false;
+    int _maxRefinementSteps = 2;
+    Array3d<float> *_pressureGrid = nullptr;
+    int _numMultigridLevels = 0;
+    int _numPreconditionerBlocks = 1;
+
     GridIndexVector _pressureCells;
     int _matSize = 0;
     GridIndexKeyMap _keymap;
@@ -0,0 +1,211 @@
+/*
+MIT License
+
+Copyright (c) 2019 Ryan L. Guy
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "profiler.h"
+
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <sstream>
+#include <iomanip>
+
+#if __MINGW32__ && !_WIN64
+    #include "mingw32_threads/mingw.mutex.h"
+    #include "mingw32_threads/mingw.thread.h"
+#else
+    #include <mutex>
+    #include <thread>
+#endif
+
+struct ZoneEvent {
+    const char *name;
+    double startTime;
+    double endTime;
+};
+
+struct ThreadBuffer {
+    std::thread::id id;
+    int index = 0;
+    std::string name;
+    std::vector<ZoneEvent> events;
+};
+
+/*
+    Thread buffers are found by thread id in one of several shards, each 
+    guarded by its own mutex, so that recording threads rarely contend. 
+    Thread local storage is not used as it fails to link against the glibc 
+    compatibility header of the Linux build. A thread that reuses the id of 
+    an exited thread continues the buffer of that thread.
+*/
+struct BufferShard {
+    std::mutex mutex;
+    std::vector<ThreadBuffer*> buffers;
+};
+
+std::atomic<bool> Profiler::_isEnabled(false);
+
+static const int _numBufferShards = 64;
+static BufferShard _bufferShards[_numBufferShards];
+static std::atomic<int> _nextThreadIndex(0);
+static const std::chrono::steady_clock::time_point _startTime = std::chrono::steady_clock::now();
+
+static BufferShard* _getBufferShard(std::thread::id id) {
+    return &(_bufferShards[std::hash<std::thread::id>()(id) % _numBufferShards]);
+}
+
+// shard mutex must be held
+static ThreadBuffer* _getThreadBuffer(BufferShard *shard, std::thread::id id) {
+    for (size_t i = 0; i < shard->buffers.size(); i++) {
+        if (shard->buffers[i]->id == id) {
+            return shard->buffers[i];
+        }
+    }
+
+    ThreadBuffer *buffer = new ThreadBuffer();
+    buffer->id = id;
+    buffer->index = _nextThreadIndex++;
+    shard->buffers.push_back(buffer);
+    return buffer;
+}
+
+static void _writeEscapedString(std::ostream &out, const std::string &str) {
+    out << "\"";
+    for (size_t i = 0; i < str.size(); i++) {
+        char c = str[i];
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if ((unsigned char)c < 0x20) {
+            out << ' ';
+        } else {
+            out << c;
+        }
+    }
+    out << "\"";
+}
+
+void Profiler::enable() {
+    _isEnabled = true;
+}
+
+void Profiler::disable() {
+    _isEnabled = false;
+}
+
+void Profiler::setThreadName(std::string name) {
+    std::thread::id id = std::this_thread::get_id();
+    BufferShard *shard = _getBufferShard(id);
+    std::unique_lock<std::mutex> lock(shard->mutex);
+    _getThreadBuffer(shard, id)->name = name;
+}
+
+/*
+    Collects and clears the events of all threads
+*/
+void Profiler::getChromeTraceData(std::vector<char> &data) {
+    std::vector<ThreadBuffer> buffers;
+    for (int sidx = 0; sidx < _numBufferShards; sidx++) {
+        BufferShard *shard = &(_bufferShards[sidx]);
+        std::unique_lock<std::mutex> lock(shard->mutex);
+        for (size_t bidx = 0; bidx < shard->buffers.size(); bidx++) {
+            ThreadBuffer *buffer = shard->buffers[bidx];
+            if (buffer->events.empty()) {
+                continue;
+            }
+
+            ThreadBuffer collected;
+            collected.index = buffer->index;
+            collected.name = buffer->name;
+            collected.events.swap(buffer->events);
+            buffers.push_back(collected);
+        }
+    }
+
+    std::sort(buffers.begin(), buffers.end(), 
+              [](const ThreadBuffer &a, const ThreadBuffer &b) { return a.index < b.index; });
+
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(3);
+    ss << "{\"traceEvents\":[";
+
+    bool isFirstEvent = true;
+    for (size_t bidx = 0; bidx < buffers.size(); bidx++) {
+        ThreadBuffer *buffer = &(buffers[bidx]);
+        std::vector<ZoneEvent> &events = buffer->events;
+        std::string name = buffer->name;
+
+        if (name.empty()) {
+            name = "Thread " + std::to_string(buffer->index);
+        }
+
+        ss << (isFirstEvent ? "\n" : ",\n");
+        ss << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << buffer->index << 
+              ",\"args\":{\"name\":";
+        _writeEscapedString(ss, name);
+        ss << "}}";
+        isFirstEvent = false;
+
+        for (size_t eidx = 0; eidx < events.size(); eidx++) {
+            ZoneEvent e = events[eidx];
+            ss << ",\n{\"name\":";
+            _writeEscapedString(ss, e.name);
+            ss << ",\"ph\":\"X\",\"pid\":0,\"tid\":" << buffer->index << 
+                  ",\"ts\":" << e.startTime << 
+                  ",\"dur\":" << (e.endTime - e.startTime) << "}";
+        }
+    }
+
+    ss << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+    std::string str = ss.str();
+    data.assign(str.begin(), str.end());
+}
+
+void Profiler::clear() {
+    for (int sidx = 0; sidx < _numBufferShards; sidx++) {
+        BufferShard *shard = &(_bufferShards[sidx]);
+        std::unique_lock<std::mutex> lock(shard->mutex);
+        for (size_t bidx = 0; bidx < shard->buffers.size(); bidx++) {
+            shard->buffers[bidx]->events.clear();
+        }
+    }
+}
+
+// in microseconds
+double Profiler::_getTime() {
+    std::chrono::steady_clock::duration d = std::chrono::steady_clock::now() - _startTime;
+    return std::chrono::duration<double, std::micro>(d).count();
+}
+
+void Profiler::_recordZone(const char *name, double startTime, double endTime) {
+    ZoneEvent e;
+    e.name = name;
+    e.startTime = startTime;
+    e.endTime = endTime;
+
+    std::thread::id id = std::this_thread::get_id();
+    BufferShard *shard = _getBufferShard(id);
+    std::unique_lock<std::mutex> lock(shard->mutex);
+    _getThreadBuffer(shard, id)->events.push_back(e);
+}
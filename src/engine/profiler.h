@@ -0,0 +1,107 @@
+/*
+MIT License
+
+Copyright (c) 2019 Ryan L. Guy
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef FLUIDENGINE_PROFILER_H
+#define FLUIDENGINE_PROFILER_H
+
+#include <vector>
+#include <string>
+#include <atomic>
+
+/*
+    Lightweight scoped profiling.
+
+    FLUIDSIM_PROFILE_SCOPE("Zone Name") times the enclosing scope. Zones may
+    be nested and are recorded into a buffer kept for the calling thread, so
+    threads rarely contend while recording. The zone name must be a string
+    literal, or otherwise outlive the next call to getChromeTraceData.
+
+    While the profiler is disabled a zone costs a single relaxed atomic load.
+    Defining FLUIDSIM_DISABLE_PROFILER removes zones at compile time.
+
+    getChromeTraceData() collects the zones recorded by all threads since the
+    previous call as Chrome trace event JSON, which can be opened in 
+    chrome://tracing or the Perfetto UI.
+*/
+
+namespace Profiler {
+
+    extern std::atomic<bool> _isEnabled;
+
+    extern void enable();
+    extern void disable();
+    inline bool isEnabled() {
+        return _isEnabled.load(std::memory_order_relaxed);
+    }
+
+    /*
+        Names the calling thread in the trace output. Unnamed threads are
+        listed by their index.
+    */
+    extern void setThreadName(std::string name);
+
+    extern void getChromeTraceData(std::vector<char> &data);
+    extern void clear();
+
+    extern double _getTime();
+    extern void _recordZone(const char *name, double startTime, double endTime);
+
+    class ScopedZone
+    {
+    public:
+        explicit ScopedZone(const char *name) {
+            if (isEnabled()) {
+                _name = name;
+                _startTime = _getTime();
+            }
+        }
+
+        ~ScopedZone() {
+            if (_name != nullptr) {
+                _recordZone(_name, _startTime, _getTime());
+            }
+        }
+
+    private:
+        ScopedZone(const ScopedZone &);
+        ScopedZone& operator=(const ScopedZone &);
+
+        const char *_name = nullptr;
+        double _startTime = 0.0;
+    };
+
+}
+
+#define FLUIDSIM_PROFILE_CONCAT_INNER(a, b) a##b
+#define FLUIDSIM_PROFILE_CONCAT(a, b) FLUIDSIM_PROFILE_CONCAT_INNER(a, b)
+
+#ifdef FLUIDSIM_DISABLE_PROFILER
+    #define FLUIDSIM_PROFILE_SCOPE(name)
+#else
+    #define FLUIDSIM_PROFILE_SCOPE(name) \
+        Profiler::ScopedZone FLUIDSIM_PROFILE_CONCAT(_profilerZone, __LINE__)(name)
+#endif
+
+#endif
@@ -554,6 +554,21 @@ class FluidSimulation(object):
         pb.init_lib_func(libfunc, [c_void_p, c_void_p], None)
         pb.execute_lib_func(libfunc, [self()])
 
+    @property
+    def enable_profiling(self):
+        libfunc = lib.FluidSimulation_is_profiling_enabled
+        pb.init_lib_func(libfunc, [c_void_p, c_void_p], c_int)
+        return bool(pb.execute_lib_func(libfunc, [self()]))
+
+    @enable_profiling.setter
+    def enable_profiling(self, boolval):
+        if boolval:
+            libfunc = lib.FluidSimulation_enable_profiling
+        else:
+            libfunc = lib.FluidSimulation_disable_profiling
+        pb.init_lib_func(libfunc, [c_void_p, c_void_p], None)
+        pb.execute_lib_func(libfunc, [self()])
+
     @property
     def enable_diffuse_material_output(self):
         libfunc = lib.FluidSimulation_is_diffuse_material_output_enabled
@@ -1484,6 +1499,91 @@ class FluidSimulation(object):
         pb.init_lib_func(libfunc, [c_void_p, c_void_p], None)
         pb.execute_lib_func(libfunc, [self()])
 
+    @property
+    def enable_matrix_free_pressure_solver(self):
+        libfunc = lib.FluidSimulation_is_matrix_free_pressure_solver_enabled
+        pb.init_lib_func(libfunc, [c_void_p, c_void_p], c_int)
+        return bool(pb.execute_lib_func(libfunc, [self()]))
+
+    @enable_matrix_free_pressure_solver.setter
+    def enable_matrix_free_pressure_solver(self, boolval):
+        if boolval:
+            libfunc = lib.FluidSimulation_enable_matrix_free_pressure_solver
+        else:
+            libfunc = lib.FluidSimulation_disable_matrix_free_pressure_solver
+        pb.init_lib_func(libfunc, [c_void_p, c_void_p], None)
+        pb.execute_lib_func(libfunc, [self()])
+
+    @property
+    def pressure_solver_preconditioner(self):
+        libfunc = lib.FluidSimulation_get_pressure_solver_preconditioner
+        pb.init_lib_func(libfunc, [c_void_p, c_void_p], c_int)
+        return pb.execute_lib_func(libfunc, [self()])
+
+    @pressure_solver_preconditioner.setter
+    def pressure_solver_preconditioner(self, preconditioner):
+        libfunc = lib.FluidSimulation_set_pressure_solver_preconditioner
+        pb.init_lib_func(libfunc, [c_void_p, c_int, c_void_p], None)
+        pb.execute_lib_func(libfunc, [self(), int(preconditioner)])
+
+    @property
+    def enable_pressure_solver_preconditioner_comparison(self):
+        libfunc = lib.FluidSimulation_is_pressure_solver_preconditioner_comparison_enabled
+        pb.init_lib_func(libfunc, [c_void_p, c_void_p], c_int)
+        return bool(pb.execute_lib_func(libfunc, [self()]))
+
+    @enable_pressure_solver_preconditioner_comparison.setter
+    def enable_pressure_solver_preconditioner_comparison(self, boolval):
+        if boolval:
+            libfunc = lib.FluidSimulation_enable_pressure_solver_preconditioner_comparison
+        else:
+            libfunc = lib.FluidSimulation_disable_pressure_solver_preconditioner_comparison
+        pb.init_lib_func(libfunc, [c_void_p, c_void_p], None)
+        pb.execute_lib_func(libfunc, [self()])
+
+    @property
+    def enable_pressure_solver_warm_start(self):
+        libfunc = lib.FluidSimulation_is_pressure_solver_warm_start_enabled
+        pb.init_lib_func(libfunc, [c_void_p, c_void_p], c_int)
+        return bool(pb.execute_lib_func(libfunc, [self()]))
+
+    @enable_pressure_solver_warm_start.setter
+    def enable_pressure_solver_warm_start(self, boolval):
+        if boolval:
+            libfunc = lib.FluidSimulation_enable_pressure_solver_warm_start
+        else:
+            libfunc = lib.FluidSimulation_disable_pressure_solver_warm_start
+        pb.init_lib_func(libfunc, [c_void_p, c_void_p], None)
+        pb.execute_lib_func(libfunc, [self()])
+
+    @property
+    def enable_mixed_precision_pressure_solver(self):
+        libfunc = lib.FluidSimulation_is_mixed_precision_pressure_solver_enabled
+        pb.init_lib_func(libfunc, [c_void_p, c_void_p], c_int)
+        return bool(pb.execute_lib_func(libfunc, [self()]))
+
+    @enable_mixed_precision_pressure_solver.setter
+    def enable_mixed_precision_pressure_solver(self, boolval):
+        if boolval:
+            libfunc = lib.FluidSimulation_enable_mixed_precision_pressure_solver
+        else:
+            libfunc = lib.FluidSimulation_disable_mixed_precision_pressure_solver
+        pb.init_lib_func(libfunc, [c_void_p, c_void_p], None)
+        pb.execute_lib_func(libfunc, [self()])
+
+    @property
+    def pressure_solver_refinement_steps(self):
+        libfunc = lib.FluidSimulation_get_pressure_solver_refinement_steps
+        pb.init_lib_func(libfunc, [c_void_p, c_void_p], c_int)
+        return pb.execute_lib_func(libfunc, [self()])
+
+    @pressure_solver_refinement_steps.setter
+    @decorators.check_ge_zero
+    def pressure_solver_refinement_steps(self, n):
+        libfunc = lib.FluidSimulation_set_pressure_solver_refinement_steps
+        pb.init_lib_func(libfunc, [c_void_p, c_int, c_void_p], None)
+        pb.execute_lib_func(libfunc, [self(), int(n)])
+
     def add_mesh_fluid_source(self, mesh_fluid_source):
         libfunc = lib.FluidSimulation_add_mesh_fluid_source
         pb.init_lib_func(libfunc, [c_void_p, c_void_p, c_void_p], None)
@@ -1564,6 +1664,50 @@ class FluidSimulation(object):
 
         return out
 
+    def get_num_marker_particle_fragments(self):
+        libfunc = lib.FluidSimulation_get_num_marker_particle_fragments
+        pb.init_lib_func(libfunc, [c_void_p, c_void_p], c_int)
+        return pb.execute_lib_func(libfunc, [self()])
+
+    def get_marker_particle_fragment_view(self, fragment_index):
+        nfragments = self.get_num_marker_particle_fragments()
+        if not isinstance(fragment_index, int):
+            raise TypeError("Fragment index must be an integer")
+        if fragment_index < 0 or fragment_index >= nfragments:
+            raise IndexError("fragment_index out of range: " + str(fragment_index))
+
+        libfunc = lib.FluidSimulation_get_marker_particle_fragment_view
+        pb.init_lib_func(libfunc, [c_void_p, c_int, c_void_p], 
+                         FluidSimulationMarkerParticleFragmentView_t)
+        return pb.execute_lib_func(libfunc, [self(), fragment_index])
+
+    # Returns one dict per fragment with the start index, size and the 
+    # position and velocity streams as ctypes float arrays that share the
+    # simulator's memory. Streams that are not stored as 32-bit floats are 
+    # None. The arrays support the buffer protocol and may be wrapped 
+    # without copying, e.g. numpy.frombuffer(view['position_x'], 
+    # dtype=numpy.float32). Views are invalidated by the next update.
+    def get_marker_particle_fragment_views(self):
+        views = []
+        for fidx in range(self.get_num_marker_particle_fragments()):
+            v = self.get_marker_particle_fragment_view(fidx)
+            views.append({
+                "start_index": v.start_index,
+                "size": v.size,
+                "position_x": self._get_stream_view(v.positions_x, v.size),
+                "position_y": self._get_stream_view(v.positions_y, v.size),
+                "position_z": self._get_stream_view(v.positions_z, v.size),
+                "velocity_x": self._get_stream_view(v.velocities_x, v.size),
+                "velocity_y": self._get_stream_view(v.velocities_y, v.size),
+                "velocity_z": self._get_stream_view(v.velocities_z, v.size)
+            })
+        return views
+
+    def _get_stream_view(self, address, size):
+        if not address:
+            return None
+        return (c_float * size).from_address(address)
+
     def get_num_diffuse_particles(self):
         libfunc = lib.FluidSimulation_get_num_diffuse_particles
         pb.init_lib_func(libfunc, [c_void_p, c_void_p], c_int)
@@ -1695,6 +1839,11 @@ class FluidSimulation(object):
                                          lib.FluidSimulation_get_logfile_data)
         return byte_str.decode("utf-8")
 
+    def get_profiling_trace_data(self):
+        byte_str = self._get_output_data(lib.FluidSimulation_get_profiling_trace_data_size,
+                                         lib.FluidSimulation_get_profiling_trace_data)
+        return byte_str.decode("utf-8")
+
     def get_frame_stats_data(self):
         libfunc = lib.FluidSimulation_get_frame_stats_data
         pb.init_lib_func(libfunc, [c_void_p, c_void_p], FluidSimulationFrameStats_t)
@@ -1844,6 +1993,17 @@ class FluidSimulationMarkerParticleData_t(ctypes.Structure):
                 ("positions", c_char_p),
                 ("velocities", c_char_p)]
 
+class FluidSimulationMarkerParticleFragmentView_t(ctypes.Structure):
+    _fields_ = [("size", c_int),
+                ("start_index", c_int),
+                ("stride", c_int),
+                ("positions_x", c_void_p),
+                ("positions_y", c_void_p),
+                ("positions_z", c_void_p),
+                ("velocities_x", c_void_p),
+                ("velocities_y", c_void_p),
+                ("velocities_z", c_void_p)]
+
 class FluidSimulationDiffuseParticleData_t(ctypes.Structure):
     _fields_ = [("size", c_int),
                 ("positions", c_char_p),
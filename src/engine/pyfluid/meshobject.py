@@ -64,6 +64,19 @@ class MeshObject():
                                               mesh_struct_current, 
                                               mesh_struct_next])
 
+    def set_mesh_transforms(self, matrix_previous, matrix_current, matrix_next):
+        matrices = []
+        for m in [matrix_previous, matrix_current, matrix_next]:
+            matrix = (c_float * 16)()
+            for i, v in enumerate(m):
+                matrix[i] = v
+            matrices.append(matrix)
+
+        libfunc = lib.MeshObject_set_mesh_transforms
+        args = [c_void_p, c_void_p, c_void_p, c_void_p, c_void_p]
+        pb.init_lib_func(libfunc, args, None)
+        pb.execute_lib_func(libfunc, [self()] + matrices)
+
     @property
     def enable(self):
         libfunc = lib.MeshObject_is_enabled
@@ -160,6 +173,21 @@ class MeshObject():
         pb.init_lib_func(libfunc, [c_void_p, c_void_p], None)
         pb.execute_lib_func(libfunc, [self()])
 
+    @property
+    def enable_rigid_mesh_levelset_cache(self):
+        libfunc = lib.MeshObject_is_rigid_mesh_levelset_cache_enabled
+        pb.init_lib_func(libfunc, [c_void_p, c_void_p], c_int)
+        return bool(pb.execute_lib_func(libfunc, [self()]))
+
+    @enable_rigid_mesh_levelset_cache.setter
+    def enable_rigid_mesh_levelset_cache(self, boolval):
+        if boolval:
+            libfunc = lib.MeshObject_enable_rigid_mesh_levelset_cache
+        else:
+            libfunc = lib.MeshObject_disable_rigid_mesh_levelset_cache
+        pb.init_lib_func(libfunc, [c_void_p, c_void_p], None)
+        pb.execute_lib_func(libfunc, [self()])
+
     @property
     def object_velocity_influence(self):
         libfunc = lib.MeshObject_get_object_velocity_influence
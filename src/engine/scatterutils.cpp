@@ -0,0 +1,83 @@
+/*
+MIT License
+
+Copyright (c) 2019 Ryan L. Guy
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "scatterutils.h"
+
+#include "sortutils.h"
+
+namespace ScatterUtils {
+
+int getColorStride(int reach, int blockwidth) {
+    // Blocks of the same color are colorStride blocks apart. The highest 
+    // node written from one block must lie below the lowest node written 
+    // from the next block of the same color.
+    for (int stride = 2; stride <= 3; stride++) {
+        if (2 * reach <= (stride - 1) * blockwidth) {
+            return stride;
+        }
+    }
+    return 0;
+}
+
+void sortPointsIntoBlocks(const std::vector<uint64_t> &blockKeys, 
+                          int numBlocks,
+                          std::vector<int> &order,
+                          std::vector<int> &blockStart) {
+    SortUtils::radixSortIndices(blockKeys, numBlocks > 0 ? numBlocks - 1 : 0, order);
+
+    // blockStart[b] is the first sorted position with a key of at least b.
+    // Each boundary between keys fills the starts of the blocks in between.
+    int n = (int)order.size();
+    blockStart = std::vector<int>(numBlocks + 1, 0);
+    ThreadUtils::parallelFor(0, n + 1, [&](int startidx, int endidx) {
+        for (int i = startidx; i < endidx; i++) {
+            int prevKey = i == 0 ? -1 : (int)blockKeys[order[i - 1]];
+            int key = i == n ? numBlocks : (int)blockKeys[order[i]];
+            for (int b = prevKey + 1; b <= key; b++) {
+                blockStart[b] = i;
+            }
+        }
+    });
+}
+
+void getBlockColorGroups(Dims3d blockdims,
+                         const std::vector<int> &blockStart,
+                         int colorStride,
+                         std::vector<std::vector<int> > &colorGroups) {
+    colorGroups = std::vector<std::vector<int> >(colorStride * colorStride * colorStride);
+    int numBlocks = blockdims.i * blockdims.j * blockdims.k;
+    for (int bidx = 0; bidx < numBlocks; bidx++) {
+        if (blockStart[bidx + 1] == blockStart[bidx]) {
+            continue;
+        }
+
+        GridIndex b = Grid3d::getUnflattenedIndex(bidx, blockdims.i, blockdims.j);
+        int color = (b.i % colorStride) + 
+                    colorStride * ((b.j % colorStride) + colorStride * (b.k % colorStride));
+        colorGroups[color].push_back(bidx);
+    }
+}
+
+}
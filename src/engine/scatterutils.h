@@ -0,0 +1,107 @@
+/*
+MIT License
+
+Copyright (c) 2019 Ryan L. Guy
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef FLUIDENGINE_SCATTERUTILS_H
+#define FLUIDENGINE_SCATTERUTILS_H
+
+#include <vector>
+#include <cstdint>
+
+#include "blockarray3d.h"
+#include "threadutils.h"
+
+/*
+    Method used to scatter particles onto block grids
+
+    ParticleScatterMethod::queue   - Particles are copied into every block 
+                                     that they overlap. Blocks are computed
+                                     independently by worker threads through 
+                                     a shared queue and merged into the 
+                                     output grid by the calling thread.
+    ParticleScatterMethod::colored - Particles are sorted once into the block
+                                     that contains them. Blocks are split 
+                                     into colors so that particles of blocks 
+                                     with the same color never write to the
+                                     same grid node. The colors are processed
+                                     in turn with the blocks of a color 
+                                     writing directly into the block grid in
+                                     parallel.
+*/
+enum class ParticleScatterMethod : char { 
+    queue   = 0x00, 
+    colored = 0x01
+};
+
+namespace ScatterUtils {
+
+    /*
+        Number of colors along each axis needed so that the footprints of 
+        particles in blocks of the same color do not overlap. reach is the
+        number of grid nodes that a particle footprint may extend past the
+        block that contains the particle. Returns 0 if the footprint is too
+        large for the block width to be colored.
+    */
+    int getColorStride(int reach, int blockwidth);
+
+    /*
+        Groups points by block. blockKeys holds the flat block index of 
+        each point. On return, the points in block b are 
+        order[blockStart[b]] to order[blockStart[b + 1] - 1] in increasing 
+        point index.
+    */
+    void sortPointsIntoBlocks(const std::vector<uint64_t> &blockKeys, 
+                              int numBlocks,
+                              std::vector<int> &order,
+                              std::vector<int> &blockStart);
+
+    /*
+        Splits the blocks that contain points into colorStride^3 groups. 
+        Blocks in the same group may be computed concurrently.
+    */
+    void getBlockColorGroups(Dims3d blockdims,
+                             const std::vector<int> &blockStart,
+                             int colorStride,
+                             std::vector<std::vector<int> > &colorGroups);
+
+    /*
+        Runs func(blockIndex) for each block of each color group. The groups
+        are processed one at a time and the blocks within a group in 
+        parallel.
+    */
+    template<class Func>
+    void parallelForEachColor(const std::vector<std::vector<int> > &colorGroups, 
+                              Func func) {
+        for (size_t cidx = 0; cidx < colorGroups.size(); cidx++) {
+            const std::vector<int> &group = colorGroups[cidx];
+            ThreadUtils::parallelFor(0, (int)group.size(), 1, [&](int startidx, int endidx) {
+                for (int i = startidx; i < endidx; i++) {
+                    func(group[i]);
+                }
+            });
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,111 @@
+/*
+MIT License
+
+Copyright (c) 2019 Ryan L. Guy
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "sortutils.h"
+
+#include <algorithm>
+
+#include "threadutils.h"
+
+namespace SortUtils {
+
+static unsigned int _spreadBits10(unsigned int x) {
+    x &= 0x000003ff;
+    x = (x | (x << 16)) & 0xff0000ff;
+    x = (x | (x << 8))  & 0x0300f00f;
+    x = (x | (x << 4))  & 0x030c30c3;
+    x = (x | (x << 2))  & 0x09249249;
+    return x;
+}
+
+unsigned int mortonCode3D(unsigned int i, unsigned int j, unsigned int k) {
+    return _spreadBits10(i) | (_spreadBits10(j) << 1) | (_spreadBits10(k) << 2);
+}
+
+void radixSortIndices(const std::vector<uint64_t> &keys, 
+                      uint64_t maxKey, 
+                      std::vector<int> &order) {
+    int n = (int)keys.size();
+    order.resize(n);
+    for (int i = 0; i < n; i++) {
+        order[i] = i;
+    }
+
+    if (n <= 1 || maxKey == 0) {
+        return;
+    }
+
+    const int radix = 256;
+    const int grainSize = 65536;
+    int numChunks = ThreadUtils::getNumChunks(0, n, grainSize);
+
+    std::vector<uint64_t> keysA(keys);
+    std::vector<uint64_t> keysB(n);
+    std::vector<int> orderB(n);
+    std::vector<int> offsets(numChunks * radix);
+
+    for (int shift = 0; shift < 64 && (maxKey >> shift) > 0; shift += 8) {
+        std::fill(offsets.begin(), offsets.end(), 0);
+        ThreadUtils::parallelFor(0, numChunks, 1, [&](int chunkBegin, int chunkEnd) {
+            for (int c = chunkBegin; c < chunkEnd; c++) {
+                int *counts = &(offsets[c * radix]);
+                int begin = c * grainSize;
+                int end = std::min(begin + grainSize, n);
+                for (int i = begin; i < end; i++) {
+                    counts[(keysA[i] >> shift) & 0xff]++;
+                }
+            }
+        });
+
+        // Each chunk scatters a digit after all smaller digits and after the
+        // same digit of all previous chunks, which keeps the sort stable
+        int sum = 0;
+        for (int d = 0; d < radix; d++) {
+            for (int c = 0; c < numChunks; c++) {
+                int count = offsets[c * radix + d];
+                offsets[c * radix + d] = sum;
+                sum += count;
+            }
+        }
+
+        ThreadUtils::parallelFor(0, numChunks, 1, [&](int chunkBegin, int chunkEnd) {
+            for (int c = chunkBegin; c < chunkEnd; c++) {
+                int *dstOffsets = &(offsets[c * radix]);
+                int begin = c * grainSize;
+                int end = std::min(begin + grainSize, n);
+                for (int i = begin; i < end; i++) {
+                    int dst = dstOffsets[(keysA[i] >> shift) & 0xff]++;
+                    keysB[dst] = keysA[i];
+                    orderB[dst] = order[i];
+                }
+            }
+        });
+
+        keysA.swap(keysB);
+        order.swap(orderB);
+    }
+}
+
+}
@@ -0,0 +1,50 @@
+/*
+MIT License
+
+Copyright (c) 2019 Ryan L. Guy
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef FLUIDENGINE_SORTUTILS_H
+#define FLUIDENGINE_SORTUTILS_H
+
+#include <vector>
+#include <cstdint>
+
+namespace SortUtils {
+
+    /*
+        Interleaves the low 10 bits of i, j and k into a 30 bit Morton code.
+    */
+    unsigned int mortonCode3D(unsigned int i, unsigned int j, unsigned int k);
+
+    /*
+        Stable parallel LSD radix sort. On return, order[n] holds the index 
+        of the key with rank n in ascending key order. Only the 8 bit digits
+        needed to represent maxKey are sorted. For a fixed input the result
+        does not depend on the number of threads.
+    */
+    void radixSortIndices(const std::vector<uint64_t> &keys, 
+                          uint64_t maxKey, 
+                          std::vector<int> &order);
+}
+
+#endif
@@ -0,0 +1,288 @@
+/*
+MIT License
+
+Copyright (c) 2019 Ryan L. Guy
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "taskgraph.h"
+
+#include <algorithm>
+
+#include "threadutils.h"
+#include "stopwatch.h"
+#include "fluidsimassert.h"
+
+TaskGraph::TaskGraph() {
+}
+
+TaskGraph::~TaskGraph() {
+}
+
+int TaskGraph::addTask(std::string name, std::function<void()> func) {
+    Task task;
+    task.name = name;
+    task.func = func;
+    _tasks.push_back(task);
+    return (int)_tasks.size() - 1;
+}
+
+/*
+    Task taskID will not start until task dependencyID has completed. A 
+    dependencyID of -1 is ignored.
+*/
+void TaskGraph::addDependency(int taskID, int dependencyID) {
+    if (dependencyID == -1) {
+        return;
+    }
+
+    FLUIDSIM_ASSERT(taskID >= 0 && taskID < (int)_tasks.size());
+    FLUIDSIM_ASSERT(dependencyID >= 0 && dependencyID < taskID);
+
+    _tasks[taskID].dependencies.push_back(dependencyID);
+    _tasks[dependencyID].dependents.push_back(taskID);
+}
+
+void TaskGraph::clear() {
+    _tasks.clear();
+    _runTime = 0.0;
+    _criticalPathTime = 0.0;
+    _criticalPath.clear();
+}
+
+void TaskGraph::run() {
+    for (size_t i = 0; i < _tasks.size(); i++) {
+        _tasks[i].numRemainingDependencies = (int)_tasks[i].dependencies.size();
+        _tasks[i].time = 0.0;
+    }
+    _readyQueue.clear();
+    _numCompletedTasks = 0;
+    _isCallerWaiting = false;
+    _exception = nullptr;
+
+    StopWatch timer;
+    timer.start();
+
+    if (ThreadUtils::getMaxThreadCount() <= 1) {
+        _runSerial();
+    } else {
+        _runParallel();
+    }
+
+    timer.stop();
+    _runTime = timer.getTime();
+    _calculateCriticalPath();
+
+    if (_exception) {
+        std::exception_ptr e = _exception;
+        _exception = nullptr;
+        std::rethrow_exception(e);
+    }
+}
+
+int TaskGraph::getNumTasks() {
+    return (int)_tasks.size();
+}
+
+std::string TaskGraph::getTaskName(int taskID) {
+    FLUIDSIM_ASSERT(taskID >= 0 && taskID < (int)_tasks.size());
+    return _tasks[taskID].name;
+}
+
+double TaskGraph::getTaskTime(int taskID) {
+    FLUIDSIM_ASSERT(taskID >= 0 && taskID < (int)_tasks.size());
+    return _tasks[taskID].time;
+}
+
+double TaskGraph::getRunTime() {
+    return _runTime;
+}
+
+double TaskGraph::getTotalTaskTime() {
+    double total = 0.0;
+    for (size_t i = 0; i < _tasks.size(); i++) {
+        total += _tasks[i].time;
+    }
+    return total;
+}
+
+double TaskGraph::getCriticalPathTime() {
+    return _criticalPathTime;
+}
+
+std::vector<int> TaskGraph::getCriticalPath() {
+    return _criticalPath;
+}
+
+void TaskGraph::_runSerial() {
+    for (size_t i = 0; i < _tasks.size(); i++) {
+        _executeTask((int)i);
+    }
+    _numCompletedTasks = (int)_tasks.size();
+}
+
+/*
+    The calling thread runs one ready task at a time and hands any other
+    ready tasks to the pool. A pool thread that completes a task continues
+    with a newly ready task itself unless the calling thread is idle, so
+    that the serial parts of the graph stay on the calling thread.
+*/
+void TaskGraph::_runParallel() {
+    int numTasks = (int)_tasks.size();
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (int i = 0; i < numTasks; i++) {
+        if (_tasks[i].numRemainingDependencies == 0) {
+            _readyQueue.push_back(i);
+        }
+    }
+
+    while (_numCompletedTasks < numTasks) {
+        if (_readyQueue.empty()) {
+            _isCallerWaiting = true;
+            _condition.wait(lock, [this, numTasks]() {
+                return !_readyQueue.empty() || _numCompletedTasks == numTasks;
+            });
+            _isCallerWaiting = false;
+            continue;
+        }
+
+        int taskID = _readyQueue.front();
+        _readyQueue.pop_front();
+        while (!_readyQueue.empty()) {
+            _submitTask(_readyQueue.front());
+            _readyQueue.pop_front();
+        }
+
+        lock.unlock();
+        _executeTask(taskID);
+        lock.lock();
+
+        std::vector<int> readyTasks;
+        _completeTask(taskID, readyTasks);
+        _readyQueue.insert(_readyQueue.end(), readyTasks.begin(), readyTasks.end());
+    }
+}
+
+void TaskGraph::_submitTask(int taskID) {
+    ThreadUtils::submitTask([this, taskID]() {
+        _executeTaskFromPool(taskID);
+    });
+}
+
+void TaskGraph::_executeTask(int taskID) {
+    Task &task = _tasks[taskID];
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_exception) {
+            return;
+        }
+    }
+
+    StopWatch timer;
+    timer.start();
+    try {
+        task.func();
+    } catch (...) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (!_exception) {
+            _exception = std::current_exception();
+        }
+    }
+    timer.stop();
+    task.time = timer.getTime();
+}
+
+void TaskGraph::_executeTaskFromPool(int taskID) {
+    for (;;) {
+        _executeTask(taskID);
+
+        std::vector<int> readyTasks;
+        {
+            // The graph may be destroyed as soon as the last task completes,
+            // so no members are accessed after releasing the lock in that case
+            std::unique_lock<std::mutex> lock(_mutex);
+            _completeTask(taskID, readyTasks);
+            if (_isCallerWaiting && !readyTasks.empty()) {
+                _readyQueue.insert(_readyQueue.end(), readyTasks.begin(), readyTasks.end());
+                readyTasks.clear();
+            }
+            if (!_readyQueue.empty() || _numCompletedTasks == (int)_tasks.size()) {
+                _condition.notify_all();
+            }
+        }
+
+        if (readyTasks.empty()) {
+            return;
+        }
+
+        for (size_t i = 1; i < readyTasks.size(); i++) {
+            _submitTask(readyTasks[i]);
+        }
+        taskID = readyTasks[0];
+    }
+}
+
+// Must be called with _mutex locked
+void TaskGraph::_completeTask(int taskID, std::vector<int> &readyTasks) {
+    _numCompletedTasks++;
+    std::vector<int> &dependents = _tasks[taskID].dependents;
+    for (size_t i = 0; i < dependents.size(); i++) {
+        Task &dependent = _tasks[dependents[i]];
+        dependent.numRemainingDependencies--;
+        if (dependent.numRemainingDependencies == 0) {
+            readyTasks.push_back(dependents[i]);
+        }
+    }
+}
+
+void TaskGraph::_calculateCriticalPath() {
+    int numTasks = (int)_tasks.size();
+    std::vector<double> finishTimes(numTasks, 0.0);
+    std::vector<int> previous(numTasks, -1);
+
+    // Tasks only depend on earlier tasks, so the order of addition is a 
+    // topological order
+    _criticalPathTime = 0.0;
+    int last = -1;
+    for (int i = 0; i < numTasks; i++) {
+        double startTime = 0.0;
+        std::vector<int> &dependencies = _tasks[i].dependencies;
+        for (size_t j = 0; j < dependencies.size(); j++) {
+            if (finishTimes[dependencies[j]] > startTime || previous[i] == -1) {
+                startTime = finishTimes[dependencies[j]];
+                previous[i] = dependencies[j];
+            }
+        }
+
+        finishTimes[i] = startTime + _tasks[i].time;
+        if (last == -1 || finishTimes[i] > _criticalPathTime) {
+            _criticalPathTime = finishTimes[i];
+            last = i;
+        }
+    }
+
+    _criticalPath.clear();
+    for (int i = last; i != -1; i = previous[i]) {
+        _criticalPath.push_back(i);
+    }
+    std::reverse(_criticalPath.begin(), _criticalPath.end());
+}
@@ -0,0 +1,114 @@
+/*
+MIT License
+
+Copyright (c) 2019 Ryan L. Guy
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef FLUIDENGINE_TASKGRAPH_H
+#define FLUIDENGINE_TASKGRAPH_H
+
+#if __MINGW32__ && !_WIN64
+    #include <mutex>
+    #include "mingw32_threads/mingw.thread.h"
+    #include "mingw32_threads/mingw.condition_variable.h"
+    #include "mingw32_threads/mingw.mutex.h"
+#else
+    #include <thread>
+    #include <mutex>
+    #include <condition_variable>
+#endif
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <functional>
+#include <exception>
+
+/*
+    A dependency graph of tasks that is executed on the shared thread pool.
+    A task starts as soon as all of the tasks that it depends on have
+    completed, so independent tasks run concurrently. Tasks may use
+    ThreadUtils::parallelFor internally.
+
+    A task may only depend on tasks that were added before it, which keeps
+    the graph acyclic and makes the order of addition a valid serial order.
+    The calling thread of run() also executes tasks. If a task throws, tasks
+    that have not yet started are skipped and the exception is rethrown from
+    run().
+
+    After run(), the time of each task and the critical path, the longest
+    chain of dependent task times, are available. The critical path time is
+    the lower bound for the run time of the graph given unlimited threads.
+*/
+class TaskGraph
+{
+public:
+    TaskGraph();
+    ~TaskGraph();
+
+    int addTask(std::string name, std::function<void()> func);
+    void addDependency(int taskID, int dependencyID);
+    void clear();
+    void run();
+
+    int getNumTasks();
+    std::string getTaskName(int taskID);
+    double getTaskTime(int taskID);
+    double getRunTime();
+    double getTotalTaskTime();
+    double getCriticalPathTime();
+    std::vector<int> getCriticalPath();
+
+private:
+
+    struct Task {
+        std::string name;
+        std::function<void()> func;
+        std::vector<int> dependencies;
+        std::vector<int> dependents;
+        int numRemainingDependencies = 0;
+        double time = 0.0;
+    };
+
+    void _runSerial();
+    void _runParallel();
+    void _submitTask(int taskID);
+    void _executeTask(int taskID);
+    void _executeTaskFromPool(int taskID);
+    void _completeTask(int taskID, std::vector<int> &readyTasks);
+    void _calculateCriticalPath();
+
+    std::vector<Task> _tasks;
+
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::deque<int> _readyQueue;
+    int _numCompletedTasks = 0;
+    bool _isCallerWaiting = false;
+    std::exception_ptr _exception;
+
+    double _runTime = 0.0;
+    double _criticalPathTime = 0.0;
+    std::vector<int> _criticalPath;
+};
+
+#endif
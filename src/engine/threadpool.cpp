@@ -0,0 +1,160 @@
+/*
+MIT License
+
+Copyright (c) 2019 Ryan L. Guy
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "threadpool.h"
+
+#include "fluidsimassert.h"
+#include "profiler.h"
+
+ThreadPool::ThreadPool() {
+    _initializeWorkers((int)std::thread::hardware_concurrency());
+}
+
+ThreadPool::ThreadPool(int numWorkers) {
+    _initializeWorkers(numWorkers);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::unique_lock<std::mutex> lock(_sleepMutex);
+        _isStopped = true;
+    }
+    _sleepCondition.notify_all();
+
+    for (size_t i = 0; i < _workers.size(); i++) {
+        _workers[i].join();
+    }
+
+    for (size_t i = 0; i < _queues.size(); i++) {
+        delete _queues[i];
+    }
+}
+
+int ThreadPool::getNumWorkers() {
+    return (int)_workers.size();
+}
+
+bool ThreadPool::isWorkerThread() {
+    return _getWorkerIndex(std::this_thread::get_id()) != -1;
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    FLUIDSIM_ASSERT(!_queues.empty());
+
+    int queueIndex = _getWorkerIndex(std::this_thread::get_id());
+    if (queueIndex == -1) {
+        queueIndex = (int)(_nextQueueIndex++ % (unsigned int)_queues.size());
+    }
+
+    WorkQueue *queue = _queues[queueIndex];
+    {
+        std::unique_lock<std::mutex> lock(queue->mutex);
+        queue->tasks.push_back(std::move(task));
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(_sleepMutex);
+        _numQueuedTasks++;
+    }
+    _sleepCondition.notify_one();
+}
+
+void ThreadPool::_initializeWorkers(int numWorkers) {
+    FLUIDSIM_ASSERT(numWorkers > 0);
+
+    _numQueuedTasks = 0;
+    _nextQueueIndex = 0;
+
+    _queues.reserve(numWorkers);
+    for (int i = 0; i < numWorkers; i++) {
+        _queues.push_back(new WorkQueue());
+    }
+
+    _workers.reserve(numWorkers);
+    _workerIds.reserve(numWorkers);
+    for (int i = 0; i < numWorkers; i++) {
+        _workers.push_back(std::thread(&ThreadPool::_workerThread, this, i));
+        _workerIds.push_back(_workers.back().get_id());
+    }
+}
+
+int ThreadPool::_getWorkerIndex(std::thread::id id) {
+    for (size_t i = 0; i < _workerIds.size(); i++) {
+        if (_workerIds[i] == id) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+void ThreadPool::_workerThread(int workerIndex) {
+    Profiler::setThreadName("Pool Worker " + std::to_string(workerIndex));
+
+    std::function<void()> task;
+    for (;;) {
+        if (_popTask(workerIndex, task)) {
+            task();
+            task = nullptr;
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(_sleepMutex);
+        _sleepCondition.wait(lock, [this]() {
+            return _isStopped || _numQueuedTasks > 0;
+        });
+
+        if (_isStopped && _numQueuedTasks <= 0) {
+            return;
+        }
+    }
+}
+
+bool ThreadPool::_popTask(int workerIndex, std::function<void()> &task) {
+    // Newest task from our own queue first for cache locality, then steal
+    // the oldest task from the other queues.
+    WorkQueue *ownQueue = _queues[workerIndex];
+    {
+        std::unique_lock<std::mutex> lock(ownQueue->mutex);
+        if (!ownQueue->tasks.empty()) {
+            task = std::move(ownQueue->tasks.back());
+            ownQueue->tasks.pop_back();
+            _numQueuedTasks--;
+            return true;
+        }
+    }
+
+    int numQueues = (int)_queues.size();
+    for (int i = 1; i < numQueues; i++) {
+        WorkQueue *victim = _queues[(workerIndex + i) % numQueues];
+        std::unique_lock<std::mutex> lock(victim->mutex);
+        if (!victim->tasks.empty()) {
+            task = std::move(victim->tasks.front());
+            victim->tasks.pop_front();
+            _numQueuedTasks--;
+            return true;
+        }
+    }
+
+    return false;
+}
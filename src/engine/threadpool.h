@@ -0,0 +1,88 @@
+/*
+MIT License
+
+Copyright (c) 2019 Ryan L. Guy
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef FLUIDENGINE_THREADPOOL_H
+#define FLUIDENGINE_THREADPOOL_H
+
+#if __MINGW32__ && !_WIN64
+    #include <mutex>
+    #include "mingw32_threads/mingw.thread.h"
+    #include "mingw32_threads/mingw.condition_variable.h"
+    #include "mingw32_threads/mingw.mutex.h"
+#else
+    #include <thread>
+    #include <mutex>
+    #include <condition_variable>
+#endif
+
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <functional>
+
+/*
+    A persistent pool of worker threads. Each worker owns a task deque.
+    Tasks submitted from a worker are pushed onto that worker's own deque and
+    tasks submitted from outside of the pool are distributed round-robin. A
+    worker pops from the back of its own deque and, when its deque is empty,
+    steals from the front of the other workers' deques.
+*/
+class ThreadPool
+{
+public:
+    ThreadPool();
+    ThreadPool(int numWorkers);
+    ~ThreadPool();
+
+    int getNumWorkers();
+    void submit(std::function<void()> task);
+
+    /*
+        Returns true if the calling thread is one of this pool's workers
+    */
+    bool isWorkerThread();
+
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()> > tasks;
+    };
+
+    void _initializeWorkers(int numWorkers);
+    void _workerThread(int workerIndex);
+    bool _popTask(int workerIndex, std::function<void()> &task);
+    int _getWorkerIndex(std::thread::id id);
+
+    std::vector<std::thread> _workers;
+    std::vector<std::thread::id> _workerIds;
+    std::vector<WorkQueue*> _queues;
+
+    std::mutex _sleepMutex;
+    std::condition_variable _sleepCondition;
+    std::atomic<int> _numQueuedTasks;
+    std::atomic<unsigned int> _nextQueueIndex;
+    bool _isStopped = false;
+};
+
+#endif
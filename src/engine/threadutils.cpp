@@ -25,12 +25,75 @@ SOFTWARE.
 #include "threadutils.h"
 
 #include <cmath>
+#include <atomic>
+#include <memory>
+#include <algorithm>
 
+#include "threadpool.h"
 #include "fluidsimassert.h"
 
 int ThreadUtils::_maxThreadCount = 0;
 bool ThreadUtils::_isMaxThreadCountInitialized = false;
 
+// Number of chunks given to each thread when parallelFor chooses the
+// grain size
+static const int _chunksPerThread = 8;
+
+static ThreadPool *_threadPool = nullptr;
+static std::mutex _threadPoolMutex;
+
+// The calling thread takes part in each loop, but the pool always has at
+// least one worker
+static int _getNumThreadPoolWorkers(int maxThreadCount) {
+	return std::max(1, maxThreadCount - 1);
+}
+
+static ThreadPool* _getThreadPool() {
+	std::unique_lock<std::mutex> lock(_threadPoolMutex);
+	if (_threadPool == nullptr) {
+		int numWorkers = _getNumThreadPoolWorkers(ThreadUtils::getMaxThreadCount());
+		_threadPool = new ThreadPool(numWorkers);
+	}
+	return _threadPool;
+}
+
+struct ParallelForJob {
+	int rangeBegin = 0;
+	int rangeEnd = 0;
+	int grainSize = 1;
+	int numChunks = 0;
+	const std::function<void(int, int)> *func = nullptr;
+
+	std::atomic<int> nextChunk;
+	std::atomic<int> completedChunks;
+	std::mutex mutex;
+	std::condition_variable finishedCondition;
+
+	// Claims and runs chunks until none remain
+	void run() {
+		int numCompleted = 0;
+		for (;;) {
+			int c = nextChunk++;
+			if (c >= numChunks) {
+				break;
+			}
+
+			int begin = rangeBegin + c * grainSize;
+			int end = (int)fmin(begin + grainSize, rangeEnd);
+			(*func)(begin, end);
+			numCompleted++;
+		}
+
+		if (numCompleted > 0) {
+			int total = (completedChunks += numCompleted);
+			if (total == numChunks) {
+				std::unique_lock<std::mutex> lock(mutex);
+				finishedCondition.notify_all();
+			}
+		}
+	}
+};
+
 void ThreadUtils::_initializeMaxThreadCount() {
 	if (_isMaxThreadCountInitialized) {
 		return;
@@ -49,6 +112,14 @@ void ThreadUtils::setMaxThreadCount(int n) {
 	FLUIDSIM_ASSERT(n > 0);
 	_maxThreadCount = n;
 	_isMaxThreadCountInitialized = true;
+
+	// The pool is recreated at the new size on the next parallelFor. Must not
+	// be called while a parallel loop is running.
+	std::unique_lock<std::mutex> lock(_threadPoolMutex);
+	if (_threadPool != nullptr && _threadPool->getNumWorkers() != _getNumThreadPoolWorkers(n)) {
+		delete _threadPool;
+		_threadPool = nullptr;
+	}
 }
 
 std::vector<int> ThreadUtils::splitRangeIntoIntervals(int rangeBegin, int rangeEnd, 
@@ -70,4 +141,73 @@ std::vector<int> ThreadUtils::splitRangeIntoIntervals(int rangeBegin, int rangeE
     }
 
     return intervals;
-}
\ No newline at end of file
+}
+int ThreadUtils::getGrainSize(int rangeBegin, int rangeEnd, int grainSize) {
+	if (grainSize > 0) {
+		return grainSize;
+	}
+
+	int rangeSize = rangeEnd - rangeBegin;
+	int numChunks = getMaxThreadCount() * _chunksPerThread;
+	return (int)fmax(1, ceil((double)rangeSize / (double)numChunks));
+}
+
+int ThreadUtils::getNumChunks(int rangeBegin, int rangeEnd, int grainSize) {
+	if (rangeEnd <= rangeBegin) {
+		return 0;
+	}
+
+	int grain = getGrainSize(rangeBegin, rangeEnd, grainSize);
+	return (rangeEnd - rangeBegin + grain - 1) / grain;
+}
+
+void ThreadUtils::submitTask(std::function<void()> task) {
+	_getThreadPool()->submit(std::move(task));
+}
+
+void ThreadUtils::parallelFor(int rangeBegin, int rangeEnd,
+	                          const std::function<void(int, int)> &func) {
+	parallelFor(rangeBegin, rangeEnd, 0, func);
+}
+
+void ThreadUtils::parallelFor(int rangeBegin, int rangeEnd, int grainSize,
+	                          const std::function<void(int, int)> &func) {
+	if (rangeEnd <= rangeBegin) {
+		return;
+	}
+
+	int grain = getGrainSize(rangeBegin, rangeEnd, grainSize);
+	int numChunks = getNumChunks(rangeBegin, rangeEnd, grain);
+	int numThreads = getMaxThreadCount();
+	if (numThreads <= 1 || numChunks <= 1) {
+		for (int c = 0; c < numChunks; c++) {
+			int begin = rangeBegin + c * grain;
+			func(begin, (int)fmin(begin + grain, rangeEnd));
+		}
+		return;
+	}
+
+	std::shared_ptr<ParallelForJob> job = std::make_shared<ParallelForJob>();
+	job->rangeBegin = rangeBegin;
+	job->rangeEnd = rangeEnd;
+	job->grainSize = grain;
+	job->numChunks = numChunks;
+	job->func = &func;
+	job->nextChunk = 0;
+	job->completedChunks = 0;
+
+	// Helper tasks that start after all chunks have been claimed return
+	// immediately, so a nested parallelFor never waits on a queued task.
+	ThreadPool *pool = _getThreadPool();
+	int numHelpers = (int)fmin(fmin(numThreads - 1, numChunks - 1), pool->getNumWorkers());
+	for (int i = 0; i < numHelpers; i++) {
+		pool->submit([job]() { job->run(); });
+	}
+
+	job->run();
+
+	std::unique_lock<std::mutex> lock(job->mutex);
+	job->finishedCondition.wait(lock, [&job]() {
+		return job->completedChunks == job->numChunks;
+	});
+}
@@ -37,6 +37,7 @@ SOFTWARE.
 #endif
 
 #include <vector>
+#include <functional>
 
 namespace ThreadUtils {
 
@@ -49,6 +50,59 @@ namespace ThreadUtils {
     extern std::vector<int> splitRangeIntoIntervals(int rangeBegin, 
                                                     int rangeEnd, 
                                                     int numIntervals);
+
+    /*
+        Runs func(chunkBegin, chunkEnd) over [rangeBegin, rangeEnd) split into
+        chunks of grainSize elements on the shared thread pool. The calling
+        thread also processes chunks and returns once all chunks are complete.
+        A grainSize <= 0 chooses a chunk size that gives each thread several
+        chunks so that uneven work is balanced between threads.
+
+        Chunk boundaries are always at rangeBegin + n * grainSize.
+    */
+    extern void parallelFor(int rangeBegin, int rangeEnd, int grainSize,
+                            const std::function<void(int, int)> &func);
+    extern void parallelFor(int rangeBegin, int rangeEnd,
+                            const std::function<void(int, int)> &func);
+    extern int getGrainSize(int rangeBegin, int rangeEnd, int grainSize);
+
+    /*
+        Runs task asynchronously on the shared thread pool. The task may call
+        parallelFor, but must not block waiting on other submitted tasks.
+    */
+    extern void submitTask(std::function<void()> task);
+    extern int getNumChunks(int rangeBegin, int rangeEnd, int grainSize);
+
+    /*
+        Computes func(chunkBegin, chunkEnd) for each chunk in parallel and
+        combines the chunk results in chunk order with reduce(a, b). For a
+        fixed grainSize, the result does not depend on the number of threads.
+    */
+    template<class T, class ChunkFunc, class ReduceFunc>
+    T parallelReduce(int rangeBegin, int rangeEnd, int grainSize, T identity,
+                     ChunkFunc func, ReduceFunc reduce) {
+        if (rangeEnd <= rangeBegin) {
+            return identity;
+        }
+
+        int grain = getGrainSize(rangeBegin, rangeEnd, grainSize);
+        int numChunks = getNumChunks(rangeBegin, rangeEnd, grain);
+        std::vector<T> chunkResults(numChunks, identity);
+        parallelFor(0, numChunks, 1, [&](int chunkBegin, int chunkEnd) {
+            for (int c = chunkBegin; c < chunkEnd; c++) {
+                int begin = rangeBegin + c * grain;
+                int end = begin + grain < rangeEnd ? begin + grain : rangeEnd;
+                chunkResults[c] = func(begin, end);
+            }
+        });
+
+        T result = identity;
+        for (int c = 0; c < numChunks; c++) {
+            result = reduce(result, chunkResults[c]);
+        }
+
+        return result;
+    }
 }
 
 #endif
\ No newline at end of file
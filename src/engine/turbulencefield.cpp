@@ -52,18 +52,9 @@ void TurbulenceField::_getVelocityGrid(MACVelocityField *macfield,
                                        Array3d<vmath::vec3> &vgrid) {
 
     int gridsize = vgrid.width * vgrid.height * vgrid.depth;
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, gridsize);
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, gridsize, numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&TurbulenceField::_getVelocityGridThread, this,
-                                 intervals[i], intervals[i + 1], macfield, &vgrid);
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, gridsize, [&](int startidx, int endidx) {
+        _getVelocityGridThread(startidx, endidx, macfield, &vgrid);
+    });
 }
 
 void TurbulenceField::_getVelocityGridThread(int startidx, int endidx, 
@@ -112,18 +103,9 @@ void TurbulenceField::calculateTurbulenceField(MACVelocityField *vfield,
     Array3d<vmath::vec3> vgrid = Array3d<vmath::vec3>(_isize, _jsize, _ksize);
     _getVelocityGrid(vfield, vgrid);
 
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, fluidCells.size());
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, fluidCells.size(), numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&TurbulenceField::_calculateTurbulenceFieldThread, this,
-                                 intervals[i], intervals[i + 1], &vgrid, &fluidCells);
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, fluidCells.size(), [&](int startidx, int endidx) {
+        _calculateTurbulenceFieldThread(startidx, endidx, &vgrid, &fluidCells);
+    });
 }
 
 void TurbulenceField::_calculateTurbulenceFieldThread(int startidx, int endidx,
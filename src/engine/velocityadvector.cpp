@@ -27,6 +27,7 @@ SOFTWARE.
 #include "macvelocityfield.h"
 #include "gridutils.h"
 #include "threadutils.h"
+#include "profiler.h"
 
 
 VelocityAdvector::VelocityAdvector() {
@@ -36,10 +37,9 @@ VelocityAdvector::~VelocityAdvector() {
 }
 
 void VelocityAdvector::advect(VelocityAdvectorParameters params) {
+    FLUIDSIM_PROFILE_SCOPE("Advect Velocities");
     _initializeParameters(params);
-    _advectGrid(Direction::U);
-    _advectGrid(Direction::V);
-    _advectGrid(Direction::W);
+    _advectGrids();
 }
 
 void VelocityAdvector::_initializeParameters(VelocityAdvectorParameters params) {
@@ -47,38 +47,48 @@ void VelocityAdvector::_initializeParameters(VelocityAdvectorParameters params)
     _vfield = params.vfield;
     _validVelocities = params.validVelocities;
     _particleRadius = params.particleRadius;
+    _scatterMethod = params.scatterMethod;
     
     _dx = _vfield->getGridCellSize();
     _chunkdx = _dx * _chunkWidth;
+}
+
+void VelocityAdvector::_advectGrids() {
+    BlockArray3d<VelocityData> blockvel;
+    _initializeBlockGrid(blockvel);
 
-    _points.clear();
-    _points.reserve(_particles->size());
-    _velocities.clear();
-    _velocities.reserve(_particles->size());
-    for (size_t i = 0; i < _particles->size(); i++) {
-        _points.push_back((*_particles)[i].position);
-        _velocities.push_back((*_particles)[i].velocity);
+    int colorStride = _getColorStride();
+    if (_scatterMethod == ParticleScatterMethod::colored && colorStride > 0) {
+        _scatterParticlesColored(blockvel, colorStride);
+    } else {
+        _scatterParticlesQueue(blockvel);
     }
 }
 
-void VelocityAdvector::_advectGrid(Direction dir) {
-    BlockArray3d<ScalarData> blockphi;
-    _initializeBlockGrid(blockphi, dir);
+int VelocityAdvector::_getColorStride() {
+    // Footprints extend past the containing block by the search radius and
+    // the half cell offset of the face grids, plus a node of margin for 
+    // rounding
+    float sr = _getKernelData().searchRadius;
+    int reach = (int)std::ceil((sr + 0.5 * _dx) / _dx) + 1;
+    return ScatterUtils::getColorStride(reach, _chunkWidth);
+}
 
+void VelocityAdvector::_scatterParticlesQueue(BlockArray3d<VelocityData> &blockvel) {
     ParticleGridCountData gridCountData;
-    _computeGridCountData(blockphi, gridCountData, dir);
+    _computeGridCountData(blockvel, gridCountData);
 
     std::vector<PointData> sortedParticleData;
     std::vector<int> blockToParticleDataIndex;
-    _sortParticlesIntoBlocks(gridCountData, sortedParticleData, blockToParticleDataIndex, dir);
+    _sortParticlesIntoBlocks(gridCountData, sortedParticleData, blockToParticleDataIndex);
 
-    std::vector<GridBlock<ScalarData> > gridBlocks;
-    blockphi.getActiveGridBlocks(gridBlocks);
+    std::vector<GridBlock<VelocityData> > gridBlocks;
+    blockvel.getActiveGridBlocks(gridBlocks);
     BoundedBuffer<ComputeBlock> computeBlockQueue(gridBlocks.size());
     BoundedBuffer<ComputeBlock> finishedComputeBlockQueue(gridBlocks.size());
     int numComputeBlocks = 0;
     for (size_t bidx = 0; bidx < gridBlocks.size(); bidx++) {
-        GridBlock<ScalarData> b = gridBlocks[bidx];
+        GridBlock<VelocityData> b = gridBlocks[bidx];
         if (gridCountData.totalGridCount[b.id] == 0) {
             continue;
         }
@@ -100,44 +110,13 @@ void VelocityAdvector::_advectGrid(Direction dir) {
                                          &computeBlockQueue, &finishedComputeBlockQueue);
     }
 
-    Array3d<float> *vfieldgrid = NULL;
-    Array3d<bool> *validgrid = NULL;
-    if (dir == Direction::U) {
-        vfieldgrid = _vfield->getArray3dU();
-        validgrid = &(_validVelocities->validU);
-    } else if (dir == Direction::V) {
-        vfieldgrid = _vfield->getArray3dV();
-        validgrid = &(_validVelocities->validV);
-    } else if (dir == Direction::W) {
-        vfieldgrid = _vfield->getArray3dW();
-        validgrid = &(_validVelocities->validW);
-    }
-
     int numComputeBlocksProcessed = 0;
     while (numComputeBlocksProcessed < numComputeBlocks) {
         std::vector<ComputeBlock> finishedBlocks;
         finishedComputeBlockQueue.popAll(finishedBlocks);
 
         for (size_t i = 0; i < finishedBlocks.size(); i++) {
-            ComputeBlock block = finishedBlocks[i];
-            GridIndex gridOffset(block.gridBlock.index.i * _chunkWidth,
-                                 block.gridBlock.index.j * _chunkWidth,
-                                 block.gridBlock.index.k * _chunkWidth);
-
-            float eps = 1e-6;
-            int datasize = _chunkWidth * _chunkWidth * _chunkWidth;
-            for (int vidx = 0; vidx < datasize; vidx++) {
-                GridIndex localidx = Grid3d::getUnflattenedIndex(vidx, _chunkWidth, _chunkWidth);
-                GridIndex vfieldidx = GridIndex(localidx.i + gridOffset.i,
-                                               localidx.j + gridOffset.j,
-                                               localidx.k + gridOffset.k);
-                if (vfieldgrid->isIndexInRange(vfieldidx)) {
-                    vfieldgrid->set(vfieldidx, block.gridBlock.data[vidx].scalar);
-                    if (block.gridBlock.data[vidx].weight > eps) {
-                        validgrid->set(vfieldidx, true);
-                    }
-                }
-            }
+            _applyBlockToVelocityField(finishedBlocks[i].gridBlock);
         }
 
         numComputeBlocksProcessed += finishedBlocks.size();
@@ -150,6 +129,117 @@ void VelocityAdvector::_advectGrid(Direction dir) {
     }
 }
 
+void VelocityAdvector::_scatterParticlesColored(BlockArray3d<VelocityData> &blockvel, 
+                                                int colorStride) {
+    Dims3d blockdims = blockvel.blockdims;
+    int numBlocks = blockdims.i * blockdims.j * blockdims.k;
+    int numParticles = (int)_particles->size();
+
+    std::vector<uint64_t> blockKeys(numParticles);
+    ThreadUtils::parallelFor(0, numParticles, [&](int startidx, int endidx) {
+        for (int i = startidx; i < endidx; i++) {
+            GridIndex b = Grid3d::positionToGridIndex(_particles->getPosition(i), _chunkdx);
+            b.i = std::min(std::max(b.i, 0), blockdims.i - 1);
+            b.j = std::min(std::max(b.j, 0), blockdims.j - 1);
+            b.k = std::min(std::max(b.k, 0), blockdims.k - 1);
+            blockKeys[i] = Grid3d::getFlatIndex(b, blockdims.i, blockdims.j);
+        }
+    });
+
+    std::vector<int> order;
+    std::vector<int> blockStart;
+    ScatterUtils::sortPointsIntoBlocks(blockKeys, numBlocks, order, blockStart);
+    std::vector<uint64_t>().swap(blockKeys);
+
+    std::vector<PointData> particleData(numParticles);
+    ThreadUtils::parallelFor(0, numParticles, [&](int startidx, int endidx) {
+        for (int i = startidx; i < endidx; i++) {
+            particleData[i] = PointData(_particles->getPosition(order[i]), 
+                                        _particles->getVelocity(order[i]));
+        }
+    });
+
+    std::vector<std::vector<int> > colorGroups;
+    ScatterUtils::getBlockColorGroups(blockdims, blockStart, colorStride, colorGroups);
+
+    KernelData kernel = _getKernelData();
+    float eps = 1e-6;
+    float sr = _particleRadius + eps;
+    float srmin = 0.5f * _dx + sr;
+    ScatterUtils::parallelForEachColor(colorGroups, [&](int bidx) {
+        FLUIDSIM_PROFILE_SCOPE("Advect Blocks");
+
+        std::vector<float> distsqx(_chunkWidth);
+        std::vector<float> distsqy(_chunkWidth);
+        std::vector<float> distsqz(_chunkWidth);
+        for (int pidx = blockStart[bidx]; pidx < blockStart[bidx + 1]; pidx++) {
+            PointData &pdata = particleData[pidx];
+
+            // Same blocks as the queue method, which cover the footprints
+            // on all three face grids
+            GridIndex bmin = Grid3d::positionToGridIndex(pdata.x - srmin, pdata.y - srmin, pdata.z - srmin, _chunkdx);
+            GridIndex bmax = Grid3d::positionToGridIndex(pdata.x + sr, pdata.y + sr, pdata.z + sr, _chunkdx);
+            bmin = GridIndex(std::max(bmin.i, 0), std::max(bmin.j, 0), std::max(bmin.k, 0));
+            bmax = GridIndex(std::min(bmax.i, blockdims.i - 1), 
+                             std::min(bmax.j, blockdims.j - 1), 
+                             std::min(bmax.k, blockdims.k - 1));
+
+            for (int bk = bmin.k; bk <= bmax.k; bk++) {
+                for (int bj = bmin.j; bj <= bmax.j; bj++) {
+                    for (int bi = bmin.i; bi <= bmax.i; bi++) {
+                        GridBlock<VelocityData> block = blockvel.getGridBlock(bi, bj, bk);
+                        if (block.id != -1) {
+                            _splatParticle(pdata, block, kernel, 
+                                           distsqx.data(), distsqy.data(), distsqz.data());
+                        }
+                    }
+                }
+            }
+        }
+    });
+
+    // Blocks cover disjoint parts of the velocity field
+    std::vector<GridBlock<VelocityData> > gridBlocks;
+    blockvel.getActiveGridBlocks(gridBlocks);
+    ThreadUtils::parallelFor(0, (int)gridBlocks.size(), 1, [&](int startidx, int endidx) {
+        for (int i = startidx; i < endidx; i++) {
+            _normalizeBlock(gridBlocks[i]);
+            _applyBlockToVelocityField(gridBlocks[i]);
+        }
+    });
+}
+
+void VelocityAdvector::_applyBlockToVelocityField(GridBlock<VelocityData> &block) {
+    Array3d<float> *vfieldgrids[3] = {
+        _vfield->getArray3dU(), _vfield->getArray3dV(), _vfield->getArray3dW()
+    };
+    Array3d<bool> *validgrids[3] = {
+        &(_validVelocities->validU), &(_validVelocities->validV), &(_validVelocities->validW)
+    };
+
+    GridIndex gridOffset(block.index.i * _chunkWidth,
+                         block.index.j * _chunkWidth,
+                         block.index.k * _chunkWidth);
+
+    float eps = 1e-6;
+    int datasize = _chunkWidth * _chunkWidth * _chunkWidth;
+    for (int vidx = 0; vidx < datasize; vidx++) {
+        GridIndex localidx = Grid3d::getUnflattenedIndex(vidx, _chunkWidth, _chunkWidth);
+        GridIndex vfieldidx = GridIndex(localidx.i + gridOffset.i,
+                                       localidx.j + gridOffset.j,
+                                       localidx.k + gridOffset.k);
+        for (int dir = 0; dir < 3; dir++) {
+            if (vfieldgrids[dir]->isIndexInRange(vfieldidx)) {
+                ScalarData data = block.data[vidx].component[dir];
+                vfieldgrids[dir]->set(vfieldidx, data.scalar);
+                if (data.weight > eps) {
+                    validgrids[dir]->set(vfieldidx, true);
+                }
+            }
+        }
+    }
+}
+
 vmath::vec3 VelocityAdvector::_getDirectionOffset(Direction dir) {
     vmath::vec3 offset;
     if (dir == Direction::U) {
@@ -163,40 +253,25 @@ vmath::vec3 VelocityAdvector::_getDirectionOffset(Direction dir) {
     return offset;
 }
 
-void VelocityAdvector::_initializeBlockGrid(BlockArray3d<ScalarData> &blockphi, Direction dir) {
+void VelocityAdvector::_initializeBlockGrid(BlockArray3d<VelocityData> &blockvel) {
+    // The block grid covers the U, V and W grids at once
     int isize, jsize, ksize;
     _vfield->getGridDimensions(&isize, &jsize, &ksize);
-    if (dir == Direction::U) {
-        isize += 1;
-    } else if (dir == Direction::V) {
-        jsize += 1;
-    } else if (dir == Direction::W) {
-        ksize += 1;
-    }
 
     BlockArray3dParameters params;
-    params.isize = isize;
-    params.jsize = jsize;
-    params.ksize = ksize;
+    params.isize = isize + 1;
+    params.jsize = jsize + 1;
+    params.ksize = ksize + 1;
     params.blockwidth = _chunkWidth;
-    Dims3d dims = BlockArray3d<ScalarData>::getBlockDimensions(params);
+    Dims3d dims = BlockArray3d<VelocityData>::getBlockDimensions(params);
 
     Array3d<bool> activeBlocks(dims.i, dims.j, dims.k, false);
 
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, _points.size());
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, _points.size(), numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&VelocityAdvector::_initializeActiveBlocksThread, this,
-                                 intervals[i], intervals[i + 1], &activeBlocks, dir);
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, _particles->size(), [&](int startidx, int endidx) {
+        _initializeActiveBlocksThread(startidx, endidx, &activeBlocks);
+    });
 
-    GridUtils::featherGrid26(&activeBlocks, numthreads);
+    GridUtils::featherGrid26(&activeBlocks);
 
     for (int k = 0; k < dims.k; k++) {
         for (int j = 0; j < dims.j; j++) {
@@ -208,44 +283,43 @@ void VelocityAdvector::_initializeBlockGrid(BlockArray3d<ScalarData> &blockphi,
         }
     }
 
-    ScalarData emptyData;
-    blockphi = BlockArray3d<ScalarData>(params);
-    blockphi.fill(emptyData);
+    VelocityData emptyData;
+    blockvel = BlockArray3d<VelocityData>(params);
+    blockvel.fill(emptyData);
 }
 
 void VelocityAdvector::_initializeActiveBlocksThread(int startidx, int endidx, 
-                                                     Array3d<bool> *activeBlocks, 
-                                                     Direction dir) {
-    vmath::vec3 offset = _getDirectionOffset(dir);
+                                                     Array3d<bool> *activeBlocks) {
+    vmath::vec3 offsets[3] = {
+        _getDirectionOffset(Direction::U),
+        _getDirectionOffset(Direction::V),
+        _getDirectionOffset(Direction::W)
+    };
+
     for (int i = startidx; i < endidx; i++) {
-        vmath::vec3 p = _points[i] - offset;
-        GridIndex g = Grid3d::positionToGridIndex(p, _chunkdx);
-        if (activeBlocks->isIndexInRange(g)) {
-            activeBlocks->set(g, true);
+        vmath::vec3 p = _particles->getPosition(i);
+        for (int dir = 0; dir < 3; dir++) {
+            GridIndex g = Grid3d::positionToGridIndex(p - offsets[dir], _chunkdx);
+            if (activeBlocks->isIndexInRange(g)) {
+                activeBlocks->set(g, true);
+            }
         }
     }
 }
 
-void VelocityAdvector::_computeGridCountData(BlockArray3d<ScalarData> &blockphi, 
-                                             ParticleGridCountData &countdata,
-                                             Direction dir) {
+void VelocityAdvector::_computeGridCountData(BlockArray3d<VelocityData> &blockvel, 
+                                             ParticleGridCountData &countdata) {
 
-    _initializeGridCountData(blockphi, countdata);
+    _initializeGridCountData(blockvel, countdata);
 
     int numthreads = countdata.numthreads;
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, _points.size(), numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&VelocityAdvector::_computeGridCountDataThread, this,
-                                 intervals[i], intervals[i + 1],
-                                 &blockphi, 
-                                 &(countdata.threadGridCountData[i]),
-                                 dir);
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, _particles->size(), numthreads);
+    ThreadUtils::parallelFor(0, numthreads, 1, [&](int tidx, int) {
+        _computeGridCountDataThread(intervals[tidx],
+                                    intervals[tidx + 1],
+                                    &blockvel,
+                                    &(countdata.threadGridCountData[tidx]));
+    });
 
     for (int tidx = 0; tidx < countdata.numthreads; tidx++) {
         std::vector<int> *threadGridCount = &(countdata.threadGridCountData[tidx].gridCount);
@@ -255,11 +329,11 @@ void VelocityAdvector::_computeGridCountData(BlockArray3d<ScalarData> &blockphi,
     }
 }
 
-void VelocityAdvector::_initializeGridCountData(BlockArray3d<ScalarData> &blockphi, 
+void VelocityAdvector::_initializeGridCountData(BlockArray3d<VelocityData> &blockvel, 
                                                 ParticleGridCountData &countdata) {
     int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, _points.size());
-    int numblocks = blockphi.getNumActiveGridBlocks();
+    int numthreads = (int)fmin(numCPU, _particles->size());
+    int numblocks = blockvel.getNumActiveGridBlocks();
     countdata.numthreads = numthreads;
     countdata.gridsize = numblocks;
     countdata.threadGridCountData = std::vector<GridCountData>(numthreads);
@@ -270,31 +344,33 @@ void VelocityAdvector::_initializeGridCountData(BlockArray3d<ScalarData> &blockp
 }
 
 void VelocityAdvector::_computeGridCountDataThread(int startidx, int endidx, 
-                                                   BlockArray3d<ScalarData> *blockphi, 
-                                                   GridCountData *countdata,
-                                                   Direction dir) {
+                                                   BlockArray3d<VelocityData> *blockvel, 
+                                                   GridCountData *countdata) {
     
     countdata->simpleGridIndices = std::vector<int>(endidx - startidx, -1);
     countdata->invalidPoints = std::vector<bool>(endidx - startidx, false);
     countdata->startidx = startidx;
     countdata->endidx = endidx;
 
+    // A particle splats to the U, V and W nodes within the particle radius of
+    // its position shifted by the staggered grid offset. The union of these
+    // regions spans [p - 0.5*dx - r, p + r] along each axis.
     float eps = 1e-6;
     float sr = _particleRadius + eps;
+    float srmin = 0.5f * _dx + sr;
     float blockdx = _chunkdx;
-    vmath::vec3 offset = _getDirectionOffset(dir);
     for (int i = startidx; i < endidx; i++) {
-        vmath::vec3 p = _points[i] - offset;
+        vmath::vec3 p = _particles->getPosition(i);
         GridIndex blockIndex = Grid3d::positionToGridIndex(p, blockdx);
         vmath::vec3 blockPosition = Grid3d::GridIndexToPosition(blockIndex, blockdx);
 
-        if (p.x - sr > blockPosition.x && 
-                p.y - sr > blockPosition.y && 
-                p.z - sr > blockPosition.z && 
+        if (p.x - srmin > blockPosition.x && 
+                p.y - srmin > blockPosition.y && 
+                p.z - srmin > blockPosition.z && 
                 p.x + sr < blockPosition.x + blockdx && 
                 p.y + sr < blockPosition.y + blockdx && 
                 p.z + sr < blockPosition.z + blockdx) {
-            int blockid = blockphi->getBlockID(blockIndex);
+            int blockid = blockvel->getBlockID(blockIndex);
             countdata->simpleGridIndices[i - startidx] = blockid;
 
             if (blockid != -1) {
@@ -303,14 +379,14 @@ void VelocityAdvector::_computeGridCountDataThread(int startidx, int endidx,
                 countdata->invalidPoints[i - startidx] = true;
             }
         } else {
-            GridIndex gmin = Grid3d::positionToGridIndex(p.x - sr, p.y - sr, p.z - sr, blockdx);
+            GridIndex gmin = Grid3d::positionToGridIndex(p.x - srmin, p.y - srmin, p.z - srmin, blockdx);
             GridIndex gmax = Grid3d::positionToGridIndex(p.x + sr, p.y + sr, p.z + sr, blockdx);
 
             int overlapCount = 0;
             for (int gk = gmin.k; gk <= gmax.k; gk++) {
                 for (int gj = gmin.j; gj <= gmax.j; gj++) {
                     for (int gi = gmin.i; gi <= gmax.i; gi++) {
-                        int blockid = blockphi->getBlockID(gi, gj, gk);
+                        int blockid = blockvel->getBlockID(gi, gj, gk);
                         if (blockid != -1) {
                             countdata->gridCount[blockid]++;
                             countdata->overlappingGridIndices.push_back(blockid);
@@ -330,16 +406,8 @@ void VelocityAdvector::_computeGridCountDataThread(int startidx, int endidx,
 
 void VelocityAdvector::_sortParticlesIntoBlocks(ParticleGridCountData &countdata, 
                                                 std::vector<PointData> &sortedParticleData, 
-                                                std::vector<int> &blockToParticleIndex,
-                                                Direction dir) {
-    int diridx = 0;
-    if (dir == Direction::U) {
-        diridx = 0;
-    } else if (dir == Direction::V) {
-        diridx = 1;
-    } else if (dir == Direction::W) {
-        diridx = 2;
-    }
+                                                std::vector<int> &blockToParticleIndex) {
+    FLUIDSIM_PROFILE_SCOPE("Sort Particles Into Blocks");
 
     blockToParticleIndex = std::vector<int>(countdata.gridsize, 0);
     int currentIndex = 0;
@@ -347,56 +415,68 @@ void VelocityAdvector::_sortParticlesIntoBlocks(ParticleGridCountData &countdata
         blockToParticleIndex[i] = currentIndex;
         currentIndex += countdata.totalGridCount[i];
     }
-    std::vector<int> blockToParticleIndexCurrent = blockToParticleIndex;
     int totalParticleCount = currentIndex;
 
-    vmath::vec3 offset = _getDirectionOffset(dir);
-    sortedParticleData = std::vector<PointData>(totalParticleCount);
+    // Each thread writes its particles after the particles of the previous 
+    // threads so that particles within a block remain in index order
+    std::vector<std::vector<int> > threadBlockToParticleIndex(countdata.numthreads);
+    std::vector<int> blockToParticleIndexCurrent = blockToParticleIndex;
     for (int tidx = 0; tidx < countdata.numthreads; tidx++) {
-        GridCountData *countData = &(countdata.threadGridCountData[tidx]);
+        threadBlockToParticleIndex[tidx] = blockToParticleIndexCurrent;
+        std::vector<int> *threadGridCount = &(countdata.threadGridCountData[tidx].gridCount);
+        for (size_t i = 0; i < blockToParticleIndexCurrent.size(); i++) {
+            blockToParticleIndexCurrent[i] += threadGridCount->at(i);
+        }
+    }
 
-        int indexOffset = countData->startidx;
-        int currentOverlappingIndex = 0;
-        for (size_t i = 0; i < countData->simpleGridIndices.size(); i++) {
-            if (countData->invalidPoints[i]) {
-                continue;
-            }
+    sortedParticleData = std::vector<PointData>(totalParticleCount);
+    ThreadUtils::parallelFor(0, countdata.numthreads, 1, [&](int tidx, int) {
+        _sortParticlesIntoBlocksThread(&(countdata.threadGridCountData[tidx]),
+                                       &(threadBlockToParticleIndex[tidx]),
+                                       &sortedParticleData);
+    });
+}
+
+void VelocityAdvector::_sortParticlesIntoBlocksThread(GridCountData *countdata,
+                                                      std::vector<int> *blockToParticleIndex,
+                                                      std::vector<PointData> *sortedParticleData) {
+    int indexOffset = countdata->startidx;
+    int currentOverlappingIndex = 0;
+    for (size_t i = 0; i < countdata->simpleGridIndices.size(); i++) {
+        if (countdata->invalidPoints[i]) {
+            continue;
+        }
 
-            vmath::vec3 p = _points[i + indexOffset] - offset;
-            float v = _velocities[i + indexOffset][diridx];
-            PointData pdata(p.x, p.y, p.z, v);
+        PointData pdata(_particles->getPosition(i + indexOffset), 
+                        _particles->getVelocity(i + indexOffset));
 
-            if (countData->simpleGridIndices[i] >= 0) {
-                int blockid = countData->simpleGridIndices[i];
-                int sortedIndex = blockToParticleIndexCurrent[blockid];
-                sortedParticleData[sortedIndex] = pdata;
-                blockToParticleIndexCurrent[blockid]++;
-            } else {
-                int numblocks = -(countData->simpleGridIndices[i]);
-                for (int blockidx = 0; blockidx < numblocks; blockidx++) {
-                    int blockid = countData->overlappingGridIndices[currentOverlappingIndex];
-                    currentOverlappingIndex++;
-
-                    int sortedIndex = blockToParticleIndexCurrent[blockid];
-                    sortedParticleData[sortedIndex] = pdata;
-                    blockToParticleIndexCurrent[blockid]++;
-                }
+        if (countdata->simpleGridIndices[i] >= 0) {
+            int blockid = countdata->simpleGridIndices[i];
+            int sortedIndex = blockToParticleIndex->at(blockid);
+            sortedParticleData->at(sortedIndex) = pdata;
+            (*blockToParticleIndex)[blockid]++;
+        } else {
+            int numblocks = -(countdata->simpleGridIndices[i]);
+            for (int blockidx = 0; blockidx < numblocks; blockidx++) {
+                int blockid = countdata->overlappingGridIndices[currentOverlappingIndex];
+                currentOverlappingIndex++;
+
+                int sortedIndex = blockToParticleIndex->at(blockid);
+                sortedParticleData->at(sortedIndex) = pdata;
+                (*blockToParticleIndex)[blockid]++;
             }
         }
     }
-
 }
 
 void VelocityAdvector::_advectionProducerThread(BoundedBuffer<ComputeBlock> *blockQueue, 
                                                 BoundedBuffer<ComputeBlock> *finishedBlockQueue) {
+    Profiler::setThreadName("Advection Worker");
 
-    float eps = 1e-6;
-    float r = _particleRadius;
-    float sr = _particleRadius + eps;
-    float rsq = r * r;
-    float coef1 = (4.0f / 9.0f) * (1.0f / (r*r*r*r*r*r));
-    float coef2 = (17.0f / 9.0f) * (1.0f / (r*r*r*r));
-    float coef3 = (22.0f / 9.0f) * (1.0f / (r*r));
+    KernelData kernel = _getKernelData();
+    std::vector<float> distsqx(_chunkWidth);
+    std::vector<float> distsqy(_chunkWidth);
+    std::vector<float> distsqz(_chunkWidth);
 
     while (blockQueue->size() > 0) {
         std::vector<ComputeBlock> computeBlocks;
@@ -405,55 +485,113 @@ void VelocityAdvector::_advectionProducerThread(BoundedBuffer<ComputeBlock> *blo
             continue;
         }
 
+        FLUIDSIM_PROFILE_SCOPE("Advect Blocks");
+
         for (size_t bidx = 0; bidx < computeBlocks.size(); bidx++) {
             ComputeBlock block = computeBlocks[bidx];
-            GridIndex blockIndex = block.gridBlock.index;
-            vmath::vec3 blockPositionOffset = Grid3d::GridIndexToPosition(blockIndex, _chunkWidth * _dx);
-
             for (int pidx = 0; pidx < block.numParticles; pidx++) {
-                PointData pdata = block.particleData[pidx];
-                vmath::vec3 p(pdata.x, pdata.y, pdata.z);
-                p -= blockPositionOffset;
-                float velocity = pdata.v;
-
-                vmath::vec3 pmin(p.x - sr, p.y - sr, p.z - sr);
-                vmath::vec3 pmax(p.x + sr, p.y + sr, p.z + sr);
-                GridIndex gmin = Grid3d::positionToGridIndex(pmin, _dx);
-                GridIndex gmax = Grid3d::positionToGridIndex(pmax, _dx);
-                gmin.i = std::max(gmin.i, 0);
-                gmin.j = std::max(gmin.j, 0);
-                gmin.k = std::max(gmin.k, 0);
-                gmax.i = std::min(gmax.i, _chunkWidth - 1);
-                gmax.j = std::min(gmax.j, _chunkWidth - 1);
-                gmax.k = std::min(gmax.k, _chunkWidth - 1);
-
-                for (int k = gmin.k; k <= gmax.k; k++) {
-                    for (int j = gmin.j; j <= gmax.j; j++) {
-                        for (int i = gmin.i; i <= gmax.i; i++) {
-                            vmath::vec3 gpos = Grid3d::GridIndexToPosition(i, j, k, _dx);
-                            vmath::vec3 v = gpos - p;
-                            float d2 = vmath::dot(v, v);
-                            if (d2 < rsq) {
-                                float weight = 1.0f - coef1*d2*d2*d2 + coef2*d2*d2 - coef3*d2;
-
-                                int flatidx = Grid3d::getFlatIndex(i, j, k, _chunkWidth, _chunkWidth);
-                                block.gridBlock.data[flatidx].scalar += weight * velocity;
-                                block.gridBlock.data[flatidx].weight += weight;
-                            }
-                        }
-                    }
-                }
+                _splatParticle(block.particleData[pidx], block.gridBlock, kernel,
+                               distsqx.data(), distsqy.data(), distsqz.data());
             }
+            _normalizeBlock(block.gridBlock);
+
+            finishedBlockQueue->push(block);
+        }
+    }
+
+}
+
+VelocityAdvector::KernelData VelocityAdvector::_getKernelData() {
+    float eps = 1e-6;
+    float r = _particleRadius;
+
+    KernelData kernel;
+    kernel.radius = r;
+    kernel.searchRadius = _particleRadius + eps;
+    kernel.coef1 = (4.0f / 9.0f) * (1.0f / (r*r*r*r*r*r));
+    kernel.coef2 = (17.0f / 9.0f) * (1.0f / (r*r*r*r));
+    kernel.coef3 = (22.0f / 9.0f) * (1.0f / (r*r));
+    kernel.offsets[0] = _getDirectionOffset(Direction::U);
+    kernel.offsets[1] = _getDirectionOffset(Direction::V);
+    kernel.offsets[2] = _getDirectionOffset(Direction::W);
+
+    return kernel;
+}
+
+/*
+    Adds the weighted velocity of a particle to the nodes of the block 
+    within the kernel radius. Nodes outside of the block are skipped.
+*/
+void VelocityAdvector::_splatParticle(PointData &pdata, GridBlock<VelocityData> &block, 
+                                      KernelData &kernel, 
+                                      float *distsqx, float *distsqy, float *distsqz) {
+    float sr = kernel.searchRadius;
+    float rsq = kernel.radius * kernel.radius;
+    float coef1 = kernel.coef1;
+    float coef2 = kernel.coef2;
+    float coef3 = kernel.coef3;
+
+    vmath::vec3 blockPositionOffset = Grid3d::GridIndexToPosition(block.index, _chunkWidth * _dx);
+    vmath::vec3 position(pdata.x, pdata.y, pdata.z);
+
+    for (int dir = 0; dir < 3; dir++) {
+        vmath::vec3 p = position - kernel.offsets[dir];
+        p -= blockPositionOffset;
+        float velocity = pdata.velocity[dir];
+
+        vmath::vec3 pmin(p.x - sr, p.y - sr, p.z - sr);
+        vmath::vec3 pmax(p.x + sr, p.y + sr, p.z + sr);
+        GridIndex gmin = Grid3d::positionToGridIndex(pmin, _dx);
+        GridIndex gmax = Grid3d::positionToGridIndex(pmax, _dx);
+        gmin.i = std::max(gmin.i, 0);
+        gmin.j = std::max(gmin.j, 0);
+        gmin.k = std::max(gmin.k, 0);
+        gmax.i = std::min(gmax.i, _chunkWidth - 1);
+        gmax.j = std::min(gmax.j, _chunkWidth - 1);
+        gmax.k = std::min(gmax.k, _chunkWidth - 1);
+
+        // Squared distances along each axis are shared by a
+        // whole row, column or slice of nodes
+        for (int i = gmin.i; i <= gmax.i; i++) {
+            float d = (float)(i * _dx) - p.x;
+            distsqx[i] = d * d;
+        }
+        for (int j = gmin.j; j <= gmax.j; j++) {
+            float d = (float)(j * _dx) - p.y;
+            distsqy[j] = d * d;
+        }
+        for (int k = gmin.k; k <= gmax.k; k++) {
+            float d = (float)(k * _dx) - p.z;
+            distsqz[k] = d * d;
+        }
 
-            int numVals = _chunkWidth * _chunkWidth * _chunkWidth;
-            for (int i = 0; i < numVals; i++) {
-                if (block.gridBlock.data[i].weight > eps) {
-                    block.gridBlock.data[i].scalar /= block.gridBlock.data[i].weight;
+        for (int k = gmin.k; k <= gmax.k; k++) {
+            for (int j = gmin.j; j <= gmax.j; j++) {
+                int flatidx = Grid3d::getFlatIndex(gmin.i, j, k, _chunkWidth, _chunkWidth);
+                for (int i = gmin.i; i <= gmax.i; i++, flatidx++) {
+                    float d2 = distsqx[i] + distsqy[j] + distsqz[k];
+                    if (d2 < rsq) {
+                        float weight = 1.0f - coef1*d2*d2*d2 + coef2*d2*d2 - coef3*d2;
+
+                        ScalarData *data = &(block.data[flatidx].component[dir]);
+                        data->scalar += weight * velocity;
+                        data->weight += weight;
+                    }
                 }
             }
-
-            finishedBlockQueue->push(block);
         }
     }
+}
 
+void VelocityAdvector::_normalizeBlock(GridBlock<VelocityData> &block) {
+    float eps = 1e-6;
+    int numVals = _chunkWidth * _chunkWidth * _chunkWidth;
+    for (int i = 0; i < numVals; i++) {
+        for (int dir = 0; dir < 3; dir++) {
+            ScalarData *data = &(block.data[i].component[dir]);
+            if (data->weight > eps) {
+                data->scalar /= data->weight;
+            }
+        }
+    }
 }
@@ -53,17 +53,19 @@ USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define FLUIDENGINE_VELOCITYADVECTOR_H
 
 #include "fragmentedvector.h"
-#include "markerparticle.h"
+#include "markerparticlestore.h"
 #include "array3d.h"
 #include "blockarray3d.h"
 #include "boundedbuffer.h"
 #include "macvelocityfield.h"
+#include "scatterutils.h"
 
 struct VelocityAdvectorParameters {
-    FragmentedVector<MarkerParticle> *particles;
+    MarkerParticleStore *particles;
     MACVelocityField *vfield;
     ValidVelocityComponentGrid *validVelocities;
     double particleRadius = 1.0;
+    ParticleScatterMethod scatterMethod = ParticleScatterMethod::queue;
 };
 
 class VelocityAdvector {
@@ -73,6 +75,9 @@ public:
     ~VelocityAdvector();
 
     void advect(VelocityAdvectorParameters params);
+
+    // Width in cells of the blocks that particles are sorted into
+    int getBlockWidth() { return _chunkWidth; }
     
 private:
     enum class Direction { U, V, W };
@@ -98,57 +103,80 @@ private:
         float weight = 0.0f;
     };
 
+    // Node (i, j, k) of a block holds U(i, j, k), V(i, j, k) and W(i, j, k)
+    struct VelocityData {
+        ScalarData component[3];
+    };
+
     struct PointData {
         float x = 0.0f;
         float y = 0.0f;
         float z = 0.0f;
-        float v = 0.0f;
+        float velocity[3];
 
         PointData() {}
-        PointData(float px, float py, float pz, float vel)
-                    : x(px), y(py), z(pz), v(vel) {}
+        PointData(vmath::vec3 p, vmath::vec3 v) : x(p.x), y(p.y), z(p.z) {
+            velocity[0] = v.x;
+            velocity[1] = v.y;
+            velocity[2] = v.z;
+        }
     };
 
     struct ComputeBlock {
-        GridBlock<ScalarData> gridBlock;
+        GridBlock<VelocityData> gridBlock;
         PointData *particleData;
         int numParticles = 0;
         float radius = 0.0f;
     };
 
+    struct KernelData {
+        float radius = 0.0f;
+        float searchRadius = 0.0f;
+        float coef1 = 0.0f;
+        float coef2 = 0.0f;
+        float coef3 = 0.0f;
+        vmath::vec3 offsets[3];
+    };
+
     void _initializeParameters(VelocityAdvectorParameters params);
-    void _advectGrid(Direction dir);
+    void _advectGrids();
+    int _getColorStride();
+    void _scatterParticlesQueue(BlockArray3d<VelocityData> &blockvel);
+    void _scatterParticlesColored(BlockArray3d<VelocityData> &blockvel, int colorStride);
     vmath::vec3 _getDirectionOffset(Direction dir);
-    void _initializeBlockGrid(BlockArray3d<ScalarData> &blockphi, Direction dir);
+    void _initializeBlockGrid(BlockArray3d<VelocityData> &blockvel);
     void _initializeActiveBlocksThread(int startidx, int endidx,
-                                       Array3d<bool> *activeBlocks,
-                                       Direction dir);
-    void _computeGridCountData(BlockArray3d<ScalarData> &blockphi, 
-                               ParticleGridCountData &countdata,
-                               Direction dir);
-    void _initializeGridCountData(BlockArray3d<ScalarData> &blockphi, 
+                                       Array3d<bool> *activeBlocks);
+    void _computeGridCountData(BlockArray3d<VelocityData> &blockvel, 
+                               ParticleGridCountData &countdata);
+    void _initializeGridCountData(BlockArray3d<VelocityData> &blockvel, 
                                   ParticleGridCountData &countdata);
     void _computeGridCountDataThread(int startidx, int endidx, 
-                                     BlockArray3d<ScalarData> *blockphi, 
-                                     GridCountData *countdata,
-                                     Direction dir);
+                                     BlockArray3d<VelocityData> *blockvel, 
+                                     GridCountData *countdata);
     void _sortParticlesIntoBlocks(ParticleGridCountData &countdata, 
                                   std::vector<PointData> &sortedParticleData, 
-                                  std::vector<int> &blockToParticleIndex,
-                                  Direction dir);
+                                  std::vector<int> &blockToParticleIndex);
+    void _sortParticlesIntoBlocksThread(GridCountData *countdata,
+                                        std::vector<int> *blockToParticleIndex,
+                                        std::vector<PointData> *sortedParticleData);
 
     void _advectionProducerThread(BoundedBuffer<ComputeBlock> *blockQueue, 
                                   BoundedBuffer<ComputeBlock> *finishedBlockQueue);
+    KernelData _getKernelData();
+    void _splatParticle(PointData &pdata, GridBlock<VelocityData> &block, 
+                        KernelData &kernel, float *distsqx, float *distsqy, float *distsqz);
+    void _normalizeBlock(GridBlock<VelocityData> &block);
+    void _applyBlockToVelocityField(GridBlock<VelocityData> &block);
 
     // Parameters
-    FragmentedVector<MarkerParticle> *_particles;
+    MarkerParticleStore *_particles;
     MACVelocityField *_vfield;
     ValidVelocityComponentGrid *_validVelocities;
-    std::vector<vmath::vec3> _points;
-    std::vector<vmath::vec3> _velocities;
     double _dx = 0.0;
     double _chunkdx = 0.0;
     double _particleRadius = 0.0;
+    ParticleScatterMethod _scatterMethod = ParticleScatterMethod::queue;
 
     int _chunkWidth = 10;
     int _numBlocksPerJob = 10;
@@ -53,7 +53,7 @@ bool ViscositySolver::applyViscosityToVelocityField(ViscositySolverParameters pa
     _computeMatrixIndexTable();
 
     int matsize = _matrixIndex.matrixSize;
-    SparseMatrixf matrix(matsize, 15);
+    FixedSparseMatrixf matrix;
     std::vector<float> rhs(matsize, 0);
     std::vector<float> soln(matsize, 0);
 
@@ -113,18 +113,9 @@ void ViscositySolver::_computeFaceStateGridMT(Array3d<float> &solidCenterPhi, in
         gridsize = _state.W.width * _state.W.height * _state.W.depth;
     }
 
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, gridsize);
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, gridsize, numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&ViscositySolver::_computeFaceStateGridThread, this,
-                                 intervals[i], intervals[i + 1], &solidCenterPhi, dir);
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, gridsize, [&](int startidx, int endidx) {
+        _computeFaceStateGridThread(startidx, endidx, &solidCenterPhi, dir);
+    });
 }
 
 void ViscositySolver::_computeFaceStateGridThread(int startidx, int endidx, 
@@ -172,18 +163,9 @@ void ViscositySolver::_computeFaceStateGridThread(int startidx, int endidx,
 
 void ViscositySolver::_computeSolidCenterPhi(Array3d<float> &solidCenterPhi) {
     int gridsize = solidCenterPhi.width * solidCenterPhi.height * solidCenterPhi.depth;
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, gridsize);
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, gridsize, numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&ViscositySolver::_computeSolidCenterPhiThread, this,
-                                 intervals[i], intervals[i + 1], &solidCenterPhi);
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, gridsize, [&](int startidx, int endidx) {
+        _computeSolidCenterPhiThread(startidx, endidx, &solidCenterPhi);
+    });
 }
 
 void ViscositySolver::_computeSolidCenterPhiThread(int startidx, int endidx, 
@@ -249,25 +231,11 @@ void ViscositySolver::_computeVolumeGrid() {
         WorkGroup(&(_volumes.edgeW), vmath::vec3(0,   0,   hdx))
     });
 
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, workqueue.size());
-    std::vector<std::thread> threads(numthreads);
-
-    while (!workqueue.empty()) {
-        
-        numthreads = (int)fmin(numCPU, workqueue.size());
-        for (int tidx = 0; tidx < numthreads; tidx++) {
-            WorkGroup workgroup = workqueue.back();
-            workqueue.pop_back();
-
-            threads[tidx] = std::thread(&ViscositySolver::_estimateVolumeFractions, this,
-                                        workgroup.grid, workgroup.offset, &validCells);
-        }
-
-        for (int tidx = 0; tidx < numthreads; tidx++) {
-            threads[tidx].join();
+    ThreadUtils::parallelFor(0, workqueue.size(), 1, [&](int startidx, int endidx) {
+        for (int idx = startidx; idx < endidx; idx++) {
+            _estimateVolumeFractions(workqueue[idx].grid, workqueue[idx].offset, &validCells);
         }
-    }
+    });
 }
 
 void ViscositySolver::_estimateVolumeFractions(Array3d<float> *volumes, 
@@ -458,13 +426,15 @@ void ViscositySolver::_computeMatrixIndexTable() {
     _matrixIndex = MatrixIndexer(_isize, _jsize, _ksize, gridToMatrixIndex);
 }
 
-void ViscositySolver::_initializeLinearSystem(SparseMatrixf &matrix, std::vector<float> &rhs) {
-    _initializeLinearSystemU(matrix, rhs);
-    _initializeLinearSystemV(matrix, rhs);
-    _initializeLinearSystemW(matrix, rhs);
+void ViscositySolver::_initializeLinearSystem(FixedSparseMatrixf &matrix, std::vector<float> &rhs) {
+    FixedSparseMatrixBuilderf builder(_matrixIndex.matrixSize, 15);
+    _initializeLinearSystemU(builder, rhs);
+    _initializeLinearSystemV(builder, rhs);
+    _initializeLinearSystemW(builder, rhs);
+    builder.build(matrix);
 }
 
-void ViscositySolver::_initializeLinearSystemU(SparseMatrixf &matrix, std::vector<float> &rhs) {
+void ViscositySolver::_initializeLinearSystemU(FixedSparseMatrixBuilderf &matrix, std::vector<float> &rhs) {
     std::vector<GridIndex> indices;
     for (int k = 1; k < _ksize; k++) {
         for (int j = 1; j < _jsize; j++) {
@@ -476,21 +446,12 @@ void ViscositySolver::_initializeLinearSystemU(SparseMatrixf &matrix, std::vecto
         }
     }
 
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, indices.size());
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, indices.size(), numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&ViscositySolver::_initializeLinearSystemThreadU, this,
-                                 intervals[i], intervals[i + 1], &indices, &matrix, &rhs);
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, indices.size(), [&](int startidx, int endidx) {
+        _initializeLinearSystemThreadU(startidx, endidx, &indices, &matrix, &rhs);
+    });
 }
 
-void ViscositySolver::_initializeLinearSystemV(SparseMatrixf &matrix, std::vector<float> &rhs) {
+void ViscositySolver::_initializeLinearSystemV(FixedSparseMatrixBuilderf &matrix, std::vector<float> &rhs) {
     std::vector<GridIndex> indices;
     for (int k = 1; k < _ksize; k++) {
         for (int j = 1; j < _jsize; j++) {
@@ -502,21 +463,12 @@ void ViscositySolver::_initializeLinearSystemV(SparseMatrixf &matrix, std::vecto
         }
     }
 
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, indices.size());
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, indices.size(), numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&ViscositySolver::_initializeLinearSystemThreadV, this,
-                                 intervals[i], intervals[i + 1], &indices, &matrix, &rhs);
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, indices.size(), [&](int startidx, int endidx) {
+        _initializeLinearSystemThreadV(startidx, endidx, &indices, &matrix, &rhs);
+    });
 }
 
-void ViscositySolver::_initializeLinearSystemW(SparseMatrixf &matrix, std::vector<float> &rhs) {
+void ViscositySolver::_initializeLinearSystemW(FixedSparseMatrixBuilderf &matrix, std::vector<float> &rhs) {
     std::vector<GridIndex> indices;
     for (int k = 1; k < _ksize; k++) {
         for (int j = 1; j < _jsize; j++) {
@@ -528,23 +480,14 @@ void ViscositySolver::_initializeLinearSystemW(SparseMatrixf &matrix, std::vecto
         }
     }
 
-    int numCPU = ThreadUtils::getMaxThreadCount();
-    int numthreads = (int)fmin(numCPU, indices.size());
-    std::vector<std::thread> threads(numthreads);
-    std::vector<int> intervals = ThreadUtils::splitRangeIntoIntervals(0, indices.size(), numthreads);
-    for (int i = 0; i < numthreads; i++) {
-        threads[i] = std::thread(&ViscositySolver::_initializeLinearSystemThreadW, this,
-                                 intervals[i], intervals[i + 1], &indices, &matrix, &rhs);
-    }
-
-    for (int i = 0; i < numthreads; i++) {
-        threads[i].join();
-    }
+    ThreadUtils::parallelFor(0, indices.size(), [&](int startidx, int endidx) {
+        _initializeLinearSystemThreadW(startidx, endidx, &indices, &matrix, &rhs);
+    });
 }
 
 void ViscositySolver::_initializeLinearSystemThreadU(int startidx, int endidx, 
                                                      std::vector<GridIndex> *indices,
-                                                     SparseMatrixf *matrix, 
+                                                     FixedSparseMatrixBuilderf *matrix, 
                                                      std::vector<float> *rhs) {
     MatrixIndexer &mj = _matrixIndex;
     FaceState FLUID = FaceState::fluid;
@@ -635,7 +578,7 @@ void ViscositySolver::_initializeLinearSystemThreadU(int startidx, int endidx,
 
 void ViscositySolver::_initializeLinearSystemThreadV(int startidx, int endidx, 
                                                      std::vector<GridIndex> *indices,
-                                                     SparseMatrixf *matrix, 
+                                                     FixedSparseMatrixBuilderf *matrix, 
                                                      std::vector<float> *rhs) {
     MatrixIndexer &mj = _matrixIndex;
     FaceState FLUID = FaceState::fluid;
@@ -726,7 +669,7 @@ void ViscositySolver::_initializeLinearSystemThreadV(int startidx, int endidx,
 
 void ViscositySolver::_initializeLinearSystemThreadW(int startidx, int endidx, 
                                                      std::vector<GridIndex> *indices,
-                                                     SparseMatrixf *matrix, 
+                                                     FixedSparseMatrixBuilderf *matrix, 
                                                      std::vector<float> *rhs) {
     MatrixIndexer &mj = _matrixIndex;
     FaceState FLUID = FaceState::fluid;
@@ -815,7 +758,7 @@ void ViscositySolver::_initializeLinearSystemThreadW(int startidx, int endidx,
     }
 }
 
-bool ViscositySolver::_solveLinearSystem(SparseMatrixf &matrix, std::vector<float> &rhs, 
+bool ViscositySolver::_solveLinearSystem(FixedSparseMatrixf &matrix, std::vector<float> &rhs, 
                                          std::vector<float> &soln) {
 
     PCGSolver<float> solver;
@@ -183,24 +183,24 @@ private:
                                   Array3d<bool> *validCells);
     void _destroyVolumeGrid();
     void _computeMatrixIndexTable();
-    void _initializeLinearSystem(SparseMatrixf &matrix, std::vector<float> &rhs);
-    void _initializeLinearSystemU(SparseMatrixf &matrix, std::vector<float> &rhs);
-    void _initializeLinearSystemV(SparseMatrixf &matrix, std::vector<float> &rhs);
-    void _initializeLinearSystemW(SparseMatrixf &matrix, std::vector<float> &rhs);
+    void _initializeLinearSystem(FixedSparseMatrixf &matrix, std::vector<float> &rhs);
+    void _initializeLinearSystemU(FixedSparseMatrixBuilderf &matrix, std::vector<float> &rhs);
+    void _initializeLinearSystemV(FixedSparseMatrixBuilderf &matrix, std::vector<float> &rhs);
+    void _initializeLinearSystemW(FixedSparseMatrixBuilderf &matrix, std::vector<float> &rhs);
     void _initializeLinearSystemThreadU(int startidx, int endidx,
                                         std::vector<GridIndex> *indices,
-                                        SparseMatrixf *matrix, 
+                                        FixedSparseMatrixBuilderf *matrix, 
                                         std::vector<float> *rhs);
     void _initializeLinearSystemThreadV(int startidx, int endidx,
                                         std::vector<GridIndex> *indices,
-                                        SparseMatrixf *matrix, 
+                                        FixedSparseMatrixBuilderf *matrix, 
                                         std::vector<float> *rhs);
     void _initializeLinearSystemThreadW(int startidx, int endidx,
                                         std::vector<GridIndex> *indices,
-                                        SparseMatrixf *matrix, 
+                                        FixedSparseMatrixBuilderf *matrix, 
                                         std::vector<float> *rhs);
 
-    bool _solveLinearSystem(SparseMatrixf &matrix, std::vector<float> &rhs, 
+    bool _solveLinearSystem(FixedSparseMatrixf &matrix, std::vector<float> &rhs, 
                             std::vector<float> &soln);
     void _applySolutionToVelocityField(std::vector<float> &soln);
 
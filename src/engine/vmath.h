@@ -154,6 +154,26 @@ inline mat3 transpose(const mat3 &m) {
                 m.m[2], m.m[5], m.m[8]);
 }
 
+inline float determinant(const mat3 &m) {
+    return m.m[0] * (m.m[4] * m.m[8] - m.m[7] * m.m[5]) -
+           m.m[3] * (m.m[1] * m.m[8] - m.m[7] * m.m[2]) +
+           m.m[6] * (m.m[1] * m.m[5] - m.m[4] * m.m[2]);
+}
+
+// Undefined for singular matrices
+inline mat3 inverse(const mat3 &m) {
+    float inv = 1.0f / determinant(m);
+    return mat3((m.m[4] * m.m[8] - m.m[5] * m.m[7]) * inv,
+                (m.m[2] * m.m[7] - m.m[1] * m.m[8]) * inv,
+                (m.m[1] * m.m[5] - m.m[2] * m.m[4]) * inv,
+                (m.m[5] * m.m[6] - m.m[3] * m.m[8]) * inv,
+                (m.m[0] * m.m[8] - m.m[2] * m.m[6]) * inv,
+                (m.m[2] * m.m[3] - m.m[0] * m.m[5]) * inv,
+                (m.m[3] * m.m[7] - m.m[4] * m.m[6]) * inv,
+                (m.m[1] * m.m[6] - m.m[0] * m.m[7]) * inv,
+                (m.m[0] * m.m[4] - m.m[1] * m.m[3]) * inv);
+}
+
 /********************************************************************************
     QUATERNION
 ********************************************************************************/